@@ -0,0 +1,40 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Matches OZZ::CompactVertex, the fixed function fetch expands the half/unorm/snorm formats. Unlit, so the
+// normal at location 3 is left out and never fetched
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 texcoord;
+
+layout(location = 0) out vec3 fragColor;
+
+// The renderer's view buffer, rewritten for every eye so recorded draws never need the view baked in
+layout(set = 0, binding = 0) uniform ViewData {
+    mat4 ViewProjection;
+    mat4 View;
+    vec4 Position;
+} view;
+
+// Matches OZZ::InstanceData
+struct Object {
+    mat4 Model;
+    vec4 Colour;
+};
+
+// Every storage buffer in the renderer's bindless set, see OZZ::BindlessSet::BUFFER_BINDING
+layout(std430, set = 1, binding = 1) readonly buffer ObjectBuffer {
+    Object objects[];
+} objectBuffers[];
+
+// Matches Scenery::BindlessDraw, which buffer and which object in it
+layout(push_constant) uniform Draw {
+    uint Buffer;
+    uint Object;
+} draw;
+
+void main() {
+    Object object = objectBuffers[draw.Buffer].objects[draw.Object];
+    gl_Position = view.ViewProjection * object.Model * vec4(position, 1.0);
+    fragColor = color.rgb * object.Colour.rgb;
+}
@@ -0,0 +1,33 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Matches OZZ::CompactVertex, the fixed function fetch expands the half/unorm/snorm formats
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 texcoord;
+layout(location = 3) in vec2 octNormal;
+
+layout(location = 0) out vec3 fragColor;
+
+// Frame ring buffer, see OZZ::FrameRingBuffer
+layout(set = 0, binding = 0) uniform FrameData {
+    mat4 VP;
+} frame;
+
+// Matches OZZ::InstanceData, one entry per instance of the draw
+struct Instance {
+    mat4 Model;
+    vec4 Colour;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer InstanceData {
+    Instance Instances[];
+} instances;
+
+#include "lighting.glsl"
+
+void main() {
+    Instance instance = instances.Instances[gl_InstanceIndex];
+    gl_Position = frame.VP * instance.Model * vec4(position, 1.0);
+    fragColor = shade(color.rgb * instance.Colour.rgb, instance.Model, octNormal);
+}
@@ -0,0 +1,114 @@
+// Shared by cull.comp, late_cull.comp and compact_draws.comp: the scene's buffers every pass reads, the depth
+// pyramids and the occlusion test. Each pass declares its own lists at bindings 3 to 7.
+
+// Matches OZZ::GpuSceneObject
+struct Object {
+    mat4 Model;
+    vec4 Colour;
+    uint Mesh;
+    uint Padding0;
+    uint Padding1;
+    uint Padding2;
+};
+
+// Matches OZZ::GpuSceneMesh
+struct Mesh {
+    uint IndexCount;
+    uint FirstIndex;
+    int VertexOffset;
+    uint InstanceBase;
+    vec4 Bounds;
+};
+
+// Matches VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint IndexCount;
+    uint InstanceCount;
+    uint FirstIndex;
+    int VertexOffset;
+    uint FirstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects { Object objects[]; };
+layout(std430, set = 0, binding = 1) readonly buffer Meshes { Mesh meshes[]; };
+
+// Matches OZZ::GpuCullParams, six planes per eye
+layout(std430, set = 0, binding = 2) readonly buffer Params {
+    vec4 Planes[12];
+    uint ObjectCount;
+    uint MeshCount;
+    vec2 DepthSize;
+    uint PyramidLevels;
+    uint Occlusion;
+    uint Padding0;
+    uint Padding1;
+    mat4 ViewProjections[2];
+    mat4 PreviousViewProjections[2];
+} params;
+
+// Matches OZZ::GpuScene's stats buffer
+layout(std430, set = 0, binding = 8) buffer Stats {
+    uint Occluded;
+    uint Recovered;
+} stats;
+
+// Both eyes' depth pyramids, see OZZ::DepthPyramid
+layout(set = 1, binding = 0) uniform sampler2D pyramids[2];
+
+// Only constant indices into the sampler array, without descriptor indexing anything else is undefined
+float pyramidTexel(uint eye, ivec2 texel, int level) {
+    return eye == 0u ? texelFetch(pyramids[0], texel, level).r : texelFetch(pyramids[1], texel, level).r;
+}
+
+ivec2 pyramidSize(uint eye, int level) {
+    return eye == 0u ? textureSize(pyramids[0], level) : textureSize(pyramids[1], level);
+}
+
+// True only when the sphere is certainly behind everything the eye's pyramid was built from
+bool occluded(vec3 centre, float radius, mat4 viewProjection, uint eye) {
+    vec2 minNdc = vec2(1.0e30);
+    vec2 maxNdc = vec2(-1.0e30);
+    float nearest = 1.0;
+
+    // The corners of the box around the sphere, projected, bound the sphere on screen and in depth
+    for (uint i = 0; i < 8; i++) {
+        vec3 corner = centre + radius * vec3((i & 1u) != 0u ? 1.0 : -1.0,
+                                             (i & 2u) != 0u ? 1.0 : -1.0,
+                                             (i & 4u) != 0u ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+
+        // Reaches behind the eye, nothing in front of it can hide it for sure
+        if (clip.w <= 0.0) {
+            return false;
+        }
+
+        vec3 ndc = clip.xyz / clip.w;
+        nearest = min(nearest, ndc.z);
+        minNdc = min(minNdc, ndc.xy);
+        maxNdc = max(maxNdc, ndc.xy);
+    }
+
+    // Off screen for this view, the frustum test has the last word
+    if (nearest <= 0.0 || any(greaterThan(minNdc, vec2(1.0))) || any(lessThan(maxNdc, vec2(-1.0)))) {
+        return false;
+    }
+
+    vec2 lastPixel = params.DepthSize - 1.0;
+    uvec2 minPixel = uvec2(clamp((minNdc * 0.5 + 0.5) * params.DepthSize, vec2(0.0), lastPixel));
+    uvec2 maxPixel = uvec2(clamp((maxNdc * 0.5 + 0.5) * params.DepthSize, vec2(0.0), lastPixel));
+
+    // Pixel p falls in texel p >> (level + 1), at this level the rectangle spans at most 2x2 texels
+    uint span = max(maxPixel.x - minPixel.x, maxPixel.y - minPixel.y);
+    int level = max(findMSB(span), 0);
+    if (level >= int(params.PyramidLevels)) {
+        return false;
+    }
+
+    uvec2 lastTexel = uvec2(pyramidSize(eye, level)) - 1u;
+    ivec2 minTexel = ivec2(min(minPixel >> uint(level + 1), lastTexel));
+    ivec2 maxTexel = ivec2(min(maxPixel >> uint(level + 1), lastTexel));
+
+    float farthest = max(max(pyramidTexel(eye, minTexel, level), pyramidTexel(eye, ivec2(maxTexel.x, minTexel.y), level)),
+                         max(pyramidTexel(eye, ivec2(minTexel.x, maxTexel.y), level), pyramidTexel(eye, maxTexel, level)));
+    return nearest > farthest;
+}
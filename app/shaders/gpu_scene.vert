@@ -0,0 +1,38 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Matches OZZ::CompactVertex, the fixed function fetch expands the half/unorm/snorm formats
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 texcoord;
+layout(location = 3) in vec2 octNormal;
+
+layout(location = 0) out vec3 fragColor;
+
+// Frame ring buffer, see OZZ::FrameRingBuffer
+layout(set = 0, binding = 0) uniform FrameData {
+    mat4 VP;
+} frame;
+
+// Matches OZZ::GpuSceneObject
+struct Object {
+    mat4 Model;
+    vec4 Colour;
+    uint Mesh;
+    uint Padding0;
+    uint Padding1;
+    uint Padding2;
+};
+
+// OZZ::GpuScene's draw set
+layout(std430, set = 1, binding = 0) readonly buffer Objects { Object objects[]; };
+// Written by cull.comp, the draw's firstInstance is the mesh's range so gl_InstanceIndex indexes straight in
+layout(std430, set = 1, binding = 1) readonly buffer VisibleObjects { uint visibleObjects[]; };
+
+#include "lighting.glsl"
+
+void main() {
+    Object object = objects[visibleObjects[gl_InstanceIndex]];
+    gl_Position = frame.VP * object.Model * vec4(position, 1.0);
+    fragColor = shade(color.rgb * object.Colour.rgb, object.Model, octNormal);
+}
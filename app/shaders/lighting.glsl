@@ -0,0 +1,21 @@
+// Shared by compact.vert and gpu_scene.vert: decodes OZZ::CompactVertex's normal and lights the vertex with
+// one fixed directional light.
+
+// Inverse of Quantize::OctahedralEncode
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+// World space, from above and slightly in front
+const vec3 LIGHT_DIRECTION = vec3(0.267, 0.802, 0.535);
+const float AMBIENT = 0.35;
+
+// Assumes uniform scale in the model matrix, which holds for everything drawn with compact vertices
+vec3 shade(vec3 colour, mat4 model, vec2 octNormal) {
+    vec3 normal = normalize(mat3(model) * decodeOctahedral(octNormal));
+    float diffuse = max(dot(normal, LIGHT_DIRECTION), 0.0);
+    return colour * (AMBIENT + (1.0 - AMBIENT) * diffuse);
+}
@@ -1,5 +1,6 @@
 #version 450
 
+// Matches OZZ::Vertex
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
 layout(location = 2) in vec2 texcoord;
@@ -7,12 +8,23 @@ layout(location = 3) in vec3 normal;
 
 layout(location = 0) out vec3 fragColor;
 
-layout( push_constant ) uniform constants {
-    mat4 Model;
+// Frame ring buffer, see OZZ::FrameRingBuffer
+layout(set = 0, binding = 0) uniform FrameData {
     mat4 VP;
-} PushConstants;
+} frame;
+
+// Matches OZZ::InstanceData, one entry per instance of the draw
+struct Instance {
+    mat4 Model;
+    vec4 Colour;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer InstanceData {
+    Instance Instances[];
+} instances;
 
 void main() {
-    gl_Position = PushConstants.VP * PushConstants.Model * vec4(position, 1.0);
-    fragColor = color;
+    Instance instance = instances.Instances[gl_InstanceIndex];
+    gl_Position = frame.VP * instance.Model * vec4(position, 1.0);
+    fragColor = color * instance.Colour.rgb;
 }
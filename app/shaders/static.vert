@@ -0,0 +1,27 @@
+#version 450
+
+// Matches OZZ::CompactVertex, the fixed function fetch expands the half/unorm/snorm formats. Unlit, so the
+// normal at location 3 is left out and never fetched
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 texcoord;
+
+layout(location = 0) out vec3 fragColor;
+
+// The renderer's view buffer, rewritten for every eye so recorded draws never need the view baked in
+layout(set = 0, binding = 0) uniform ViewData {
+    mat4 ViewProjection;
+    mat4 View;
+    vec4 Position;
+} view;
+
+// Matches OZZ::InstanceData, constant for the life of a static bundle
+layout(push_constant) uniform Object {
+    mat4 Model;
+    vec4 Colour;
+} object;
+
+void main() {
+    gl_Position = view.ViewProjection * object.Model * vec4(position, 1.0);
+    fragColor = color.rgb * object.Colour.rgb;
+}
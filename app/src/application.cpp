@@ -6,46 +6,100 @@
 #include "application.h"
 #include "ozz_vulkan/brushes/shapes.h"
 
+// Per-eye data shared by every draw, see compact.vert and gpu_scene.vert
+struct FrameUniforms {
+    glm::mat4 VP;
+};
+
+#if defined(OZZ_EMBEDDED_ASSETS)
+extern const unsigned char ozz_embedded_assets[];
+extern const size_t ozz_embedded_assets_size;
+#endif
 
 Application::Application() {
 // Initialize _renderer
     _renderer = std::make_unique<OZZ::Renderer>();
-    _renderer->Init();
+
+    // Mount packed assets, loose files in assets/ are used as a fallback
+#if defined(OZZ_EMBEDDED_ASSETS)
+    _renderer->MountAssetArchive(ozz_embedded_assets, ozz_embedded_assets_size);
+#else
+    if (std::filesystem::exists(OZZ_ASSETS_ARCHIVE)) {
+        _renderer->MountAssetArchive(OZZ_ASSETS_ARCHIVE);
+    } else {
+        spdlog::info("No asset archive found, loading assets from disk");
+    }
+#endif
+
+    if (!_renderer->Init()) {
+        spdlog::error("Couldn't initialize the renderer, nothing will run");
+        return;
+    }
+    _initialized = true;
+
+    // GPU scenes skip what's hidden behind last frame's depth
+    if (!_renderer->EnableOcclusionCulling("assets/shaders/depth_pyramid.comp.spv")) {
+        spdlog::info("Occlusion culling unavailable, GPU scenes only cull against the view");
+    }
 
     // Create the camera
     _cameraObject = std::make_unique<CameraObject>();
     _cameraObject->Translate(glm::vec3(0.0f, 0.0f, 0.0f));
     _cameraObject->Rotate(glm::angleAxis(glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
 
-    // Create cube
-    _cube = std::make_unique<Cube>(_renderer.get());
-    _cube2 = std::make_unique<Cube>(_renderer.get());
-    _cube2->Translate(glm::vec3(1.f, 0.0f, -5.0f));
-    _cube2->Rotate(90.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+    // Create cubes, they share one mesh and pipeline and are drawn together
+    _cubeBatch = std::make_unique<CubeBatch>(_renderer.get());
+    _drawList = _renderer->CreateDrawList();
+    _scenery = std::make_unique<Scenery>(_renderer.get());
+    _denseSphere = std::make_unique<DenseSphere>(_renderer.get());
+
+    _cubes.resize(2);
+    _cubes[1].Translate(glm::vec3(1.f, 0.0f, -5.0f));
+    _cubes[1].Rotate(90.0f, glm::vec3(0.0f, 1.0f, 0.0f));
 }
 
 Application::~Application() {
     _renderer->WaitIdle();
-    _cube.reset(nullptr);
-    _cube2.reset(nullptr);
+    _drawList.reset(nullptr);
+    _scenery.reset(nullptr);
+    _denseSphere.reset(nullptr);
+    _cubeBatch.reset(nullptr);
     _renderer.reset(nullptr);
 }
 
 void Application::Run() {
+    if (!_initialized) {
+        return;
+    }
+
     _isRunning = true;
     while (_isRunning) {
         if (_renderer->Update()) {
             Stop();
             continue;
         }
+        // No frame while the session isn't running or the runtime doesn't want this one rendered
         auto frameInfo = _renderer->BeginFrame();
         if (!frameInfo.has_value()) {
-            spdlog::error("Failed to begin frame, exiting...");
             continue;
         }
 
         update(frameInfo.value());
         renderFrame(frameInfo.value());
+
+        // After EndFrame, logging is allowed to allocate
+        if (_frameCount % COMMAND_STATS_INTERVAL == 0) {
+            auto stats = _renderer->GetCommandStats().GetTotal();
+            spdlog::debug("Frame {}: {} draws ({} indirect, {} mesh), {} triangles, {} pipeline binds, {} push constant bytes, {} calls elided",
+                          _frameCount, stats.Draws, stats.IndirectDraws, stats.MeshDraws, stats.Triangles, stats.PipelineBinds,
+                          stats.PushConstantBytes, stats.ElidedCalls);
+
+            if (_cubeBatch->IsOcclusionCulling()) {
+                auto cullStats = _cubeBatch->GetCullStats();
+                spdlog::debug("Frame {}: {} cubes, {} occluded, {} recovered by the late pass",
+                              _frameCount, cullStats.Objects, cullStats.Occluded, cullStats.Recovered);
+            }
+        }
     }
 
     spdlog::info("Application stopped");
@@ -61,26 +115,53 @@ void Application::update(const OZZ::FrameInfo& frameInfo) {
     if (headInfo.has_value()) {
         _cameraObject->SetHeadPose(headInfo.value());
     }
-    _cube->Update(0);
-    _cube2->Update(0);
+    for (auto& cube : _cubes) {
+        cube.Update(0);
+    }
 
     _frameCount++;
 }
 
 void Application::renderFrame(const OZZ::FrameInfo& frameInfo) {
     auto [leftEyePose, rightEyePose] = _renderer->GetEyePoseInfo(frameInfo.PredictedDisplayTime).value();
-    renderEye(OZZ::EyeTarget::Left, leftEyePose);
-    renderEye(OZZ::EyeTarget::Right, rightEyePose);
+
+    auto view = _cameraObject->GetViewMatrix();
+    std::array<glm::mat4, EYE_COUNT> viewProjections = {
+            leftEyePose.GetProjectionMatrix() * view,
+            rightEyePose.GetProjectionMatrix() * view,
+    };
+
+    // Both eyes share the camera, so they share its inverse as their place in the world
+    auto eyeToWorld = glm::inverse(view);
+    auto frustum = OZZ::StereoFrustum::FromEyes(leftEyePose.FOV, eyeToWorld, rightEyePose.FOV, eyeToWorld);
+
+    // What the static bundles see, written into the view buffer as each eye starts rendering
+    for (auto eye : {OZZ::EyeTarget::Left, OZZ::EyeTarget::Right}) {
+        _renderer->SetViewUniforms(eye, {
+            .ViewProjection = viewProjections[static_cast<size_t>(eye)],
+            .View = view,
+            .Position = eyeToWorld[3],
+        });
+    }
+
+    // Culled and sorted once for both eyes, before either is recorded
+    _scenery->Draw(frustum);
+    _drawList->Clear();
+    _cubeBatch->Prepare(_cubes, frustum, glm::vec3(eyeToWorld[3]), *_drawList);
+    _drawList->Sort();
+
+    renderEye(OZZ::EyeTarget::Left, viewProjections[0]);
+    renderEye(OZZ::EyeTarget::Right, viewProjections[1]);
     _renderer->RenderFrame(frameInfo);
     _renderer->EndFrame();
 }
 
-void Application::renderEye(OZZ::EyeTarget eye, const OZZ::EyePoseInfo& eyePoseInfo) {
+void Application::renderEye(OZZ::EyeTarget eye, const glm::mat4& viewProjection) {
     VkCommandBufferInheritanceRenderingInfo renderingInheritance { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO };
     renderingInheritance.colorAttachmentCount = 1;
     auto swapchainFormat = _renderer->GetSwapchainFormat();
     renderingInheritance.pColorAttachmentFormats = &swapchainFormat;
-    renderingInheritance.depthAttachmentFormat = VK_FORMAT_D32_SFLOAT;
+    renderingInheritance.depthAttachmentFormat = _renderer->GetDepthFormat();
     renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
     VkCommandBufferInheritanceInfo inheritanceInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
@@ -93,8 +174,8 @@ void Application::renderEye(OZZ::EyeTarget eye, const OZZ::EyePoseInfo& eyePoseI
     beginInfo.pInheritanceInfo = &inheritanceInfo;
     beginInfo.pNext = nullptr;
 
-    auto commandBuffer = _renderer->RequestCommandBuffer(eye);
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    auto encoder = _renderer->RequestCommandEncoder(eye);
+    vkBeginCommandBuffer(encoder.GetCommandBuffer(), &beginInfo);
 
     auto [width, height] = _renderer->GetSwapchainSize();
     VkViewport viewport = {
@@ -108,14 +189,32 @@ void Application::renderEye(OZZ::EyeTarget eye, const OZZ::EyePoseInfo& eyePoseI
             {(uint32_t) width, (uint32_t) height}
     };
 
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    encoder.SetViewport(viewport);
+    encoder.SetScissor(scissor);
 
-    auto view = _cameraObject->GetViewMatrix();
+    // Meshlets outside this eye's view or facing away from it never reach the rasterizer
+    _denseSphere->Draw(encoder);
+
+    // View-projection once per eye
+    auto frameData = _renderer->AllocateFrameUniform(FrameUniforms { .VP = viewProjection });
+
+    if (frameData.IsValid()) {
+        _drawList->Record(encoder, frameData, eye);
+        // With a GPU scene the cubes skip the draw list, one indirect draw however many there are
+        _cubeBatch->Draw(encoder, frameData);
+    }
+
+    vkEndCommandBuffer(encoder.GetCommandBuffer());
 
-    auto projection = eyePoseInfo.GetProjectionMatrix();
-    _cube->Draw(commandBuffer, view, projection);
-    _cube2->Draw(commandBuffer, view, projection);
+    // Cubes last frame's depth hid get another look against this frame's, anything visible is drawn on top
+    if (frameData.IsValid() && _cubeBatch->IsOcclusionCulling()) {
+        _cubeBatch->CullLate(eye);
 
-    vkEndCommandBuffer(commandBuffer);
+        auto lateEncoder = _renderer->RequestLateCommandEncoder(eye);
+        vkBeginCommandBuffer(lateEncoder.GetCommandBuffer(), &beginInfo);
+        lateEncoder.SetViewport(viewport);
+        lateEncoder.SetScissor(scissor);
+        _cubeBatch->DrawLate(lateEncoder, frameData, eye);
+        vkEndCommandBuffer(lateEncoder.GetCommandBuffer());
+    }
 }
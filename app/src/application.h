@@ -6,7 +6,11 @@
 
 #include <ozz_vulkan/renderer.h>
 #include <memory>
+#include <vector>
 #include "cube.h"
+#include "cube_batch.h"
+#include "scenery.h"
+#include "dense_sphere.h"
 #include "camera_object.h"
 
 class Application {
@@ -20,15 +24,22 @@ public:
 private:
     void update(const OZZ::FrameInfo& frameInfo);
     void renderFrame(const OZZ::FrameInfo& frameInfo);
-    void renderEye(OZZ::EyeTarget eye, const OZZ::EyePoseInfo& eyePoseInfo);
+    void renderEye(OZZ::EyeTarget eye, const glm::mat4& viewProjection);
 
 private:
     std::unique_ptr<OZZ::Renderer> _renderer;
+    bool _initialized {false};
     bool _isRunning {false};
 
-    std::unique_ptr<Cube> _cube;
-    std::unique_ptr<Cube> _cube2;
+    std::vector<Cube> _cubes;
+    std::unique_ptr<CubeBatch> _cubeBatch;
+    std::unique_ptr<Scenery> _scenery;
+    std::unique_ptr<DenseSphere> _denseSphere;
+    std::unique_ptr<OZZ::DrawList> _drawList;
     std::unique_ptr<CameraObject> _cameraObject;
 
     uint64_t _frameCount {0};
+
+    // How often the renderer's command stats are logged, in frames
+    static constexpr uint64_t COMMAND_STATS_INTERVAL = 600;
 };
@@ -3,16 +3,20 @@
 //
 
 #pragma once
-#include <ozz_vulkan/renderer.h>
+#include <ozz_vulkan/resources/instancing.h>
 #include <glm/gtx/quaternion.hpp>
 
+// Just a transform and a tint, every cube is drawn in one instanced draw by CubeBatch
 class Cube {
 public:
-    Cube(OZZ::Renderer* renderer);
-    ~Cube();
-
     void Update(float deltaTime);
-    void Draw(VkCommandBuffer commandBuffer, glm::mat4 view, glm::mat4 projection);
+
+    [[nodiscard]] const glm::mat4& GetModelMatrix() const { return _modelMatrix; }
+    [[nodiscard]] OZZ::InstanceData GetInstanceData() const {
+        return { .Model = _modelMatrix, .Colour = _colour };
+    }
+
+    void SetColour(glm::vec4 colour) { _colour = colour; }
 
     void Rotate(float degrees, glm::vec3 axis) {
         _rotation = glm::rotate(_rotation, glm::radians(degrees), axis);
@@ -24,17 +28,10 @@ public:
         updateModelMatrix();
     }
 private:
-    void createVertexBuffer(OZZ::Renderer* renderer);
-    void createIndexBuffer(OZZ::Renderer* renderer);
-    void createShader(OZZ::Renderer* renderer);
-
     void updateModelMatrix();
 private:
-    std::unique_ptr<OZZ::Shader> _shader;
-    std::unique_ptr<OZZ::VertexBuffer> _vertexBuffer;
-    std::unique_ptr<OZZ::IndexBuffer> _indexBuffer;
-
     glm::mat4 _modelMatrix { 1.0f };
     glm::quat _rotation { 1.0f, 0.0f, 0.0f, 0.0f };
     glm::vec3 _translation { 0.0f, 0.0f, 0.0f };
+    glm::vec4 _colour { 1.0f };
 };
@@ -0,0 +1,178 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include "cube_batch.h"
+#include "ozz_vulkan/brushes/shapes.h"
+#include <algorithm>
+
+CubeBatch::CubeBatch(OZZ::Renderer* renderer) : _renderer(renderer), _meshPool(&renderer->GetMeshPool<OZZ::CompactVertex>()) {
+    createMesh();
+    createScene();
+    createShader();
+}
+
+CubeBatch::~CubeBatch() {
+    _scene.reset(nullptr);
+    _meshPool->Release(_mesh);
+    _shader.reset(nullptr);
+}
+
+void CubeBatch::Prepare(const std::vector<Cube>& cubes, const OZZ::StereoFrustum& frustum, glm::vec3 viewer,
+                        OZZ::DrawList& drawList) {
+    if (!_scene) {
+        submitInstances(cubes, frustum, viewer, drawList);
+        return;
+    }
+
+    while (_objects.size() < cubes.size()) {
+        _objects.push_back(_scene->AddObject(_sceneMesh, glm::mat4{1.f}));
+    }
+    while (_objects.size() > cubes.size()) {
+        _scene->RemoveObject(_objects.back());
+        _objects.pop_back();
+    }
+
+    // Every cube spins, so every cube is written. A static object would cost nothing here.
+    for (size_t i = 0; i < cubes.size(); i++) {
+        auto instance = cubes[i].GetInstanceData();
+        _scene->SetTransform(_objects[i], instance.Model);
+        _scene->SetColour(_objects[i], instance.Colour);
+    }
+
+    auto commandBuffer = _renderer->RequestPreRenderCommandBuffer();
+    beginComputeCommands(commandBuffer);
+    _scene->Cull(commandBuffer, frustum);
+    vkEndCommandBuffer(commandBuffer);
+}
+
+void CubeBatch::CullLate(OZZ::EyeTarget eye) {
+    if (!IsOcclusionCulling()) return;
+
+    auto commandBuffer = _renderer->RequestPostDepthCommandBuffer(eye);
+    beginComputeCommands(commandBuffer);
+    _scene->CullLate(commandBuffer, eye);
+    vkEndCommandBuffer(commandBuffer);
+}
+
+void CubeBatch::DrawLate(OZZ::CommandEncoder& encoder, const OZZ::FrameAllocation& frameData, OZZ::EyeTarget eye) {
+    if (!IsOcclusionCulling()) return;
+
+    _shader->Bind(encoder);
+    _renderer->BindFrameData(encoder, *_shader, frameData, {});
+    _meshPool->Bind(encoder);
+    _scene->DrawLate(encoder, *_shader, eye);
+}
+
+void CubeBatch::beginComputeCommands(VkCommandBuffer commandBuffer) {
+    VkCommandBufferInheritanceInfo inheritanceInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+
+    VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+}
+
+void CubeBatch::submitInstances(const std::vector<Cube>& cubes, const OZZ::StereoFrustum& frustum, glm::vec3 viewer,
+                                OZZ::DrawList& drawList) {
+    // The cube spans -0.5..0.5 on every axis and only ever spins, a sphere around it never needs updating
+    _bounds.Clear();
+    for (const auto& cube : cubes) {
+        _bounds.AddSphere(glm::vec3(cube.GetModelMatrix()[3]), glm::sqrt(3.f) * 0.5f);
+    }
+    _culler.Cull(frustum, _bounds);
+
+    auto left = _culler.GetVisible(OZZ::EyeTarget::Left);
+    auto right = _culler.GetVisible(OZZ::EyeTarget::Right);
+
+    // A cube both eyes see is written twice, it keeps each eye down to a single contiguous draw
+    auto instances = _renderer->AllocateInstances(static_cast<uint32_t>(left.size() + right.size()));
+    if (!instances.IsValid()) return;
+
+    uint32_t written = 0;
+    for (auto [eye, visible] : {std::pair{OZZ::EyeTarget::Left, left}, std::pair{OZZ::EyeTarget::Right, right}}) {
+        if (visible.empty()) continue;
+
+        // Instances rasterize in order, nearest first lets the depth test reject what's behind them
+        _depthOrder.resize(std::max(_depthOrder.size(), visible.size()));
+        _sortScratch.resize(_depthOrder.size());
+        for (size_t i = 0; i < visible.size(); i++) {
+            auto distance = glm::distance(viewer, glm::vec3(cubes[visible[i]].GetModelMatrix()[3]));
+            _depthOrder[i] = { .Key = OZZ::DrawKey::DepthBits(distance), .Index = visible[i] };
+        }
+        auto sorted = OZZ::RadixSort(std::span(_depthOrder).first(visible.size()), _sortScratch);
+
+        auto first = written;
+        for (const auto& entry : sorted) {
+            instances.Instances[written++] = cubes[entry.Index].GetInstanceData();
+        }
+
+        drawList.Submit({
+            .Pipeline = _shader.get(),
+            .Pool = _meshPool,
+            .Mesh = _mesh,
+            .Instances = instances.Storage,
+            .InstanceCount = written - first,
+            .FirstInstance = first,
+            .Depth = glm::distance(viewer, glm::vec3(cubes[sorted.front().Index].GetModelMatrix()[3])),
+            .Eye = eye,
+        });
+    }
+}
+
+void CubeBatch::Draw(OZZ::CommandEncoder& encoder, const OZZ::FrameAllocation& frameData) {
+    if (!_scene) return;
+
+    _shader->Bind(encoder);
+    _renderer->BindFrameData(encoder, *_shader, frameData, {});
+    _meshPool->Bind(encoder);
+    _scene->Draw(encoder, *_shader);
+}
+
+void CubeBatch::createMesh() {
+    // Quantize on the stack, the pool writes the vertices and indices straight into staging memory
+    std::array<OZZ::CompactVertex, OZZ::Brushes::cubeVertices.size()> cubeVertices{};
+    OZZ::ConvertVertices<OZZ::CompactVertex>(OZZ::Brushes::cubeVertices, std::span(cubeVertices));
+
+    _mesh = _meshPool->Add(std::span<const OZZ::CompactVertex>(cubeVertices),
+                           std::span<const uint32_t>(OZZ::Brushes::cubeIndices));
+}
+
+void CubeBatch::createScene() {
+    OZZ::GpuSceneConfiguration config {
+            .CullShaderPath = "assets/shaders/cull.comp.spv",
+            .CompactShaderPath = "assets/shaders/compact_draws.comp.spv",
+            .LateCullShaderPath = "assets/shaders/late_cull.comp.spv",
+            .MaxObjects = 1024,
+            .MaxMeshes = 16,
+    };
+
+    _scene = _renderer->CreateGpuScene<OZZ::CompactVertex>(config);
+    if (!_scene->IsValid()) {
+        spdlog::info("GPU driven rendering unavailable, cubes are drawn with instancing");
+        _scene.reset(nullptr);
+        return;
+    }
+
+    // The cube spans -0.5..0.5 on every axis
+    _sceneMesh = _scene->AddMesh(_mesh, glm::vec4(0.f, 0.f, 0.f, glm::sqrt(3.f) * 0.5f));
+}
+
+void CubeBatch::createShader() {
+    // No push constants, each instance finds its data through gl_InstanceIndex
+    OZZ::ShaderConfiguration config {
+            .VertexShaderPath = "assets/shaders/compact.vert.spv",
+            .FragmentShaderPath = "assets/shaders/simple.frag.spv",
+            .DescriptorSetLayouts = { _renderer->GetFrameDataLayout() },
+            .VertexLayout = OZZ::DescribeVertexLayout<OZZ::CompactVertex>()
+    };
+
+    if (_scene) {
+        // Set 1 is the scene's objects and this frame's visible list
+        config.VertexShaderPath = "assets/shaders/gpu_scene.vert.spv";
+        config.DescriptorSetLayouts.push_back(_scene->GetDrawSetLayout());
+    }
+
+    _shader = _renderer->CreateShader(config);
+}
@@ -0,0 +1,62 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+#include <ozz_vulkan/renderer.h>
+#include <ozz_vulkan/culling/frustum_culler.h>
+#include <vector>
+#include "cube.h"
+
+/*
+ * The cube mesh and pipeline, shared by every cube. Where the device allows it the cubes live in a GpuScene
+ * and are culled and drawn on the GPU, otherwise they are culled on the CPU and each eye's visible cubes go into
+ * the draw list as one instanced draw, nearest cube first.
+ */
+class CubeBatch {
+public:
+    explicit CubeBatch(OZZ::Renderer* renderer);
+    ~CubeBatch();
+
+    // Once per frame before either eye is recorded, viewer is where depth is measured from
+    void Prepare(const std::vector<Cube>& cubes, const OZZ::StereoFrustum& frustum, glm::vec3 viewer,
+                 OZZ::DrawList& drawList);
+
+    // The GPU scene's draws, without one everything went into the draw list. frameData holds the eye's view-projection
+    void Draw(OZZ::CommandEncoder& encoder, const OZZ::FrameAllocation& frameData);
+
+    // Once the eye's main pass is recorded, another look at the cubes last frame's depth hid
+    void CullLate(OZZ::EyeTarget eye);
+    // Into the eye's late encoder, the cubes CullLate found visible after all
+    void DrawLate(OZZ::CommandEncoder& encoder, const OZZ::FrameAllocation& frameData, OZZ::EyeTarget eye);
+
+    [[nodiscard]] bool IsGpuDriven() const { return _scene != nullptr; }
+    [[nodiscard]] bool IsOcclusionCulling() const { return _scene && _scene->IsOcclusionCulling(); }
+    [[nodiscard]] OZZ::GpuCullStats GetCullStats() const { return _scene ? _scene->GetCullStats() : OZZ::GpuCullStats{}; }
+
+private:
+    void createMesh();
+    void createScene();
+    void createShader();
+    // Begun for compute, outside of rendering
+    void beginComputeCommands(VkCommandBuffer commandBuffer);
+    // CPU culling for when there's no GPU scene
+    void submitInstances(const std::vector<Cube>& cubes, const OZZ::StereoFrustum& frustum, glm::vec3 viewer,
+                         OZZ::DrawList& drawList);
+
+private:
+    OZZ::Renderer* _renderer;
+    std::unique_ptr<OZZ::Shader> _shader;
+    OZZ::MeshPool* _meshPool;
+    OZZ::MeshHandle _mesh;
+
+    std::unique_ptr<OZZ::GpuScene> _scene;
+    OZZ::SceneMeshHandle _sceneMesh;
+    std::vector<OZZ::SceneObjectHandle> _objects;
+
+    // CPU culling and instance order when there's no GPU scene
+    OZZ::CullingBounds _bounds;
+    OZZ::FrustumCuller _culler;
+    std::vector<OZZ::SortEntry> _depthOrder;
+    std::vector<OZZ::SortEntry> _sortScratch;
+};
@@ -0,0 +1,100 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include "dense_sphere.h"
+#include "ozz_vulkan/brushes/shapes.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+DenseSphere::DenseSphere(OZZ::Renderer* renderer) : _renderer(renderer) {
+    auto [vertices, indices] = OZZ::Brushes::GenerateSphere<uint32_t>(1.f, SPHERE_SEGMENTS, SPHERE_SEGMENTS);
+
+    // Shaded by its normals so the meshlets' facing is easy to check by eye
+    for (auto& vertex : vertices) {
+        vertex.Colour = vertex.Normal * 0.5f + 0.5f;
+    }
+
+    _model = glm::translate(glm::mat4{1.f}, glm::vec3(-2.f, 0.f, -5.f));
+
+    if (_renderer->GetDeviceCapabilities().MeshShader) {
+        createMeshlets(vertices, indices);
+    } else {
+        createClassic(vertices, indices);
+    }
+}
+
+DenseSphere::~DenseSphere() {
+    if (_mesh.IsValid()) {
+        _renderer->GetMeshPool<OZZ::CompactVertex>().Release(_mesh);
+    }
+    _meshlets.reset(nullptr);
+    _shader.reset(nullptr);
+}
+
+void DenseSphere::Draw(OZZ::CommandEncoder& encoder) {
+    if (!_shader) return;
+
+    if (_meshlets) {
+        if (!_meshlets->IsReady()) return;
+
+        _shader->Bind(encoder);
+        _renderer->BindViewData(encoder, *_shader);
+        _meshlets->Draw(encoder, *_shader, _model);
+        return;
+    }
+
+    auto& pool = _renderer->GetMeshPool<OZZ::CompactVertex>();
+    if (!_mesh.IsValid() || !pool.IsReady(_mesh)) return;
+
+    _shader->Bind(encoder);
+    _renderer->BindViewData(encoder, *_shader);
+    pool.Bind(encoder);
+
+    OZZ::InstanceData object { .Model = _model };
+    encoder.PushConstants(_shader->GetPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, object);
+    pool.Draw(encoder, _mesh);
+}
+
+void DenseSphere::createMeshlets(std::span<const OZZ::Vertex> vertices, std::span<const uint32_t> indices) {
+    _meshlets = _renderer->CreateMeshletMesh(vertices, indices);
+    if (!_meshlets || !_meshlets->IsValid()) {
+        spdlog::warn("Couldn't split the sphere into meshlets, drawing it whole");
+        _meshlets.reset(nullptr);
+        createClassic(vertices, indices);
+        return;
+    }
+
+    // Culled per meshlet in the task shader, the view comes from the view buffer at set 0
+    OZZ::ShaderConfiguration config {
+            .FragmentShaderPath = "assets/shaders/simple.frag.spv",
+            .TaskShaderPath = "assets/shaders/meshlet.task.spv",
+            .MeshShaderPath = "assets/shaders/meshlet.mesh.spv",
+            .PushConstants = { OZZ::PushConstantDefinition(sizeof(OZZ::MeshletMesh::DrawConstants),
+                                                           VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT) },
+            .DescriptorSetLayouts = { _renderer->GetViewDataLayout(), _meshlets->GetDescriptorSetLayout() },
+    };
+
+    _shader = _renderer->CreateShader(config);
+    spdlog::info("Dense sphere: {} triangles in {} meshlets, drawn with mesh shaders",
+                 _meshlets->GetTriangleCount(), _meshlets->GetMeshletCount());
+}
+
+void DenseSphere::createClassic(std::span<const OZZ::Vertex> vertices, std::span<const uint32_t> indices) {
+    auto compact = OZZ::ConvertVertices<OZZ::CompactVertex>(vertices);
+    _mesh = _renderer->GetMeshPool<OZZ::CompactVertex>().Add(std::span<const OZZ::CompactVertex>(compact), indices);
+    if (!_mesh.IsValid()) {
+        spdlog::error("Mesh pool is out of room for the dense sphere");
+        return;
+    }
+
+    OZZ::ShaderConfiguration config {
+            .VertexShaderPath = "assets/shaders/static.vert.spv",
+            .FragmentShaderPath = "assets/shaders/simple.frag.spv",
+            .PushConstants = { OZZ::PushConstantDefinition(sizeof(OZZ::InstanceData), VK_SHADER_STAGE_VERTEX_BIT) },
+            .DescriptorSetLayouts = { _renderer->GetViewDataLayout() },
+            .VertexLayout = OZZ::DescribeVertexLayout<OZZ::CompactVertex>()
+    };
+
+    _shader = _renderer->CreateShader(config);
+    spdlog::info("Dense sphere: {} triangles, drawn whole without mesh shaders", indices.size() / 3);
+}
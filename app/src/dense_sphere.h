@@ -0,0 +1,40 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+#include <ozz_vulkan/renderer.h>
+#include <memory>
+
+/*
+ * A finely tessellated sphere, the kind of mesh meshlets are for. Where the device has mesh shaders it's split
+ * into meshlets and each eye's task shader drops the ones outside the view or facing away, otherwise it sits
+ * in the compact mesh pool and is drawn whole.
+ */
+class DenseSphere {
+public:
+    explicit DenseSphere(OZZ::Renderer* renderer);
+    ~DenseSphere();
+
+    // Into the eye's encoder, reads the view from the renderer's view buffer
+    void Draw(OZZ::CommandEncoder& encoder);
+
+    [[nodiscard]] bool IsMeshShading() const { return _meshlets != nullptr; }
+
+private:
+    void createMeshlets(std::span<const OZZ::Vertex> vertices, std::span<const uint32_t> indices);
+    void createClassic(std::span<const OZZ::Vertex> vertices, std::span<const uint32_t> indices);
+
+private:
+    OZZ::Renderer* _renderer;
+    std::unique_ptr<OZZ::Shader> _shader;
+
+    // One or the other
+    std::unique_ptr<OZZ::MeshletMesh> _meshlets;
+    OZZ::MeshHandle _mesh {};
+
+    glm::mat4 _model { 1.f };
+
+    // About 33k triangles, a few hundred meshlets
+    static constexpr uint32_t SPHERE_SEGMENTS = 128;
+};
@@ -0,0 +1,125 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include "scenery.h"
+#include "ozz_vulkan/brushes/shapes.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+Scenery::Scenery(OZZ::Renderer* renderer) : _renderer(renderer) {
+    createShader();
+    createFloor();
+}
+
+Scenery::~Scenery() {
+    _bundles.clear();
+    if (auto* bindless = _renderer->GetBindlessSet()) {
+        bindless->Release(_objectsHandle);
+    }
+    _objects.reset(nullptr);
+    _floor = {};
+    _shader.reset(nullptr);
+}
+
+void Scenery::Draw(const OZZ::StereoFrustum& frustum) {
+    // Nothing can be recorded against the clusters until they're on the GPU
+    if (!_floor.IsReady()) return;
+    // The bindless shader has nowhere else to get the transforms from
+    if (_renderer->GetBindlessSet() && !(_objectsHandle.IsValid() && _objects->IsReady())) return;
+
+    for (size_t i = 0; i < _bundles.size(); i++) {
+        if (_bundles[i]->NeedsRecording()) {
+            record(i);
+        }
+    }
+
+    _culler.Cull(frustum, _bounds);
+    for (auto eye : {OZZ::EyeTarget::Left, OZZ::EyeTarget::Right}) {
+        for (auto cluster : _culler.GetVisible(eye)) {
+            _renderer->ExecuteBundle(*_bundles[cluster], eye);
+        }
+    }
+}
+
+void Scenery::record(size_t cluster) {
+    const auto& floorCluster = _floor.GetClusters()[cluster];
+    auto& bundle = *_bundles[cluster];
+
+    auto [width, height] = _renderer->GetSwapchainSize();
+    auto encoder = bundle.Begin({static_cast<uint32_t>(width), static_cast<uint32_t>(height)});
+    if (!encoder.IsValid()) return;
+
+    _shader->Bind(encoder);
+    _renderer->BindViewData(encoder, *_shader);
+    _floor.GetMeshPool()->Bind(encoder);
+
+    // The tile colours are baked into the vertices, only the cluster's position is left
+    if (_objectsHandle.IsValid()) {
+        _renderer->BindBindlessData(encoder, *_shader, 1);
+        BindlessDraw draw { .Buffer = _objectsHandle.Index, .Object = static_cast<uint32_t>(cluster) };
+        encoder.PushConstants(_shader->GetPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, draw);
+    } else {
+        OZZ::InstanceData object { .Model = glm::translate(glm::mat4{1.f}, floorCluster.Center) };
+        encoder.PushConstants(_shader->GetPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, object);
+    }
+    _floor.GetMeshPool()->Draw(encoder, floorCluster.Mesh);
+
+    bundle.End(encoder);
+}
+
+void Scenery::createShader() {
+    // The view comes from the view buffer at set 0, each cluster's transform and colour from the bindless set at 1
+    if (_renderer->GetBindlessSet()) {
+        OZZ::ShaderConfiguration config {
+                .VertexShaderPath = "assets/shaders/bindless.vert.spv",
+                .FragmentShaderPath = "assets/shaders/simple.frag.spv",
+                .PushConstants = { OZZ::PushConstantDefinition(sizeof(BindlessDraw), VK_SHADER_STAGE_VERTEX_BIT) },
+                .DescriptorSetLayouts = { _renderer->GetViewDataLayout(), _renderer->GetBindlessLayout() },
+                .VertexLayout = OZZ::DescribeVertexLayout<OZZ::CompactVertex>()
+        };
+
+        _shader = _renderer->CreateShader(config);
+        return;
+    }
+
+    // Without one, they're push constants
+    OZZ::ShaderConfiguration config {
+            .VertexShaderPath = "assets/shaders/static.vert.spv",
+            .FragmentShaderPath = "assets/shaders/simple.frag.spv",
+            .PushConstants = { OZZ::PushConstantDefinition(sizeof(OZZ::InstanceData), VK_SHADER_STAGE_VERTEX_BIT) },
+            .DescriptorSetLayouts = { _renderer->GetViewDataLayout() },
+            .VertexLayout = OZZ::DescribeVertexLayout<OZZ::CompactVertex>()
+    };
+
+    _shader = _renderer->CreateShader(config);
+}
+
+void Scenery::createFloor() {
+    constexpr float half = FLOOR_TILES * 0.5f;
+
+    // Flattened cubes, one piece per tile
+    OZZ::StaticBatcher batcher(FLOOR_CELL_SIZE);
+    for (int x = 0; x < FLOOR_TILES; x++) {
+        for (int z = 0; z < FLOOR_TILES; z++) {
+            auto model = glm::translate(glm::mat4{1.f}, glm::vec3(x - half + 0.5f, FLOOR_HEIGHT, z - half + 0.5f));
+            model = glm::scale(model, glm::vec3(0.9f, 0.05f, 0.9f));
+
+            auto shade = (x + z) % 2 == 0 ? 0.8f : 0.35f;
+            batcher.Add(_shader->GetId(), OZZ::Brushes::cubeVertices, OZZ::Brushes::cubeIndices, model, glm::vec3(shade));
+        }
+    }
+
+    _floor = batcher.Build<OZZ::CompactVertex>(_renderer->GetMeshPool<OZZ::CompactVertex>());
+
+    std::vector<OZZ::InstanceData> objects;
+    for (const auto& cluster : _floor.GetClusters()) {
+        _bounds.AddBox(cluster.Min, cluster.Max);
+        _bundles.push_back(_renderer->CreateStaticBundle());
+        objects.push_back({ .Model = glm::translate(glm::mat4{1.f}, cluster.Center) });
+    }
+
+    if (auto* bindless = _renderer->GetBindlessSet(); bindless && !objects.empty()) {
+        _objects = _renderer->CreateStorageBufferAsync(std::span<const OZZ::InstanceData>(objects));
+        _objectsHandle = bindless->AddBuffer(_objects->GetBuffer());
+    }
+}
@@ -0,0 +1,56 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+#include <ozz_vulkan/renderer.h>
+#include <ozz_vulkan/culling/frustum_culler.h>
+#include <ozz_vulkan/resources/static_batch.h>
+#include <memory>
+#include <vector>
+
+/*
+ * A checkerboard floor that never moves. The tiles are merged into a few spatial clusters at load time, each
+ * recorded once into its own static bundle that reads the view from the renderer's view buffer. A frame culls
+ * the clusters and executes the bundles each eye can see. With a bindless set the clusters' transforms sit in
+ * one storage buffer and each draw only pushes its index.
+ */
+class Scenery {
+public:
+    explicit Scenery(OZZ::Renderer* renderer);
+    ~Scenery();
+
+    // Once per frame, records a cluster's bundle again only when it's been invalidated
+    void Draw(const OZZ::StereoFrustum& frustum);
+
+private:
+    // bindless.vert's push constants
+    struct BindlessDraw {
+        uint32_t Buffer;
+        uint32_t Object;
+    };
+
+    void createShader();
+    void createFloor();
+    void record(size_t cluster);
+
+private:
+    OZZ::Renderer* _renderer;
+    std::unique_ptr<OZZ::Shader> _shader;
+
+    OZZ::StaticBatch _floor;
+    // One per cluster of _floor
+    std::vector<std::unique_ptr<OZZ::StaticBundle>> _bundles;
+
+    // One InstanceData per cluster, only with the renderer's bindless set
+    std::unique_ptr<OZZ::StorageBuffer> _objects;
+    OZZ::BindlessBuffer _objectsHandle {};
+
+    OZZ::CullingBounds _bounds;
+    OZZ::FrustumCuller _culler;
+
+    static constexpr int FLOOR_TILES = 10;
+    static constexpr float FLOOR_HEIGHT = -1.5f;
+    // Half the floor on each side, four clusters of 25 tiles
+    static constexpr float FLOOR_CELL_SIZE = FLOOR_TILES * 0.5f;
+};
@@ -6,8 +6,10 @@
 #pragma once
 #include <array>
 #include <glm/glm.hpp>
+#include <span>
 #include <utility>
 #include <numbers>
+#include <limits>
 #include <ozz_vulkan/resources/types.h>
 #include <spdlog/spdlog.h>
 
@@ -333,10 +335,30 @@ namespace OZZ {
                 }
         };
 
-        static std::pair<std::vector<Vertex>, std::vector<uint32_t>>
-        GenerateSphere(float radius = 1.f, uint32_t sectors = 50, uint32_t stacks = 50) {
-            std::vector<Vertex> vertices{};
-            std::vector<uint32_t> indices{};
+        constexpr uint32_t SphereVertexCount(uint32_t sectors, uint32_t stacks) {
+            return (sectors + 1) * (stacks + 1);
+        }
+
+        // The first and last stacks are a single triangle per sector
+        constexpr uint32_t SphereIndexCount(uint32_t sectors, uint32_t stacks) {
+            return stacks < 2 ? 0 : 6 * sectors * (stacks - 1);
+        }
+
+        /*
+         * Writes a sphere into spans sized by SphereVertexCount / SphereIndexCount, which can point straight
+         * into a MeshBuilder's staging memory. Any vertex layout with FromVertex works, it's converted on the way.
+         */
+        template <VertexLayout VertexType = Vertex, IndexElement IndexType = uint32_t>
+        void WriteSphere(std::span<VertexType> vertices, std::span<IndexType> indices,
+                         float radius = 1.f, uint32_t sectors = 50, uint32_t stacks = 50) {
+            if (vertices.size() < SphereVertexCount(sectors, stacks) || indices.size() < SphereIndexCount(sectors, stacks)) {
+                spdlog::error("Sphere with {} sectors and {} stacks doesn't fit the spans it was given", sectors, stacks);
+                return;
+            }
+
+            auto vertex = vertices.begin();
+            auto index = indices.begin();
+            auto pushIndex = [&index](uint32_t value) { *index++ = static_cast<IndexType>(value); };
             uint32_t k1, k2;
             float x, y, z, xy;                              // vertex.Position
             float nx, ny, nz, lengthInv = 1.0f / radius;    // vertex.Normal
@@ -351,11 +373,9 @@ namespace OZZ {
                 xy = radius * cosf(stackAngle);             // r * cos(u)
                 z = radius * sinf(stackAngle);              // r * sin(u)
 
-                k1 = i * (sectors + 1);     // beginning of current stack
-                k2 = k1 + sectors + 1;
                 // add (sectorCount+1) vertices per stack
                 // the first and last vertices have same.Position and.Normal, but different tex coords
-                for (uint32_t j = 0; j <= sectors; ++j, ++k1, ++k2) {
+                for (uint32_t j = 0; j <= sectors; ++j) {
                     sectorAngle = static_cast<float>(j) * sectorStep;           // starting from 0 to 2pi
 
                     // vertex.Position (x, y, z)
@@ -371,13 +391,17 @@ namespace OZZ {
                     s = (float) j / static_cast<float>(sectors);
                     t = (float) i / static_cast<float>(stacks);
 
-                    vertices.push_back(Vertex{
+                    Vertex generated {
                             .Position = {x, y, z},
                             .TexCoord = {s, t},
                             .Normal = {nx, ny, nz},
-                    });
-
+                    };
 
+                    if constexpr (std::is_same_v<VertexType, Vertex>) {
+                        *vertex++ = generated;
+                    } else {
+                        *vertex++ = VertexType::FromVertex(generated);
+                    }
                 }
             }
 
@@ -389,21 +413,38 @@ namespace OZZ {
                     // 2 triangles per sector excluding first and last stacks
                     // k1 => k2 => k1+1
                     if (i != 0) {
-                        indices.push_back(k1);
-                        indices.push_back(k1 + 1);
-                        indices.push_back(k2);
+                        pushIndex(k1);
+                        pushIndex(k1 + 1);
+                        pushIndex(k2);
                     }
 
                     // k1+1 => k2 => k2+1
                     if (i != (stacks - 1)) {
-                        indices.push_back(k1 + 1);
-                        indices.push_back(k2 + 1);
-                        indices.push_back(k2);
+                        pushIndex(k1 + 1);
+                        pushIndex(k2 + 1);
+                        pushIndex(k2);
                     }
                 }
             }
+        }
+
+        // Pass uint16_t as IndexType to get 16-bit indices, which fit up to 65536 vertices (about 255x255 sectors x stacks)
+        template <IndexElement IndexType = uint32_t>
+        static std::pair<std::vector<Vertex>, std::vector<IndexType>>
+        GenerateSphere(float radius = 1.f, uint32_t sectors = 50, uint32_t stacks = 50) {
+            if constexpr (std::is_same_v<IndexType, uint16_t>) {
+                if (SphereVertexCount(sectors, stacks) > std::numeric_limits<uint16_t>::max() + 1u) {
+                    spdlog::error("Sphere with {} sectors and {} stacks has too many vertices for 16-bit indices", sectors, stacks);
+                    return {};
+                }
+            }
+
+            // Sized up front, both are written exactly once
+            std::vector<Vertex> vertices(SphereVertexCount(sectors, stacks));
+            std::vector<IndexType> indices(SphereIndexCount(sectors, stacks));
+            WriteSphere<Vertex, IndexType>(vertices, indices, radius, sectors, stacks);
 
-            return {vertices, indices};
+            return {std::move(vertices), std::move(indices)};
         }
     }
 }
\ No newline at end of file
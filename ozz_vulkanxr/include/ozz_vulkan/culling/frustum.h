@@ -0,0 +1,47 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <ozz_vulkan/internal/xr_types.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+
+namespace OZZ {
+    // Normalised planes facing inwards, p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+    struct Frustum {
+        static constexpr uint32_t PLANE_COUNT = 6;
+
+        // Left, right, bottom, top, near, far
+        std::array<glm::vec4, PLANE_COUNT> Planes {};
+
+        // Clip space depth runs 0..1 (GLM_FORCE_DEPTH_ZERO_TO_ONE)
+        static Frustum FromViewProjection(const glm::mat4& viewProjection);
+        // Keeps everything, for when no frustum can be built
+        static Frustum Infinite();
+
+        [[nodiscard]] bool IntersectsSphere(glm::vec3 centre, float radius) const;
+        [[nodiscard]] bool IntersectsBox(glm::vec3 min, glm::vec3 max) const;
+    };
+
+    /*
+     * Both eyes' frusta plus a single frustum that contains both of them.
+     *
+     * The combined frustum looks down the average of the two eyes' orientations, opens wide enough to take in
+     * every edge of both eyes' FOV and has its apex pulled back until both eyes sit inside it. Anything it
+     * rejects neither eye can see, so most of a scene is thrown out with one test instead of two.
+     */
+    struct StereoFrustum {
+        // Indexed by EyeTarget
+        std::array<Frustum, 2> Eyes {};
+        Frustum Combined {};
+
+        // eyeToWorld places each eye in the space the bounds are in, the inverse of the eye's view matrix
+        static StereoFrustum FromEyes(const FieldOfView& leftFov, const glm::mat4& leftEyeToWorld,
+                                      const FieldOfView& rightFov, const glm::mat4& rightEyeToWorld);
+        // Straight from Renderer::GetEyePoseInfo, for bounds in the XR reference space
+        static StereoFrustum FromEyePoses(const EyePoseInfo& left, const EyePoseInfo& right);
+    };
+}
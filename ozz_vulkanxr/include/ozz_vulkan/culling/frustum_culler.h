@@ -0,0 +1,98 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <ozz_vulkan/culling/frustum.h>
+#include <ozz_vulkan/internal/xr_types.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace OZZ {
+    /*
+     * Bounding volumes packed structure-of-arrays, a batch of them loads straight into SIMD registers.
+     *
+     * Spheres and boxes share the layout: every entry is a centre, a radius and half extents, a sphere has
+     * zero extents and a box a zero radius. The arrays are padded to a whole batch so the last one never
+     * reads past the end.
+     */
+    class CullingBounds {
+    public:
+        // Widest batch any implementation tests
+        static constexpr uint32_t BATCH_SIZE = 8;
+
+        // Returns the index visibility lists refer to the bounds by
+        uint32_t AddSphere(glm::vec3 centre, float radius);
+        uint32_t AddBox(glm::vec3 min, glm::vec3 max);
+
+        void SetSphere(uint32_t index, glm::vec3 centre, float radius);
+        void SetBox(uint32_t index, glm::vec3 min, glm::vec3 max);
+
+        // Keeps the memory, refilling every frame doesn't allocate
+        void Clear();
+        void Reserve(uint32_t count);
+
+        [[nodiscard]] uint32_t GetCount() const { return _count; }
+
+    private:
+        friend class FrustumCuller;
+
+        uint32_t add();
+        void set(uint32_t index, glm::vec3 centre, float radius, glm::vec3 extents);
+
+    private:
+        uint32_t _count { 0 };
+        std::vector<float> _centreX;
+        std::vector<float> _centreY;
+        std::vector<float> _centreZ;
+        std::vector<float> _radius;
+        std::vector<float> _extentX;
+        std::vector<float> _extentY;
+        std::vector<float> _extentZ;
+    };
+
+    struct CullStats {
+        uint32_t Tested { 0 };
+        // Rejected by the combined frustum, neither eye had to be tested
+        uint32_t CulledCombined { 0 };
+        uint32_t VisibleLeft { 0 };
+        uint32_t VisibleRight { 0 };
+        // Visible to at least one eye
+        uint32_t Visible { 0 };
+        std::chrono::nanoseconds Time { 0 };
+    };
+
+    /*
+     * Tests CullingBounds against a StereoFrustum in SIMD batches: everything against the combined frustum
+     * first, then only the survivors against each eye. Uses AVX on x86-64 CPUs that have it, picked at
+     * runtime, SSE on any other x86-64 CPU and plain scalar code everywhere else.
+     *
+     * The visibility lists hold indices into the bounds and stay valid until the next Cull. Render thread only.
+     */
+    class FrustumCuller {
+    public:
+        // "AVX", "SSE" or "scalar", whichever this build uses on this CPU
+        static const char* GetInstructionSet();
+
+        void Cull(const StereoFrustum& frustum, const CullingBounds& bounds);
+
+        // Left or Right for one eye, BOTH for everything either eye can see
+        [[nodiscard]] std::span<const uint32_t> GetVisible(EyeTarget eye) const {
+            auto index = static_cast<size_t>(eye);
+            return {_visible[index].data(), _visibleCounts[index]};
+        }
+
+        [[nodiscard]] const CullStats& GetStats() const { return _stats; }
+
+    private:
+        // Indexed by EyeTarget, sized to the bounds so the kernels can write without checking
+        std::array<std::vector<uint32_t>, 3> _visible;
+        std::array<uint32_t, 3> _visibleCounts {};
+        CullStats _stats {};
+    };
+}
@@ -0,0 +1,37 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace OZZ::AllocationTracker {
+    /*
+     * With OZZ_TRACK_FRAME_ALLOCATIONS defined the library replaces the global operator new and counts every
+     * call per thread. The renderer uses it to check that a warmed up frame never touches the heap.
+     *
+     * Runtime and driver calls made from the render thread aren't ours to fix, wrap them in an IgnoreScope.
+     * Without the define everything here compiles away.
+     */
+#ifdef OZZ_TRACK_FRAME_ALLOCATIONS
+    inline constexpr bool Enabled = true;
+
+    // operator new calls made by the calling thread outside of any IgnoreScope
+    uint64_t GetThreadAllocationCount();
+
+    struct IgnoreScope {
+        IgnoreScope();
+        ~IgnoreScope();
+
+        IgnoreScope(const IgnoreScope&) = delete;
+        IgnoreScope& operator=(const IgnoreScope&) = delete;
+    };
+#else
+    inline constexpr bool Enabled = false;
+
+    inline uint64_t GetThreadAllocationCount() { return 0; }
+
+    struct IgnoreScope {};
+#endif
+}
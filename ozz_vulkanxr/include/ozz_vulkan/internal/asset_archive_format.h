@@ -0,0 +1,69 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+/*
+ * On-disk layout of a packed asset archive (.ozz)
+ *
+ * [ArchiveHeader]
+ * [entry data, each blob aligned to ARCHIVE_DATA_ALIGNMENT]
+ * [ArchiveEntry * EntryCount] - sorted by NameHash
+ * [string table]              - entry names, not null terminated
+ *
+ * Shared between the runtime reader and the asset packer tool, so this header
+ * must not pull in any graphics headers.
+ */
+namespace OZZ::Archive {
+    constexpr char ARCHIVE_MAGIC[4] = {'O', 'Z', 'Z', 'A'};
+    constexpr uint32_t ARCHIVE_VERSION = 1;
+
+    // SPIR-V must be 4-byte aligned, keep blobs 16-byte aligned for anything else we pack.
+    constexpr uint64_t ARCHIVE_DATA_ALIGNMENT = 16;
+
+    enum EntryFlags : uint32_t {
+        ENTRY_FLAG_NONE = 0,
+        ENTRY_FLAG_LZ4 = 1 << 0,
+    };
+
+    struct ArchiveHeader {
+        char Magic[4];
+        uint32_t Version;
+        uint32_t EntryCount;
+        uint32_t StringTableSize;
+        uint64_t EntryTableOffset;
+        uint64_t StringTableOffset;
+    };
+
+    struct ArchiveEntry {
+        uint64_t NameHash;
+        uint32_t NameOffset;
+        uint32_t NameLength;
+        uint64_t DataOffset;
+        uint64_t StoredSize;    // size in the archive (compressed size for LZ4 entries)
+        uint64_t Size;          // uncompressed size
+        uint32_t Flags;
+        uint32_t Reserved;
+    };
+
+    static_assert(sizeof(ArchiveHeader) == 32);
+    static_assert(sizeof(ArchiveEntry) == 48);
+
+    // FNV-1a, used to look entries up without touching the string table
+    constexpr uint64_t HashName(std::string_view name) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : name) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    constexpr uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
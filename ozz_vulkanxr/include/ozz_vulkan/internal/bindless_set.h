@@ -0,0 +1,121 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "graphics_includes.h"
+#include "command_encoder.h"
+#include "deletion_queue.h"
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace OZZ {
+    constexpr uint32_t INVALID_BINDLESS_INDEX = std::numeric_limits<uint32_t>::max();
+
+    // A slot in BindlessSet's image array, shaders index textures[] with it
+    struct BindlessTexture {
+        uint32_t Index { INVALID_BINDLESS_INDEX };
+
+        [[nodiscard]] bool IsValid() const { return Index != INVALID_BINDLESS_INDEX; }
+    };
+
+    // A slot in BindlessSet's storage buffer array
+    struct BindlessBuffer {
+        uint32_t Index { INVALID_BINDLESS_INDEX };
+
+        [[nodiscard]] bool IsValid() const { return Index != INVALID_BINDLESS_INDEX; }
+    };
+
+    /*
+     * One descriptor set holding every texture and storage buffer registered with it, in two large
+     * partially bound arrays: combined image samplers at binding 0 and storage buffers at binding 1, visible
+     * to every stage. Resources are registered once and referred to by index from then on, usually through
+     * push constants, so draws using different resources share a pipeline layout and never bind a set of
+     * their own. Shaders declare the arrays unsized, see GL_EXT_nonuniform_qualifier.
+     *
+     * Slots are written with update-after-bind, and only ever while no pending command buffer can read them:
+     * a slot is written once when it's handed out and never again until it's been released and every frame
+     * in flight has retired. Registering a resource never disturbs command buffers already recorded against
+     * the set, static bundles included. The set and its layout live as long as the renderer. Thread safe.
+     */
+    class BindlessSet {
+    public:
+        static constexpr uint32_t TEXTURE_BINDING = 0;
+        static constexpr uint32_t BUFFER_BINDING = 1;
+
+        // Capacities are clamped to the device's update-after-bind limits by the renderer
+        BindlessSet(VkDevice device, uint32_t textureCapacity, uint32_t bufferCapacity, DeletionQueue* deletions);
+        ~BindlessSet();
+
+        BindlessSet(const BindlessSet&) = delete;
+        BindlessSet& operator=(const BindlessSet&) = delete;
+
+        [[nodiscard]] bool IsValid() const { return _set != VK_NULL_HANDLE; }
+
+        // Invalid once the array is full. The view and sampler have to outlive the handle.
+        BindlessTexture AddTexture(VkImageView view, VkSampler sampler,
+                                   VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        /*
+         * A slot in use can't be rewritten while anything pending may read it, so this writes the image into a
+         * fresh slot and releases the old one like Release(). Draws recorded from now on use the returned
+         * handle, bundles recorded with the old one have to be recorded again. Invalid (and the old slot
+         * kept) once the array is full.
+         */
+        [[nodiscard]] BindlessTexture UpdateTexture(BindlessTexture texture, VkImageView view, VkSampler sampler,
+                                                    VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        // The slot is reused once the frames in flight retire, nothing may be recorded with it after this
+        void Release(BindlessTexture texture);
+
+        // Invalid once the array is full. The buffer has to outlive the handle and never move, see StorageBuffer.
+        BindlessBuffer AddBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+        // Into a fresh slot like UpdateTexture, the old one is released
+        [[nodiscard]] BindlessBuffer UpdateBuffer(BindlessBuffer handle, VkBuffer buffer, VkDeviceSize offset = 0,
+                                                  VkDeviceSize range = VK_WHOLE_SIZE);
+        void Release(BindlessBuffer buffer);
+
+        // The same set for the life of the renderer, safe to record into a static bundle
+        void Bind(CommandEncoder& encoder, VkPipelineLayout pipelineLayout, uint32_t set,
+                  VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) const;
+
+        [[nodiscard]] VkDescriptorSetLayout GetDescriptorSetLayout() const { return _setLayout; }
+        [[nodiscard]] VkDescriptorSet GetDescriptorSet() const { return _set; }
+
+        [[nodiscard]] uint32_t GetTextureCapacity() const { return _textures.Capacity; }
+        [[nodiscard]] uint32_t GetBufferCapacity() const { return _buffers.Capacity; }
+        // Slots handed out and not yet released
+        [[nodiscard]] uint32_t GetTextureCount() const;
+        [[nodiscard]] uint32_t GetBufferCount() const;
+
+    private:
+        // One array's slots, indices below Next that aren't in Free are in use
+        struct Slots {
+            uint32_t Capacity { 0 };
+            uint32_t Next { 0 };
+            std::vector<uint32_t> Free;
+
+            uint32_t Acquire();
+            [[nodiscard]] uint32_t GetUsed() const { return Next - static_cast<uint32_t>(Free.size()); }
+        };
+
+        void createDescriptors();
+        void writeTexture(uint32_t index, VkImageView view, VkSampler sampler, VkImageLayout layout);
+        void writeBuffer(uint32_t index, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+        void release(Slots& slots, uint32_t index);
+
+    private:
+        VkDevice _device { VK_NULL_HANDLE };
+        DeletionQueue* _deletions { nullptr };
+
+        VkDescriptorSetLayout _setLayout { VK_NULL_HANDLE };
+        VkDescriptorPool _descriptorPool { VK_NULL_HANDLE };
+        VkDescriptorSet _set { VK_NULL_HANDLE };
+
+        // Guards the slots and descriptor writes, updates to one set have to be externally synchronized
+        mutable std::mutex _mutex;
+        Slots _textures {};
+        Slots _buffers {};
+    };
+}
@@ -0,0 +1,144 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "graphics_includes.h"
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace OZZ {
+    // What one or more encoders recorded
+    struct CommandStats {
+        uint32_t Draws { 0 };
+        // Counted once per call, how many draws and triangles they make is only known to the GPU
+        uint32_t IndirectDraws { 0 };
+        // Mesh shader dispatches, what they draw is decided by their task shaders
+        uint32_t MeshDraws { 0 };
+        // Assumes triangle lists
+        uint64_t Triangles { 0 };
+
+        uint32_t PipelineBinds { 0 };
+        uint32_t VertexBufferBinds { 0 };
+        uint32_t IndexBufferBinds { 0 };
+        uint32_t DescriptorSetBinds { 0 };
+        // Viewports and scissors
+        uint32_t DynamicStateSets { 0 };
+        uint32_t PushConstantBytes { 0 };
+
+        // Calls dropped because they wouldn't have changed anything
+        uint32_t ElidedCalls { 0 };
+
+        CommandStats& operator+=(const CommandStats& other);
+    };
+
+    // A frame's counts, per eye. BOTH is for command buffers both eyes execute, they are counted once.
+    struct FrameCommandStats {
+        // Indexed by EyeTarget
+        std::array<CommandStats, 3> Eyes {};
+
+        [[nodiscard]] CommandStats GetTotal() const;
+    };
+
+    /*
+     * Thin wrapper over a command buffer that remembers what it has bound and drops calls that would bind it
+     * again: pipelines, vertex and index buffers, descriptor sets, viewport, scissor and push constant bytes.
+     * Everything that does go through is counted into the CommandStats it was made with, if any.
+     *
+     * It only knows about calls made through it. After recording anything straight into GetCommandBuffer()
+     * (or executing secondaries), call Invalidate(). Cheap to make, one per command buffer being recorded.
+     */
+    class CommandEncoder {
+    public:
+        // Anything past these goes straight through uncached
+        static constexpr uint32_t MAX_VERTEX_BINDINGS = 4;
+        static constexpr uint32_t MAX_DESCRIPTOR_SETS = 4;
+        static constexpr uint32_t MAX_DYNAMIC_OFFSETS = 4;
+        // The smallest maxPushConstantsSize a device may have
+        static constexpr uint32_t MAX_PUSH_CONSTANT_BYTES = 128;
+
+        // Extension entry points the loader doesn't export, once after the device is created with them enabled
+        static void LoadDeviceFunctions(VkDevice device, bool meshShader);
+        [[nodiscard]] static bool CanDrawMeshTasks();
+
+        CommandEncoder() = default;
+        explicit CommandEncoder(VkCommandBuffer commandBuffer, CommandStats* stats = nullptr);
+
+        [[nodiscard]] VkCommandBuffer GetCommandBuffer() const { return _commandBuffer; }
+        [[nodiscard]] bool IsValid() const { return _commandBuffer != VK_NULL_HANDLE; }
+
+        // Forgets everything bound, the next call of each kind is recorded whatever it binds
+        void Invalidate();
+
+        void BindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline);
+        void BindVertexBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset = 0);
+        void BindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType);
+        void BindDescriptorSet(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set,
+                               VkDescriptorSet descriptorSet, std::span<const uint32_t> dynamicOffsets = {});
+
+        void SetViewport(const VkViewport& viewport);
+        void SetScissor(const VkRect2D& scissor);
+
+        void PushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size,
+                           const void* data);
+
+        template <typename T>
+        void PushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, const T& constants, uint32_t offset = 0) {
+            PushConstants(layout, stages, offset, sizeof(T), &constants);
+        }
+
+        void Draw(uint32_t vertexCount, uint32_t instanceCount = 1, uint32_t firstVertex = 0, uint32_t firstInstance = 0);
+        void DrawIndexed(uint32_t indexCount, uint32_t instanceCount = 1, uint32_t firstIndex = 0,
+                         int32_t vertexOffset = 0, uint32_t firstInstance = 0);
+        void DrawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride);
+        void DrawIndexedIndirectCount(VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer,
+                                      VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride);
+        // Needs DeviceCapabilities::MeshShader
+        void DrawMeshTasks(uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+
+    private:
+        struct BoundSet {
+            VkPipelineLayout Layout { VK_NULL_HANDLE };
+            VkDescriptorSet Set { VK_NULL_HANDLE };
+            uint32_t OffsetCount { 0 };
+            std::array<uint32_t, MAX_DYNAMIC_OFFSETS> Offsets {};
+        };
+
+        struct BindPointState {
+            VkPipeline Pipeline { VK_NULL_HANDLE };
+            std::array<BoundSet, MAX_DESCRIPTOR_SETS> Sets {};
+        };
+
+        BindPointState& state(VkPipelineBindPoint bindPoint);
+        void elided();
+
+    private:
+        VkCommandBuffer _commandBuffer { VK_NULL_HANDLE };
+        CommandStats* _stats { nullptr };
+
+        BindPointState _graphics {};
+        BindPointState _compute {};
+
+        std::array<VkBuffer, MAX_VERTEX_BINDINGS> _vertexBuffers {};
+        std::array<VkDeviceSize, MAX_VERTEX_BINDINGS> _vertexOffsets {};
+
+        VkBuffer _indexBuffer { VK_NULL_HANDLE };
+        VkDeviceSize _indexOffset { 0 };
+        VkIndexType _indexType { VK_INDEX_TYPE_UINT16 };
+
+        bool _hasViewport { false };
+        VkViewport _viewport {};
+        bool _hasScissor { false };
+        VkRect2D _scissor {};
+
+        // Bytes pushed with this layout and these stages, anything else starts over
+        VkPipelineLayout _pushLayout { VK_NULL_HANDLE };
+        VkShaderStageFlags _pushStages { 0 };
+        std::array<std::byte, MAX_PUSH_CONSTANT_BYTES> _pushData {};
+        std::bitset<MAX_PUSH_CONSTANT_BYTES> _pushValid {};
+    };
+}
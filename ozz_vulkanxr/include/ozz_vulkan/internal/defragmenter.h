@@ -0,0 +1,132 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "graphics_includes.h"
+#include "deletion_queue.h"
+#include "upload_manager.h"
+#include "memory_tracker.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace OZZ {
+    struct DefragmentationStats {
+        uint32_t Runs { 0 };
+        uint32_t Passes { 0 };
+        uint32_t AllocationsMoved { 0 };
+        VkDeviceSize BytesMoved { 0 };
+        // Device memory handed back to the driver, what defragmentation is actually for
+        VkDeviceSize BytesFreed { 0 };
+        uint32_t DeviceMemoryBlocksFreed { 0 };
+    };
+
+    /*
+     * Compacts the allocator's default pools a little at a time using VMA's incremental defragmentation.
+     *
+     * Only buffers that registered themselves can move, everything else VMA proposes is ignored. A pass goes:
+     *   1. begin the pass, create a buffer at each move's destination, copy on the transfer queue
+     *   2. once the copies have landed, point every owner at its new buffer (render thread, between frames)
+     *   3. once the frames that could still read the old buffers have retired, destroy them and end the pass
+     * At most one pass is in flight at a time and each pass is capped in bytes and allocations, so a frame
+     * never pays for more than a handful of small copies.
+     *
+     * Owners that die while their buffer is part of a pass hand their teardown over through Release().
+     */
+    class Defragmenter {
+    public:
+        static constexpr VkDeviceSize DEFAULT_BYTES_PER_PASS = 8 * 1024 * 1024;
+        static constexpr uint32_t DEFAULT_ALLOCATIONS_PER_PASS = 64;
+        // Roughly every ten seconds at the usual headset refresh rates
+        static constexpr uint32_t DEFAULT_FRAMES_BETWEEN_RUNS = 900;
+
+        Defragmenter(VkDevice device, VmaAllocator allocator, UploadManager& uploads, DeletionQueue& deletions,
+                     MemoryTracker* memory = nullptr);
+        // The device has to be idle, a pass still in progress is wrapped up on the spot
+        ~Defragmenter();
+
+        Defragmenter(const Defragmenter&) = delete;
+        Defragmenter& operator=(const Defragmenter&) = delete;
+
+        /*
+         * buffer is the owner's handle and is rewritten when the buffer moves. The new buffer gets the same size,
+         * usage and sharing mode. It isn't moved before uploadValue is visible.
+         */
+        void Register(VmaAllocation allocation, VkBuffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage,
+                      uint64_t uploadValue);
+        // From the owner's destructor, the handle is never rewritten after this
+        void Unregister(VmaAllocation allocation);
+        // From the owner's deferred deleter. Returns true if the allocation is mid-move, the defragmenter then destroys it
+        bool Release(VmaAllocation allocation);
+
+        // Render thread, once per frame before anything is recorded
+        void Update();
+
+        void SetEnabled(bool enabled);
+        void SetFramesBetweenRuns(uint32_t frames) { _framesBetweenRuns = frames; }
+
+        [[nodiscard]] DefragmentationStats GetStats() const;
+        // Bumped whenever owners are pointed at new buffers, anything recorded against the old handles is stale
+        [[nodiscard]] uint64_t GetGeneration() const { return _generation.load(std::memory_order_acquire); }
+
+    private:
+        enum class State {
+            Idle,
+            // Between passes of a run, the next Update begins another pass
+            Ready,
+            // Waiting on the transfer queue
+            Copying,
+            // Owners use the new buffers, waiting on the deletion queue to end the pass
+            Retiring,
+        };
+
+        struct Entry {
+            VkBuffer* Buffer;
+            VkDeviceSize Size;
+            VkBufferUsageFlags Usage;
+            uint64_t UploadValue;
+        };
+
+        struct Move {
+            uint32_t Index;
+            VmaAllocation Allocation;
+            VkBuffer OldBuffer;
+            VkBuffer NewBuffer;
+            bool Swapped { false };
+            bool Released { false };
+        };
+
+        void beginRun();
+        void beginPass();
+        void swapBuffers();
+        void endPass();
+        void endRun();
+
+    private:
+        VkDevice _device { VK_NULL_HANDLE };
+        VmaAllocator _allocator { VK_NULL_HANDLE };
+        UploadManager* _uploads { nullptr };
+        DeletionQueue* _deletions { nullptr };
+        MemoryTracker* _memory { nullptr };
+
+        bool _enabled { true };
+        uint32_t _framesBetweenRuns { DEFAULT_FRAMES_BETWEEN_RUNS };
+        uint32_t _framesSinceRun { 0 };
+
+        State _state { State::Idle };
+        VmaDefragmentationContext _context { VK_NULL_HANDLE };
+        VmaDefragmentationPassMoveInfo _pass {};
+        std::vector<Move> _moves;
+        // Kept between passes so a run doesn't allocate every frame
+        std::vector<BufferCopy> _copies;
+        uint64_t _copyValue { 0 };
+
+        std::unordered_map<VmaAllocation, Entry> _entries;
+        DefragmentationStats _stats {};
+        std::atomic<uint64_t> _generation { 0 };
+        mutable std::mutex _mutex;
+    };
+}
@@ -0,0 +1,77 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "frame_clock.h"
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace OZZ {
+    /*
+     * Holds on to GPU handles until every frame that could have used them has retired.
+     *
+     * Deleters are stamped with the frame being recorded when they're pushed (or the last one, between
+     * frames), the renderer flushes everything up to the newest frame whose fences have signalled.
+     * Frame numbers only grow, so the queue stays sorted and flushing never scans past the first survivor.
+     * Flushing happens on the render thread only.
+     */
+    class DeletionQueue {
+    public:
+        explicit DeletionQueue(const FrameClock& clock) : _clock(&clock) {}
+
+        ~DeletionQueue() {
+            FlushAll();
+        }
+
+        DeletionQueue(const DeletionQueue&) = delete;
+        DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+        void Push(std::function<void()> deleter) {
+            std::lock_guard lock(_mutex);
+            _pending.push_back({_clock->FrameNumber.load(), std::move(deleter)});
+        }
+
+        void Flush(uint64_t retiredFrame) {
+            {
+                std::lock_guard lock(_mutex);
+                while (!_pending.empty() && _pending.front().Frame <= retiredFrame) {
+                    _ready.push_back(std::move(_pending.front()));
+                    _pending.pop_front();
+                }
+            }
+
+            // Deleters may take other locks (mesh pools, the upload manager), so run them outside ours
+            for (auto& pending : _ready) {
+                pending.Deleter();
+            }
+            // Keeps its capacity, flushing every frame shouldn't allocate every frame
+            _ready.clear();
+        }
+
+        // Only once the device is idle
+        void FlushAll() {
+            Flush(std::numeric_limits<uint64_t>::max());
+        }
+
+        [[nodiscard]] size_t GetPendingCount() const {
+            std::lock_guard lock(_mutex);
+            return _pending.size();
+        }
+
+    private:
+        struct Pending {
+            uint64_t Frame;
+            std::function<void()> Deleter;
+        };
+
+        const FrameClock* _clock;
+        std::deque<Pending> _pending;
+        std::vector<Pending> _ready;
+        mutable std::mutex _mutex;
+    };
+}
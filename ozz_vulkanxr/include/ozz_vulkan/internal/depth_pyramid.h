@@ -0,0 +1,122 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "graphics_includes.h"
+#include "memory_tracker.h"
+#include "xr_types.h"
+#include <ozz_vulkan/resources/compute_shader.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <memory>
+#include <unordered_map>
+
+namespace OZZ {
+    /*
+     * A mip chain of each eye's depth, every texel the farthest depth of the pixels under it. Tested against
+     * to find objects hidden behind what was already drawn, see GpuScene.
+     *
+     * Level 0 is half the depth buffer's size and every level halves again (rounding down) until 1x1, texels
+     * on an odd edge take in the extra row or column, so pixel p of the depth buffer is always covered by
+     * texel min(p >> (level + 1), levelSize - 1). The renderer builds each eye's pyramid right after the eye's
+     * main pass, with the view it was rendered with. Both pyramids live on one queue with barriers around
+     * their reads and writes, so there's one per eye rather than one per frame in flight. Render thread only.
+     */
+    class DepthPyramid {
+    public:
+        // Power of two sizes up to 8k depth buffers
+        static constexpr uint32_t MAX_LEVELS = 13;
+        static constexpr uint32_t GROUP_SIZE = 8;
+        static constexpr uint32_t MAX_DEPTH_SOURCES = 16;
+
+        // depth_pyramid.comp's push constants, one level's build
+        struct LevelSizes {
+            glm::uvec2 SourceSize;
+            glm::uvec2 DestinationSize;
+        };
+
+        DepthPyramid(VkDevice device, VmaAllocator allocator, MemoryTracker* memory = nullptr);
+        ~DepthPyramid();
+
+        DepthPyramid(const DepthPyramid&) = delete;
+        DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+        // For depth buffers of extent and format, recording the new images' layout transitions into commandBuffer. Device must be idle.
+        void Resize(VkCommandBuffer commandBuffer, VkExtent2D depthExtent, VkFormat depthFormat);
+
+        // Nothing is built until there's a shader to build with, see Renderer::EnableOcclusionCulling
+        void SetBuildShader(std::unique_ptr<ComputeShader> shader);
+        // Set 0 of the build shader, the level's source as a sampler2D at binding 0 and its r32f image at 1
+        [[nodiscard]] VkDescriptorSetLayout GetBuildSetLayout() const { return _buildSetLayout; }
+        [[nodiscard]] bool CanBuild() const { return _buildShader && _buildShader->IsValid() && _levelCount > 0; }
+
+        // The view the eye's next build will be rendered with
+        void SetViewProjection(EyeTarget eye, const glm::mat4& viewProjection);
+
+        /*
+         * After the eye's rendering has ended. depthImage is in DEPTH_STENCIL_ATTACHMENT_OPTIMAL and is left
+         * that way, depthView has to be able to sample its depth aspect.
+         */
+        void Record(VkCommandBuffer commandBuffer, EyeTarget eye, VkImage depthImage, VkImageView depthView);
+
+        // True once both eyes have been built since the last resize
+        [[nodiscard]] bool IsReady() const { return _built[0] && _built[1]; }
+        // What the eye's pyramid was last built from
+        [[nodiscard]] const glm::mat4& GetBuiltViewProjection(EyeTarget eye) const { return _builtViewProjections[static_cast<size_t>(eye)]; }
+        // What it will be built from next, normally this frame's view
+        [[nodiscard]] const glm::mat4& GetViewProjection(EyeTarget eye) const { return _viewProjections[static_cast<size_t>(eye)]; }
+
+        [[nodiscard]] VkExtent2D GetDepthExtent() const { return _depthExtent; }
+        [[nodiscard]] uint32_t GetLevelCount() const { return _levelCount; }
+
+        // Binding 0 is both eyes' pyramids as sampler2D[2], left first. Valid for the life of the pyramid.
+        [[nodiscard]] VkDescriptorSetLayout GetSampleSetLayout() const { return _sampleSetLayout; }
+        [[nodiscard]] VkDescriptorSet GetSampleSet() const { return _sampleSet; }
+
+    private:
+        struct EyePyramid {
+            VkImage Image { VK_NULL_HANDLE };
+            VmaAllocation Allocation { VK_NULL_HANDLE };
+            // Every level, for sampling
+            VkImageView View { VK_NULL_HANDLE };
+            // One level each, level i's build reads LevelViews[i - 1] and writes LevelViews[i]
+            std::array<VkImageView, MAX_LEVELS> LevelViews {};
+            // Level i's build set for i > 0, level 0's depend on the depth image
+            std::array<VkDescriptorSet, MAX_LEVELS> LevelSets {};
+        };
+
+        void createLayouts();
+        void destroyImages();
+        VkDescriptorSet allocateBuildSet(VkImageView source, VkImageLayout sourceLayout, VkImageView destination);
+        VkDescriptorSet getDepthSourceSet(EyeTarget eye, VkImageView depthView);
+
+    private:
+        VkDevice _device { VK_NULL_HANDLE };
+        VmaAllocator _allocator { VK_NULL_HANDLE };
+        MemoryTracker* _memory { nullptr };
+
+        std::unique_ptr<ComputeShader> _buildShader {};
+
+        VkSampler _sampler { VK_NULL_HANDLE };
+        VkDescriptorSetLayout _buildSetLayout { VK_NULL_HANDLE };
+        VkDescriptorSetLayout _sampleSetLayout { VK_NULL_HANDLE };
+        // The sample set lives for the pyramid's life, build sets are reset with every resize
+        VkDescriptorPool _samplePool { VK_NULL_HANDLE };
+        VkDescriptorPool _buildPool { VK_NULL_HANDLE };
+        VkDescriptorSet _sampleSet { VK_NULL_HANDLE };
+
+        VkExtent2D _depthExtent { 0, 0 };
+        VkImageAspectFlags _depthAspect { VK_IMAGE_ASPECT_DEPTH_BIT };
+        VkExtent2D _baseExtent { 0, 0 };
+        uint32_t _levelCount { 0 };
+        std::array<EyePyramid, 2> _eyes {};
+        // Per depth image view, each swapchain image brings its own depth buffer
+        std::unordered_map<VkImageView, VkDescriptorSet> _depthSourceSets;
+
+        std::array<glm::mat4, 2> _viewProjections { glm::mat4 { 1.f }, glm::mat4 { 1.f } };
+        std::array<glm::mat4, 2> _builtViewProjections { glm::mat4 { 1.f }, glm::mat4 { 1.f } };
+        std::array<bool, 2> _built { false, false };
+    };
+}
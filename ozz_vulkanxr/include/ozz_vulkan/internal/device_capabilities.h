@@ -0,0 +1,21 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+namespace OZZ {
+    // Optional device features the renderer found and enabled, resources pick their code paths from it
+    struct DeviceCapabilities {
+        // vkCmdDrawIndexedIndirectCount, the draw count comes from a buffer written on the GPU
+        bool DrawIndirectCount { false };
+        // More than one draw per indirect call
+        bool MultiDrawIndirect { false };
+        // Indirect draws may start at a non-zero firstInstance
+        bool DrawIndirectFirstInstance { false };
+        // VK_EXT_mesh_shader with task shaders, see MeshletMesh
+        bool MeshShader { false };
+        // Partially bound, update-after-bind arrays of textures and storage buffers, see BindlessSet
+        bool DescriptorIndexing { false };
+    };
+}
@@ -0,0 +1,78 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace OZZ {
+    /*
+     * Bump allocator for CPU data that only lives for one frame, rewound by Renderer::BeginFrame.
+     *
+     * Nothing is ever freed individually and no destructors run, so only trivially destructible types go in
+     * (or pmr containers that are done with before the next BeginFrame). When a frame asks for more than the
+     * arena holds, the rest comes from the heap and the arena grows to fit on the next Reset, so after a few
+     * frames of warm-up the steady state never touches the heap.
+     *
+     * It is a std::pmr::memory_resource too, std::pmr::vector<T> list(&arena) keeps a container on it.
+     * Render thread only.
+     */
+    class FrameArena : public std::pmr::memory_resource {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+
+        explicit FrameArena(size_t capacity = DEFAULT_CAPACITY);
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        template <typename T>
+        std::span<T> AllocateArray(size_t count) {
+            static_assert(std::is_trivially_destructible_v<T>, "Frame arena memory is never destructed");
+            auto data = static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+            for (size_t i = 0; i < count; i++) {
+                new (data + i) T();
+            }
+            return {data, count};
+        }
+
+        template <typename T, typename... Args>
+        T* New(Args&&... args) {
+            static_assert(std::is_trivially_destructible_v<T>, "Frame arena memory is never destructed");
+            return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        // Invalidates everything handed out since the last Reset
+        void Reset();
+
+        [[nodiscard]] size_t GetCapacity() const { return _capacity; }
+        [[nodiscard]] size_t GetUsed() const { return _head + _overflowBytes; }
+        // Most bytes any frame asked for since the arena was created
+        [[nodiscard]] size_t GetHighWater() const { return _highWater; }
+
+    protected:
+        void* do_allocate(size_t bytes, size_t alignment) override { return Allocate(bytes, alignment); }
+        void do_deallocate(void*, size_t, size_t) override {}
+        [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    private:
+        std::unique_ptr<std::byte[]> _buffer;
+        size_t _capacity { 0 };
+        size_t _head { 0 };
+        size_t _highWater { 0 };
+
+        // Only used during warm-up, freed on the next Reset
+        std::vector<std::unique_ptr<std::byte[]>> _overflow;
+        size_t _overflowBytes { 0 };
+    };
+}
@@ -0,0 +1,21 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace OZZ {
+    /*
+     * Which per-frame slot the frame being recorded owns. Resources that are N-buffered against frames in
+     * flight read this to pick the copy the GPU is guaranteed to be done with.
+     */
+    struct FrameClock {
+        std::atomic<uint64_t> FrameNumber {0};
+        std::atomic<uint32_t> Slot {0};
+        // False between EndFrame and the next BeginFrame, when the slot may still be in flight
+        std::atomic<bool> InFrame {false};
+    };
+}
@@ -6,14 +6,15 @@
 
 #include "graphics_includes.h"
 #include <spdlog/spdlog.h>
+#include <array>
+#include <span>
 #include <vector>
-#include <unordered_map>
 #include "xr_types.h"
 
 namespace OZZ {
     struct FrameCommandBufferCache {
-        explicit FrameCommandBufferCache(VkDevice vkDevice,
-                                         VkCommandPool commandPool) : vkDevice(vkDevice), commandPool(commandPool) {
+        explicit FrameCommandBufferCache(VkDevice vkDevice, VkCommandPool commandPool, uint32_t slot)
+                : Slot(slot), vkDevice(vkDevice), commandPool(commandPool) {
             // Create fences
             VkFenceCreateInfo fenceCreateInfo {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
             if (vkCreateFence(vkDevice, &fenceCreateInfo, nullptr, &leftEyeFence) != VK_SUCCESS ||
@@ -21,9 +22,21 @@ namespace OZZ {
                 spdlog::error("Failed to create fences");
             }
 
-            CommandBuffers[EyeTarget::Left] = {};
-            CommandBuffers[EyeTarget::Right] = {};
-            CommandBuffers[EyeTarget::BOTH] = {};
+            // Enough for the usual frame, the vectors keep whatever they grow to so it's only paid once
+            for (auto& buffers : CommandBuffers) {
+                buffers.reserve(INITIAL_COMMAND_BUFFER_CAPACITY);
+            }
+            for (auto& buffers : BundleCommandBuffers) {
+                buffers.reserve(INITIAL_COMMAND_BUFFER_CAPACITY);
+            }
+            for (auto& buffers : PostDepthCommandBuffers) {
+                buffers.reserve(INITIAL_COMMAND_BUFFER_CAPACITY);
+            }
+            for (auto& buffers : LateCommandBuffers) {
+                buffers.reserve(INITIAL_COMMAND_BUFFER_CAPACITY);
+            }
+            PreRenderCommandBuffers.reserve(INITIAL_COMMAND_BUFFER_CAPACITY);
+            freeCommandBuffers.reserve(INITIAL_COMMAND_BUFFER_CAPACITY * (CommandBuffers.size() * 3 + 1));
         }
 
         ~FrameCommandBufferCache() {
@@ -39,23 +52,49 @@ namespace OZZ {
             }
 
             clearCommandBuffers();
+            if (!freeCommandBuffers.empty()) {
+                vkFreeCommandBuffers(vkDevice, commandPool, static_cast<uint32_t>(freeCommandBuffers.size()),
+                                     freeCommandBuffers.data());
+                freeCommandBuffers.clear();
+            }
         }
 
-        void Claim() {
+        void Claim(uint64_t frameNumber) {
             Available = false;
+            InFlight = false;
+            FrameNumber = frameNumber;
+            leftEyeSubmitted = rightEyeSubmitted = false;
+            preRenderRecorded = false;
         }
 
-        void CheckAndClearCaches(uint64_t timeout = 0) {
-            VkFence fences[] = {leftEyeFence, rightEyeFence};
-
-            if (vkWaitForFences(vkDevice, 2, fences, VK_TRUE, timeout) == VK_SUCCESS) {
-                // Clear command buffers
-                clearCommandBuffers();
+        void MarkSubmitted(EyeTarget target) {
+            if (target == EyeTarget::Left) {
+                leftEyeSubmitted = true;
+            } else {
+                rightEyeSubmitted = true;
+            }
+        }
 
-                // Reset fences
-                vkResetFences(vkDevice, 2, fences);
+        // Called once the frame is over, a frame that never got submitted is recycled straight away
+        void Finish() {
+            InFlight = true;
+            CheckAndClearCaches();
+        }
 
-                Available = true;
+        void CheckAndClearCaches(uint64_t timeout = 0) {
+            // Only fences that were actually submitted will ever signal
+            if (!InFlight) return;
+
+            VkFence fences[2];
+            uint32_t fenceCount = 0;
+            if (leftEyeSubmitted) fences[fenceCount++] = leftEyeFence;
+            if (rightEyeSubmitted) fences[fenceCount++] = rightEyeFence;
+
+            if (fenceCount == 0 || vkWaitForFences(vkDevice, fenceCount, fences, VK_TRUE, timeout) == VK_SUCCESS) {
+                if (fenceCount > 0) {
+                    vkResetFences(vkDevice, fenceCount, fences);
+                }
+                recycle();
             }
         }
 
@@ -68,36 +107,112 @@ namespace OZZ {
         }
 
         const auto& GetCommandBuffers(EyeTarget target) const {
-            return CommandBuffers.at(target);
+            return CommandBuffers[static_cast<size_t>(target)];
         }
 
         void PushCommandBuffer(VkCommandBuffer commandBuffer, EyeTarget target) {
-            CommandBuffers.at(target).push_back(commandBuffer);
+            CommandBuffers[static_cast<size_t>(target)].push_back(commandBuffer);
         }
 
-        bool Available {true};
-    private:
-        void clearCommandBuffers() {
-            if (!CommandBuffers[OZZ::EyeTarget::Left].empty())
-                vkFreeCommandBuffers(vkDevice, commandPool, CommandBuffers[OZZ::EyeTarget::Left].size(),
-                                     CommandBuffers[OZZ::EyeTarget::Left].data());
+        const auto& GetBundleCommandBuffers(EyeTarget target) const {
+            return BundleCommandBuffers[static_cast<size_t>(target)];
+        }
 
-            if (!CommandBuffers[OZZ::EyeTarget::Right].empty())
-                vkFreeCommandBuffers(vkDevice, commandPool, CommandBuffers[OZZ::EyeTarget::Right].size(),
-                                     CommandBuffers[OZZ::EyeTarget::Right].data());
+        // A StaticBundle's buffer, executed this frame but owned by the bundle and never recycled here
+        void PushBundleCommandBuffer(VkCommandBuffer commandBuffer, EyeTarget target) {
+            BundleCommandBuffers[static_cast<size_t>(target)].push_back(commandBuffer);
+        }
 
-            if (!CommandBuffers[OZZ::EyeTarget::BOTH].empty())
-                vkFreeCommandBuffers(vkDevice, commandPool, CommandBuffers[OZZ::EyeTarget::BOTH].size(),
-                                     CommandBuffers[OZZ::EyeTarget::BOTH].data());
+        const auto& GetPostDepthCommandBuffers(EyeTarget target) const {
+            return PostDepthCommandBuffers[static_cast<size_t>(target)];
+        }
+
+        void PushPostDepthCommandBuffer(VkCommandBuffer commandBuffer, EyeTarget target) {
+            PostDepthCommandBuffers[static_cast<size_t>(target)].push_back(commandBuffer);
+        }
 
-            CommandBuffers[OZZ::EyeTarget::Left].clear();
-            CommandBuffers[OZZ::EyeTarget::Right].clear();
-            CommandBuffers[OZZ::EyeTarget::BOTH].clear();
+        const auto& GetLateCommandBuffers(EyeTarget target) const {
+            return LateCommandBuffers[static_cast<size_t>(target)];
+        }
+
+        void PushLateCommandBuffer(VkCommandBuffer commandBuffer, EyeTarget target) {
+            LateCommandBuffers[static_cast<size_t>(target)].push_back(commandBuffer);
+        }
+
+        void PushPreRenderCommandBuffer(VkCommandBuffer commandBuffer) {
+            PreRenderCommandBuffers.push_back(commandBuffer);
+        }
+
+        /*
+         * The pre-render buffers go into whichever eye is recorded first, the other eye is submitted after it
+         * on the same queue. Empty once they've been handed out this frame.
+         */
+        std::span<const VkCommandBuffer> TakePreRenderCommandBuffers() {
+            if (preRenderRecorded) return {};
+            preRenderRecorded = true;
+            return PreRenderCommandBuffers;
+        }
+
+        // A secondary command buffer this cache used in an earlier frame, or VK_NULL_HANDLE. Beginning it resets it.
+        VkCommandBuffer TakeRecycledCommandBuffer() {
+            if (freeCommandBuffers.empty()) return VK_NULL_HANDLE;
+
+            auto commandBuffer = freeCommandBuffers.back();
+            freeCommandBuffers.pop_back();
+            return commandBuffer;
+        }
+
+        bool Available {true};
+        // Submitted and waiting on the GPU
+        bool InFlight {false};
+        uint64_t FrameNumber {0};
+        // Which per-frame resources (e.g. the frame ring buffer's region) belong to this cache
+        const uint32_t Slot;
+    private:
+        void recycle() {
+            clearCommandBuffers();
+            leftEyeSubmitted = rightEyeSubmitted = false;
+            InFlight = false;
+            Available = true;
+        }
+
+        // Command buffers go back on the free list rather than to the pool, the pool resets them on begin
+        void clearCommandBuffers() {
+            for (auto& buffers : CommandBuffers) {
+                freeCommandBuffers.insert(freeCommandBuffers.end(), buffers.begin(), buffers.end());
+                buffers.clear();
+            }
+            for (auto* lists : {&PostDepthCommandBuffers, &LateCommandBuffers}) {
+                for (auto& buffers : *lists) {
+                    freeCommandBuffers.insert(freeCommandBuffers.end(), buffers.begin(), buffers.end());
+                    buffers.clear();
+                }
+            }
+            freeCommandBuffers.insert(freeCommandBuffers.end(), PreRenderCommandBuffers.begin(), PreRenderCommandBuffers.end());
+            PreRenderCommandBuffers.clear();
+            for (auto& buffers : BundleCommandBuffers) {
+                buffers.clear();
+            }
         }
     private:
-        std::unordered_map<EyeTarget, std::vector<VkCommandBuffer>> CommandBuffers;
+        static constexpr size_t INITIAL_COMMAND_BUFFER_CAPACITY = 8;
+
+        // Indexed by EyeTarget
+        std::array<std::vector<VkCommandBuffer>, 3> CommandBuffers;
+        // Indexed by EyeTarget, executed ahead of CommandBuffers
+        std::array<std::vector<VkCommandBuffer>, 3> BundleCommandBuffers;
+        // Indexed by EyeTarget, recorded outside of rendering and run once the eye's depth pyramid is built
+        std::array<std::vector<VkCommandBuffer>, 3> PostDepthCommandBuffers;
+        // Indexed by EyeTarget, drawn into the eye's images again after the post-depth buffers
+        std::array<std::vector<VkCommandBuffer>, 3> LateCommandBuffers;
+        // Recorded outside of rendering, run once per frame ahead of both eyes
+        std::vector<VkCommandBuffer> PreRenderCommandBuffers;
+        bool preRenderRecorded {false};
+        std::vector<VkCommandBuffer> freeCommandBuffers;
         VkFence leftEyeFence {VK_NULL_HANDLE};
         VkFence rightEyeFence {VK_NULL_HANDLE};
+        bool leftEyeSubmitted {false};
+        bool rightEyeSubmitted {false};
 
         VkDevice vkDevice {VK_NULL_HANDLE};
         VkCommandPool commandPool {VK_NULL_HANDLE};
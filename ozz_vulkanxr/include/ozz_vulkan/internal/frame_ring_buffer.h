@@ -0,0 +1,97 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "graphics_includes.h"
+#include "command_encoder.h"
+#include "memory_tracker.h"
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace OZZ {
+    // A chunk of this frame's uniform/storage data, write through Data and bind with Offset
+    struct FrameAllocation {
+        void* Data { nullptr };
+        uint32_t Offset { 0 };
+        VkDeviceSize Size { 0 };
+
+        [[nodiscard]] bool IsValid() const { return Data != nullptr; }
+
+        template <typename T>
+        [[nodiscard]] T* As() const { return static_cast<T*>(Data); }
+    };
+
+    /*
+     * Linear per-frame allocator over one persistently mapped, host visible buffer.
+     *
+     * The buffer is split into one region per frame in flight. BeginFrame rewinds a region once the frame
+     * that last used it has retired, after that allocations are a single atomic bump and a memcpy.
+     *
+     * Shaders see the data through one descriptor set with two dynamic bindings:
+     *   binding 0, uniform buffer - small per-frame / per-view data, up to GetUniformRange() bytes
+     *   binding 1, storage buffer - bulk per-object data, up to GetStorageRange() bytes
+     * Both take their allocation's Offset as the dynamic offset, so the set never has to be rewritten.
+     */
+    class FrameRingBuffer {
+    public:
+        static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 4 * 1024 * 1024;
+        static constexpr VkDeviceSize STORAGE_WINDOW = 1024 * 1024;
+        static constexpr VkDeviceSize UNIFORM_WINDOW = 64 * 1024;
+
+        FrameRingBuffer(VkDevice device, VmaAllocator allocator, const VkPhysicalDeviceLimits& limits,
+                        uint32_t frameCount, MemoryTracker* memory = nullptr, VkDeviceSize frameSize = DEFAULT_FRAME_SIZE);
+        ~FrameRingBuffer();
+
+        FrameRingBuffer(const FrameRingBuffer&) = delete;
+        FrameRingBuffer& operator=(const FrameRingBuffer&) = delete;
+
+        // The caller guarantees the GPU is done with everything previously allocated from slot
+        void BeginFrame(uint32_t slot);
+        // Makes this frame's writes visible to the device, call before submitting
+        void Flush();
+
+        // Thread safe, returns an invalid allocation when the frame's region is exhausted
+        FrameAllocation AllocateUniform(VkDeviceSize size);
+        FrameAllocation AllocateStorage(VkDeviceSize size);
+
+        // An invalid allocation binds the start of the frame's region, for shaders that only use one of the bindings
+        void Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set,
+                  const FrameAllocation& uniform, const FrameAllocation& storage) const;
+        void Bind(CommandEncoder& encoder, VkPipelineLayout pipelineLayout, uint32_t set,
+                  const FrameAllocation& uniform, const FrameAllocation& storage) const;
+
+        [[nodiscard]] VkDescriptorSetLayout GetDescriptorSetLayout() const { return _setLayout; }
+        [[nodiscard]] VkDeviceSize GetUniformRange() const { return _uniformRange; }
+        [[nodiscard]] VkDeviceSize GetStorageRange() const { return _storageRange; }
+
+    private:
+        FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize maxSize);
+        void createDescriptors();
+
+    private:
+        VkDevice _device { VK_NULL_HANDLE };
+        VmaAllocator _allocator { VK_NULL_HANDLE };
+        MemoryTracker* _memory { nullptr };
+
+        VkBuffer _buffer { VK_NULL_HANDLE };
+        VmaAllocation _allocation { VK_NULL_HANDLE };
+        std::byte* _mapped { nullptr };
+
+        VkDeviceSize _frameSize { 0 };
+        uint32_t _frameCount { 0 };
+        VkDeviceSize _uniformAlignment { 0 };
+        VkDeviceSize _storageAlignment { 0 };
+        VkDeviceSize _uniformRange { 0 };
+        VkDeviceSize _storageRange { 0 };
+
+        VkDeviceSize _frameBase { 0 };
+        std::atomic<VkDeviceSize> _head { 0 };
+
+        VkDescriptorSetLayout _setLayout { VK_NULL_HANDLE };
+        VkDescriptorPool _descriptorPool { VK_NULL_HANDLE };
+        VkDescriptorSet _descriptorSet { VK_NULL_HANDLE };
+    };
+}
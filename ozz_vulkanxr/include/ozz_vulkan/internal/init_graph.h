@@ -0,0 +1,142 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <spdlog/spdlog.h>
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace OZZ {
+    struct InitStageTiming {
+        std::string Name;
+        // Relative to the start of the graph
+        std::chrono::duration<double, std::milli> Start;
+        std::chrono::duration<double, std::milli> Duration;
+    };
+
+    /*
+     * Runs initialization stages as a dependency graph.
+     *
+     * Every stage gets its own thread and waits on the stages it depends on, so stages
+     * without a path between them run concurrently. Dependencies must be added before
+     * the stages that use them, which also rules out cycles.
+     *
+     * A stage fails by returning false or throwing, and every stage depending on it
+     * (directly or not) is skipped rather than run on top of missing state.
+     */
+    class InitGraph {
+    public:
+        void AddStage(const std::string& name, const std::vector<std::string>& dependencies, std::function<bool()> task) {
+            Stage stage { .Name = name, .Task = std::move(task) };
+
+            for (const auto& dependency : dependencies) {
+                auto it = stageLookup.find(dependency);
+                if (it == stageLookup.end()) {
+                    // Dropping it would let the stage race whatever it meant to wait on
+                    spdlog::error("Init stage {} depends on unknown stage {}", name, dependency);
+                    assert(false && "Init stage dependencies must be added before the stages using them");
+                    misconfigured = true;
+                    continue;
+                }
+                stage.Dependencies.push_back(it->second);
+            }
+
+            stageLookup[name] = stages.size();
+            stages.push_back(std::move(stage));
+        }
+
+        // False if the graph is misconfigured or a stage failed, nothing runs in the first case
+        [[nodiscard]] bool Run() {
+            if (misconfigured) {
+                spdlog::error("Init graph has stages with unknown dependencies, not running it");
+                return false;
+            }
+
+            auto graphStart = std::chrono::steady_clock::now();
+            timings.assign(stages.size(), {});
+
+            // Each resolves to whether its stage (and everything it depends on) succeeded
+            std::vector<std::shared_future<bool>> futures;
+            futures.reserve(stages.size());
+
+            for (size_t i = 0; i < stages.size(); i++) {
+                std::vector<std::shared_future<bool>> waitOn;
+                for (auto dependency : stages[i].Dependencies) {
+                    waitOn.push_back(futures[dependency]);
+                }
+
+                futures.push_back(std::async(std::launch::async, [this, i, graphStart, waitOn = std::move(waitOn)]() {
+                    timings[i].Name = stages[i].Name;
+
+                    bool dependenciesSucceeded = true;
+                    for (auto& future : waitOn) {
+                        dependenciesSucceeded &= future.get();
+                    }
+
+                    if (!dependenciesSucceeded) {
+                        spdlog::error("Skipping init stage {}, a stage it depends on failed", stages[i].Name);
+                        return false;
+                    }
+
+                    auto start = std::chrono::steady_clock::now();
+                    bool succeeded = false;
+                    try {
+                        succeeded = stages[i].Task();
+                        if (!succeeded) {
+                            spdlog::error("Init stage {} failed", stages[i].Name);
+                        }
+                    } catch (const std::exception& e) {
+                        spdlog::error("Init stage {} failed: {}", stages[i].Name, e.what());
+                    } catch (...) {
+                        spdlog::error("Init stage {} failed", stages[i].Name);
+                    }
+                    auto end = std::chrono::steady_clock::now();
+
+                    timings[i].Start = start - graphStart;
+                    timings[i].Duration = end - start;
+                    return succeeded;
+                }).share());
+            }
+
+            bool succeeded = true;
+            for (auto& future : futures) {
+                succeeded &= future.get();
+            }
+
+            totalDuration = std::chrono::steady_clock::now() - graphStart;
+            return succeeded;
+        }
+
+        void LogTimings() const {
+            spdlog::info("Renderer startup took {:.2f}ms", totalDuration.count());
+            for (const auto& timing : timings) {
+                spdlog::info("  {:<24} start {:>8.2f}ms  took {:>8.2f}ms", timing.Name, timing.Start.count(), timing.Duration.count());
+            }
+        }
+
+        [[nodiscard]] const std::vector<InitStageTiming>& GetTimings() const { return timings; }
+        [[nodiscard]] std::chrono::duration<double, std::milli> GetTotalDuration() const { return totalDuration; }
+
+    private:
+        struct Stage {
+            std::string Name;
+            std::function<bool()> Task;
+            std::vector<size_t> Dependencies {};
+        };
+
+        std::vector<Stage> stages;
+        std::unordered_map<std::string, size_t> stageLookup;
+        bool misconfigured { false };
+
+        std::vector<InitStageTiming> timings;
+        std::chrono::duration<double, std::milli> totalDuration {0};
+    };
+}
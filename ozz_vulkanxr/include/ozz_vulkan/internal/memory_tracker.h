@@ -0,0 +1,117 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "graphics_includes.h"
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace OZZ {
+    enum class MemoryCategory : uint8_t {
+        Depth,
+        Vertex,
+        Index,
+        Staging,
+        Uniform,
+        Texture,
+        Count
+    };
+
+    const char* MemoryCategoryName(MemoryCategory category);
+    // Buffers that can be bound as both vertex and index data count as vertex memory
+    MemoryCategory MemoryCategoryForBufferUsage(VkBufferUsageFlags usage);
+
+    struct MemoryCategoryStats {
+        VkDeviceSize Bytes { 0 };
+        uint32_t Allocations { 0 };
+    };
+
+    struct HeapBudget {
+        uint32_t Heap { 0 };
+        bool DeviceLocal { false };
+        // Usage covers the whole process (other allocators included) when VK_EXT_memory_budget is enabled
+        VkDeviceSize Usage { 0 };
+        VkDeviceSize Budget { 0 };
+        // Bytes of the heap held by this renderer's allocator
+        VkDeviceSize AllocatorBytes { 0 };
+
+        [[nodiscard]] float GetUsageFraction() const {
+            return Budget > 0 ? static_cast<float>(Usage) / static_cast<float>(Budget) : 0.f;
+        }
+    };
+
+    struct MemoryStats {
+        std::array<MemoryCategoryStats, static_cast<size_t>(MemoryCategory::Count)> Categories {};
+        std::vector<HeapBudget> Heaps;
+        // Without the extension budgets are VMA's estimate, 80% of each heap
+        bool BudgetSupported { false };
+
+        [[nodiscard]] const MemoryCategoryStats& Get(MemoryCategory category) const {
+            return Categories[static_cast<size_t>(category)];
+        }
+    };
+
+    // Sent when a heap's usage crosses one of the configured fractions of its budget, in either direction
+    struct MemoryBudgetEvent {
+        HeapBudget Heap;
+        float Threshold { 0.f };
+        bool Rising { true };
+    };
+
+    using MemoryBudgetCallback = std::function<void(const MemoryBudgetEvent&)>;
+
+    /*
+     * Keeps per-category totals of everything allocated through the renderer's VMA allocator and watches
+     * the heap budgets.
+     *
+     * Track() stores the category in the allocation's user data, so Untrack() only needs the allocation and
+     * the totals can't drift from what was really allocated. Both are thread safe.
+     */
+    class MemoryTracker {
+    public:
+        static constexpr std::array<float, 3> DEFAULT_THRESHOLDS { 0.75f, 0.9f, 1.f };
+
+        MemoryTracker(VkPhysicalDevice physicalDevice, VmaAllocator allocator, bool budgetSupported);
+
+        MemoryTracker(const MemoryTracker&) = delete;
+        MemoryTracker& operator=(const MemoryTracker&) = delete;
+
+        void Track(VmaAllocation allocation, MemoryCategory category);
+        void Untrack(VmaAllocation allocation);
+
+        // Refreshes the budgets and fires the callback for any threshold crossed since last frame
+        void BeginFrame(uint64_t frameNumber);
+
+        // Thresholds are fractions of a heap's budget, sorted on the way in
+        void SetBudgetCallback(std::vector<float> thresholds, MemoryBudgetCallback callback);
+
+        [[nodiscard]] MemoryStats GetStats() const;
+        [[nodiscard]] bool IsBudgetSupported() const { return _budgetSupported; }
+
+    private:
+        [[nodiscard]] std::vector<HeapBudget> getHeapBudgets() const;
+        [[nodiscard]] HeapBudget makeHeapBudget(uint32_t heap, const VmaBudget& budget) const;
+
+    private:
+        VmaAllocator _allocator { VK_NULL_HANDLE };
+        bool _budgetSupported { false };
+        VkPhysicalDeviceMemoryProperties _memoryProperties {};
+
+        struct AtomicCategoryStats {
+            std::atomic<VkDeviceSize> Bytes { 0 };
+            std::atomic<uint32_t> Allocations { 0 };
+        };
+        std::array<AtomicCategoryStats, static_cast<size_t>(MemoryCategory::Count)> _categories {};
+
+        std::mutex _callbackMutex;
+        std::vector<float> _thresholds { DEFAULT_THRESHOLDS.begin(), DEFAULT_THRESHOLDS.end() };
+        MemoryBudgetCallback _callback {};
+        // Per heap, how many thresholds its usage was past on the last check
+        std::vector<size_t> _heapLevels;
+    };
+}
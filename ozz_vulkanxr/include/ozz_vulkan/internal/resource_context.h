@@ -0,0 +1,42 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "graphics_includes.h"
+#include "deletion_queue.h"
+#include "device_capabilities.h"
+#include "frame_clock.h"
+#include "memory_tracker.h"
+#include "upload_manager.h"
+
+namespace OZZ {
+    class Defragmenter;
+
+    // Everything a GPU resource needs from the renderer, handed out by Renderer::GetResourceContext
+    struct ResourceContext {
+        VkDevice Device { VK_NULL_HANDLE };
+        VmaAllocator Allocator { VK_NULL_HANDLE };
+        UploadManager* Uploads { nullptr };
+        DeletionQueue* Deletions { nullptr };
+        const FrameClock* Clock { nullptr };
+        MemoryTracker* Memory { nullptr };
+        // Only device local buffers that are never mapped register with it
+        Defragmenter* Defrag { nullptr };
+        const DeviceCapabilities* Capabilities { nullptr };
+
+        void Track(VmaAllocation allocation, MemoryCategory category) const {
+            if (Memory) Memory->Track(allocation, category);
+        }
+
+        // Runs deleter once no frame in flight can reference the resource any more
+        void Defer(std::function<void()> deleter) const {
+            if (Deletions) {
+                Deletions->Push(std::move(deleter));
+            } else {
+                deleter();
+            }
+        }
+    };
+}
@@ -6,6 +6,7 @@
 
 #include "graphics_includes.h"
 #include "vk_utils.h"
+#include "memory_tracker.h"
 #include <spdlog/spdlog.h>
 
 namespace OZZ {
@@ -35,10 +36,14 @@ namespace OZZ {
             commandPool = other.commandPool;
         }
 
-        SwapchainImage(VkDevice device, VmaAllocator allocator, const Swapchain *swapchain,
-                       XrSwapchainImageVulkan2KHR image,
-                       VkCommandPool commandPool, VkQueue queue) : image(image), vkDevice(device), vmaAllocator(allocator),
-                                                    commandPool(commandPool) {
+        /*
+         * The depth image layout transition is recorded into setupCommandBuffer rather than submitted here,
+         * so the caller can batch every image's transition into a single submit.
+         */
+        SwapchainImage(VkDevice device, VmaAllocator allocator, MemoryTracker* memory, const Swapchain *swapchain,
+                       XrSwapchainImageVulkan2KHR image, VkFormat depthFormat,
+                       VkCommandPool commandPool, VkCommandBuffer setupCommandBuffer) : image(image), vkDevice(device), vmaAllocator(allocator),
+                                                    memoryTracker(memory), commandPool(commandPool) {
 
             VkImageViewCreateInfo imageViewCreateInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
             imageViewCreateInfo.image = image.image;
@@ -59,13 +64,14 @@ namespace OZZ {
             // Create depth stencil image
             VkImageCreateInfo depthImageCreateInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
             depthImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-            depthImageCreateInfo.format = VK_FORMAT_D32_SFLOAT;
+            depthImageCreateInfo.format = depthFormat;
             depthImageCreateInfo.extent = depthImageExtent;
             depthImageCreateInfo.mipLevels = 1;
             depthImageCreateInfo.arrayLayers = 1;
             depthImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
             depthImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-            depthImageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            // Sampled to build the depth pyramid, see DepthPyramid
+            depthImageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
             VmaAllocationCreateInfo depthImageAllocationCreateInfo{};
             depthImageAllocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -74,13 +80,15 @@ namespace OZZ {
             if (vmaCreateImage(vmaAllocator, &depthImageCreateInfo, &depthImageAllocationCreateInfo,
                                &depthImage, &depthImageAllocation, nullptr) != VK_SUCCESS) {
                 spdlog::error("Failed to create depth image");
+            } else if (memoryTracker) {
+                memoryTracker->Track(depthImageAllocation, MemoryCategory::Depth);
             }
 
             VkImageViewCreateInfo depthImageViewCreateInfo {
                     .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
                     .image = depthImage,
                     .viewType = VK_IMAGE_VIEW_TYPE_2D,
-                    .format = VK_FORMAT_D32_SFLOAT,
+                    .format = depthFormat,
                     .subresourceRange = {
                             .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
                             .baseMipLevel = 0,
@@ -99,8 +107,8 @@ namespace OZZ {
             }
 
             // transition depth image layout
-            transitionImageLayout(device, commandPool, queue, depthImage, VK_FORMAT_D32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED,
-                                  VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+            recordImageLayoutTransition(setupCommandBuffer, depthImage, VK_IMAGE_LAYOUT_UNDEFINED,
+                                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depthFormat);
 
             VkCommandBufferAllocateInfo commandBufferAllocateInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
             commandBufferAllocateInfo.commandPool = commandPool;
@@ -119,6 +127,7 @@ namespace OZZ {
             vkDestroyImageView(vkDevice, imageView, nullptr);
             vkDestroyImageView(vkDevice, depthImageView, nullptr);
 
+            if (memoryTracker) memoryTracker->Untrack(depthImageAllocation);
             vmaDestroyImage(vmaAllocator, depthImage, depthImageAllocation);
             vkFreeCommandBuffers(vkDevice, commandPool, 1, &commandBuffer);
             vkDevice = VK_NULL_HANDLE;
@@ -132,6 +141,7 @@ namespace OZZ {
         VkCommandPool commandPool{VK_NULL_HANDLE};
         VkDevice vkDevice{VK_NULL_HANDLE};
         VmaAllocator vmaAllocator{VK_NULL_HANDLE};
+        MemoryTracker* memoryTracker{nullptr};
 
         VkImage depthImage{VK_NULL_HANDLE};
         VkImageView depthImageView{VK_NULL_HANDLE};
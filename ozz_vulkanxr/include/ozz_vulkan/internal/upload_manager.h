@@ -0,0 +1,178 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "graphics_includes.h"
+#include "memory_tracker.h"
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace OZZ {
+
+    struct BufferCopy {
+        VkBuffer Src { VK_NULL_HANDLE };
+        VkBuffer Dst { VK_NULL_HANDLE };
+        VkDeviceSize Size { 0 };
+    };
+
+    // Where a piece of staging memory came from, only the UploadManager looks inside
+    struct StagingAllocation {
+        VkBuffer Buffer { VK_NULL_HANDLE };
+        VkDeviceSize Offset { 0 };
+        void* Data { nullptr };
+
+        // Ring bookkeeping
+        uint64_t RingSpan { 0 };
+
+        // Only set for uploads too large for the ring
+        VmaAllocation OverflowAllocation { VK_NULL_HANDLE };
+    };
+
+    /*
+     * Staging memory handed straight to the caller, filled in place and then submitted, so the data is
+     * written exactly once on the CPU side. Every write has to end in SubmitStagingWrite or CancelStagingWrite.
+     */
+    struct StagingWrite {
+        std::byte* Data { nullptr };
+        VkDeviceSize Size { 0 };
+        StagingAllocation Staging {};
+
+        [[nodiscard]] bool IsValid() const { return Data != nullptr; }
+    };
+
+    // Copies [SrcOffset, SrcOffset + Size) of a staging write into Dst
+    struct StagingCopy {
+        VkDeviceSize SrcOffset { 0 };
+        VkBuffer Dst { VK_NULL_HANDLE };
+        VkDeviceSize DstOffset { 0 };
+        VkDeviceSize Size { 0 };
+    };
+
+    /*
+     * Streams data into device local buffers and images.
+     *
+     * Data is copied into a persistently mapped staging ring and the copy is recorded and submitted
+     * on the transfer queue (a dedicated transfer family when the device has one). Every upload
+     * signals a value on a timeline semaphore, a resource is safe to use once that value is visible.
+     *
+     * All public functions are thread safe, loader threads can upload while the render thread draws.
+     */
+    class UploadManager {
+    public:
+        static constexpr VkDeviceSize DEFAULT_STAGING_SIZE = 16 * 1024 * 1024;
+
+        UploadManager(VkDevice device, VmaAllocator allocator, VkQueue queue, uint32_t queueFamilyIndex,
+                      uint32_t graphicsQueueFamilyIndex, std::mutex* queueMutex, MemoryTracker* memory = nullptr,
+                      VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+        ~UploadManager();
+
+        UploadManager(const UploadManager&) = delete;
+        UploadManager& operator=(const UploadManager&) = delete;
+
+        // Returns the timeline value that is signalled once the data has landed in dst, nothing is copied if staging fails
+        uint64_t UploadToBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+        // Copies tightly packed texel data into mip 0 / layer 0 of image and leaves it in finalLayout
+        uint64_t UploadToImage(VkImage image, VkExtent3D extent, VkImageAspectFlags aspect, const void* data,
+                               VkDeviceSize size, VkImageLayout finalLayout);
+
+        // Device to device copies on the transfer queue, no staging involved
+        uint64_t CopyBuffers(const std::vector<BufferCopy>& copies);
+
+        /*
+         * Reserves size bytes of staging memory (16 byte aligned) for the caller to fill. Keep the write short
+         * lived, the ring can't reuse anything reserved after it until it's submitted or cancelled. The write
+         * is invalid if no staging memory could be allocated.
+         */
+        StagingWrite BeginStagingWrite(VkDeviceSize size);
+        // Copies the regions into their buffers in a single submit and consumes the write
+        uint64_t SubmitStagingWrite(StagingWrite& write, std::span<const StagingCopy> copies);
+        void CancelStagingWrite(StagingWrite& write);
+
+        // Blocks until value has been signalled
+        void Wait(uint64_t value);
+
+        /*
+         * Visible values are what the render thread may rely on. The renderer calls BeginFrame once a frame to
+         * pick up completed uploads and makes its graphics submits wait on GetVisibleValue(), which is already
+         * signalled and so costs nothing, but gives the transfer writes a proper dependency.
+         */
+        void BeginFrame();
+        [[nodiscard]] bool IsVisible(uint64_t value) const { return value <= _visibleValue.load(); }
+        [[nodiscard]] uint64_t GetVisibleValue() const { return _visibleValue.load(); }
+
+        [[nodiscard]] VkSemaphore GetTimelineSemaphore() const { return _timeline; }
+        [[nodiscard]] uint32_t GetQueueFamilyIndex() const { return _queueFamilyIndex; }
+
+        // Resources touched by both queues need concurrent sharing when the families differ
+        void ApplySharingMode(VkBufferCreateInfo& createInfo) const;
+        void ApplySharingMode(VkImageCreateInfo& createInfo) const;
+
+    private:
+        // One allocation out of the ring, handed back in allocation order
+        struct RingSpan {
+            VkDeviceSize End;
+            VkDeviceSize Bytes;
+            bool Released { false };
+        };
+
+        struct Submission {
+            uint64_t Value;
+            StagingAllocation Staging;
+            VkCommandBuffer CommandBuffer;
+        };
+
+        // Data is null if neither the ring nor an overflow buffer could take size bytes
+        StagingAllocation allocateStaging(VkDeviceSize size);
+        std::optional<StagingAllocation> tryAllocateRing(VkDeviceSize size);
+        StagingAllocation allocateOverflow(VkDeviceSize size);
+
+        VkCommandBuffer beginCommandBuffer();
+        uint64_t submit(VkCommandBuffer commandBuffer, const StagingAllocation& staging);
+
+        void retireCompleted();
+        void retire(Submission& submission);
+        void releaseStaging(const StagingAllocation& staging);
+        void markVisible(uint64_t value);
+
+    private:
+        VkDevice _device { VK_NULL_HANDLE };
+        VmaAllocator _allocator { VK_NULL_HANDLE };
+        MemoryTracker* _memory { nullptr };
+        VkQueue _queue { VK_NULL_HANDLE };
+        uint32_t _queueFamilyIndex { 0 };
+        std::mutex* _queueMutex { nullptr };
+
+        uint32_t _sharedFamilies[2] {};
+        bool _concurrentSharing { false };
+
+        VkCommandPool _commandPool { VK_NULL_HANDLE };
+        std::vector<VkCommandBuffer> _freeCommandBuffers;
+
+        VkSemaphore _timeline { VK_NULL_HANDLE };
+        uint64_t _nextValue { 1 };
+        std::atomic<uint64_t> _visibleValue { 0 };
+
+        // Staging ring, [_ringTail, _ringHead) is in flight (wrapping around the end)
+        VkBuffer _ringBuffer { VK_NULL_HANDLE };
+        VmaAllocation _ringAllocation { VK_NULL_HANDLE };
+        std::byte* _ringData { nullptr };
+        VkDeviceSize _ringSize { 0 };
+        VkDeviceSize _ringHead { 0 };
+        VkDeviceSize _ringTail { 0 };
+        VkDeviceSize _ringUsed { 0 };
+        // Staging writes can be submitted out of order, the tail only moves past spans that are all released
+        std::deque<RingSpan> _ringSpans;
+        uint64_t _ringSpanBase { 0 };
+
+        std::deque<Submission> _inFlight;
+        std::mutex _mutex;
+    };
+
+} // OZZ
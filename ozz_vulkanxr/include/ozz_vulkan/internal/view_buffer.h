@@ -0,0 +1,73 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include "graphics_includes.h"
+#include "command_encoder.h"
+#include "memory_tracker.h"
+#include "xr_types.h"
+#include <glm/glm.hpp>
+#include <array>
+
+namespace OZZ {
+    // What static bundles know about the eye they're drawn for, std140 layout
+    struct ViewUniforms {
+        glm::mat4 ViewProjection { 1.f };
+        glm::mat4 View { 1.f };
+        // xyz is the eye's position in the world
+        glm::vec4 Position { 0.f, 0.f, 0.f, 1.f };
+    };
+
+    static_assert(sizeof(ViewUniforms) % 16 == 0);
+
+    /*
+     * The current eye's ViewUniforms in one small device local buffer behind a plain (non-dynamic) uniform
+     * descriptor, so command buffers can be recorded against it once and keep drawing with new views.
+     *
+     * Each eye's primary command buffer rewrites it with vkCmdUpdateBuffer before rendering starts. The
+     * barriers around the update order it after every earlier submission's reads and before this eye's, so
+     * one buffer serves both eyes and every frame in flight. Render thread only.
+     */
+    class ViewBuffer {
+    public:
+        // With meshShaders task and mesh shaders can read it too, DeviceCapabilities::MeshShader
+        ViewBuffer(VkDevice device, VmaAllocator allocator, MemoryTracker* memory = nullptr, bool meshShaders = false);
+        ~ViewBuffer();
+
+        ViewBuffer(const ViewBuffer&) = delete;
+        ViewBuffer& operator=(const ViewBuffer&) = delete;
+
+        // Used from the next eye recorded, keeps its value until set again
+        void Set(EyeTarget eye, const ViewUniforms& uniforms);
+
+        // Into the eye's primary command buffer, outside of rendering
+        void RecordUpdate(VkCommandBuffer commandBuffer, EyeTarget eye) const;
+
+        void Bind(CommandEncoder& encoder, VkPipelineLayout pipelineLayout, uint32_t set) const;
+
+        [[nodiscard]] VkDescriptorSetLayout GetDescriptorSetLayout() const { return _setLayout; }
+
+    private:
+        void createDescriptors();
+
+    private:
+        VkDevice _device { VK_NULL_HANDLE };
+        VmaAllocator _allocator { VK_NULL_HANDLE };
+        MemoryTracker* _memory { nullptr };
+        // Every stage that can read the buffer, for the layout and the update's barriers
+        VkShaderStageFlags _shaderStages { VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT };
+        VkPipelineStageFlags _pipelineStages { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
+
+        VkBuffer _buffer { VK_NULL_HANDLE };
+        VmaAllocation _allocation { VK_NULL_HANDLE };
+
+        // Indexed by EyeTarget, Left and Right only
+        std::array<ViewUniforms, 2> _views {};
+
+        VkDescriptorSetLayout _setLayout { VK_NULL_HANDLE };
+        VkDescriptorPool _descriptorPool { VK_NULL_HANDLE };
+        VkDescriptorSet _descriptorSet { VK_NULL_HANDLE };
+    };
+}
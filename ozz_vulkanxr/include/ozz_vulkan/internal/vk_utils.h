@@ -9,10 +9,10 @@
 #include <spdlog/spdlog.h>
 
 namespace OZZ {
-    static VkShaderModule createShaderModule(VkDevice device, const std::vector<char> &code) {
+    static VkShaderModule createShaderModule(VkDevice device, const void *code, size_t codeSize) {
         VkShaderModuleCreateInfo createInfo{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+        createInfo.codeSize = codeSize;
+        createInfo.pCode = reinterpret_cast<const uint32_t *>(code);
 
         VkShaderModule shaderModule;
         if (auto err = vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -22,6 +22,10 @@ namespace OZZ {
         return shaderModule;
     }
 
+    static VkShaderModule createShaderModule(VkDevice device, const std::vector<char> &code) {
+        return createShaderModule(device, code.data(), code.size());
+    }
+
     static int64_t SelectColorSwapchainFormat(const std::vector<int64_t> &runtimeFormats) {
         // List of supported color swapchain formats.
         constexpr int64_t SupportedColorSwapchainFormats[] = {VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB,
@@ -84,8 +88,21 @@ namespace OZZ {
         vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
     }
 
-    static void transitionImageLayout(VkDevice device, VkCommandBuffer commandBuffer, VkQueue queue, VkImage image, VkFormat format,
-                                      VkImageLayout oldLayout, VkImageLayout newLayout) {
+    static bool hasStencilComponent(VkFormat format) {
+        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ||
+               format == VK_FORMAT_D16_UNORM_S8_UINT;
+    }
+
+    // Barriers on combined depth/stencil images have to name both aspects
+    static VkImageAspectFlags depthBarrierAspect(VkFormat format) {
+        return hasStencilComponent(format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT
+                                           : VK_IMAGE_ASPECT_DEPTH_BIT;
+    }
+
+    // format only matters for depth images
+    static void recordImageLayoutTransition(VkCommandBuffer commandBuffer, VkImage image,
+                                            VkImageLayout oldLayout, VkImageLayout newLayout,
+                                            VkFormat format = VK_FORMAT_UNDEFINED) {
         VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
         barrier.oldLayout = oldLayout;
         barrier.newLayout = newLayout;
@@ -95,7 +112,7 @@ namespace OZZ {
 
         barrier.image = image;
         if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+            barrier.subresourceRange.aspectMask = depthBarrierAspect(format);
         } else {
             barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         }
@@ -135,6 +152,11 @@ namespace OZZ {
                              0, nullptr,
                              0, nullptr,
                              1, &barrier);
+    }
+
+    static void transitionImageLayout(VkDevice device, VkCommandBuffer commandBuffer, VkQueue queue, VkImage image, VkFormat format,
+                                      VkImageLayout oldLayout, VkImageLayout newLayout) {
+        recordImageLayoutTransition(commandBuffer, image, oldLayout, newLayout, format);
 
         vkEndCommandBuffer(commandBuffer);
     }
@@ -4,6 +4,10 @@
 
 #pragma once
 
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
 namespace OZZ {
 
     enum class EyeTarget {
@@ -12,4 +16,65 @@ namespace OZZ {
         BOTH,
     };
 
+    struct HeadPoseInfo {
+        glm::quat Orientation;
+        glm::vec3 Position;
+    };
+
+    struct FieldOfView {
+        float AngleDown;
+        float AngleLeft;
+        float AngleRight;
+        float AngleUp;
+    };
+
+    struct EyePoseInfo {
+        // Clip planes of GetProjectionMatrix, culling builds its near and far planes from them
+        static constexpr float NEAR_Z = 0.1f;
+        static constexpr float FAR_Z = 100.0f;
+
+        FieldOfView FOV;
+        glm::quat Orientation;
+        glm::vec3 Position;
+
+        [[nodiscard]] glm::mat4 GetProjectionMatrix() const {
+
+            auto projection = glm::mat4{1.f};
+
+            const float nearZ = NEAR_Z;
+            const float farZ = FAR_Z;
+
+            const float tanAngleLeft = tanf(FOV.AngleLeft);
+            const float tanAngleRight = tanf(FOV.AngleRight);
+            const float tanAngleUp = tanf(FOV.AngleUp);
+            const float tanAngleDown = tanf(FOV.AngleDown);
+
+            const float tanAngleWidth = tanAngleRight - tanAngleLeft;
+
+            const float tanAngleHeight = tanAngleDown - tanAngleUp;
+
+            projection[0][0] = 2.0f / tanAngleWidth;
+            projection[1][0] = 0.0f;
+            projection[2][0] = (tanAngleRight + tanAngleLeft) / tanAngleWidth;
+            projection[3][0] = 0.0f;
+
+            projection[0][1] = 0.0f;
+            projection[1][1] = 2.0f / tanAngleHeight;
+            projection[2][1] = (tanAngleUp + tanAngleDown) / tanAngleHeight;
+            projection[3][1] = 0.0f;
+
+            projection[0][2] = 0.0f;
+            projection[1][2] = 0.0f;
+            projection[2][2] = -farZ / (farZ - nearZ);
+            projection[3][2] = -(farZ * nearZ) / (farZ - nearZ);
+
+            projection[0][3] = 0.0f;
+            projection[1][3] = 0.0f;
+            projection[2][3] = -1.0f;
+            projection[3][3] = 0.0f;
+
+            return projection;
+        }
+    };
+
 } // OZZ
\ No newline at end of file
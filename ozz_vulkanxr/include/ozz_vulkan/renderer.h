@@ -11,73 +11,57 @@
 #include "ozz_vulkan/internal/swapchain_image.h"
 #include "ozz_vulkan/internal/xr_types.h"
 #include "ozz_vulkan/resources/shader.h"
+#include "ozz_vulkan/resources/compute_shader.h"
+#include "ozz_vulkan/resources/asset_archive.h"
 
 #include "ozz_vulkan/internal/frame_command_buffer_cache.h"
+#include "ozz_vulkan/internal/command_encoder.h"
+#include "ozz_vulkan/internal/init_graph.h"
+#include "ozz_vulkan/internal/frame_ring_buffer.h"
+#include "ozz_vulkan/internal/view_buffer.h"
+#include "ozz_vulkan/internal/depth_pyramid.h"
+#include "ozz_vulkan/internal/bindless_set.h"
+#include "ozz_vulkan/internal/frame_clock.h"
+#include "ozz_vulkan/internal/deletion_queue.h"
+#include "ozz_vulkan/internal/resource_context.h"
+#include "ozz_vulkan/internal/memory_tracker.h"
+#include "ozz_vulkan/internal/defragmenter.h"
+#include "ozz_vulkan/internal/frame_arena.h"
 #include "ozz_vulkan/resources/buffer.h"
-
+#include "ozz_vulkan/resources/mesh_pool.h"
+#include "ozz_vulkan/resources/meshlet.h"
+#include "ozz_vulkan/resources/dynamic_buffer.h"
+#include "ozz_vulkan/resources/instancing.h"
+#include "ozz_vulkan/resources/gpu_scene.h"
+#include "ozz_vulkan/resources/draw_list.h"
+#include "ozz_vulkan/resources/static_bundle.h"
+
+#include <array>
 #include <memory>
 #include <unordered_map>
 #include <tuple>
 #include <optional>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <typeindex>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 namespace OZZ {
-    struct HeadPoseInfo {
-        glm::quat Orientation;
-        glm::vec3 Position;
-    };
-
-    struct FieldOfView {
-        float AngleDown;
-        float AngleLeft;
-        float AngleRight;
-        float AngleUp;
-    };
-
-    struct EyePoseInfo {
-        FieldOfView FOV;
-        glm::quat Orientation;
-        glm::vec3 Position;
-
-        [[nodiscard]] glm::mat4 GetProjectionMatrix() const {
-
-            auto projection = glm::mat4{1.f};
-
-            const float nearZ = 0.1f;
-            const float farZ = 100.0f;
-
-            const float tanAngleLeft = tanf(FOV.AngleLeft);
-            const float tanAngleRight = tanf(FOV.AngleRight);
-            const float tanAngleUp = tanf(FOV.AngleUp);
-            const float tanAngleDown = tanf(FOV.AngleDown);
-
-            const float tanAngleWidth = tanAngleRight - tanAngleLeft;
-
-            const float tanAngleHeight = tanAngleDown - tanAngleUp;
-
-            projection[0][0] = 2.0f / tanAngleWidth;
-            projection[1][0] = 0.0f;
-            projection[2][0] = (tanAngleRight + tanAngleLeft) / tanAngleWidth;
-            projection[3][0] = 0.0f;
-
-            projection[0][1] = 0.0f;
-            projection[1][1] = 2.0f / tanAngleHeight;
-            projection[2][1] = (tanAngleUp + tanAngleDown) / tanAngleHeight;
-            projection[3][1] = 0.0f;
-
-            projection[0][2] = 0.0f;
-            projection[1][2] = 0.0f;
-            projection[2][2] = -farZ / (farZ - nearZ);
-            projection[3][2] = -(farZ * nearZ) / (farZ - nearZ);
-
-            projection[0][3] = 0.0f;
-            projection[1][3] = 0.0f;
-            projection[2][3] = -1.0f;
-            projection[3][3] = 0.0f;
-
-            return projection;
-        }
+    // Mirrors XrSessionState, plus Lost while the renderer is rebuilding a lost session
+    enum class SessionState {
+        Unknown,
+        Idle,
+        Ready,
+        Synchronized,
+        Visible,
+        Focused,
+        Stopping,
+        LossPending,
+        Exiting,
+        Lost,
     };
 
     struct FrameInfo {
@@ -90,80 +74,303 @@ namespace OZZ {
         ~Renderer();
 
         // Lifecycle functions
-        void Init();
+        // False if a stage failed, the renderer mustn't be used then
+        [[nodiscard]] bool Init();
+        // Drains pending XR events, returns true when the app should exit. Sleeps briefly while the session isn't running.
         bool Update();
         std::optional<FrameInfo> BeginFrame();
         VkCommandBuffer RequestCommandBuffer(EyeTarget target);
+        // RequestCommandBuffer wrapped in an encoder that skips redundant binds and counts into this frame's stats
+        CommandEncoder RequestCommandEncoder(EyeTarget target);
+        /*
+         * Secondary command buffer that runs once per frame before either eye starts rendering, for compute
+         * and transfer work the eyes depend on (e.g. GpuScene::Cull). Begin it with an inheritance info that
+         * has no rendering info and without RENDER_PASS_CONTINUE.
+         */
+        VkCommandBuffer RequestPreRenderCommandBuffer();
+        /*
+         * Secondary command buffer that runs outside of rendering after the eye's depth pyramid is built, for
+         * compute that tests against this frame's depth (e.g. GpuScene::CullLate). Begun like a pre-render one.
+         */
+        VkCommandBuffer RequestPostDepthCommandBuffer(EyeTarget target);
+        // Like RequestCommandEncoder, but drawn after the post-depth buffers on top of the eye's color and depth
+        CommandEncoder RequestLateCommandEncoder(EyeTarget target);
         void RenderFrame(const FrameInfo& frameInfo);
         void EndFrame();
         void WaitIdle();
         void Cleanup();
 
+        // Located once per display time, RenderFrame submits the same views
         [[nodiscard]] std::optional<std::tuple<EyePoseInfo, EyePoseInfo>> GetEyePoseInfo(int64_t predictedDisplayTime) const;
         std::optional<HeadPoseInfo> GetHeadPosition(const FrameInfo& frameInfo);
 
         // Resource functions
+        bool MountAssetArchive(const std::filesystem::path& path);
+        bool MountAssetArchive(const void* data, size_t size);
+        [[nodiscard]] const AssetArchive* GetAssetArchive() const { return assetArchive.get(); }
+
         std::unique_ptr<Shader> CreateShader(ShaderConfiguration& config);
-        std::unique_ptr<VertexBuffer> CreateVertexBuffer(const std::vector<Vertex>& vertices);
-        std::unique_ptr<IndexBuffer> CreateIndexBuffer(const std::vector<uint32_t>& indices);
+        std::unique_ptr<ComputeShader> CreateComputeShader(ComputeShaderConfiguration& config);
+
+        // Culled and drawn on the GPU, for scenes too large to walk on the CPU every frame. Meshes come from GetMeshPool<T>().
+        template <VertexLayout T = Vertex>
+        std::unique_ptr<GpuScene> CreateGpuScene(GpuSceneConfiguration config) {
+            return std::make_unique<GpuScene>(GetResourceContext(), GetMeshPool<T>(), std::move(config),
+                                              MAX_FRAMES_IN_FLIGHT, depthPyramid.get(), assetArchive.get());
+        }
+        // Split into meshlets for the mesh shading path, null without DeviceCapabilities::MeshShader. Check IsReady() before drawing.
+        std::unique_ptr<MeshletMesh> CreateMeshletMesh(std::span<const Vertex> vertices, std::span<const uint32_t> indices) {
+            if (!deviceCapabilities.MeshShader) return nullptr;
+            return std::make_unique<MeshletMesh>(GetResourceContext(), vertices, indices);
+        }
+        // Block until the data is resident in device local memory
+        template <VertexLayout T>
+        std::unique_ptr<VertexBuffer> CreateVertexBuffer(std::span<const T> vertices) {
+            auto buffer = CreateVertexBufferAsync(vertices);
+            buffer->WaitUntilReady();
+            return buffer;
+        }
+        template <IndexElement T>
+        std::unique_ptr<IndexBuffer> CreateIndexBuffer(std::span<const T> indices) {
+            auto buffer = CreateIndexBufferAsync(indices);
+            buffer->WaitUntilReady();
+            return buffer;
+        }
+        template <VertexLayout T>
+        std::unique_ptr<VertexBuffer> CreateVertexBuffer(const std::vector<T>& vertices) {
+            return CreateVertexBuffer(std::span<const T>(vertices));
+        }
+        template <IndexElement T>
+        std::unique_ptr<IndexBuffer> CreateIndexBuffer(const std::vector<T>& indices) {
+            return CreateIndexBuffer(std::span<const T>(indices));
+        }
+
+        // Return as soon as the upload is queued, check IsReady() before drawing. Safe to call from loader threads.
+        template <VertexLayout T>
+        std::unique_ptr<VertexBuffer> CreateVertexBufferAsync(std::span<const T> vertices) {
+            return std::make_unique<VertexBuffer>(GetResourceContext(), vertices);
+        }
+        template <IndexElement T>
+        std::unique_ptr<IndexBuffer> CreateIndexBufferAsync(std::span<const T> indices) {
+            return std::make_unique<IndexBuffer>(GetResourceContext(), indices);
+        }
+        template <VertexLayout T>
+        std::unique_ptr<VertexBuffer> CreateVertexBufferAsync(const std::vector<T>& vertices) {
+            return CreateVertexBufferAsync(std::span<const T>(vertices));
+        }
+        template <IndexElement T>
+        std::unique_ptr<IndexBuffer> CreateIndexBufferAsync(const std::vector<T>& indices) {
+            return CreateIndexBufferAsync(std::span<const T>(indices));
+        }
+
+        // Never moved once uploaded, so descriptors (a BindlessSet's included) can keep pointing at it
+        template <typename T>
+        std::unique_ptr<StorageBuffer> CreateStorageBufferAsync(std::span<const T> elements) {
+            return std::make_unique<StorageBuffer>(GetResourceContext(), elements);
+        }
+
+        // For geometry that changes every frame, one copy per frame in flight so updates never stall the GPU
+        template <VertexLayout T = Vertex>
+        std::unique_ptr<DynamicVertexBuffer> CreateDynamicVertexBuffer(uint32_t vertexCapacity) {
+            return std::make_unique<DynamicVertexBuffer>(GetResourceContext(), MAX_FRAMES_IN_FLIGHT, sizeof(T), vertexCapacity);
+        }
+
+        template <IndexElement I = uint16_t>
+        std::unique_ptr<DynamicIndexBuffer> CreateDynamicIndexBuffer(uint32_t indexCapacity) {
+            return std::make_unique<DynamicIndexBuffer>(GetResourceContext(), MAX_FRAMES_IN_FLIGHT, IndexTypeOf<I>(), indexCapacity);
+        }
+
+        // Shared vertex/index storage, prefer it over individual buffers for anything drawn often. One pool per layout.
+        template <VertexLayout T = Vertex>
+        [[nodiscard]] MeshPool& GetMeshPool() { return getMeshPool(typeid(T), sizeof(T)); }
+
+        /*
+         * Per-frame shader data, only valid between BeginFrame and EndFrame. Add GetFrameDataLayout() to a
+         * shader's DescriptorSetLayouts and call BindFrameData to make an allocation visible to it.
+         */
+        FrameAllocation AllocateFrameUniform(VkDeviceSize size) { return frameRing->AllocateUniform(size); }
+        FrameAllocation AllocateFrameStorage(VkDeviceSize size) { return frameRing->AllocateStorage(size); }
+
+        /*
+         * Per-instance data for count instances out of this frame's storage, invalid if the frame is out of room
+         * or count doesn't fit GetStorageRange(). Allocate once per frame and bind it for both eyes.
+         */
+        InstanceAllocation AllocateInstances(uint32_t count) {
+            auto storage = frameRing->AllocateStorage(VkDeviceSize{count} * sizeof(InstanceData));
+            if (!storage.IsValid()) return {};
+            return {
+                .Storage = storage,
+                .Instances = {storage.As<InstanceData>(), count},
+            };
+        }
+
+        template <typename T>
+        FrameAllocation AllocateFrameUniform(const T& value) {
+            auto allocation = AllocateFrameUniform(sizeof(T));
+            if (allocation.IsValid()) {
+                std::memcpy(allocation.Data, &value, sizeof(T));
+            }
+            return allocation;
+        }
+
+        void BindFrameData(VkCommandBuffer commandBuffer, const Shader& shader, const FrameAllocation& uniform,
+                           const FrameAllocation& storage, uint32_t set = 0) const {
+            frameRing->Bind(commandBuffer, shader.GetPipelineLayout(), set, uniform, storage);
+        }
+
+        void BindFrameData(CommandEncoder& encoder, const Shader& shader, const FrameAllocation& uniform,
+                           const FrameAllocation& storage, uint32_t set = 0) const {
+            frameRing->Bind(encoder, shader.GetPipelineLayout(), set, uniform, storage);
+        }
+
+        [[nodiscard]] VkDescriptorSetLayout GetFrameDataLayout() const { return frameRing->GetDescriptorSetLayout(); }
+
+        // Sorts a frame's draws by pipeline, mesh and depth and skips redundant binds when recording them
+        std::unique_ptr<DrawList> CreateDrawList() const { return std::make_unique<DrawList>(*frameRing); }
+
+        /*
+         * The view static bundles draw with. Set both eyes every frame before they're rendered, each eye's
+         * uniforms are written into the view buffer on the GPU right before its rendering starts. Shaders
+         * take GetViewDataLayout() and read a ViewUniforms at binding 0.
+         */
+        void SetViewUniforms(EyeTarget eye, const ViewUniforms& uniforms) {
+            viewBuffer->Set(eye, uniforms);
+            depthPyramid->SetViewProjection(eye, uniforms.ViewProjection);
+        }
+        [[nodiscard]] VkDescriptorSetLayout GetViewDataLayout() const { return viewBuffer->GetDescriptorSetLayout(); }
+        // The same descriptor set every frame, so it's safe to record into a static bundle
+        void BindViewData(CommandEncoder& encoder, const Shader& shader, uint32_t set = 0) const {
+            viewBuffer->Bind(encoder, shader.GetPipelineLayout(), set);
+        }
+
+        /*
+         * Every texture and storage buffer registered with it behind one descriptor set, draws pick theirs by
+         * index through push constants. Null without DeviceCapabilities::DescriptorIndexing. Shaders take
+         * GetBindlessLayout() and BindBindlessData binds the set, the same one for the life of the renderer.
+         */
+        [[nodiscard]] BindlessSet* GetBindlessSet() const { return bindlessSet.get(); }
+        [[nodiscard]] VkDescriptorSetLayout GetBindlessLayout() const {
+            return bindlessSet ? bindlessSet->GetDescriptorSetLayout() : VK_NULL_HANDLE;
+        }
+        void BindBindlessData(CommandEncoder& encoder, const Shader& shader, uint32_t set) const {
+            if (bindlessSet) bindlessSet->Bind(encoder, shader.GetPipelineLayout(), set);
+        }
+
+        /*
+         * Builds each eye's depth pyramid after its main pass from now on, GPU scenes then skip objects hidden
+         * behind the previous frame's depth. Returns false if the pyramid shader couldn't be built.
+         */
+        bool EnableOcclusionCulling(const std::filesystem::path& pyramidShaderPath);
+        [[nodiscard]] const DepthPyramid& GetDepthPyramid() const { return *depthPyramid; }
+
+        // Recorded once and executed every frame, see StaticBundle
+        std::unique_ptr<StaticBundle> CreateStaticBundle();
+        // Between BeginFrame and EndFrame, runs the bundle ahead of the eye's other command buffers this frame
+        void ExecuteBundle(const StaticBundle& bundle, EyeTarget target = EyeTarget::BOTH);
+
+        /*
+         * What resources need to create themselves and to hand their handles back. Resources built from it
+         * can be dropped at any time, their handles are only destroyed once every frame in flight has retired.
+         */
+        [[nodiscard]] ResourceContext GetResourceContext() {
+            return {
+                .Device = vkDevice,
+                .Allocator = vmaAllocator,
+                .Uploads = uploadManager.get(),
+                .Deletions = &deletionQueue,
+                .Clock = &frameClock,
+                .Memory = memoryTracker.get(),
+                .Defrag = defragmenter.get(),
+                .Capabilities = &deviceCapabilities,
+            };
+        }
+
+        [[nodiscard]] const DeviceCapabilities& GetDeviceCapabilities() const { return deviceCapabilities; }
+
+        // Per-category totals of our own allocations, plus usage against budget for every memory heap
+        [[nodiscard]] MemoryStats GetMemoryStats() const { return memoryTracker->GetStats(); }
+        // Called from BeginFrame whenever a heap's usage crosses one of thresholds (fractions of its budget)
+        void SetMemoryBudgetCallback(std::vector<float> thresholds, MemoryBudgetCallback callback) {
+            memoryTracker->SetBudgetCallback(std::move(thresholds), std::move(callback));
+        }
+
+        // Vertex and index buffers are compacted in the background a few megabytes per frame, on by default
+        void SetDefragmentationEnabled(bool enabled) { defragmenter->SetEnabled(enabled); }
+        [[nodiscard]] DefragmentationStats GetDefragmentationStats() const { return defragmenter->GetStats(); }
+
+        // What the last rendered frame's command encoders recorded, per eye
+        [[nodiscard]] const FrameCommandStats& GetCommandStats() const { return lastFrameCommandStats; }
+
+        /*
+         * Scratch memory for the current frame, rewound at the start of every BeginFrame. Per-frame lists
+         * (draws, visible objects, ...) belong here rather than in fresh vectors, a warmed up frame shouldn't
+         * touch the heap. Build with OZZ_TRACK_FRAME_ALLOCATIONS to have EndFrame check that it doesn't.
+         */
+        [[nodiscard]] FrameArena& GetFrameArena() { return frameArena; }
+
+        [[nodiscard]] SessionState GetSessionState() const { return sessionState; }
+        // True between xrBeginSession and xrEndSession, frames can only be begun while running
+        [[nodiscard]] bool IsSessionRunning() const { return xrSessionInitialized && !xrSessionLost; }
+
+        [[nodiscard]] const std::vector<InitStageTiming>& GetStartupTimings() const { return startupTimings; }
 
         [[nodiscard]] std::tuple<int, int> GetSwapchainSize() const { return std::make_tuple(swapchains[0].width, swapchains[0].height); }
         [[nodiscard]] VkFormat GetSwapchainFormat() const { return static_cast<VkFormat>(swapchainColorFormat); }
+        [[nodiscard]] VkFormat GetDepthFormat() const { return depthFormat; }
     private:
-        void initXrInstance();
-        void initGetXrSystem();
-        void initVulkanInstance();
-        void initVulkanDebugMessenger();
-        void initVulkanDevice();
-        void initVulkanMemoryAllocator();
-        void initXrSession();
-        void initXrReferenceSpaces();
-        void initXrSwapchains();
-        void createCommandPool();
-        void createFrameData();
+        // Init stages, each returns false when it failed
+        bool enumerateVulkanInstanceSupport();
+        bool initXrInstance();
+        bool initGetXrSystem();
+        bool initVulkanInstance();
+        bool initVulkanDebugMessenger();
+        bool initVulkanDevice();
+        bool initVulkanMemoryAllocator();
+        bool initXrSession();
+        bool initXrReferenceSpaces();
+        bool initXrSwapchains();
+        bool createCommandPool();
+        bool createUploadManager();
+        bool createDefragmenter();
+        bool createFrameRingBuffer();
+        bool createViewBuffer();
+        bool createBindlessSet();
+        MeshPool& getMeshPool(std::type_index layout, uint32_t stride);
+        bool createFrameData();
+        // Recycles every frame whose fences have signalled and destroys what was waiting on them
+        void retireFrames();
 
         void renderEye(Swapchain* swapchain, const std::vector<std::unique_ptr<SwapchainImage>>& images,
                                  VkQueue queue, EyeTarget eye);
 
         bool processXREvents();
+        bool handleSessionStateChanged(const XrEventDataSessionStateChanged& event);
+        void submitEmptyFrame(int64_t displayTime);
+
+        // Session loss recovery, rebuilds only the XR side and reattaches it to the existing device
+        void destroyXrSessionResources();
+        void handleXrLoss(bool instanceLost);
+        // Returns false when the session can't be recovered without a full restart
+        bool tryRecoverXrSession();
 
         VkCommandBuffer getCommandBufferForSubmission();
+        // Fills lastViews for the display time, only calls into the runtime the first time it's asked for
+        bool locateViews(int64_t predictedDisplayTime) const;
         static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
                                                             VkDebugUtilsMessageTypeFlagsEXT messageType,
                                                             const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
                                                             void* pUserData);
 
-        [[nodiscard]] static XrPosef getPoseFromEyePose(const EyePoseInfo& eyeInfo) {
-            return {
-                .orientation = {
-                        .x = eyeInfo.Orientation.x,
-                        .y = eyeInfo.Orientation.y,
-                        .z = eyeInfo.Orientation.z,
-                        .w = eyeInfo.Orientation.w,
-                },
-                .position = {
-                        .x = eyeInfo.Position.x,
-                        .y = eyeInfo.Position.y,
-                        .z = eyeInfo.Position.z
-                }
-            };
-        };
-
-        static XrFovf getFovFromEyeFov(const EyePoseInfo& eyeInfo) {
-            return {
-                    .angleLeft = eyeInfo.FOV.AngleLeft,
-                    .angleRight = eyeInfo.FOV.AngleRight,
-                    .angleUp = eyeInfo.FOV.AngleUp,
-                    .angleDown = eyeInfo.FOV.AngleDown,
-            };
-        };
     private:
         // Vulkan Entities
         VkInstance vkInstance{VK_NULL_HANDLE};
         VkPhysicalDevice vkPhysicalDevice{VK_NULL_HANDLE};
         VkDevice vkDevice{VK_NULL_HANDLE};
         VkDebugUtilsMessengerEXT vkDebugMessenger{VK_NULL_HANDLE};
+        std::vector<const char*> vulkanInstanceLayers;
+        std::vector<const char*> vulkanInstanceExtensions;
         VkQueue vkQueue;
+        VkQueue vkTransferQueue{VK_NULL_HANDLE};
         VmaAllocator vmaAllocator;
         std::vector<XrSwapchainImageVulkan2KHR> swapchainImages[EYE_COUNT];
         std::vector<std::vector<std::unique_ptr<SwapchainImage>>> wrappedSwapchainImages{};
@@ -171,8 +378,31 @@ namespace OZZ {
         VkCommandPool commandPool;
 
         uint32_t vkQueueFamilyIndex;
+        uint32_t vkTransferQueueFamilyIndex;
+
+        /*
+         * Guards every transfer queue submit. When uploads have to share the graphics queue it also guards
+         * rendering and the XR runtime's use of that queue.
+         */
+        bool transferQueueShared{false};
+        std::mutex vkQueueMutex;
+
+        [[nodiscard]] std::unique_lock<std::mutex> lockGraphicsQueue() {
+            return transferQueueShared ? std::unique_lock(vkQueueMutex) : std::unique_lock<std::mutex>();
+        }
+
+        bool memoryBudgetSupported{false};
+        DeviceCapabilities deviceCapabilities{};
+        std::unique_ptr<MemoryTracker> memoryTracker {};
+        std::unique_ptr<UploadManager> uploadManager {};
+        std::unique_ptr<Defragmenter> defragmenter {};
+        std::unordered_map<std::type_index, std::unique_ptr<MeshPool>> meshPools {};
+        std::mutex meshPoolMutex;
 
         bool xrSessionInitialized{false};
+        bool xrSessionLost{false};
+        SessionState sessionState{SessionState::Unknown};
+        std::chrono::steady_clock::time_point lastXrRecoveryAttempt{};
         XrInstance xrInstance{XR_NULL_HANDLE};
         XrSystemId xrSystemId{XR_NULL_SYSTEM_ID};
         XrSession xrSession{XR_NULL_HANDLE};
@@ -181,8 +411,11 @@ namespace OZZ {
 
         std::vector<XrViewConfigurationView> viewConfigurationViews;
         int64_t swapchainColorFormat{-1};
+        VkFormat depthFormat{VK_FORMAT_UNDEFINED};
         std::vector<Swapchain> swapchains;
 
+        std::unique_ptr<AssetArchive> assetArchive {};
+
         /*
          * The Framebuffer cache conatains secondary command buffers for each eye, or both eyes
          *
@@ -200,26 +433,73 @@ namespace OZZ {
         FrameCommandBufferCache* currentFrameBufferCache {nullptr};
 
         FrameCommandBufferCache* getAvailableFrameBufferCache(VkDevice vkDevice) {
+            frameNumber++;
+
             for (auto& cache : frameCommandBufferCache) {
                 if (cache->Available) {
-                    cache->Claim();
+                    cache->Claim(frameNumber);
                     return cache.get();
                 }
             }
-            spdlog::trace("No available cache found");
 
-            // No available cache found, create a new one
-            auto& newCache = frameCommandBufferCache.emplace_back(
-                    std::make_shared<FrameCommandBufferCache>(vkDevice, commandPool));
-            newCache->Claim();
+            if (frameCommandBufferCache.size() < MAX_FRAMES_IN_FLIGHT) {
+                spdlog::trace("No available cache found");
 
-            if (frameCommandBufferCache.size() > 5) {
-                spdlog::warn("Frame command buffer cache is getting large, performance could be suffering.");
+                // No available cache found, create a new one. Its index doubles as its slot in per-frame resources
+                auto& newCache = frameCommandBufferCache.emplace_back(
+                        std::make_shared<FrameCommandBufferCache>(vkDevice, commandPool,
+                                                                  static_cast<uint32_t>(frameCommandBufferCache.size())));
+                newCache->Claim(frameNumber);
+                return newCache.get();
             }
-            return newCache.get();
+
+            // Every frame is in flight, block on the oldest rather than letting the CPU run further ahead
+            auto oldest = std::min_element(frameCommandBufferCache.begin(), frameCommandBufferCache.end(),
+                                           [](const auto& a, const auto& b) { return a->FrameNumber < b->FrameNumber; });
+            (*oldest)->CheckAndClearCaches(UINT64_MAX);
+            (*oldest)->Claim(frameNumber);
+            return oldest->get();
         }
 
         bool _pauseValidation { false };
 
+        std::vector<InitStageTiming> startupTimings {};
+
+        std::unique_ptr<FrameRingBuffer> frameRing {};
+        std::unique_ptr<ViewBuffer> viewBuffer {};
+        // Null without descriptor indexing
+        std::unique_ptr<BindlessSet> bindlessSet {};
+        // Created with the first frame data and resized with the swapchains after, GPU scenes keep a pointer to it
+        std::unique_ptr<DepthPyramid> depthPyramid {};
+        uint64_t frameNumber {0};
+        FrameClock frameClock {};
+        DeletionQueue deletionQueue {frameClock};
+
+        FrameArena frameArena {};
+        uint64_t frameAllocationBaseline {0};
+
+        // Filled by this frame's encoders, published by EndFrame
+        FrameCommandStats frameCommandStats {};
+        FrameCommandStats lastFrameCommandStats {};
+
+        mutable std::array<XrView, EYE_COUNT> lastViews {};
+        mutable int64_t lastViewsTime {-1};
+
+        // How long shutdown is willing to wait on a runtime that hangs in xrDestroyInstance
+        static constexpr auto XR_INSTANCE_DESTROY_TIMEOUT = std::chrono::milliseconds(250);
+        // How often to retry rebuilding a lost session while the runtime/headset is unavailable
+        static constexpr auto XR_RECOVERY_RETRY_INTERVAL = std::chrono::milliseconds(250);
+        // How many frames the CPU may record ahead of the GPU, also the number of per-frame resource slots
+        static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+        // Bindless slots asked for, fewer if the device's update-after-bind limits are lower
+        static constexpr uint32_t BINDLESS_TEXTURE_CAPACITY = 16 * 1024;
+        static constexpr uint32_t BINDLESS_BUFFER_CAPACITY = 16 * 1024;
+        // Kept out of the bindless arrays from each descriptor limit, for the other sets bound next to them
+        static constexpr uint32_t BINDLESS_RESERVED_RESOURCES = 64;
+        // Upper bound on how long Update() sleeps while the session isn't running
+        static constexpr auto IDLE_WAIT_INTERVAL = std::chrono::milliseconds(10);
+        // Frames allowed to allocate while caches and pools grow to their steady-state size
+        static constexpr uint64_t ALLOCATION_WARMUP_FRAMES = 16;
+
     };
 } // namespace OZZ
\ No newline at end of file
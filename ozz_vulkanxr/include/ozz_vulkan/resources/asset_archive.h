@@ -0,0 +1,67 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <ozz_vulkan/internal/asset_archive_format.h>
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace OZZ {
+
+    /*
+     * A view of a single asset.
+     *
+     * Uncompressed entries point straight into the archive mapping and own nothing.
+     * Compressed entries are decompressed into Storage and Bytes points there instead.
+     */
+    struct AssetData {
+        std::span<const std::byte> Bytes;
+        std::vector<std::byte> Storage;
+
+        [[nodiscard]] const void* Data() const { return Bytes.data(); }
+        [[nodiscard]] size_t Size() const { return Bytes.size(); }
+    };
+
+    class AssetArchive {
+    public:
+        // Memory maps an archive from disk
+        explicit AssetArchive(const std::filesystem::path& path);
+        // Wraps an archive that is already in memory (i.e embedded in the executable). Data must outlive the archive.
+        AssetArchive(const void* data, size_t size);
+        ~AssetArchive();
+
+        AssetArchive(const AssetArchive&) = delete;
+        AssetArchive& operator=(const AssetArchive&) = delete;
+
+        [[nodiscard]] bool IsOpen() const { return _header != nullptr; }
+        [[nodiscard]] bool Contains(std::string_view name) const { return findEntry(name) != nullptr; }
+        [[nodiscard]] uint32_t GetEntryCount() const { return _header ? _header->EntryCount : 0; }
+
+        [[nodiscard]] std::optional<AssetData> Load(std::string_view name) const;
+
+    private:
+        bool validate();
+        [[nodiscard]] const Archive::ArchiveEntry* findEntry(std::string_view name) const;
+        [[nodiscard]] std::string_view getEntryName(const Archive::ArchiveEntry& entry) const;
+
+    private:
+        const std::byte* _data { nullptr };
+        size_t _size { 0 };
+
+        const Archive::ArchiveHeader* _header { nullptr };
+        const Archive::ArchiveEntry* _entries { nullptr };
+        const char* _strings { nullptr };
+
+        // set when we own a mapping that needs to be released
+        void* _mapping { nullptr };
+        size_t _mappingSize { 0 };
+        std::vector<std::byte> _fallbackStorage;
+    };
+
+} // OZZ
@@ -5,41 +5,123 @@
 #pragma once
 #include <ozz_vulkan/resources/types.h>
 #include <ozz_vulkan/internal/graphics_includes.h>
+#include <ozz_vulkan/internal/resource_context.h>
+#include <span>
 #include <vector>
 
 namespace OZZ {
 
+    /*
+     * Vertex and index buffers live in device local memory and are filled through the UploadManager.
+     *
+     * Construction returns as soon as the upload is queued. A buffer must not be drawn until IsReady()
+     * returns true (or after WaitUntilReady()). Destruction is deferred until no frame in flight can use it.
+     *
+     * The data is copied once, straight into staging memory, so any contiguous range will do (spans of
+     * constexpr arrays included). Nothing is kept after construction, temporaries are fine.
+     */
     class VertexBuffer {
     public:
-        VertexBuffer(VmaAllocator allocator, const std::vector<Vertex>& vertices);
+        VertexBuffer(const ResourceContext& context, const void* data, uint32_t vertexCount, uint32_t stride);
+
+        template <VertexLayout T>
+        VertexBuffer(const ResourceContext& context, std::span<const T> vertices)
+            : VertexBuffer(context, vertices.data(), static_cast<uint32_t>(vertices.size()), sizeof(T)) {}
+
+        template <VertexLayout T>
+        VertexBuffer(const ResourceContext& context, const std::vector<T>& vertices)
+            : VertexBuffer(context, std::span<const T>(vertices)) {}
+
         ~VertexBuffer();
 
+        VertexBuffer(const VertexBuffer&) = delete;
+        VertexBuffer& operator=(const VertexBuffer&) = delete;
+
         void Bind(VkCommandBuffer commandBuffer);
 
+        [[nodiscard]] bool IsReady() const { return _context.Uploads->IsVisible(_uploadValue); }
+        void WaitUntilReady() const { _context.Uploads->Wait(_uploadValue); }
+
         [[nodiscard]] VkBuffer GetBuffer() const { return _buffer; }
         [[nodiscard]] VkDeviceSize GetSize() const { return _size; }
+        [[nodiscard]] uint32_t GetStride() const { return _stride; }
     private:
         VkBuffer _buffer { VK_NULL_HANDLE };
         VmaAllocation _allocation { VK_NULL_HANDLE };
         VkDeviceSize _size { 0 };
-        VmaAllocator _allocator { VK_NULL_HANDLE };
+        uint32_t _stride { 0 };
+        ResourceContext _context {};
+        uint64_t _uploadValue { 0 };
     };
 
+    /*
+     * Stores 16-bit indices whenever the largest index fits, whatever type the indices were handed over in.
+     * Bind() uses the stored type, so callers never need to care which one they got.
+     */
     class IndexBuffer {
     public:
-        IndexBuffer(VmaAllocator allocator, const std::vector<uint32_t>& indices);
+        IndexBuffer(const ResourceContext& context, std::span<const uint32_t> indices);
+        IndexBuffer(const ResourceContext& context, std::span<const uint16_t> indices);
+        IndexBuffer(const ResourceContext& context, const std::vector<uint32_t>& indices)
+            : IndexBuffer(context, std::span<const uint32_t>(indices)) {}
+        IndexBuffer(const ResourceContext& context, const std::vector<uint16_t>& indices)
+            : IndexBuffer(context, std::span<const uint16_t>(indices)) {}
         ~IndexBuffer();
 
+        IndexBuffer(const IndexBuffer&) = delete;
+        IndexBuffer& operator=(const IndexBuffer&) = delete;
+
         void Bind(VkCommandBuffer commandBuffer);
 
+        [[nodiscard]] bool IsReady() const { return _context.Uploads->IsVisible(_uploadValue); }
+        void WaitUntilReady() const { _context.Uploads->Wait(_uploadValue); }
+
+        [[nodiscard]] VkBuffer GetBuffer() const { return _buffer; }
+        [[nodiscard]] VkDeviceSize GetSize() const { return _size; }
+        [[nodiscard]] uint32_t GetIndexCount() const { return _indexCount; }
+        [[nodiscard]] VkIndexType GetIndexType() const { return _indexType; }
+
+    private:
+        void create(const void* data, uint32_t indexCount, VkIndexType indexType, bool narrow = false);
+
+    private:
+        VkBuffer _buffer { VK_NULL_HANDLE };
+        VmaAllocation _allocation { VK_NULL_HANDLE };
+        VkDeviceSize _size { 0 };
+        uint32_t _indexCount { 0 };
+        VkIndexType _indexType { VK_INDEX_TYPE_UINT32 };
+        ResourceContext _context {};
+        uint64_t _uploadValue { 0 };
+    };
+
+    /*
+     * Read-only shader data, e.g. per-object transforms indexed through a BindlessSet. Filled once like the
+     * buffers above, but never moved by the defragmenter since descriptors hold on to the handle.
+     */
+    class StorageBuffer {
+    public:
+        StorageBuffer(const ResourceContext& context, const void* data, VkDeviceSize size);
+
+        template <typename T>
+        StorageBuffer(const ResourceContext& context, std::span<const T> elements)
+            : StorageBuffer(context, elements.data(), elements.size_bytes()) {}
+
+        ~StorageBuffer();
+
+        StorageBuffer(const StorageBuffer&) = delete;
+        StorageBuffer& operator=(const StorageBuffer&) = delete;
+
+        [[nodiscard]] bool IsReady() const { return _context.Uploads->IsVisible(_uploadValue); }
+        void WaitUntilReady() const { _context.Uploads->Wait(_uploadValue); }
+
         [[nodiscard]] VkBuffer GetBuffer() const { return _buffer; }
         [[nodiscard]] VkDeviceSize GetSize() const { return _size; }
-        [[nodiscard]] uint32_t GetIndexCount() const { return _size / sizeof(uint32_t); }
 
     private:
         VkBuffer _buffer { VK_NULL_HANDLE };
         VmaAllocation _allocation { VK_NULL_HANDLE };
         VkDeviceSize _size { 0 };
-        VmaAllocator _allocator { VK_NULL_HANDLE };
+        ResourceContext _context {};
+        uint64_t _uploadValue { 0 };
     };
-}
\ No newline at end of file
+}
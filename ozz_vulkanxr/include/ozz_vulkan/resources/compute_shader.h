@@ -0,0 +1,55 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+#pragma once
+
+#include <ozz_vulkan/internal/graphics_includes.h>
+#include <ozz_vulkan/internal/resource_context.h>
+#include <ozz_vulkan/resources/push_constants.h>
+#include <ozz_vulkan/resources/asset_archive.h>
+#include <filesystem>
+#include <vector>
+
+namespace OZZ {
+    struct ComputeShaderConfiguration {
+        std::filesystem::path ShaderPath;
+
+        std::vector<PushConstantDefinition> PushConstants;
+        // In set order
+        std::vector<VkDescriptorSetLayout> DescriptorSetLayouts;
+    };
+
+    // A compute pipeline. Dispatches have to be recorded outside of rendering, see Renderer::RequestPreRenderCommandBuffer
+    class ComputeShader {
+    public:
+        ComputeShader(const ResourceContext& context, ComputeShaderConfiguration config, const AssetArchive* archive = nullptr);
+        ~ComputeShader();
+
+        ComputeShader(const ComputeShader&) = delete;
+        ComputeShader& operator=(const ComputeShader&) = delete;
+
+        void Bind(VkCommandBuffer commandBuffer) const;
+        void BindDescriptorSet(VkCommandBuffer commandBuffer, VkDescriptorSet set, uint32_t setIndex = 0) const;
+
+        template <typename T>
+        void YeetPushConstants(VkCommandBuffer commandBuffer, T constants, uint32_t offset = 0) const {
+            vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, offset, sizeof(T), &constants);
+        }
+
+        [[nodiscard]] bool IsValid() const { return _pipeline != VK_NULL_HANDLE; }
+        [[nodiscard]] const ComputeShaderConfiguration& GetConfiguration() const { return _config; }
+        [[nodiscard]] VkPipelineLayout GetPipelineLayout() const { return _pipelineLayout; }
+
+    private:
+        void createPipeline();
+        VkShaderModule loadShaderModule(const std::filesystem::path& path);
+
+    private:
+        VkDevice _device;
+        ResourceContext _context;
+        const AssetArchive* _archive;
+        const ComputeShaderConfiguration _config;
+        VkPipeline _pipeline { VK_NULL_HANDLE };
+        VkPipelineLayout _pipelineLayout { VK_NULL_HANDLE };
+    };
+}
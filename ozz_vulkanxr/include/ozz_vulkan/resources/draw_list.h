@@ -0,0 +1,127 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <ozz_vulkan/internal/graphics_includes.h>
+#include <ozz_vulkan/internal/command_encoder.h>
+#include <ozz_vulkan/internal/frame_ring_buffer.h>
+#include <ozz_vulkan/internal/xr_types.h>
+#include <ozz_vulkan/resources/mesh_pool.h>
+#include <ozz_vulkan/resources/shader.h>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace OZZ {
+    // Sorted in this order, everything in one pass is drawn before anything in the next
+    enum class DrawPass : uint8_t {
+        Opaque,
+        // Sorted back to front instead of front to back
+        Transparent,
+    };
+
+    /*
+     * A draw's 64-bit sort key, most significant first:
+     *   4 bits pass | 12 bits pipeline | 16 bits mesh | 32 bits depth
+     * so sorting the keys groups draws by pipeline, then by mesh, and orders each group by depth.
+     */
+    struct DrawKey {
+        static constexpr uint32_t PASS_BITS = 4;
+        static constexpr uint32_t PIPELINE_BITS = 12;
+        static constexpr uint32_t MESH_BITS = 16;
+        static constexpr uint32_t DEPTH_BITS = 32;
+
+        static constexpr uint32_t DEPTH_SHIFT = 0;
+        static constexpr uint32_t MESH_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+        static constexpr uint32_t PIPELINE_SHIFT = MESH_SHIFT + MESH_BITS;
+        static constexpr uint32_t PASS_SHIFT = PIPELINE_SHIFT + PIPELINE_BITS;
+
+        static_assert(PASS_SHIFT + PASS_BITS == 64);
+
+        // Only the low bits of pipeline and mesh make it in, ids that collide just sort together
+        static uint64_t Make(DrawPass pass, uint32_t pipeline, uint32_t mesh, float depth);
+        // Orders like depth does for anything >= 0, negative and NaN depths sort as 0
+        static uint32_t DepthBits(float depth);
+    };
+
+    // Something to sort, Index points back at whatever the key was made for
+    struct SortEntry {
+        uint64_t Key { 0 };
+        uint32_t Index { 0 };
+    };
+
+    /*
+     * Stable LSD radix sort on the keys, a byte per pass. Bytes every key shares cost a histogram and
+     * nothing else, so keys that only differ in depth take about as long as sorting 32-bit ones.
+     * scratch must be at least as large as entries. Returns entries or scratch, whichever ended up sorted.
+     */
+    std::span<SortEntry> RadixSort(std::span<SortEntry> entries, std::span<SortEntry> scratch);
+
+    struct DrawSubmission {
+        DrawPass Pass { DrawPass::Opaque };
+        Shader* Pipeline { nullptr };
+        // Drawn out of Pool, which is bound whenever it differs from the previous draw's
+        const MeshPool* Pool { nullptr };
+        MeshHandle Mesh {};
+
+        // Bound as set 0's storage next to the view's frame uniform, see InstanceAllocation
+        FrameAllocation Instances {};
+        uint32_t InstanceCount { 1 };
+        uint32_t FirstInstance { 0 };
+
+        // Distance from the viewer
+        float Depth { 0.f };
+        // Left or Right to draw for one eye only
+        EyeTarget Eye { EyeTarget::BOTH };
+    };
+
+    // What the last Record actually bound, Draws minus each count is how many binds it skipped
+    struct DrawListStats {
+        uint32_t Draws { 0 };
+        uint32_t PipelineBinds { 0 };
+        uint32_t MeshPoolBinds { 0 };
+        uint32_t FrameDataBinds { 0 };
+    };
+
+    /*
+     * This frame's draws, sorted before they're recorded.
+     *
+     * Submit in any order, Sort() once, then Record() into each eye's command buffer. Recording walks the draws
+     * in key order and only binds a pipeline, a mesh pool or frame data when it differs from what the previous
+     * draw left bound, so each pipeline is normally bound once per pass. Opaque draws go front to back for
+     * early depth rejection.
+     *
+     * The list keeps its memory between frames, Clear() and refill it every frame. Render thread only.
+     */
+    class DrawList {
+    public:
+        explicit DrawList(const FrameRingBuffer& frameRing);
+
+        DrawList(const DrawList&) = delete;
+        DrawList& operator=(const DrawList&) = delete;
+
+        void Clear();
+        void Submit(const DrawSubmission& draw);
+        void Sort();
+
+        // After Sort, frameUniform is the eye's frame data. Pipelines take the frame data at set 0.
+        void Record(CommandEncoder& encoder, const FrameAllocation& frameUniform, EyeTarget eye = EyeTarget::BOTH);
+
+        [[nodiscard]] uint32_t GetCount() const { return static_cast<uint32_t>(_draws.size()); }
+        [[nodiscard]] const DrawListStats& GetStats() const { return _stats; }
+
+    private:
+        const FrameRingBuffer* _frameRing;
+
+        std::vector<DrawSubmission> _draws;
+        std::vector<SortEntry> _entries;
+        std::vector<SortEntry> _scratch;
+        // Whichever of _entries and _scratch the sort finished in
+        std::span<const SortEntry> _sorted;
+        bool _isSorted { true };
+
+        DrawListStats _stats {};
+    };
+}
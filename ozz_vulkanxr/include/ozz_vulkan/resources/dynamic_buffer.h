@@ -0,0 +1,133 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+#include <ozz_vulkan/resources/types.h>
+#include <ozz_vulkan/internal/graphics_includes.h>
+#include <ozz_vulkan/internal/resource_context.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace OZZ {
+
+    /*
+     * A persistently mapped buffer with one copy per frame in flight, for data that changes every frame.
+     *
+     * Writes land in a CPU shadow and straight into the current frame's copy. The other copies only remember
+     * the byte range that changed, and catch up with a single memcpy of that range the next time their frame
+     * comes around. Bind always picks the copy owned by the frame being recorded, so nothing the GPU is still
+     * reading is ever written.
+     */
+    class DynamicBuffer {
+    public:
+        DynamicBuffer(const ResourceContext& context, VkBufferUsageFlags usage, VkDeviceSize size, uint32_t copyCount);
+        ~DynamicBuffer();
+
+        DynamicBuffer(const DynamicBuffer&) = delete;
+        DynamicBuffer& operator=(const DynamicBuffer&) = delete;
+
+        void Write(VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+        [[nodiscard]] VkBuffer GetBuffer() const { return _buffer; }
+        [[nodiscard]] VkDeviceSize GetSize() const { return _size; }
+        // Offset of the current frame's copy, brought up to date first
+        VkDeviceSize GetCurrentOffset();
+
+    private:
+        struct DirtyRange {
+            VkDeviceSize Begin { std::numeric_limits<VkDeviceSize>::max() };
+            VkDeviceSize End { 0 };
+
+            void Add(VkDeviceSize begin, VkDeviceSize end) {
+                Begin = std::min(Begin, begin);
+                End = std::max(End, end);
+            }
+            [[nodiscard]] bool Empty() const { return End <= Begin; }
+            void Clear() { *this = {}; }
+        };
+
+        void syncCurrentCopy(uint32_t slot);
+        void copyRange(uint32_t copy, VkDeviceSize begin, VkDeviceSize end);
+
+    private:
+        ResourceContext _context {};
+        const FrameClock* _clock { nullptr };
+
+        VkBuffer _buffer { VK_NULL_HANDLE };
+        VmaAllocation _allocation { VK_NULL_HANDLE };
+        std::byte* _mapped { nullptr };
+
+        VkDeviceSize _size { 0 };
+        VkDeviceSize _copyStride { 0 };
+
+        std::vector<std::byte> _shadow;
+        std::vector<DirtyRange> _dirty;
+        std::mutex _mutex;
+    };
+
+    class DynamicVertexBuffer {
+    public:
+        DynamicVertexBuffer(const ResourceContext& context, uint32_t copyCount, uint32_t stride, uint32_t vertexCapacity)
+            : _buffer(context, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VkDeviceSize{stride} * vertexCapacity, copyCount),
+              _stride(stride), _capacity(vertexCapacity) {}
+
+        // Only the given vertices are copied, to this frame's copy now and to the others when their frame comes up
+        template <VertexLayout T>
+        void Update(uint32_t firstVertex, std::span<const T> vertices) {
+            if (sizeof(T) != _stride) {
+                spdlog::error("Vertex layout of {} bytes doesn't match the dynamic buffer's {} byte layout", sizeof(T), _stride);
+                return;
+            }
+            _buffer.Write(VkDeviceSize{firstVertex} * _stride, vertices.data(), vertices.size_bytes());
+        }
+
+        void Bind(VkCommandBuffer commandBuffer, uint32_t binding = 0) {
+            VkBuffer buffer = _buffer.GetBuffer();
+            VkDeviceSize offset = _buffer.GetCurrentOffset();
+            vkCmdBindVertexBuffers(commandBuffer, binding, 1, &buffer, &offset);
+        }
+
+        [[nodiscard]] uint32_t GetStride() const { return _stride; }
+        [[nodiscard]] uint32_t GetCapacity() const { return _capacity; }
+
+    private:
+        DynamicBuffer _buffer;
+        uint32_t _stride;
+        uint32_t _capacity;
+    };
+
+    class DynamicIndexBuffer {
+    public:
+        DynamicIndexBuffer(const ResourceContext& context, uint32_t copyCount, VkIndexType indexType, uint32_t indexCapacity)
+            : _buffer(context, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VkDeviceSize{IndexSize(indexType)} * indexCapacity,
+                      copyCount),
+              _indexType(indexType), _capacity(indexCapacity) {}
+
+        template <IndexElement I>
+        void Update(uint32_t firstIndex, std::span<const I> indices) {
+            if (IndexTypeOf<I>() != _indexType) {
+                spdlog::error("Index type doesn't match the dynamic index buffer's");
+                return;
+            }
+            _buffer.Write(VkDeviceSize{firstIndex} * sizeof(I), indices.data(), indices.size_bytes());
+        }
+
+        void Bind(VkCommandBuffer commandBuffer) {
+            vkCmdBindIndexBuffer(commandBuffer, _buffer.GetBuffer(), _buffer.GetCurrentOffset(), _indexType);
+        }
+
+        [[nodiscard]] VkIndexType GetIndexType() const { return _indexType; }
+        [[nodiscard]] uint32_t GetCapacity() const { return _capacity; }
+
+    private:
+        DynamicBuffer _buffer;
+        VkIndexType _indexType;
+        uint32_t _capacity;
+    };
+}
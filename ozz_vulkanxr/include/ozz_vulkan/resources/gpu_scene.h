@@ -0,0 +1,301 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <ozz_vulkan/culling/frustum.h>
+#include <ozz_vulkan/internal/depth_pyramid.h>
+#include <ozz_vulkan/internal/graphics_includes.h>
+#include <ozz_vulkan/internal/resource_context.h>
+#include <ozz_vulkan/resources/asset_archive.h>
+#include <ozz_vulkan/resources/compute_shader.h>
+#include <ozz_vulkan/resources/mesh_pool.h>
+#include <ozz_vulkan/resources/shader.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace OZZ {
+    // std430 mirrors of the buffers cull.comp, late_cull.comp and compact_draws.comp read, keep them in sync with the shaders
+    struct GpuSceneObject {
+        glm::mat4 Model { 1.f };
+        glm::vec4 Colour { 1.f };
+        uint32_t Mesh { 0 };
+        uint32_t Padding[3] {};
+    };
+
+    static_assert(sizeof(GpuSceneObject) == 96);
+
+    struct GpuSceneMesh {
+        uint32_t IndexCount { 0 };
+        uint32_t FirstIndex { 0 };
+        int32_t VertexOffset { 0 };
+        // Where the mesh's visible objects start in the visible object list, also the draw's firstInstance
+        uint32_t InstanceBase { 0 };
+        // Bounding sphere in mesh space, xyz centre and w radius
+        glm::vec4 Bounds { 0.f };
+    };
+
+    static_assert(sizeof(GpuSceneMesh) == 32);
+
+    struct GpuCullParams {
+        static constexpr uint32_t MAX_VIEWS = 2;
+        static constexpr uint32_t PLANES_PER_VIEW = Frustum::PLANE_COUNT;
+
+        // Normalised frustum planes, a point is inside a plane when dot(plane.xyz, point) + plane.w >= 0
+        std::array<glm::vec4, MAX_VIEWS * PLANES_PER_VIEW> Planes {};
+        uint32_t ObjectCount { 0 };
+        uint32_t MeshCount { 0 };
+        // Of the depth buffers the pyramids were built from
+        glm::vec2 DepthSize { 0.f };
+        uint32_t PyramidLevels { 0 };
+        // Non-zero when the pyramids hold last frame's depth and objects behind it are skipped
+        uint32_t Occlusion { 0 };
+        uint32_t Padding[2] {};
+        // This frame's views, what the late pass tests against once each eye's pyramid is rebuilt
+        std::array<glm::mat4, MAX_VIEWS> ViewProjections {};
+        // The views the pyramids were last built with, what the early pass tests against
+        std::array<glm::mat4, MAX_VIEWS> PreviousViewProjections {};
+    };
+
+    static_assert(offsetof(GpuCullParams, DepthSize) == 200);
+    static_assert(offsetof(GpuCullParams, ViewProjections) == 224);
+    static_assert(sizeof(GpuCullParams) == 480);
+
+    // What a frame's culling did, read back a few frames late
+    struct GpuCullStats {
+        uint32_t Objects { 0 };
+        // Inside a frustum but behind last frame's depth in every eye that could see it
+        uint32_t Occluded { 0 };
+        // Occluded objects the late pass found visible after all, counted once per eye that draws them
+        uint32_t Recovered { 0 };
+    };
+
+    struct GpuSceneConfiguration {
+        std::filesystem::path CullShaderPath;
+        std::filesystem::path CompactShaderPath;
+        // Leave empty to only cull against the frusta
+        std::filesystem::path LateCullShaderPath;
+
+        uint32_t MaxObjects { 64 * 1024 };
+        uint32_t MaxMeshes { 256 };
+    };
+
+    struct SceneMeshHandle {
+        uint32_t Id { 0 };
+
+        [[nodiscard]] bool IsValid() const { return Id != 0; }
+    };
+
+    struct SceneObjectHandle {
+        uint32_t Id { 0 };
+
+        [[nodiscard]] bool IsValid() const { return Id != 0; }
+    };
+
+    /*
+     * Objects whose visibility and draws are worked out on the GPU.
+     *
+     * Every object's transform and mesh lives in a storage buffer. Once per frame Cull() records a compute pass
+     * that tests each object's bounding sphere against both eyes' frusta, appends the ones that survive to
+     * their mesh's range of a visible object list, then compacts one VkDrawIndexedIndirectCommand per mesh
+     * with anything visible. Draw() hands the result to vkCmdDrawIndexedIndirectCount, so it is one call per
+     * eye however many objects or meshes there are.
+     *
+     * The CPU only touches what changed: edits are logged and replayed into each frame slot's copy of the
+     * object buffer when that slot next comes round, a frame where nothing moved writes a few hundred bytes.
+     *
+     * With occlusion culling on (see Renderer::EnableOcclusionCulling) the cull pass also tests what's in a
+     * frustum against the depth pyramids the previous frame left, from the views they were built with, and
+     * holds back whatever every eye that could see it has behind that depth. That guess can be wrong for
+     * whatever the view or the scene uncovered since, so each eye then runs CullLate() once its own pyramid
+     * has been rebuilt from this frame's depth, and DrawLate() draws the held back objects that turn out to
+     * be visible. Nothing visible is ever skipped, at worst it's drawn a pass later.
+     *
+     * Meshes come from one MeshPool and must use 16-bit indices, the pool's Bind() has to be in effect when
+     * Draw() is recorded. Vertex shaders find their object through GetDrawSetLayout(), see gpu_scene.vert.
+     * Render thread only.
+     */
+    class GpuScene {
+    public:
+        static constexpr uint32_t GROUP_SIZE = 64;
+
+        GpuScene(const ResourceContext& context, MeshPool& meshPool, GpuSceneConfiguration config,
+                 uint32_t frameCount, const DepthPyramid* pyramid, const AssetArchive* archive = nullptr);
+        ~GpuScene();
+
+        GpuScene(const GpuScene&) = delete;
+        GpuScene& operator=(const GpuScene&) = delete;
+
+        // False when the pipelines failed to build or the device can't start indirect draws at firstInstance
+        [[nodiscard]] bool IsValid() const;
+
+        // bounds is a sphere around the mesh in its own space. Returns an invalid handle when the scene is full.
+        SceneMeshHandle AddMesh(const MeshHandle& mesh, glm::vec4 bounds);
+        // Only once no object uses the mesh any more, the pool's mesh is still the caller's to release
+        void RemoveMesh(SceneMeshHandle mesh);
+
+        SceneObjectHandle AddObject(SceneMeshHandle mesh, const glm::mat4& model, glm::vec4 colour = glm::vec4{1.f});
+        void RemoveObject(SceneObjectHandle object);
+        void SetTransform(SceneObjectHandle object, const glm::mat4& model);
+        void SetColour(SceneObjectHandle object, glm::vec4 colour);
+
+        /*
+         * Records this frame's culling into commandBuffer, which must run before either eye renders, see
+         * Renderer::RequestPreRenderCommandBuffer. An object is drawn if either eye of frustum can see it.
+         */
+        void Cull(VkCommandBuffer commandBuffer, const StereoFrustum& frustum);
+
+        // Inside rendering, after Cull this frame. shader has GetDrawSetLayout() at set.
+        void Draw(VkCommandBuffer commandBuffer, const Shader& shader, uint32_t set = 1) const;
+        void Draw(CommandEncoder& encoder, const Shader& shader, uint32_t set = 1) const;
+
+        /*
+         * Records the eye's second look at what Cull held back, against the pyramid built from this frame's
+         * depth. Outside of rendering, see Renderer::RequestPostDepthCommandBuffer. Does nothing unless this
+         * frame's cull was an occlusion cull.
+         */
+        void CullLate(VkCommandBuffer commandBuffer, EyeTarget eye);
+        // Inside the eye's late rendering after CullLate, see Renderer::RequestLateCommandEncoder
+        void DrawLate(CommandEncoder& encoder, const Shader& shader, EyeTarget eye, uint32_t set = 1) const;
+
+        // Whether Cull tests against depth at all, it still won't until both eyes' pyramids have been built once
+        [[nodiscard]] bool IsOcclusionCulling() const;
+        // The newest frame whose results are back, MAX_FRAMES_IN_FLIGHT frames behind
+        [[nodiscard]] const GpuCullStats& GetCullStats() const { return _cullStats; }
+
+        [[nodiscard]] VkDescriptorSetLayout GetDrawSetLayout() const { return _drawSetLayout; }
+        [[nodiscard]] uint32_t GetObjectCount() const { return static_cast<uint32_t>(_objects.size()); }
+        [[nodiscard]] const GpuSceneConfiguration& GetConfiguration() const { return _config; }
+
+    private:
+        struct SceneBuffer {
+            VkBuffer Buffer { VK_NULL_HANDLE };
+            VmaAllocation Allocation { VK_NULL_HANDLE };
+            // Only host visible buffers are mapped
+            std::byte* Mapped { nullptr };
+            VkDeviceSize Size { 0 };
+        };
+
+        // An eye's late pass, a list of its own so it doesn't disturb what the other eye already drew
+        struct LateResources {
+            SceneBuffer InstanceCounts;
+            SceneBuffer VisibleObjects;
+            SceneBuffer DrawCommands;
+            SceneBuffer DrawCount;
+
+            VkDescriptorSet CullSet { VK_NULL_HANDLE };
+            VkDescriptorSet DrawSet { VK_NULL_HANDLE };
+            uint64_t CulledFrame { UINT64_MAX };
+        };
+
+        // One per frame slot, the GPU may still be reading the others
+        struct FrameResources {
+            // Host visible, written by the CPU
+            SceneBuffer Objects;
+            SceneBuffer Meshes;
+            SceneBuffer Params;
+            // Device local, written by the cull pass
+            SceneBuffer InstanceCounts;
+            SceneBuffer VisibleObjects;
+            SceneBuffer DrawCommands;
+            SceneBuffer DrawCount;
+            SceneBuffer OcclusionFlags;
+            // Host visible, read back when the slot comes round again
+            SceneBuffer Stats;
+
+            VkDescriptorSet CullSet { VK_NULL_HANDLE };
+            VkDescriptorSet DrawSet { VK_NULL_HANDLE };
+            std::array<LateResources, 2> Late;
+            uint32_t CulledObjects { 0 };
+            bool StatsPending { false };
+
+            // False until the slot's object buffer holds a full copy, it then only replays the change log
+            bool Synced { false };
+            uint64_t SyncedChanges { 0 };
+            uint64_t MeshVersion { UINT64_MAX };
+        };
+
+        struct MeshEntry {
+            MeshHandle Mesh;
+            glm::vec4 Bounds;
+            uint32_t ObjectCount { 0 };
+            bool InUse { false };
+            // Not drawn before the pool's upload is visible
+            bool Ready { false };
+        };
+
+        static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+        // Objects, meshes, params, instance counts, visible objects, draw commands, draw count, occlusion flags, stats
+        static constexpr uint32_t CULL_BINDING_COUNT = 9;
+        // A cull and a draw set for the early pass and for each eye's late pass
+        static constexpr uint32_t SETS_PER_FRAME = 6;
+
+        // Matches cull.comp's stats buffer
+        struct StatsCounters {
+            uint32_t Occluded;
+            uint32_t Recovered;
+        };
+
+        SceneBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible, bool readback = false);
+        void createDescriptors(uint32_t frameCount);
+        void writeDescriptorSets(VkDescriptorSet cullSet, VkDescriptorSet drawSet,
+                                 const std::array<const SceneBuffer*, CULL_BINDING_COUNT>& buffers);
+        void drawIndirect(CommandEncoder& encoder, const Shader& shader, uint32_t set, VkDescriptorSet drawSet,
+                          const SceneBuffer& commands, const SceneBuffer& count) const;
+        void readStats(FrameResources& frame);
+        void markChanged(uint32_t index);
+        [[nodiscard]] uint32_t objectIndex(SceneObjectHandle object) const;
+
+        void updateMeshReadiness();
+        void syncObjects(FrameResources& frame);
+        void syncMeshes(FrameResources& frame);
+        // Drops log entries every synced slot has replayed
+        void trimChanges();
+
+    private:
+        ResourceContext _context;
+        MeshPool* _meshPool;
+        const GpuSceneConfiguration _config;
+
+        std::unique_ptr<ComputeShader> _cullShader;
+        std::unique_ptr<ComputeShader> _compactShader;
+        std::unique_ptr<ComputeShader> _lateCullShader;
+        const DepthPyramid* _pyramid;
+
+        VkDescriptorSetLayout _cullSetLayout { VK_NULL_HANDLE };
+        VkDescriptorSetLayout _drawSetLayout { VK_NULL_HANDLE };
+        VkDescriptorPool _descriptorPool { VK_NULL_HANDLE };
+        std::vector<FrameResources> _frames;
+
+        // Dense, swap-removed. _objectIds maps back to handles, _objectIndices maps handles to positions
+        std::vector<GpuSceneObject> _objects;
+        std::vector<uint32_t> _objectIds;
+        std::vector<uint32_t> _objectIndices;
+        std::vector<uint32_t> _freeObjectIds;
+
+        std::vector<MeshEntry> _meshes;
+        std::vector<uint32_t> _freeMeshes;
+        uint32_t _pendingMeshes { 0 };
+        // Bumped whenever the mesh table or the number of objects per mesh changes
+        uint64_t _meshVersion { 0 };
+
+        // Object positions edited since the oldest slot last synced, _changeBase is the absolute index of the first
+        std::vector<uint32_t> _changes;
+        uint64_t _changeBase { 0 };
+        // Per object, the cull it was last logged for, so an object edited twice in a frame is logged once
+        std::vector<uint64_t> _changedAt;
+        uint64_t _cullSerial { 0 };
+
+        uint64_t _culledFrame { UINT64_MAX };
+        uint32_t _culledMeshCount { 0 };
+        // Whether this frame's cull held anything back for the late passes
+        bool _culledWithOcclusion { false };
+        GpuCullStats _cullStats {};
+    };
+}
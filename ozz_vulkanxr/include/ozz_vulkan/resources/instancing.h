@@ -0,0 +1,35 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <ozz_vulkan/internal/frame_ring_buffer.h>
+#include <glm/glm.hpp>
+#include <span>
+
+namespace OZZ {
+    // What instanced shaders read per instance from the frame storage binding, std430 layout
+    struct InstanceData {
+        glm::mat4 Model { 1.f };
+        // Multiplies the vertex colour
+        glm::vec4 Colour { 1.f };
+    };
+
+    static_assert(sizeof(InstanceData) == 80);
+
+    /*
+     * This frame's data for a run of instances, from Renderer::AllocateInstances.
+     *
+     * Bind Storage as the storage allocation and draw with an instanceCount of GetCount(), instance i reads
+     * Instances[gl_InstanceIndex]. Several meshes can share one allocation by drawing their ranges with
+     * firstInstance set, gl_InstanceIndex includes it.
+     */
+    struct InstanceAllocation {
+        FrameAllocation Storage {};
+        std::span<InstanceData> Instances {};
+
+        [[nodiscard]] bool IsValid() const { return Storage.IsValid(); }
+        [[nodiscard]] uint32_t GetCount() const { return static_cast<uint32_t>(Instances.size()); }
+    };
+}
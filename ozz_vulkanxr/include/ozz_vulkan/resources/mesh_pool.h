@@ -0,0 +1,276 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+#include <ozz_vulkan/resources/types.h>
+#include <ozz_vulkan/internal/graphics_includes.h>
+#include <ozz_vulkan/internal/command_encoder.h>
+#include <ozz_vulkan/internal/resource_context.h>
+#include <spdlog/spdlog.h>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace OZZ {
+
+    // Where a mesh lives inside the pool's shared buffers, cheap to copy around
+    struct MeshHandle {
+        uint32_t Id { 0 };
+        int32_t VertexOffset { 0 };
+        uint32_t VertexCount { 0 };
+        uint32_t FirstIndex { 0 };
+        uint32_t IndexCount { 0 };
+        VkIndexType IndexType { VK_INDEX_TYPE_UINT16 };
+        uint64_t UploadValue { 0 };
+
+        [[nodiscard]] bool IsValid() const { return Id != 0; }
+    };
+
+    template <VertexLayout T, IndexElement I>
+    class MeshBuilder;
+
+    /*
+     * Sub-allocates meshes out of one large vertex buffer and one large index buffer.
+     *
+     * Ranges are managed by VMA virtual blocks measured in vertices and indices, so the allocation offsets
+     * are directly usable as vertexOffset / firstIndex. Bind once per command buffer and every pooled mesh
+     * can be drawn without touching the bindings again. A pool holds a single vertex layout.
+     *
+     * Since indices are relative to vertexOffset, any mesh with up to 65536 vertices is stored with 16-bit
+     * indices. Larger meshes go into a separate, smaller 32-bit index buffer, and Draw() switches index
+     * buffers around them.
+     *
+     * Identical meshes are uploaded once, Add() hashes the contents and hands back the existing mesh with
+     * its reference count bumped. The hash is 128 bits wide so telling meshes apart needs no CPU copy of them.
+     *
+     * Either way the mesh data is written once, straight into staging memory, and both streams go up in a
+     * single transfer submit. Build() goes further and lets the caller generate the mesh in place.
+     */
+    class MeshPool {
+    public:
+        static constexpr uint32_t DEFAULT_VERTEX_CAPACITY = 256 * 1024;
+        static constexpr uint32_t DEFAULT_INDEX_CAPACITY = 1024 * 1024;
+        static constexpr uint32_t DEFAULT_LARGE_INDEX_CAPACITY = 256 * 1024;
+
+        MeshPool(const ResourceContext& context, uint32_t vertexStride, uint32_t vertexCapacity = DEFAULT_VERTEX_CAPACITY, uint32_t indexCapacity = DEFAULT_INDEX_CAPACITY);
+        ~MeshPool();
+
+        MeshPool(const MeshPool&) = delete;
+        MeshPool& operator=(const MeshPool&) = delete;
+
+        // Returns an invalid handle if the pool is out of space
+        template <VertexLayout T, IndexElement I>
+        MeshHandle Add(std::span<const T> vertices, std::span<const I> indices) {
+            if (sizeof(T) != _vertexStride) {
+                spdlog::error("Vertex layout of {} bytes doesn't match the mesh pool's {} byte layout", sizeof(T), _vertexStride);
+                return {};
+            }
+
+            if constexpr (std::is_same_v<I, uint32_t>) {
+                if (FitsUInt16Indices(indices)) {
+                    return add(vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(),
+                               static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT16, true);
+                }
+            }
+
+            return add(vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(),
+                       static_cast<uint32_t>(indices.size()), IndexTypeOf<I>());
+        }
+
+        template <VertexLayout T, IndexElement I>
+        MeshHandle Add(const std::vector<T>& vertices, const std::vector<I>& indices) {
+            return Add(std::span<const T>(vertices), std::span<const I>(indices));
+        }
+
+        /*
+         * For meshes generated on the spot: reserves staging memory for vertexCount vertices and indexCount
+         * indices, the builder hands it out to be filled in place. Built meshes aren't shared the way Add()
+         * shares identical ones, that would mean reading the data back out of staging memory to hash it.
+         * They're also stored with the index type asked for, so pick uint16_t when the mesh allows it.
+         */
+        template <VertexLayout T, IndexElement I>
+        MeshBuilder<T, I> Build(uint32_t vertexCount, uint32_t indexCount);
+
+        // Once every handle to the mesh is released its ranges go back to the pool, after the frames in flight retire
+        void Release(const MeshHandle& mesh);
+
+        [[nodiscard]] bool IsReady(const MeshHandle& mesh) const { return _context.Uploads->IsVisible(mesh.UploadValue); }
+
+        // Binds the vertex buffer and the 16-bit index buffer
+        void Bind(VkCommandBuffer commandBuffer) const;
+        void Bind(CommandEncoder& encoder) const;
+        // One draw for every instance, see InstanceAllocation
+        void Draw(VkCommandBuffer commandBuffer, const MeshHandle& mesh, uint32_t instanceCount = 1,
+                  uint32_t firstInstance = 0) const;
+        void Draw(CommandEncoder& encoder, const MeshHandle& mesh, uint32_t instanceCount = 1,
+                  uint32_t firstInstance = 0) const;
+
+        [[nodiscard]] VkBuffer GetVertexBuffer() const { return _vertexBuffer; }
+        [[nodiscard]] VkBuffer GetIndexBuffer(VkIndexType indexType = VK_INDEX_TYPE_UINT16) const;
+        [[nodiscard]] uint32_t GetVertexStride() const { return _vertexStride; }
+        [[nodiscard]] size_t GetMeshCount() const;
+
+    private:
+        template <VertexLayout, IndexElement>
+        friend class MeshBuilder;
+
+        struct IndexStorage {
+            VkBuffer Buffer { VK_NULL_HANDLE };
+            VmaAllocation Allocation { VK_NULL_HANDLE };
+            VmaVirtualBlock Block { VK_NULL_HANDLE };
+        };
+
+        struct ContentHash {
+            uint64_t Low { 0 };
+            uint64_t High { 0 };
+
+            bool operator==(const ContentHash&) const = default;
+        };
+
+        struct ContentHashKey {
+            size_t operator()(const ContentHash& hash) const { return static_cast<size_t>(hash.Low ^ hash.High); }
+        };
+
+        struct Entry {
+            MeshHandle Handle;
+            ContentHash Hash;
+            uint32_t References;
+            VmaVirtualAllocation VertexAllocation;
+            VmaVirtualAllocation IndexAllocation;
+        };
+
+        // narrowIndices means indices are 32-bit ones to be stored as 16-bit, narrowed on the way into staging
+        MeshHandle add(const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount,
+                       VkIndexType indexType, bool narrowIndices = false);
+        // From MeshBuilder::Commit
+        MeshHandle addBuilt(StagingWrite& write, uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType);
+        // Finds room for a filled staging write and submits it, hashed meshes can be shared. _mutex must be held
+        MeshHandle commit(StagingWrite& write, uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType,
+                          std::optional<ContentHash> hash);
+        // Staging holds the vertices first, then the indices
+        [[nodiscard]] VkDeviceSize stagingIndexOffset(uint32_t vertexCount) const;
+        ContentHash hashMesh(const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount,
+                          VkIndexType indexType) const;
+
+        IndexStorage createIndexStorage(VkIndexType indexType, uint32_t capacity);
+        void destroyIndexStorage(IndexStorage& storage);
+        IndexStorage& getIndexStorage(VkIndexType indexType);
+
+    private:
+        ResourceContext _context {};
+        uint32_t _vertexStride { 0 };
+
+        VkBuffer _vertexBuffer { VK_NULL_HANDLE };
+        VmaAllocation _vertexAllocation { VK_NULL_HANDLE };
+        VmaVirtualBlock _vertexBlock { VK_NULL_HANDLE };
+
+        // Both created with the pool and never replaced, so drawing needs no lock
+        IndexStorage _indices16 {};
+        IndexStorage _indices32 {};
+
+        uint32_t _nextId { 1 };
+        std::unordered_map<uint32_t, Entry> _entries;
+        std::unordered_map<ContentHash, uint32_t, ContentHashKey> _entriesByHash;
+        mutable std::mutex _mutex;
+    };
+
+    /*
+     * A mesh being written straight into staging memory, from MeshPool::Build(). Fill GetVertices() and
+     * GetIndices() in place, then Commit(). A builder dropped without committing gives its memory back.
+     * Keep builders short lived, see UploadManager::BeginStagingWrite.
+     */
+    template <VertexLayout T, IndexElement I>
+    class MeshBuilder {
+    public:
+        MeshBuilder() = default;
+
+        ~MeshBuilder() {
+            cancel();
+        }
+
+        MeshBuilder(const MeshBuilder&) = delete;
+        MeshBuilder& operator=(const MeshBuilder&) = delete;
+
+        MeshBuilder(MeshBuilder&& other) noexcept
+            : _pool(other._pool), _write(other._write), _vertexCount(other._vertexCount),
+              _indexCount(other._indexCount), _indexOffset(other._indexOffset) {
+            other._write = {};
+        }
+
+        MeshBuilder& operator=(MeshBuilder&& other) noexcept {
+            if (this != &other) {
+                cancel();
+                _pool = other._pool;
+                _write = other._write;
+                _vertexCount = other._vertexCount;
+                _indexCount = other._indexCount;
+                _indexOffset = other._indexOffset;
+                other._write = {};
+            }
+            return *this;
+        }
+
+        [[nodiscard]] bool IsValid() const { return _write.IsValid(); }
+
+        // Write-only, staging memory is uncached and slow to read back
+        [[nodiscard]] std::span<T> GetVertices() {
+            if (!IsValid()) return {};
+            return {reinterpret_cast<T*>(_write.Data), _vertexCount};
+        }
+
+        [[nodiscard]] std::span<I> GetIndices() {
+            if (!IsValid()) return {};
+            return {reinterpret_cast<I*>(_write.Data + _indexOffset), _indexCount};
+        }
+
+        // Queues the upload and empties the builder. Returns an invalid handle if the pool is out of space
+        MeshHandle Commit() {
+            if (!IsValid()) return {};
+            return _pool->addBuilt(_write, _vertexCount, _indexCount, IndexTypeOf<I>());
+        }
+
+    private:
+        friend class MeshPool;
+
+        MeshBuilder(MeshPool* pool, StagingWrite write, uint32_t vertexCount, uint32_t indexCount, VkDeviceSize indexOffset)
+            : _pool(pool), _write(write), _vertexCount(vertexCount), _indexCount(indexCount), _indexOffset(indexOffset) {}
+
+        void cancel() {
+            if (_write.IsValid()) {
+                _pool->_context.Uploads->CancelStagingWrite(_write);
+            }
+        }
+
+    private:
+        MeshPool* _pool { nullptr };
+        StagingWrite _write {};
+        uint32_t _vertexCount { 0 };
+        uint32_t _indexCount { 0 };
+        VkDeviceSize _indexOffset { 0 };
+    };
+
+    template <VertexLayout T, IndexElement I>
+    MeshBuilder<T, I> MeshPool::Build(uint32_t vertexCount, uint32_t indexCount) {
+        if (sizeof(T) != _vertexStride) {
+            spdlog::error("Vertex layout of {} bytes doesn't match the mesh pool's {} byte layout", sizeof(T), _vertexStride);
+            return {};
+        }
+
+        if (vertexCount == 0 || indexCount == 0) {
+            spdlog::error("Can't build an empty mesh in the mesh pool");
+            return {};
+        }
+
+        auto indexOffset = stagingIndexOffset(vertexCount);
+        auto write = _context.Uploads->BeginStagingWrite(indexOffset + VkDeviceSize{indexCount} * sizeof(I));
+        if (!write.IsValid()) {
+            spdlog::error("Failed to reserve staging memory for a mesh of {} vertices", vertexCount);
+            return {};
+        }
+
+        return MeshBuilder<T, I>(this, write, vertexCount, indexCount, indexOffset);
+    }
+}
@@ -0,0 +1,151 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <ozz_vulkan/internal/graphics_includes.h>
+#include <ozz_vulkan/internal/command_encoder.h>
+#include <ozz_vulkan/internal/resource_context.h>
+#include <ozz_vulkan/resources/types.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace OZZ {
+    class Shader;
+
+    // One cluster of a mesh, small enough for a single mesh shader workgroup
+    struct Meshlet {
+        // Into MeshletData::Vertices
+        uint32_t VertexOffset { 0 };
+        // Into MeshletData::Triangles, in triangles
+        uint32_t TriangleOffset { 0 };
+        uint32_t VertexCount { 0 };
+        uint32_t TriangleCount { 0 };
+
+        // Bounds all of its vertices
+        glm::vec3 Center { 0.f };
+        float Radius { 0.f };
+
+        /*
+         * Every triangle faces away from a viewer at p when dot(normalize(ConeApex - p), ConeAxis) >= ConeCutoff.
+         * Meshlets whose normals spread too far get a zero axis and never pass.
+         */
+        glm::vec3 ConeApex { 0.f };
+        glm::vec3 ConeAxis { 0.f };
+        float ConeCutoff { 1.f };
+    };
+
+    // A mesh split by BuildMeshlets, vertices are referenced by their index in the source mesh
+    struct MeshletData {
+        std::vector<Meshlet> Meshlets;
+        // Source vertex indices, each meshlet's VertexCount of them from its VertexOffset
+        std::vector<uint32_t> Vertices;
+        // Three meshlet-local vertex indices per triangle
+        std::vector<uint8_t> Triangles;
+
+        [[nodiscard]] bool IsEmpty() const { return Meshlets.empty(); }
+    };
+
+    /*
+     * Splits an indexed triangle list into meshlets of at most maxVertices vertices and maxTriangles triangles.
+     *
+     * Greedy: a meshlet grows with whichever triangle touching it adds the fewest new vertices, closest to its
+     * centre breaking ties, and a new one starts from the next unused triangle once nothing fits. That keeps
+     * meshlets compact patches rather than strips, which is what their bounds and cones need to cull well. It
+     * doesn't reorder for vertex reuse across meshlets. Winding is left to the pipeline, the cones take their
+     * facing from the vertex normals.
+     */
+    MeshletData BuildMeshlets(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                              uint32_t maxVertices = 64, uint32_t maxTriangles = 124);
+
+    /*
+     * A mesh drawn by a task and mesh shader, one task invocation per meshlet and one mesh workgroup per meshlet
+     * that survives its frustum and backface cone test. Only usable with DeviceCapabilities::MeshShader, draw the
+     * source mesh the classic way otherwise.
+     *
+     * Meshlets, their vertices (duplicated at meshlet borders) and packed triangles live in three storage
+     * buffers behind one descriptor set, see GetDescriptorSetLayout(). The buffers are uploaded once and stay
+     * put, they aren't handed to the defragmenter since the set refers to them. Drop it at any time.
+     */
+    class MeshletMesh {
+    public:
+        // The most meshlets one task workgroup culls, meshlet.task's local size
+        static constexpr uint32_t TASK_GROUP_SIZE = 32;
+        static constexpr uint32_t MAX_VERTICES = 64;
+        static constexpr uint32_t MAX_TRIANGLES = 124;
+
+        // meshlet.task and meshlet.mesh's push constants
+        struct DrawConstants {
+            glm::mat4 Model { 1.f };
+            glm::vec4 Colour { 1.f };
+            uint32_t MeshletCount { 0 };
+            uint32_t Padding[3] {};
+        };
+
+        static_assert(sizeof(DrawConstants) <= CommandEncoder::MAX_PUSH_CONSTANT_BYTES);
+
+        MeshletMesh(const ResourceContext& context, std::span<const Vertex> vertices, std::span<const uint32_t> indices);
+        ~MeshletMesh();
+
+        MeshletMesh(const MeshletMesh&) = delete;
+        MeshletMesh& operator=(const MeshletMesh&) = delete;
+
+        [[nodiscard]] bool IsValid() const { return _descriptorSet != VK_NULL_HANDLE && _meshletCount > 0; }
+        [[nodiscard]] bool IsReady() const { return IsValid() && _context.Uploads->IsVisible(_uploadValue); }
+
+        // Add it to a mesh shader's DescriptorSetLayouts after the view data, the layout is the same for every mesh
+        [[nodiscard]] VkDescriptorSetLayout GetDescriptorSetLayout() const { return _setLayout; }
+
+        /*
+         * Binds the mesh's set at set and pushes constants, model should only scale uniformly or the cones
+         * cull triangles that can be seen. The shader has to have its view data bound already.
+         */
+        void Draw(CommandEncoder& encoder, const Shader& shader, const glm::mat4& model,
+                  const glm::vec4& colour = glm::vec4 { 1.f }, uint32_t set = 1) const;
+
+        [[nodiscard]] uint32_t GetMeshletCount() const { return _meshletCount; }
+        [[nodiscard]] uint32_t GetTriangleCount() const { return _triangleCount; }
+
+    private:
+        // std430, what meshlet.task and meshlet.mesh read
+        struct GpuMeshlet {
+            glm::vec4 Sphere;
+            glm::vec4 ConeApex;
+            glm::vec4 ConeAxisCutoff;
+            uint32_t VertexOffset;
+            uint32_t TriangleOffset;
+            uint32_t VertexCount;
+            uint32_t TriangleCount;
+        };
+
+        struct GpuVertex {
+            glm::vec4 Position;
+            glm::vec4 Colour;
+        };
+
+        static_assert(sizeof(GpuMeshlet) == 64);
+        static_assert(sizeof(GpuVertex) == 32);
+
+        enum BufferIndex : uint32_t { Meshlets = 0, Vertices, Triangles, BufferCount };
+
+        void upload(const MeshletData& data, std::span<const Vertex> vertices);
+        void createDescriptors();
+
+    private:
+        ResourceContext _context;
+
+        VkBuffer _buffers[BufferCount] {};
+        VmaAllocation _allocations[BufferCount] {};
+        uint64_t _uploadValue { 0 };
+
+        VkDescriptorSetLayout _setLayout { VK_NULL_HANDLE };
+        VkDescriptorPool _descriptorPool { VK_NULL_HANDLE };
+        VkDescriptorSet _descriptorSet { VK_NULL_HANDLE };
+
+        uint32_t _meshletCount { 0 };
+        uint32_t _triangleCount { 0 };
+    };
+}
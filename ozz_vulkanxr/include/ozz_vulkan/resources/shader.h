@@ -4,7 +4,11 @@
 #pragma once
 
 #include <ozz_vulkan/internal/graphics_includes.h>
+#include <ozz_vulkan/internal/command_encoder.h>
+#include <ozz_vulkan/internal/resource_context.h>
 #include <ozz_vulkan/resources/push_constants.h>
+#include <ozz_vulkan/resources/asset_archive.h>
+#include <ozz_vulkan/resources/types.h>
 #include <filesystem>
 
 namespace OZZ {
@@ -13,16 +17,26 @@ namespace OZZ {
 
         std::filesystem::path VertexShaderPath;
         std::filesystem::path FragmentShaderPath;
+        // Set MeshShaderPath instead of VertexShaderPath for a mesh shading pipeline, which has no vertex input.
+        // The task shader is optional. Needs DeviceCapabilities::MeshShader.
+        std::filesystem::path TaskShaderPath;
+        std::filesystem::path MeshShaderPath;
 
         std::vector<PushConstantDefinition> PushConstants;
+        // In set order, e.g. Renderer::GetFrameDataLayout()
+        std::vector<VkDescriptorSetLayout> DescriptorSetLayouts;
+
+        // Pipelines are specialized for one vertex layout, see DescribeVertexLayout. Unused by mesh shading pipelines.
+        VertexLayoutDescription VertexLayout { DescribeVertexLayout<Vertex>() };
     };
 
     class Shader {
     public:
-        Shader(VkDevice device, ShaderConfiguration  config);
+        Shader(const ResourceContext& context, ShaderConfiguration config, const AssetArchive* archive = nullptr);
        ~Shader();
 
        void Bind(VkCommandBuffer commandBuffer);
+       void Bind(CommandEncoder& encoder) const;
 
        template <typename T>
        void YeetPushConstants(VkCommandBuffer commandBuffer, T constants, VkShaderStageFlags shaderFlags, uint32_t offset = 0) {
@@ -30,14 +44,23 @@ namespace OZZ {
        }
 
        [[nodiscard]] const ShaderConfiguration& GetConfiguration() const { return _config; }
+       [[nodiscard]] VkPipelineLayout GetPipelineLayout() const { return _pipelineLayout; }
+       [[nodiscard]] VkPipeline GetPipeline() const { return _pipeline; }
+       // Unique for the life of the program, draw lists sort by it
+       [[nodiscard]] uint32_t GetId() const { return _id; }
+       [[nodiscard]] bool IsMeshShading() const { return !_config.MeshShaderPath.empty(); }
     private:
         void recreatePipeline();
         void destroyPipeline();
         void createPipeline();
+        VkShaderModule loadShaderModule(const std::filesystem::path& path);
 
     private:
         VkDevice _device;
+        ResourceContext _context;
+        const AssetArchive* _archive;
         const ShaderConfiguration _config;
+        const uint32_t _id;
         VkPipeline _pipeline;
         VkPipelineLayout _pipelineLayout;
     };
@@ -0,0 +1,146 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <ozz_vulkan/resources/types.h>
+#include <ozz_vulkan/resources/mesh_pool.h>
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace OZZ {
+    // One merged mesh, drawn with a single call at Center
+    struct StaticCluster {
+        MeshHandle Mesh {};
+        // Whatever the pieces were added with, usually the pipeline they're drawn with
+        uint32_t Group { 0 };
+        // Vertices are relative to Center, draw with a model matrix that translates by it
+        glm::vec3 Center { 0.f };
+        // World space bounds of everything merged into the cluster
+        glm::vec3 Min { 0.f };
+        glm::vec3 Max { 0.f };
+        uint32_t PieceCount { 0 };
+    };
+
+    struct StaticBatchStats {
+        // Draws before batching, one per piece
+        uint32_t Pieces { 0 };
+        // Draws after batching
+        uint32_t Clusters { 0 };
+        uint32_t Vertices { 0 };
+        uint32_t Indices { 0 };
+
+        [[nodiscard]] uint32_t GetDrawsSaved() const { return Pieces > Clusters ? Pieces - Clusters : 0; }
+    };
+
+    /*
+     * Clusters built by StaticBatcher, living in a mesh pool. Releases its meshes when dropped.
+     */
+    class StaticBatch {
+    public:
+        StaticBatch() = default;
+        StaticBatch(MeshPool* pool, std::vector<StaticCluster> clusters, StaticBatchStats stats)
+                : _pool(pool), _clusters(std::move(clusters)), _stats(stats) {}
+        ~StaticBatch();
+
+        StaticBatch(const StaticBatch&) = delete;
+        StaticBatch& operator=(const StaticBatch&) = delete;
+        StaticBatch(StaticBatch&& other) noexcept;
+        StaticBatch& operator=(StaticBatch&& other) noexcept;
+
+        [[nodiscard]] std::span<const StaticCluster> GetClusters() const { return _clusters; }
+        [[nodiscard]] const StaticBatchStats& GetStats() const { return _stats; }
+        [[nodiscard]] MeshPool* GetMeshPool() const { return _pool; }
+        // Ready to draw once every cluster's upload has landed
+        [[nodiscard]] bool IsReady() const;
+
+    private:
+        void release();
+
+    private:
+        MeshPool* _pool { nullptr };
+        std::vector<StaticCluster> _clusters;
+        StaticBatchStats _stats {};
+    };
+
+    /*
+     * Merges static meshes into a few large ones at load time.
+     *
+     * Pieces are pre-transformed and bucketed by group and by which cell of a uniform grid their centre
+     * falls in, each bucket becomes one mesh, so a level built from hundreds of pieces costs a draw per cell
+     * rather than a draw per piece. Cells are what's culled afterwards, keep them around the size of what
+     * the frustum usually cuts through. A cell that outgrows 16-bit indices is split.
+     *
+     * Vertices are stored relative to their cluster's centre so compact layouts keep their precision however
+     * far from the origin the level goes. Add everything, then Build() once.
+     */
+    class StaticBatcher {
+    public:
+        static constexpr float DEFAULT_CELL_SIZE = 8.f;
+        static constexpr uint32_t MAX_CLUSTER_VERTICES = std::numeric_limits<uint16_t>::max() + 1;
+
+        explicit StaticBatcher(float cellSize = DEFAULT_CELL_SIZE) : _cellSize(cellSize) {}
+
+        // colour multiplies the vertex colours, indices are relative to vertices
+        void Add(uint32_t group, std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                 const glm::mat4& transform, glm::vec3 colour = glm::vec3 { 1.f });
+
+        // Uploads every cluster into pool and empties the batcher
+        template <VertexLayout T>
+        StaticBatch Build(MeshPool& pool) {
+            auto clusters = buildClusters();
+            std::vector<T> converted;
+
+            for (auto& cluster : clusters) {
+                auto& built = cluster.Cluster;
+                if constexpr (std::is_same_v<T, Vertex>) {
+                    built.Mesh = pool.Add(std::span<const Vertex>(cluster.Vertices), std::span<const uint16_t>(cluster.Indices));
+                } else {
+                    converted.resize(cluster.Vertices.size());
+                    ConvertVertices<T>(cluster.Vertices, std::span<T>(converted));
+                    built.Mesh = pool.Add(std::span<const T>(converted), std::span<const uint16_t>(cluster.Indices));
+                }
+
+                if (!built.Mesh.IsValid()) {
+                    spdlog::error("Mesh pool is out of room for a static cluster of {} vertices", cluster.Vertices.size());
+                }
+            }
+
+            return finish(pool, clusters);
+        }
+
+        [[nodiscard]] uint32_t GetPieceCount() const { return static_cast<uint32_t>(_pieces.size()); }
+
+    private:
+        struct Piece {
+            uint32_t Group;
+            glm::ivec3 Cell;
+            uint32_t FirstVertex;
+            uint32_t VertexCount;
+            uint32_t FirstIndex;
+            uint32_t IndexCount;
+        };
+
+        struct PendingCluster {
+            StaticCluster Cluster;
+            std::vector<Vertex> Vertices;
+            std::vector<uint16_t> Indices;
+        };
+
+        std::vector<PendingCluster> buildClusters();
+        StaticBatch finish(MeshPool& pool, std::vector<PendingCluster>& clusters);
+
+    private:
+        float _cellSize;
+        // Every piece's world space vertices, back to back
+        std::vector<Vertex> _vertices;
+        std::vector<uint32_t> _indices;
+        std::vector<Piece> _pieces;
+    };
+}
@@ -0,0 +1,65 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#pragma once
+
+#include <ozz_vulkan/internal/graphics_includes.h>
+#include <ozz_vulkan/internal/command_encoder.h>
+#include <ozz_vulkan/internal/resource_context.h>
+
+namespace OZZ {
+    /*
+     * A secondary command buffer recorded once and executed every frame, for content that doesn't change
+     * from one frame to the next. Recorded with SIMULTANEOUS_USE so the same buffer can be in both eyes of
+     * every frame in flight at once.
+     *
+     * Nothing that changes per frame or per eye can be baked in: view data comes from Renderer::BindViewData,
+     * which stays valid for the life of the renderer, and per-draw data goes in push constants or buffers
+     * that outlive the bundle. Frame ring allocations are never valid here.
+     *
+     * Re-record when NeedsRecording() says so: after Invalidate(), or once the defragmenter has moved
+     * buffers the recorded commands may reference. Hand it to Renderer::ExecuteBundle every frame it's drawn.
+     * Render thread only.
+     */
+    class StaticBundle {
+    public:
+        StaticBundle(const ResourceContext& context, VkCommandPool commandPool, VkFormat colorFormat, VkFormat depthFormat);
+        ~StaticBundle();
+
+        StaticBundle(const StaticBundle&) = delete;
+        StaticBundle& operator=(const StaticBundle&) = delete;
+
+        [[nodiscard]] bool NeedsRecording() const;
+        // e.g. when something drawn by the bundle moved or was removed
+        void Invalidate() { _recorded = false; }
+
+        /*
+         * Starts over on a fresh command buffer, the previous one is freed once no frame can be using it.
+         * The viewport and scissor are set to extent. Counts into GetRecordedStats() rather than the frame's.
+         */
+        CommandEncoder Begin(VkExtent2D extent);
+        void End(CommandEncoder& encoder);
+
+        [[nodiscard]] bool IsRecorded() const { return _recorded; }
+        [[nodiscard]] VkCommandBuffer GetCommandBuffer() const { return _commandBuffer; }
+        // What one execution of the bundle costs, added to an eye's stats every time it's executed
+        [[nodiscard]] const CommandStats& GetRecordedStats() const { return _recordedStats; }
+
+    private:
+        void releaseCommandBuffer();
+
+    private:
+        ResourceContext _context;
+        VkCommandPool _commandPool { VK_NULL_HANDLE };
+        VkFormat _colorFormat { VK_FORMAT_UNDEFINED };
+        VkFormat _depthFormat { VK_FORMAT_UNDEFINED };
+
+        VkCommandBuffer _commandBuffer { VK_NULL_HANDLE };
+        bool _recording { false };
+        bool _recorded { false };
+        // The defragmenter's generation when the bundle was recorded
+        uint64_t _generation { 0 };
+        CommandStats _recordedStats {};
+    };
+}
@@ -0,0 +1,97 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <ozz_vulkan/internal/graphics_includes.h>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <type_traits>
+#include <vector>
+
+namespace OZZ {
+    struct VertexAttribute {
+        uint32_t Location;
+        VkFormat Format;
+        uint32_t Offset;
+    };
+
+    /*
+     * A vertex layout is any trivially copyable struct that lists its attributes through a static
+     * constexpr GetAttributes(). offsetof is fine in there since the type is complete inside member functions.
+     */
+    template <typename T>
+    concept VertexLayout = std::is_trivially_copyable_v<T> && std::is_standard_layout_v<T> && requires {
+        { T::GetAttributes()[0] } -> std::convertible_to<VertexAttribute>;
+    };
+
+    // What the pipeline needs to know about a vertex layout
+    struct VertexLayoutDescription {
+        VkVertexInputBindingDescription Binding;
+        std::vector<VkVertexInputAttributeDescription> Attributes;
+    };
+
+    template <VertexLayout T>
+    VertexLayoutDescription DescribeVertexLayout(uint32_t binding = 0) {
+        VertexLayoutDescription description {
+            .Binding = {
+                .binding = binding,
+                .stride = sizeof(T),
+                .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+            }
+        };
+
+        for (const auto& attribute : T::GetAttributes()) {
+            description.Attributes.push_back({
+                .location = attribute.Location,
+                .binding = binding,
+                .format = attribute.Format,
+                .offset = attribute.Offset
+            });
+        }
+
+        return description;
+    }
+
+    namespace Quantize {
+        inline uint16_t Half(float value) {
+            return glm::packHalf1x16(value);
+        }
+
+        // Expects value in [-1, 1]
+        inline int16_t Snorm16(float value) {
+            return static_cast<int16_t>(glm::packSnorm1x16(value));
+        }
+
+        inline uint32_t Unorm8x4(glm::vec4 value) {
+            return glm::packUnorm4x8(value);
+        }
+
+        // Maps a unit vector onto the [-1, 1] square, two components instead of three with even precision everywhere
+        inline glm::vec2 OctahedralEncode(glm::vec3 normal) {
+            float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+            if (sum == 0.f) return {0.f, 0.f};
+
+            normal /= sum;
+            glm::vec2 encoded {normal.x, normal.y};
+
+            if (normal.z < 0.f) {
+                glm::vec2 signs {encoded.x >= 0.f ? 1.f : -1.f, encoded.y >= 0.f ? 1.f : -1.f};
+                encoded = (1.f - glm::abs(glm::vec2{encoded.y, encoded.x})) * signs;
+            }
+
+            return encoded;
+        }
+
+        inline glm::vec3 OctahedralDecode(glm::vec2 encoded) {
+            glm::vec3 normal {encoded.x, encoded.y, 1.f - std::abs(encoded.x) - std::abs(encoded.y)};
+            float t = glm::max(-normal.z, 0.f);
+            normal.x += normal.x >= 0.f ? -t : t;
+            normal.y += normal.y >= 0.f ? -t : t;
+            return glm::normalize(normal);
+        }
+    }
+}
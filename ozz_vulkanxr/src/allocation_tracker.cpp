@@ -0,0 +1,77 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/allocation_tracker.h>
+
+#ifdef OZZ_TRACK_FRAME_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace {
+    thread_local uint64_t allocationCount = 0;
+    thread_local uint32_t ignoreDepth = 0;
+
+    void* allocate(std::size_t size) {
+        if (ignoreDepth == 0) {
+            allocationCount++;
+        }
+
+        if (size == 0) size = 1;
+        if (auto ptr = std::malloc(size)) return ptr;
+        throw std::bad_alloc();
+    }
+
+    void* allocateAligned(std::size_t size, std::align_val_t alignment) {
+        if (ignoreDepth == 0) {
+            allocationCount++;
+        }
+
+        auto align = static_cast<std::size_t>(alignment);
+        // aligned_alloc wants the size to be a multiple of the alignment
+        size = ((size == 0 ? 1 : size) + align - 1) & ~(align - 1);
+#if defined(_WIN32)
+        if (auto ptr = _aligned_malloc(size, align)) return ptr;
+#else
+        if (auto ptr = std::aligned_alloc(align, size)) return ptr;
+#endif
+        throw std::bad_alloc();
+    }
+
+    void freeAligned(void* ptr) {
+#if defined(_WIN32)
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+}
+
+namespace OZZ::AllocationTracker {
+    uint64_t GetThreadAllocationCount() {
+        return allocationCount;
+    }
+
+    IgnoreScope::IgnoreScope() {
+        ignoreDepth++;
+    }
+
+    IgnoreScope::~IgnoreScope() {
+        ignoreDepth--;
+    }
+}
+
+// The array and nothrow forms forward to these in the standard library
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { freeAligned(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { freeAligned(ptr); }
+
+#endif
@@ -0,0 +1,203 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/resources/asset_archive.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+// No mmap on windows, we read the archive into memory once instead
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(OZZ_WITH_LZ4)
+#include <lz4.h>
+#endif
+
+namespace OZZ {
+
+    AssetArchive::AssetArchive(const std::filesystem::path& path) {
+#if defined(_WIN32)
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            spdlog::error("Failed to open asset archive {}", path.string());
+            return;
+        }
+
+        _fallbackStorage.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(_fallbackStorage.data()), static_cast<std::streamsize>(_fallbackStorage.size()));
+
+        _data = _fallbackStorage.data();
+        _size = _fallbackStorage.size();
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            spdlog::error("Failed to open asset archive {}", path.string());
+            return;
+        }
+
+        struct stat fileStat{};
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+            spdlog::error("Failed to stat asset archive {}", path.string());
+            close(fd);
+            return;
+        }
+
+        _mappingSize = static_cast<size_t>(fileStat.st_size);
+        _mapping = mmap(nullptr, _mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps its own reference to the file
+        close(fd);
+
+        if (_mapping == MAP_FAILED) {
+            spdlog::error("Failed to map asset archive {}", path.string());
+            _mapping = nullptr;
+            _mappingSize = 0;
+            return;
+        }
+
+        // Shaders are read front to back exactly once at startup
+        madvise(_mapping, _mappingSize, MADV_WILLNEED);
+
+        _data = static_cast<const std::byte*>(_mapping);
+        _size = _mappingSize;
+#endif
+
+        if (!validate()) {
+            spdlog::error("Asset archive {} is invalid", path.string());
+            return;
+        }
+
+        spdlog::trace("Mounted asset archive {} with {} entries", path.string(), _header->EntryCount);
+    }
+
+    AssetArchive::AssetArchive(const void* data, size_t size) : _data(static_cast<const std::byte*>(data)), _size(size) {
+        if (!validate()) {
+            spdlog::error("Embedded asset archive is invalid");
+            return;
+        }
+
+        spdlog::trace("Mounted embedded asset archive with {} entries", _header->EntryCount);
+    }
+
+    AssetArchive::~AssetArchive() {
+#if !defined(_WIN32)
+        if (_mapping != nullptr) {
+            munmap(_mapping, _mappingSize);
+            _mapping = nullptr;
+        }
+#endif
+    }
+
+    std::optional<AssetData> AssetArchive::Load(std::string_view name) const {
+        auto* entry = findEntry(name);
+        if (!entry) {
+            return std::nullopt;
+        }
+
+        auto stored = std::span<const std::byte>(_data + entry->DataOffset, entry->StoredSize);
+
+        if ((entry->Flags & Archive::ENTRY_FLAG_LZ4) == 0) {
+            return AssetData { .Bytes = stored, .Storage = {} };
+        }
+
+#if defined(OZZ_WITH_LZ4)
+        AssetData asset {};
+        asset.Storage.resize(entry->Size);
+
+        auto decompressed = LZ4_decompress_safe(reinterpret_cast<const char*>(stored.data()),
+                                                reinterpret_cast<char*>(asset.Storage.data()),
+                                                static_cast<int>(entry->StoredSize),
+                                                static_cast<int>(entry->Size));
+
+        if (decompressed < 0 || static_cast<uint64_t>(decompressed) != entry->Size) {
+            spdlog::error("Failed to decompress asset {}", name);
+            return std::nullopt;
+        }
+
+        asset.Bytes = asset.Storage;
+        return asset;
+#else
+        spdlog::error("Asset {} is LZ4 compressed but LZ4 support was not compiled in", name);
+        return std::nullopt;
+#endif
+    }
+
+    bool AssetArchive::validate() {
+        if (_data == nullptr || _size < sizeof(Archive::ArchiveHeader)) {
+            return false;
+        }
+
+        auto* header = reinterpret_cast<const Archive::ArchiveHeader*>(_data);
+
+        if (std::memcmp(header->Magic, Archive::ARCHIVE_MAGIC, sizeof(Archive::ARCHIVE_MAGIC)) != 0) {
+            spdlog::error("Asset archive has bad magic");
+            return false;
+        }
+
+        if (header->Version != Archive::ARCHIVE_VERSION) {
+            spdlog::error("Asset archive version {} is not supported (expected {})", header->Version, Archive::ARCHIVE_VERSION);
+            return false;
+        }
+
+        // Sizes are checked against _size before offsets are, offset + size could wrap around
+        auto entryTableSize = uint64_t{header->EntryCount} * sizeof(Archive::ArchiveEntry);
+        auto outOfBounds = [size = uint64_t{_size}](uint64_t offset, uint64_t length) {
+            return length > size || offset > size - length;
+        };
+
+        if (outOfBounds(header->EntryTableOffset, entryTableSize) ||
+            outOfBounds(header->StringTableOffset, header->StringTableSize)) {
+            spdlog::error("Asset archive tables are out of bounds");
+            return false;
+        }
+
+        auto* entries = reinterpret_cast<const Archive::ArchiveEntry*>(_data + header->EntryTableOffset);
+        for (uint32_t i = 0; i < header->EntryCount; i++) {
+            const auto& entry = entries[i];
+            if (outOfBounds(entry.DataOffset, entry.StoredSize) ||
+                uint64_t{entry.NameOffset} + entry.NameLength > header->StringTableSize) {
+                spdlog::error("Asset archive entry {} is out of bounds", i);
+                return false;
+            }
+        }
+
+        _header = header;
+        _entries = entries;
+        _strings = reinterpret_cast<const char*>(_data + header->StringTableOffset);
+        return true;
+    }
+
+    const Archive::ArchiveEntry* AssetArchive::findEntry(std::string_view name) const {
+        if (!_header) return nullptr;
+
+        auto hash = Archive::HashName(name);
+        auto* begin = _entries;
+        auto* end = _entries + _header->EntryCount;
+
+        auto it = std::lower_bound(begin, end, hash, [](const Archive::ArchiveEntry& entry, uint64_t value) {
+            return entry.NameHash < value;
+        });
+
+        // Walk any hash collisions and compare the real names
+        for (; it != end && it->NameHash == hash; ++it) {
+            if (getEntryName(*it) == name) {
+                return it;
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::string_view AssetArchive::getEntryName(const Archive::ArchiveEntry& entry) const {
+        return {_strings + entry.NameOffset, entry.NameLength};
+    }
+
+} // OZZ
@@ -0,0 +1,217 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/bindless_set.h>
+#include <spdlog/spdlog.h>
+
+namespace OZZ {
+
+    uint32_t BindlessSet::Slots::Acquire() {
+        if (!Free.empty()) {
+            auto index = Free.back();
+            Free.pop_back();
+            return index;
+        }
+        return Next < Capacity ? Next++ : INVALID_BINDLESS_INDEX;
+    }
+
+    BindlessSet::BindlessSet(VkDevice device, uint32_t textureCapacity, uint32_t bufferCapacity, DeletionQueue* deletions)
+            : _device(device), _deletions(deletions) {
+        _textures.Capacity = textureCapacity;
+        _buffers.Capacity = bufferCapacity;
+        createDescriptors();
+    }
+
+    BindlessSet::~BindlessSet() {
+        // After the deletion queue's last flush, nothing can still be using the set
+        if (_descriptorPool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+            _descriptorPool = VK_NULL_HANDLE;
+        }
+
+        if (_setLayout != VK_NULL_HANDLE) {
+            vkDestroyDescriptorSetLayout(_device, _setLayout, nullptr);
+            _setLayout = VK_NULL_HANDLE;
+        }
+    }
+
+    BindlessTexture BindlessSet::AddTexture(VkImageView view, VkSampler sampler, VkImageLayout layout) {
+        std::lock_guard lock(_mutex);
+        if (!IsValid()) return {};
+
+        auto index = _textures.Acquire();
+        if (index == INVALID_BINDLESS_INDEX) {
+            spdlog::error("Bindless set is out of texture slots, all {} are in use", _textures.Capacity);
+            return {};
+        }
+
+        writeTexture(index, view, sampler, layout);
+        return {index};
+    }
+
+    BindlessTexture BindlessSet::UpdateTexture(BindlessTexture texture, VkImageView view, VkSampler sampler, VkImageLayout layout) {
+        auto updated = AddTexture(view, sampler, layout);
+        if (updated.IsValid()) {
+            Release(texture);
+        }
+        return updated;
+    }
+
+    void BindlessSet::Release(BindlessTexture texture) {
+        if (!texture.IsValid()) return;
+        release(_textures, texture.Index);
+    }
+
+    BindlessBuffer BindlessSet::AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+        std::lock_guard lock(_mutex);
+        if (!IsValid()) return {};
+
+        auto index = _buffers.Acquire();
+        if (index == INVALID_BINDLESS_INDEX) {
+            spdlog::error("Bindless set is out of storage buffer slots, all {} are in use", _buffers.Capacity);
+            return {};
+        }
+
+        writeBuffer(index, buffer, offset, range);
+        return {index};
+    }
+
+    BindlessBuffer BindlessSet::UpdateBuffer(BindlessBuffer handle, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+        auto updated = AddBuffer(buffer, offset, range);
+        if (updated.IsValid()) {
+            Release(handle);
+        }
+        return updated;
+    }
+
+    void BindlessSet::Release(BindlessBuffer buffer) {
+        if (!buffer.IsValid()) return;
+        release(_buffers, buffer.Index);
+    }
+
+    void BindlessSet::Bind(CommandEncoder& encoder, VkPipelineLayout pipelineLayout, uint32_t set,
+                           VkPipelineBindPoint bindPoint) const {
+        encoder.BindDescriptorSet(bindPoint, pipelineLayout, set, _set);
+    }
+
+    uint32_t BindlessSet::GetTextureCount() const {
+        std::lock_guard lock(_mutex);
+        return _textures.GetUsed();
+    }
+
+    uint32_t BindlessSet::GetBufferCount() const {
+        std::lock_guard lock(_mutex);
+        return _buffers.GetUsed();
+    }
+
+    void BindlessSet::release(Slots& slots, uint32_t index) {
+        // The stale descriptor stays in place, partially bound arrays don't mind as long as nothing reads it
+        auto reclaim = [this, &slots, index]() {
+            std::lock_guard lock(_mutex);
+            slots.Free.push_back(index);
+        };
+
+        if (_deletions) {
+            _deletions->Push(std::move(reclaim));
+        } else {
+            reclaim();
+        }
+    }
+
+    void BindlessSet::createDescriptors() {
+        if (_textures.Capacity == 0 || _buffers.Capacity == 0) {
+            spdlog::error("Bindless set needs room for at least one texture and one buffer");
+            return;
+        }
+
+        VkDescriptorSetLayoutBinding bindings[2] {};
+        bindings[0].binding = TEXTURE_BINDING;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = _textures.Capacity;
+        bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+
+        bindings[1].binding = BUFFER_BINDING;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[1].descriptorCount = _buffers.Capacity;
+        bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+        // Most slots are empty most of the time, and slots are written while the set is bound
+        constexpr VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                                                          VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                                          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        VkDescriptorBindingFlags flags[2] = {bindingFlags, bindingFlags};
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO};
+        bindingFlagsInfo.bindingCount = 2;
+        bindingFlagsInfo.pBindingFlags = flags;
+
+        VkDescriptorSetLayoutCreateInfo layoutCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+        layoutCreateInfo.pNext = &bindingFlagsInfo;
+        layoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        layoutCreateInfo.bindingCount = 2;
+        layoutCreateInfo.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(_device, &layoutCreateInfo, nullptr, &_setLayout) != VK_SUCCESS) {
+            spdlog::error("Failed to create bindless descriptor set layout");
+            return;
+        }
+
+        VkDescriptorPoolSize poolSizes[2] = {
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _textures.Capacity},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _buffers.Capacity},
+        };
+
+        VkDescriptorPoolCreateInfo poolCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+        poolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolCreateInfo.maxSets = 1;
+        poolCreateInfo.poolSizeCount = 2;
+        poolCreateInfo.pPoolSizes = poolSizes;
+
+        if (vkCreateDescriptorPool(_device, &poolCreateInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+            spdlog::error("Failed to create bindless descriptor pool");
+            return;
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        allocateInfo.descriptorPool = _descriptorPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &_setLayout;
+
+        if (vkAllocateDescriptorSets(_device, &allocateInfo, &_set) != VK_SUCCESS) {
+            spdlog::error("Failed to allocate bindless descriptor set");
+            _set = VK_NULL_HANDLE;
+            return;
+        }
+
+        spdlog::trace("Created bindless set with {} texture and {} storage buffer slots", _textures.Capacity, _buffers.Capacity);
+    }
+
+    void BindlessSet::writeTexture(uint32_t index, VkImageView view, VkSampler sampler, VkImageLayout layout) {
+        VkDescriptorImageInfo imageInfo{sampler, view, layout};
+
+        VkWriteDescriptorSet write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        write.dstSet = _set;
+        write.dstBinding = TEXTURE_BINDING;
+        write.dstArrayElement = index;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    }
+
+    void BindlessSet::writeBuffer(uint32_t index, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+        VkDescriptorBufferInfo bufferInfo{buffer, offset, range};
+
+        VkWriteDescriptorSet write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        write.dstSet = _set;
+        write.dstBinding = BUFFER_BINDING;
+        write.dstArrayElement = index;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    }
+}
@@ -2,32 +2,84 @@
 // Created by ozzadar on 10/05/23.
 //
 
-#include <cstring>
 #include <spdlog/spdlog.h>
+#include <cstring>
 #include "ozz_vulkan/resources/buffer.h"
+#include "ozz_vulkan/internal/defragmenter.h"
+
+namespace {
+    /*
+     * Creates a device local buffer and queues an upload into it, returns the upload's timeline value.
+     * fill writes the contents straight into staging memory. Buffers descriptors point at can't be moved,
+     * pass movable = false to keep them away from the defragmenter.
+     */
+    template <typename Fill>
+    uint64_t createDeviceLocalBuffer(const OZZ::ResourceContext& context, VkBufferUsageFlags usage, VkDeviceSize size,
+                                     VkBuffer* buffer, VmaAllocation* allocation, Fill&& fill, bool movable = true) {
+        VkBufferCreateInfo bufferCreateInfo{};
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.size = size;
+        // Transfer source too, so the defragmenter can copy it elsewhere
+        bufferCreateInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | (movable ? VK_BUFFER_USAGE_TRANSFER_SRC_BIT : 0u);
+        context.Uploads->ApplySharingMode(bufferCreateInfo);
 
-OZZ::VertexBuffer::VertexBuffer(VmaAllocator allocator, const std::vector<Vertex> &vertices) : _allocator(allocator) {
-    VkBufferCreateInfo bufferCreateInfo{};
-    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferCreateInfo.size = sizeof(Vertex) * vertices.size();
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        VmaAllocationCreateInfo allocationCreateInfo{};
+        allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
-    VmaAllocationCreateInfo allocationCreateInfo{};
-    allocationCreateInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+        if (vmaCreateBuffer(context.Allocator, &bufferCreateInfo, &allocationCreateInfo, buffer, allocation, nullptr) != VK_SUCCESS) {
+            spdlog::error("Failed to create device local buffer of {} bytes", size);
+            return 0;
+        }
+        context.Track(*allocation, OZZ::MemoryCategoryForBufferUsage(usage));
+
+        auto write = context.Uploads->BeginStagingWrite(size);
+        uint64_t uploadValue = context.Uploads->GetVisibleValue();
+        if (write.IsValid()) {
+            fill(write.Data);
+            OZZ::StagingCopy copy {
+                .Dst = *buffer,
+                .Size = size,
+            };
+            uploadValue = context.Uploads->SubmitStagingWrite(write, {&copy, 1});
+        }
+
+        if (context.Defrag && movable) {
+            context.Defrag->Register(*allocation, buffer, size, bufferCreateInfo.usage, uploadValue);
+        }
+        return uploadValue;
+    }
 
-    vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &_buffer, &_allocation, nullptr);
-    _size = bufferCreateInfo.size;
+    void destroyDeviceLocalBuffer(const OZZ::ResourceContext& context, VkBuffer buffer, VmaAllocation allocation,
+                                  uint64_t uploadValue) {
+        // The handle must not be rewritten once its owner is gone
+        if (context.Defrag) {
+            context.Defrag->Unregister(allocation);
+        }
 
-    void* data;
-    vmaMapMemory(allocator, _allocation, &data);
-    memcpy(data, vertices.data(), _size);
-    vmaUnmapMemory(allocator, _allocation);
+        context.Defer([uploads = context.Uploads, allocator = context.Allocator, memory = context.Memory,
+                       defrag = context.Defrag, buffer, allocation, uploadValue]() {
+            // The transfer queue may still be writing into it
+            uploads->Wait(uploadValue);
+            // Caught in the middle of being moved, the defragmenter finishes the job when its pass ends
+            if (defrag && defrag->Release(allocation)) return;
+
+            if (memory) memory->Untrack(allocation);
+            vmaDestroyBuffer(allocator, buffer, allocation);
+        });
+    }
+}
+
+OZZ::VertexBuffer::VertexBuffer(const ResourceContext& context, const void* data, uint32_t vertexCount, uint32_t stride)
+        : _stride(stride), _context(context) {
+    _size = VkDeviceSize{stride} * vertexCount;
+    _uploadValue = createDeviceLocalBuffer(context, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, _size, &_buffer, &_allocation,
+                                           [&](std::byte* staging) { std::memcpy(staging, data, _size); });
 }
 
 OZZ::VertexBuffer::~VertexBuffer() {
     if (_buffer != VK_NULL_HANDLE) {
         spdlog::trace("Destroying vertex buffer");
-        vmaDestroyBuffer(_allocator, _buffer, _allocation);
+        destroyDeviceLocalBuffer(_context, _buffer, _allocation, _uploadValue);
         _buffer = VK_NULL_HANDLE;
     }
 }
@@ -37,33 +89,54 @@ void OZZ::VertexBuffer::Bind(VkCommandBuffer commandBuffer) {
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, &_buffer, &offset);
 }
 
-OZZ::IndexBuffer::IndexBuffer(VmaAllocator allocator, const std::vector<uint32_t> &indices): _allocator(allocator) {
-    VkBufferCreateInfo bufferCreateInfo{};
-    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferCreateInfo.size = sizeof(uint32_t) * indices.size();
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-
-    VmaAllocationCreateInfo allocationCreateInfo{};
-    allocationCreateInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
-
-    vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &_buffer, &_allocation, nullptr);
-    _size = bufferCreateInfo.size;
+OZZ::IndexBuffer::IndexBuffer(const ResourceContext& context, std::span<const uint32_t> indices) : _context(context) {
+    if (FitsUInt16Indices(indices)) {
+        create(indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT16, true);
+    } else {
+        create(indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT32);
+    }
+}
 
+OZZ::IndexBuffer::IndexBuffer(const ResourceContext& context, std::span<const uint16_t> indices) : _context(context) {
+    create(indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT16);
+}
 
-    void* data;
-    vmaMapMemory(allocator, _allocation, &data);
-    memcpy(data, indices.data(), _size);
-    vmaUnmapMemory(allocator, _allocation);
+// narrow means data holds 32-bit indices to be stored as 16-bit ones, they're narrowed on the way into staging
+void OZZ::IndexBuffer::create(const void* data, uint32_t indexCount, VkIndexType indexType, bool narrow) {
+    _indexCount = indexCount;
+    _indexType = indexType;
+    _size = VkDeviceSize{IndexSize(indexType)} * indexCount;
+    _uploadValue = createDeviceLocalBuffer(_context, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, _size, &_buffer, &_allocation,
+                                           [&](std::byte* staging) {
+        if (narrow) {
+            NarrowIndices({static_cast<const uint32_t*>(data), indexCount}, reinterpret_cast<uint16_t*>(staging));
+        } else {
+            std::memcpy(staging, data, _size);
+        }
+    });
 }
 
 OZZ::IndexBuffer::~IndexBuffer() {
     if (_buffer != VK_NULL_HANDLE) {
         spdlog::trace("Destroying index buffer");
-        vmaDestroyBuffer(_allocator, _buffer, _allocation);
+        destroyDeviceLocalBuffer(_context, _buffer, _allocation, _uploadValue);
         _buffer = VK_NULL_HANDLE;
     }
 }
 
 void OZZ::IndexBuffer::Bind(VkCommandBuffer commandBuffer) {
-    vkCmdBindIndexBuffer(commandBuffer, _buffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindIndexBuffer(commandBuffer, _buffer, 0, _indexType);
+}
+
+OZZ::StorageBuffer::StorageBuffer(const ResourceContext& context, const void* data, VkDeviceSize size) : _size(size), _context(context) {
+    _uploadValue = createDeviceLocalBuffer(context, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _size, &_buffer, &_allocation,
+                                           [&](std::byte* staging) { std::memcpy(staging, data, _size); }, false);
+}
+
+OZZ::StorageBuffer::~StorageBuffer() {
+    if (_buffer != VK_NULL_HANDLE) {
+        spdlog::trace("Destroying storage buffer");
+        destroyDeviceLocalBuffer(_context, _buffer, _allocation, _uploadValue);
+        _buffer = VK_NULL_HANDLE;
+    }
 }
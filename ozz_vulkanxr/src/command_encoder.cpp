@@ -0,0 +1,230 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/command_encoder.h>
+#include <algorithm>
+#include <cstring>
+
+namespace OZZ {
+
+    namespace {
+        PFN_vkCmdDrawMeshTasksEXT cmdDrawMeshTasks = nullptr;
+    }
+
+    CommandStats& CommandStats::operator+=(const CommandStats& other) {
+        Draws += other.Draws;
+        IndirectDraws += other.IndirectDraws;
+        MeshDraws += other.MeshDraws;
+        Triangles += other.Triangles;
+        PipelineBinds += other.PipelineBinds;
+        VertexBufferBinds += other.VertexBufferBinds;
+        IndexBufferBinds += other.IndexBufferBinds;
+        DescriptorSetBinds += other.DescriptorSetBinds;
+        DynamicStateSets += other.DynamicStateSets;
+        PushConstantBytes += other.PushConstantBytes;
+        ElidedCalls += other.ElidedCalls;
+        return *this;
+    }
+
+    CommandStats FrameCommandStats::GetTotal() const {
+        CommandStats total {};
+        for (const auto& eye : Eyes) {
+            total += eye;
+        }
+        return total;
+    }
+
+    void CommandEncoder::LoadDeviceFunctions(VkDevice device, bool meshShader) {
+        cmdDrawMeshTasks = meshShader
+                ? reinterpret_cast<PFN_vkCmdDrawMeshTasksEXT>(vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT"))
+                : nullptr;
+    }
+
+    bool CommandEncoder::CanDrawMeshTasks() {
+        return cmdDrawMeshTasks != nullptr;
+    }
+
+    CommandEncoder::CommandEncoder(VkCommandBuffer commandBuffer, CommandStats* stats)
+            : _commandBuffer(commandBuffer), _stats(stats) {}
+
+    void CommandEncoder::Invalidate() {
+        _graphics = {};
+        _compute = {};
+        _vertexBuffers = {};
+        _vertexOffsets = {};
+        _indexBuffer = VK_NULL_HANDLE;
+        _hasViewport = false;
+        _hasScissor = false;
+        _pushLayout = VK_NULL_HANDLE;
+        _pushValid.reset();
+    }
+
+    void CommandEncoder::BindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline) {
+        auto& bound = state(bindPoint);
+        if (bound.Pipeline == pipeline) {
+            elided();
+            return;
+        }
+
+        vkCmdBindPipeline(_commandBuffer, bindPoint, pipeline);
+        bound.Pipeline = pipeline;
+        if (_stats) _stats->PipelineBinds++;
+    }
+
+    void CommandEncoder::BindVertexBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset) {
+        if (binding < MAX_VERTEX_BINDINGS) {
+            if (_vertexBuffers[binding] == buffer && _vertexOffsets[binding] == offset) {
+                elided();
+                return;
+            }
+            _vertexBuffers[binding] = buffer;
+            _vertexOffsets[binding] = offset;
+        }
+
+        vkCmdBindVertexBuffers(_commandBuffer, binding, 1, &buffer, &offset);
+        if (_stats) _stats->VertexBufferBinds++;
+    }
+
+    void CommandEncoder::BindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType) {
+        if (_indexBuffer == buffer && _indexOffset == offset && _indexType == indexType) {
+            elided();
+            return;
+        }
+
+        vkCmdBindIndexBuffer(_commandBuffer, buffer, offset, indexType);
+        _indexBuffer = buffer;
+        _indexOffset = offset;
+        _indexType = indexType;
+        if (_stats) _stats->IndexBufferBinds++;
+    }
+
+    void CommandEncoder::BindDescriptorSet(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set,
+                                           VkDescriptorSet descriptorSet, std::span<const uint32_t> dynamicOffsets) {
+        auto& sets = state(bindPoint).Sets;
+        auto cacheable = set < MAX_DESCRIPTOR_SETS && dynamicOffsets.size() <= MAX_DYNAMIC_OFFSETS;
+
+        if (cacheable) {
+            auto& bound = sets[set];
+            if (bound.Layout == layout && bound.Set == descriptorSet && bound.OffsetCount == dynamicOffsets.size()
+                && std::equal(dynamicOffsets.begin(), dynamicOffsets.end(), bound.Offsets.begin())) {
+                elided();
+                return;
+            }
+        }
+
+        vkCmdBindDescriptorSets(_commandBuffer, bindPoint, layout, set, 1, &descriptorSet,
+                                static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+        if (_stats) _stats->DescriptorSetBinds++;
+
+        // A different layout may disturb the other sets, only trust the one just bound
+        for (uint32_t i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+            if (i != set && sets[i].Layout != layout) sets[i] = {};
+        }
+
+        if (cacheable) {
+            auto& bound = sets[set];
+            bound.Layout = layout;
+            bound.Set = descriptorSet;
+            bound.OffsetCount = static_cast<uint32_t>(dynamicOffsets.size());
+            std::copy(dynamicOffsets.begin(), dynamicOffsets.end(), bound.Offsets.begin());
+        }
+    }
+
+    void CommandEncoder::SetViewport(const VkViewport& viewport) {
+        if (_hasViewport && std::memcmp(&_viewport, &viewport, sizeof(VkViewport)) == 0) {
+            elided();
+            return;
+        }
+
+        vkCmdSetViewport(_commandBuffer, 0, 1, &viewport);
+        _viewport = viewport;
+        _hasViewport = true;
+        if (_stats) _stats->DynamicStateSets++;
+    }
+
+    void CommandEncoder::SetScissor(const VkRect2D& scissor) {
+        if (_hasScissor && std::memcmp(&_scissor, &scissor, sizeof(VkRect2D)) == 0) {
+            elided();
+            return;
+        }
+
+        vkCmdSetScissor(_commandBuffer, 0, 1, &scissor);
+        _scissor = scissor;
+        _hasScissor = true;
+        if (_stats) _stats->DynamicStateSets++;
+    }
+
+    void CommandEncoder::PushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset,
+                                       uint32_t size, const void* data) {
+        auto cacheable = offset + size <= MAX_PUSH_CONSTANT_BYTES;
+
+        if (cacheable) {
+            if (layout != _pushLayout || stages != _pushStages) {
+                _pushLayout = layout;
+                _pushStages = stages;
+                _pushValid.reset();
+            }
+
+            auto unchanged = std::memcmp(&_pushData[offset], data, size) == 0;
+            for (uint32_t i = offset; unchanged && i < offset + size; i++) {
+                unchanged = _pushValid[i];
+            }
+
+            if (unchanged) {
+                elided();
+                return;
+            }
+
+            std::memcpy(&_pushData[offset], data, size);
+            for (uint32_t i = offset; i < offset + size; i++) {
+                _pushValid[i] = true;
+            }
+        }
+
+        vkCmdPushConstants(_commandBuffer, layout, stages, offset, size, data);
+        if (_stats) _stats->PushConstantBytes += size;
+    }
+
+    void CommandEncoder::Draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+        vkCmdDraw(_commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+        if (_stats) {
+            _stats->Draws++;
+            _stats->Triangles += uint64_t{vertexCount / 3} * instanceCount;
+        }
+    }
+
+    void CommandEncoder::DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex,
+                                     int32_t vertexOffset, uint32_t firstInstance) {
+        vkCmdDrawIndexed(_commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+        if (_stats) {
+            _stats->Draws++;
+            _stats->Triangles += uint64_t{indexCount / 3} * instanceCount;
+        }
+    }
+
+    void CommandEncoder::DrawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) {
+        vkCmdDrawIndexedIndirect(_commandBuffer, buffer, offset, drawCount, stride);
+        if (_stats) _stats->IndirectDraws++;
+    }
+
+    void CommandEncoder::DrawIndexedIndirectCount(VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer,
+                                                  VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride) {
+        vkCmdDrawIndexedIndirectCount(_commandBuffer, buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
+        if (_stats) _stats->IndirectDraws++;
+    }
+
+    void CommandEncoder::DrawMeshTasks(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+        if (!cmdDrawMeshTasks) return;
+        cmdDrawMeshTasks(_commandBuffer, groupCountX, groupCountY, groupCountZ);
+        if (_stats) _stats->MeshDraws++;
+    }
+
+    CommandEncoder::BindPointState& CommandEncoder::state(VkPipelineBindPoint bindPoint) {
+        return bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ? _compute : _graphics;
+    }
+
+    void CommandEncoder::elided() {
+        if (_stats) _stats->ElidedCalls++;
+    }
+}
@@ -0,0 +1,95 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/resources/compute_shader.h>
+#include <ozz_vulkan/internal/utils.h>
+#include <ozz_vulkan/internal/vk_utils.h>
+
+#include <utility>
+#include <spdlog/spdlog.h>
+
+namespace OZZ {
+
+    ComputeShader::ComputeShader(const ResourceContext& context, ComputeShaderConfiguration config,
+                                 const AssetArchive* archive) :
+            _device(context.Device),
+            _context(context),
+            _archive(archive),
+            _config(std::move(config)) {
+        spdlog::trace("Creating compute shader with path: {}", _config.ShaderPath.string());
+        createPipeline();
+    }
+
+    ComputeShader::~ComputeShader() {
+        spdlog::trace("Destroying compute shader");
+        // Frames still in flight may have the pipeline bound
+        _context.Defer([device = _device, pipeline = _pipeline, pipelineLayout = _pipelineLayout]() {
+            if (pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, pipeline, nullptr);
+            }
+
+            if (pipelineLayout != VK_NULL_HANDLE) {
+                vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+            }
+        });
+        _pipeline = VK_NULL_HANDLE;
+        _pipelineLayout = VK_NULL_HANDLE;
+    }
+
+    void ComputeShader::Bind(VkCommandBuffer commandBuffer) const {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+    }
+
+    void ComputeShader::BindDescriptorSet(VkCommandBuffer commandBuffer, VkDescriptorSet set, uint32_t setIndex) const {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, setIndex, 1, &set, 0, nullptr);
+    }
+
+    void ComputeShader::createPipeline() {
+        VkShaderModule shaderModule = loadShaderModule(_config.ShaderPath);
+
+        std::vector<VkPushConstantRange> pushConstants;
+        for (auto& pushConstant : _config.PushConstants) {
+            pushConstants.emplace_back(pushConstant.GetRange());
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(_config.DescriptorSetLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = _config.DescriptorSetLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
+        pipelineLayoutInfo.pPushConstantRanges = pushConstants.empty() ? nullptr : pushConstants.data();
+
+        if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+            spdlog::error("Failed to create compute pipeline layout");
+            vkDestroyShaderModule(_device, shaderModule, nullptr);
+            return;
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = _pipelineLayout;
+
+        if (vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline) != VK_SUCCESS) {
+            spdlog::error("Failed to create compute pipeline");
+            _pipeline = VK_NULL_HANDLE;
+        } else {
+            spdlog::trace("Created compute pipeline");
+        }
+        vkDestroyShaderModule(_device, shaderModule, nullptr);
+    }
+
+    VkShaderModule ComputeShader::loadShaderModule(const std::filesystem::path& path) {
+        if (_archive) {
+            if (auto asset = _archive->Load(path.generic_string()); asset.has_value()) {
+                return createShaderModule(_device, asset->Data(), asset->Size());
+            }
+            spdlog::warn("Shader {} not found in asset archive, falling back to disk", path.string());
+        }
+
+        auto code = readFile(path);
+        return createShaderModule(_device, code);
+    }
+}
@@ -0,0 +1,260 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/defragmenter.h>
+#include <spdlog/spdlog.h>
+
+namespace OZZ {
+
+    Defragmenter::Defragmenter(VkDevice device, VmaAllocator allocator, UploadManager& uploads, DeletionQueue& deletions,
+                               MemoryTracker* memory) : _device(device), _allocator(allocator), _uploads(&uploads),
+                                                        _deletions(&deletions), _memory(memory) {
+        _moves.reserve(DEFAULT_ALLOCATIONS_PER_PASS);
+        _copies.reserve(DEFAULT_ALLOCATIONS_PER_PASS);
+    }
+
+    Defragmenter::~Defragmenter() {
+        std::lock_guard lock(_mutex);
+
+        if (_state == State::Copying) {
+            _uploads->Wait(_copyValue);
+        }
+
+        // Nothing is in flight any more, whatever the pass got to can be settled right away
+        if (_state == State::Copying || _state == State::Retiring) {
+            endPass();
+        }
+
+        if (_context != VK_NULL_HANDLE) {
+            endRun();
+        }
+
+        if (!_entries.empty()) {
+            spdlog::warn("Destroying defragmenter with {} buffers still registered", _entries.size());
+        }
+    }
+
+    void Defragmenter::Register(VmaAllocation allocation, VkBuffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage,
+                                uint64_t uploadValue) {
+        if (allocation == VK_NULL_HANDLE) return;
+
+        std::lock_guard lock(_mutex);
+        _entries[allocation] = Entry {
+            .Buffer = buffer,
+            .Size = size,
+            .Usage = usage,
+            .UploadValue = uploadValue,
+        };
+    }
+
+    void Defragmenter::Unregister(VmaAllocation allocation) {
+        std::lock_guard lock(_mutex);
+        _entries.erase(allocation);
+    }
+
+    bool Defragmenter::Release(VmaAllocation allocation) {
+        std::lock_guard lock(_mutex);
+
+        if (_state != State::Copying && _state != State::Retiring) return false;
+
+        for (auto& move : _moves) {
+            if (move.Allocation == allocation) {
+                // Whichever buffer the owner ended up with, both are ours to destroy once the pass ends
+                move.Released = true;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void Defragmenter::Update() {
+        std::lock_guard lock(_mutex);
+
+        switch (_state) {
+            case State::Idle:
+                if (!_enabled || ++_framesSinceRun < _framesBetweenRuns) return;
+                beginRun();
+                if (_state != State::Ready) return;
+                beginPass();
+                break;
+            case State::Ready:
+                beginPass();
+                break;
+            case State::Copying:
+                if (_uploads->IsVisible(_copyValue)) {
+                    swapBuffers();
+                }
+                break;
+            case State::Retiring:
+                break;
+        }
+    }
+
+    void Defragmenter::SetEnabled(bool enabled) {
+        std::lock_guard lock(_mutex);
+        // A run already underway finishes, it just won't be followed by another
+        _enabled = enabled;
+    }
+
+    DefragmentationStats Defragmenter::GetStats() const {
+        std::lock_guard lock(_mutex);
+        return _stats;
+    }
+
+    void Defragmenter::beginRun() {
+        _framesSinceRun = 0;
+
+        VmaDefragmentationInfo info{};
+        info.maxBytesPerPass = DEFAULT_BYTES_PER_PASS;
+        info.maxAllocationsPerPass = DEFAULT_ALLOCATIONS_PER_PASS;
+
+        if (vmaBeginDefragmentation(_allocator, &info, &_context) != VK_SUCCESS) {
+            spdlog::error("Failed to begin defragmentation");
+            _context = VK_NULL_HANDLE;
+            return;
+        }
+
+        _stats.Runs++;
+        _state = State::Ready;
+    }
+
+    void Defragmenter::beginPass() {
+        auto result = vmaBeginDefragmentationPass(_allocator, _context, &_pass);
+        if (result == VK_SUCCESS) {
+            // Nothing left worth moving
+            endRun();
+            return;
+        }
+
+        if (result != VK_INCOMPLETE) {
+            spdlog::error("Failed to begin defragmentation pass {}", result);
+            endRun();
+            return;
+        }
+
+        _stats.Passes++;
+        _moves.clear();
+        _copies.clear();
+
+        for (uint32_t i = 0; i < _pass.moveCount; i++) {
+            auto& move = _pass.pMoves[i];
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+
+            // Pools, rings and staging aren't ours to move, neither is anything still being uploaded
+            auto it = _entries.find(move.srcAllocation);
+            if (it == _entries.end() || !_uploads->IsVisible(it->second.UploadValue)) continue;
+
+            const auto& entry = it->second;
+
+            VkBufferCreateInfo bufferCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+            bufferCreateInfo.size = entry.Size;
+            bufferCreateInfo.usage = entry.Usage;
+            _uploads->ApplySharingMode(bufferCreateInfo);
+
+            VkBuffer newBuffer{VK_NULL_HANDLE};
+            if (vkCreateBuffer(_device, &bufferCreateInfo, nullptr, &newBuffer) != VK_SUCCESS) {
+                spdlog::error("Failed to create buffer for defragmentation move");
+                continue;
+            }
+
+            if (vmaBindBufferMemory(_allocator, move.dstTmpAllocation, newBuffer) != VK_SUCCESS) {
+                spdlog::error("Failed to bind buffer for defragmentation move");
+                vkDestroyBuffer(_device, newBuffer, nullptr);
+                continue;
+            }
+
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY;
+            _moves.push_back(Move {
+                .Index = i,
+                .Allocation = move.srcAllocation,
+                .OldBuffer = *entry.Buffer,
+                .NewBuffer = newBuffer,
+            });
+            _copies.push_back({*entry.Buffer, newBuffer, entry.Size});
+        }
+
+        if (_copies.empty()) {
+            // Everything proposed belongs to someone else, another pass would only propose it again
+            endPass();
+            if (_context != VK_NULL_HANDLE) {
+                endRun();
+            }
+            return;
+        }
+
+        _copyValue = _uploads->CopyBuffers(_copies);
+        _state = State::Copying;
+    }
+
+    void Defragmenter::swapBuffers() {
+        for (auto& move : _moves) {
+            auto it = _entries.find(move.Allocation);
+            if (it == _entries.end() || move.Released) continue;
+
+            *it->second.Buffer = move.NewBuffer;
+            move.Swapped = true;
+        }
+
+        _generation.fetch_add(1, std::memory_order_release);
+        _state = State::Retiring;
+
+        // Frames recorded before the swap may still read the old buffers, the pass ends once they retire
+        _deletions->Push([this]() {
+            std::lock_guard lock(_mutex);
+            if (_state != State::Retiring) return;
+
+            endPass();
+            if (_state == State::Ready && !_enabled) {
+                endRun();
+            }
+        });
+    }
+
+    void Defragmenter::endPass() {
+        for (auto& move : _moves) {
+            auto& passMove = _pass.pMoves[move.Index];
+
+            if (move.Released) {
+                // The owner is gone, VMA frees both the old and the new memory
+                if (_memory) _memory->Untrack(move.Allocation);
+                passMove.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY;
+                vkDestroyBuffer(_device, move.OldBuffer, nullptr);
+                vkDestroyBuffer(_device, move.NewBuffer, nullptr);
+            } else if (move.Swapped) {
+                // VMA points the allocation at its new memory, the owner is already using the new buffer
+                vkDestroyBuffer(_device, move.OldBuffer, nullptr);
+            } else {
+                // Unregistered before the copy landed, the owner keeps its old buffer
+                passMove.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                vkDestroyBuffer(_device, move.NewBuffer, nullptr);
+            }
+        }
+        _moves.clear();
+
+        auto result = vmaEndDefragmentationPass(_allocator, _context, &_pass);
+        _state = result == VK_INCOMPLETE ? State::Ready : State::Idle;
+
+        if (_state == State::Idle) {
+            endRun();
+        }
+    }
+
+    void Defragmenter::endRun() {
+        VmaDefragmentationStats stats{};
+        vmaEndDefragmentation(_allocator, _context, &stats);
+        _context = VK_NULL_HANDLE;
+        _state = State::Idle;
+
+        _stats.AllocationsMoved += stats.allocationsMoved;
+        _stats.BytesMoved += stats.bytesMoved;
+        _stats.BytesFreed += stats.bytesFreed;
+        _stats.DeviceMemoryBlocksFreed += stats.deviceMemoryBlocksFreed;
+
+        if (stats.allocationsMoved > 0 || stats.bytesFreed > 0) {
+            spdlog::info("Defragmentation moved {} allocations ({} bytes), reclaimed {} bytes in {} memory blocks",
+                         stats.allocationsMoved, stats.bytesMoved, stats.bytesFreed, stats.deviceMemoryBlocksFreed);
+        }
+    }
+}
@@ -0,0 +1,348 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/depth_pyramid.h>
+#include <ozz_vulkan/internal/vk_utils.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <bit>
+
+namespace OZZ {
+
+    DepthPyramid::DepthPyramid(VkDevice device, VmaAllocator allocator, MemoryTracker* memory)
+            : _device(device), _allocator(allocator), _memory(memory) {
+        createLayouts();
+    }
+
+    DepthPyramid::~DepthPyramid() {
+        _buildShader.reset();
+        destroyImages();
+
+        if (_buildPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(_device, _buildPool, nullptr);
+        if (_samplePool != VK_NULL_HANDLE) vkDestroyDescriptorPool(_device, _samplePool, nullptr);
+        if (_buildSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(_device, _buildSetLayout, nullptr);
+        if (_sampleSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(_device, _sampleSetLayout, nullptr);
+        if (_sampler != VK_NULL_HANDLE) vkDestroySampler(_device, _sampler, nullptr);
+    }
+
+    void DepthPyramid::SetBuildShader(std::unique_ptr<ComputeShader> shader) {
+        _buildShader = std::move(shader);
+        if (!CanBuild()) {
+            spdlog::error("Depth pyramid shader failed to build, occlusion culling stays off");
+        }
+    }
+
+    void DepthPyramid::SetViewProjection(EyeTarget eye, const glm::mat4& viewProjection) {
+        if (eye == EyeTarget::BOTH) {
+            _viewProjections.fill(viewProjection);
+            return;
+        }
+        _viewProjections[static_cast<size_t>(eye)] = viewProjection;
+    }
+
+    void DepthPyramid::Resize(VkCommandBuffer commandBuffer, VkExtent2D depthExtent, VkFormat depthFormat) {
+        destroyImages();
+        _depthSourceSets.clear();
+        _built = {false, false};
+        _levelCount = 0;
+
+        // Layout creation failed and was logged, there's nothing to build with
+        if (_buildPool == VK_NULL_HANDLE || _sampleSet == VK_NULL_HANDLE) return;
+        vkResetDescriptorPool(_device, _buildPool, 0);
+
+        _depthExtent = depthExtent;
+        _depthAspect = depthBarrierAspect(depthFormat);
+        _baseExtent = {std::max(depthExtent.width / 2, 1u), std::max(depthExtent.height / 2, 1u)};
+        _levelCount = std::min<uint32_t>(std::bit_width(std::max(_baseExtent.width, _baseExtent.height)), MAX_LEVELS);
+
+        if (depthExtent.width < 2 || depthExtent.height < 2) {
+            spdlog::error("Depth buffer of {}x{} is too small for a depth pyramid", depthExtent.width, depthExtent.height);
+            _levelCount = 0;
+            return;
+        }
+
+        VkImageCreateInfo imageCreateInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+        imageCreateInfo.extent = {_baseExtent.width, _baseExtent.height, 1};
+        imageCreateInfo.mipLevels = _levelCount;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+        VmaAllocationCreateInfo allocationCreateInfo{};
+        allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+        std::array<VkImageMemoryBarrier, 2> barriers{};
+        std::array<VkDescriptorImageInfo, 2> sampleInfos{};
+
+        for (size_t eye = 0; eye < _eyes.size(); eye++) {
+            auto& pyramid = _eyes[eye];
+
+            if (vmaCreateImage(_allocator, &imageCreateInfo, &allocationCreateInfo, &pyramid.Image, &pyramid.Allocation,
+                               nullptr) != VK_SUCCESS) {
+                spdlog::error("Failed to create depth pyramid image");
+                destroyImages();
+                _levelCount = 0;
+                return;
+            }
+            if (_memory) _memory->Track(pyramid.Allocation, MemoryCategory::Depth);
+
+            VkImageViewCreateInfo viewCreateInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+            viewCreateInfo.image = pyramid.Image;
+            viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+            viewCreateInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, _levelCount, 0, 1};
+            vkCreateImageView(_device, &viewCreateInfo, nullptr, &pyramid.View);
+
+            for (uint32_t level = 0; level < _levelCount; level++) {
+                viewCreateInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+                vkCreateImageView(_device, &viewCreateInfo, nullptr, &pyramid.LevelViews[level]);
+            }
+
+            for (uint32_t level = 1; level < _levelCount; level++) {
+                pyramid.LevelSets[level] = allocateBuildSet(pyramid.LevelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL,
+                                                           pyramid.LevelViews[level]);
+            }
+
+            // The pyramid stays in GENERAL, it's written as storage and sampled
+            auto& barrier = barriers[eye];
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = pyramid.Image;
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, _levelCount, 0, 1};
+
+            sampleInfos[eye] = {_sampler, pyramid.View, VK_IMAGE_LAYOUT_GENERAL};
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                             0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+        VkWriteDescriptorSet write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        write.dstSet = _sampleSet;
+        write.dstBinding = 0;
+        write.descriptorCount = static_cast<uint32_t>(sampleInfos.size());
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = sampleInfos.data();
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+
+        spdlog::info("Depth pyramid of {} levels from {}x{}", _levelCount, _baseExtent.width, _baseExtent.height);
+    }
+
+    void DepthPyramid::Record(VkCommandBuffer commandBuffer, EyeTarget eye, VkImage depthImage, VkImageView depthView) {
+        if (!CanBuild() || eye == EyeTarget::BOTH) return;
+
+        auto eyeIndex = static_cast<size_t>(eye);
+        auto& pyramid = _eyes[eyeIndex];
+
+        auto depthSet = getDepthSourceSet(eye, depthView);
+        if (depthSet == VK_NULL_HANDLE) return;
+
+        VkImageMemoryBarrier depthBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.image = depthImage;
+        depthBarrier.subresourceRange = {_depthAspect, 0, 1, 0, 1};
+
+        // Culls recorded since the last build may still be reading the pyramid
+        VkImageMemoryBarrier pyramidBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        pyramidBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        pyramidBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        pyramidBarrier.image = pyramid.Image;
+        pyramidBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, _levelCount, 0, 1};
+
+        std::array<VkImageMemoryBarrier, 2> barriers{depthBarrier, pyramidBarrier};
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+                             static_cast<uint32_t>(barriers.size()), barriers.data());
+
+        _buildShader->Bind(commandBuffer);
+
+        glm::uvec2 sourceSize {_depthExtent.width, _depthExtent.height};
+        for (uint32_t level = 0; level < _levelCount; level++) {
+            glm::uvec2 destinationSize {std::max(_baseExtent.width >> level, 1u), std::max(_baseExtent.height >> level, 1u)};
+
+            _buildShader->BindDescriptorSet(commandBuffer, level == 0 ? depthSet : pyramid.LevelSets[level]);
+            _buildShader->YeetPushConstants(commandBuffer, LevelSizes {sourceSize, destinationSize});
+            vkCmdDispatch(commandBuffer, (destinationSize.x + GROUP_SIZE - 1) / GROUP_SIZE,
+                          (destinationSize.y + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+            // The next level reads this one, as do culls recorded after the build
+            VkImageMemoryBarrier levelBarrier = pyramidBarrier;
+            levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            levelBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+
+            sourceSize = destinationSize;
+        }
+
+        // Back to an attachment with its contents, a late pass may still draw into it
+        depthBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+        _builtViewProjections[eyeIndex] = _viewProjections[eyeIndex];
+        _built[eyeIndex] = true;
+    }
+
+    void DepthPyramid::createLayouts() {
+        VkSamplerCreateInfo samplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+        samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+        samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+        samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        if (vkCreateSampler(_device, &samplerCreateInfo, nullptr, &_sampler) != VK_SUCCESS) {
+            spdlog::error("Failed to create depth pyramid sampler");
+            return;
+        }
+
+        std::array<VkDescriptorSetLayoutBinding, 2> buildBindings{};
+        buildBindings[0] = {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr};
+        buildBindings[1] = {1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr};
+
+        VkDescriptorSetLayoutCreateInfo layoutCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+        layoutCreateInfo.bindingCount = static_cast<uint32_t>(buildBindings.size());
+        layoutCreateInfo.pBindings = buildBindings.data();
+
+        if (vkCreateDescriptorSetLayout(_device, &layoutCreateInfo, nullptr, &_buildSetLayout) != VK_SUCCESS) {
+            spdlog::error("Failed to create depth pyramid build descriptor set layout");
+            return;
+        }
+
+        VkDescriptorSetLayoutBinding sampleBinding{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+                                                   VK_SHADER_STAGE_COMPUTE_BIT, nullptr};
+        layoutCreateInfo.bindingCount = 1;
+        layoutCreateInfo.pBindings = &sampleBinding;
+
+        if (vkCreateDescriptorSetLayout(_device, &layoutCreateInfo, nullptr, &_sampleSetLayout) != VK_SUCCESS) {
+            spdlog::error("Failed to create depth pyramid sample descriptor set layout");
+            return;
+        }
+
+        VkDescriptorPoolSize samplePoolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2};
+        VkDescriptorPoolCreateInfo poolCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+        poolCreateInfo.maxSets = 1;
+        poolCreateInfo.poolSizeCount = 1;
+        poolCreateInfo.pPoolSizes = &samplePoolSize;
+
+        if (vkCreateDescriptorPool(_device, &poolCreateInfo, nullptr, &_samplePool) != VK_SUCCESS) {
+            spdlog::error("Failed to create depth pyramid sample descriptor pool");
+            return;
+        }
+
+        // Every level of both eyes, plus a level 0 set per depth buffer
+        constexpr uint32_t buildSets = 2 * MAX_LEVELS + MAX_DEPTH_SOURCES;
+        std::array<VkDescriptorPoolSize, 2> buildPoolSizes{{
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, buildSets},
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, buildSets},
+        }};
+        poolCreateInfo.maxSets = buildSets;
+        poolCreateInfo.poolSizeCount = static_cast<uint32_t>(buildPoolSizes.size());
+        poolCreateInfo.pPoolSizes = buildPoolSizes.data();
+
+        if (vkCreateDescriptorPool(_device, &poolCreateInfo, nullptr, &_buildPool) != VK_SUCCESS) {
+            spdlog::error("Failed to create depth pyramid build descriptor pool");
+            return;
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        allocateInfo.descriptorPool = _samplePool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &_sampleSetLayout;
+
+        if (vkAllocateDescriptorSets(_device, &allocateInfo, &_sampleSet) != VK_SUCCESS) {
+            spdlog::error("Failed to allocate depth pyramid sample descriptor set");
+        }
+    }
+
+    void DepthPyramid::destroyImages() {
+        for (auto& pyramid : _eyes) {
+            for (auto& view : pyramid.LevelViews) {
+                if (view != VK_NULL_HANDLE) vkDestroyImageView(_device, view, nullptr);
+            }
+            if (pyramid.View != VK_NULL_HANDLE) vkDestroyImageView(_device, pyramid.View, nullptr);
+
+            if (pyramid.Image != VK_NULL_HANDLE) {
+                if (_memory) _memory->Untrack(pyramid.Allocation);
+                vmaDestroyImage(_allocator, pyramid.Image, pyramid.Allocation);
+            }
+
+            pyramid = {};
+        }
+    }
+
+    VkDescriptorSet DepthPyramid::allocateBuildSet(VkImageView source, VkImageLayout sourceLayout, VkImageView destination) {
+        VkDescriptorSetAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        allocateInfo.descriptorPool = _buildPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &_buildSetLayout;
+
+        VkDescriptorSet set;
+        if (vkAllocateDescriptorSets(_device, &allocateInfo, &set) != VK_SUCCESS) {
+            spdlog::error("Failed to allocate depth pyramid build descriptor set");
+            return VK_NULL_HANDLE;
+        }
+
+        VkDescriptorImageInfo sourceInfo{_sampler, source, sourceLayout};
+        VkDescriptorImageInfo destinationInfo{VK_NULL_HANDLE, destination, VK_IMAGE_LAYOUT_GENERAL};
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        writes[0] = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        writes[0].dstSet = set;
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &sourceInfo;
+
+        writes[1] = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        writes[1].dstSet = set;
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &destinationInfo;
+
+        vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        return set;
+    }
+
+    VkDescriptorSet DepthPyramid::getDepthSourceSet(EyeTarget eye, VkImageView depthView) {
+        auto it = _depthSourceSets.find(depthView);
+        if (it != _depthSourceSets.end()) return it->second;
+
+        if (_depthSourceSets.size() >= MAX_DEPTH_SOURCES) {
+            spdlog::error("More than {} depth buffers feeding the depth pyramid", MAX_DEPTH_SOURCES);
+            return VK_NULL_HANDLE;
+        }
+
+        auto set = allocateBuildSet(depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                    _eyes[static_cast<size_t>(eye)].LevelViews[0]);
+        _depthSourceSets.emplace(depthView, set);
+        return set;
+    }
+}
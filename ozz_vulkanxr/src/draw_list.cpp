@@ -0,0 +1,137 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/resources/draw_list.h>
+#include <spdlog/spdlog.h>
+#include <array>
+#include <bit>
+
+namespace OZZ {
+
+    uint32_t DrawKey::DepthBits(float depth) {
+        // A positive float's bits order the same way its value does
+        if (!(depth > 0.f)) return 0;
+        return std::bit_cast<uint32_t>(depth);
+    }
+
+    uint64_t DrawKey::Make(DrawPass pass, uint32_t pipeline, uint32_t mesh, float depth) {
+        auto depthBits = DepthBits(depth);
+        if (pass == DrawPass::Transparent) {
+            depthBits = ~depthBits;
+        }
+
+        constexpr uint64_t pipelineMask = (1ull << PIPELINE_BITS) - 1;
+        constexpr uint64_t meshMask = (1ull << MESH_BITS) - 1;
+
+        return uint64_t{static_cast<uint8_t>(pass)} << PASS_SHIFT
+               | (pipeline & pipelineMask) << PIPELINE_SHIFT
+               | (mesh & meshMask) << MESH_SHIFT
+               | uint64_t{depthBits} << DEPTH_SHIFT;
+    }
+
+    std::span<SortEntry> RadixSort(std::span<SortEntry> entries, std::span<SortEntry> scratch) {
+        if (entries.size() < 2 || scratch.size() < entries.size()) return entries;
+        scratch = scratch.first(entries.size());
+
+        auto* source = &entries;
+        auto* destination = &scratch;
+
+        for (uint32_t shift = 0; shift < 64; shift += 8) {
+            std::array<uint32_t, 256> counts {};
+            for (const auto& entry : *source) {
+                counts[(entry.Key >> shift) & 0xff]++;
+            }
+
+            // Every key has the same byte here, the order wouldn't change
+            if (counts[((*source)[0].Key >> shift) & 0xff] == source->size()) continue;
+
+            uint32_t offset = 0;
+            for (auto& count : counts) {
+                auto bucket = count;
+                count = offset;
+                offset += bucket;
+            }
+
+            for (const auto& entry : *source) {
+                (*destination)[counts[(entry.Key >> shift) & 0xff]++] = entry;
+            }
+
+            std::swap(source, destination);
+        }
+
+        return *source;
+    }
+
+    DrawList::DrawList(const FrameRingBuffer& frameRing) : _frameRing(&frameRing) {}
+
+    void DrawList::Clear() {
+        _draws.clear();
+        _entries.clear();
+        _sorted = {};
+        _isSorted = true;
+    }
+
+    void DrawList::Submit(const DrawSubmission& draw) {
+        if (draw.Pipeline == nullptr || draw.Pool == nullptr || !draw.Mesh.IsValid() || draw.InstanceCount == 0) return;
+
+        _entries.push_back({
+            .Key = DrawKey::Make(draw.Pass, draw.Pipeline->GetId(), draw.Mesh.Id, draw.Depth),
+            .Index = static_cast<uint32_t>(_draws.size()),
+        });
+        _draws.push_back(draw);
+        _isSorted = false;
+    }
+
+    void DrawList::Sort() {
+        if (_scratch.size() < _entries.size()) {
+            _scratch.resize(_entries.capacity());
+        }
+
+        _sorted = RadixSort(_entries, _scratch);
+        _isSorted = true;
+    }
+
+    void DrawList::Record(CommandEncoder& encoder, const FrameAllocation& frameUniform, EyeTarget eye) {
+        _stats = {};
+
+        if (!_isSorted) {
+            spdlog::warn("Recording a draw list that hasn't been sorted since its last submit");
+            Sort();
+        }
+
+        Shader* boundPipeline = nullptr;
+        const MeshPool* boundPool = nullptr;
+        VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+        const void* boundInstances = nullptr;
+
+        for (const auto& entry : _sorted) {
+            const auto& draw = _draws[entry.Index];
+            if (eye != EyeTarget::BOTH && draw.Eye != EyeTarget::BOTH && draw.Eye != eye) continue;
+
+            if (draw.Pipeline != boundPipeline) {
+                draw.Pipeline->Bind(encoder);
+                boundPipeline = draw.Pipeline;
+                _stats.PipelineBinds++;
+            }
+
+            // Sets stay bound across pipelines with the same layout, only the storage offset can move them
+            auto layout = draw.Pipeline->GetPipelineLayout();
+            if (layout != boundLayout || draw.Instances.Data != boundInstances) {
+                _frameRing->Bind(encoder, layout, 0, frameUniform, draw.Instances);
+                boundLayout = layout;
+                boundInstances = draw.Instances.Data;
+                _stats.FrameDataBinds++;
+            }
+
+            if (draw.Pool != boundPool) {
+                draw.Pool->Bind(encoder);
+                boundPool = draw.Pool;
+                _stats.MeshPoolBinds++;
+            }
+
+            draw.Pool->Draw(encoder, draw.Mesh, draw.InstanceCount, draw.FirstInstance);
+            _stats.Draws++;
+        }
+    }
+}
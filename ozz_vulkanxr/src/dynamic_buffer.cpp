@@ -0,0 +1,105 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/resources/dynamic_buffer.h>
+#include <cstring>
+
+namespace OZZ {
+
+    // Keeps every copy's base aligned for vertex, index and storage use
+    static constexpr VkDeviceSize COPY_ALIGNMENT = 256;
+
+    DynamicBuffer::DynamicBuffer(const ResourceContext& context, VkBufferUsageFlags usage, VkDeviceSize size,
+                                 uint32_t copyCount) : _context(context), _clock(context.Clock), _size(size) {
+        _copyStride = (size + COPY_ALIGNMENT - 1) & ~(COPY_ALIGNMENT - 1);
+        _shadow.resize(size);
+        _dirty.resize(copyCount);
+
+        VkBufferCreateInfo bufferCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bufferCreateInfo.size = _copyStride * copyCount;
+        bufferCreateInfo.usage = usage;
+
+        VmaAllocationCreateInfo allocationCreateInfo{};
+        allocationCreateInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+        allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VmaAllocationInfo allocationInfo{};
+        if (vmaCreateBuffer(_context.Allocator, &bufferCreateInfo, &allocationCreateInfo, &_buffer, &_allocation,
+                            &allocationInfo) != VK_SUCCESS) {
+            spdlog::error("Failed to create dynamic buffer of {} bytes", bufferCreateInfo.size);
+            return;
+        }
+
+        _mapped = static_cast<std::byte*>(allocationInfo.pMappedData);
+        _context.Track(_allocation, MemoryCategoryForBufferUsage(usage));
+    }
+
+    DynamicBuffer::~DynamicBuffer() {
+        if (_buffer != VK_NULL_HANDLE) {
+            spdlog::trace("Destroying dynamic buffer");
+            _context.Defer([allocator = _context.Allocator, memory = _context.Memory, buffer = _buffer,
+                            allocation = _allocation]() {
+                if (memory) memory->Untrack(allocation);
+                vmaDestroyBuffer(allocator, buffer, allocation);
+            });
+            _buffer = VK_NULL_HANDLE;
+        }
+    }
+
+    void DynamicBuffer::Write(VkDeviceSize offset, const void* data, VkDeviceSize size) {
+        if (size == 0) return;
+
+        if (offset + size > _size) {
+            spdlog::error("Dynamic buffer write of {} bytes at {} is out of range ({} bytes)", size, offset, _size);
+            return;
+        }
+
+        std::lock_guard lock(_mutex);
+        std::memcpy(_shadow.data() + offset, data, size);
+
+        // Outside a frame the current slot may still be in flight, so only the shadow is safe to touch
+        bool inFrame = _clock->InFrame.load();
+        uint32_t slot = _clock->Slot.load();
+
+        for (uint32_t copy = 0; copy < _dirty.size(); copy++) {
+            if (!inFrame || copy != slot) {
+                _dirty[copy].Add(offset, offset + size);
+            }
+        }
+
+        if (inFrame) {
+            syncCurrentCopy(slot);
+            copyRange(slot, offset, offset + size);
+        }
+    }
+
+    VkDeviceSize DynamicBuffer::GetCurrentOffset() {
+        std::lock_guard lock(_mutex);
+
+        uint32_t slot = _clock->Slot.load();
+        if (_clock->InFrame.load()) {
+            syncCurrentCopy(slot);
+        }
+
+        return _copyStride * slot;
+    }
+
+    void DynamicBuffer::syncCurrentCopy(uint32_t slot) {
+        if (slot >= _dirty.size()) return;
+
+        auto& dirty = _dirty[slot];
+        if (!dirty.Empty()) {
+            copyRange(slot, dirty.Begin, dirty.End);
+            dirty.Clear();
+        }
+    }
+
+    void DynamicBuffer::copyRange(uint32_t copy, VkDeviceSize begin, VkDeviceSize end) {
+        if (_mapped == nullptr) return;
+
+        auto copyOffset = _copyStride * copy;
+        std::memcpy(_mapped + copyOffset + begin, _shadow.data() + begin, end - begin);
+        vmaFlushAllocation(_context.Allocator, _allocation, copyOffset + begin, end - begin);
+    }
+}
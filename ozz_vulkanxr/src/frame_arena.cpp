@@ -0,0 +1,50 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/frame_arena.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstdint>
+
+namespace OZZ {
+
+    static size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    FrameArena::FrameArena(size_t capacity) : _buffer(std::make_unique<std::byte[]>(capacity)), _capacity(capacity) {}
+
+    void* FrameArena::Allocate(size_t size, size_t alignment) {
+        auto base = reinterpret_cast<uintptr_t>(_buffer.get());
+        auto offset = alignUp(base + _head, alignment) - base;
+
+        if (offset + size <= _capacity) {
+            _head = offset + size;
+            return _buffer.get() + offset;
+        }
+
+        // Out of room this frame, Reset grows the arena so it doesn't happen again
+        auto& block = _overflow.emplace_back(std::make_unique<std::byte[]>(size + alignment));
+        _overflowBytes += size + alignment;
+
+        auto blockBase = reinterpret_cast<uintptr_t>(block.get());
+        return block.get() + (alignUp(blockBase, alignment) - blockBase);
+    }
+
+    void FrameArena::Reset() {
+        _highWater = std::max(_highWater, GetUsed());
+
+        if (!_overflow.empty()) {
+            auto capacity = alignUp(_highWater + _highWater / 2, alignof(std::max_align_t));
+            spdlog::trace("Frame arena overflowed by {} bytes, growing to {} bytes", _overflowBytes, capacity);
+
+            _buffer = std::make_unique<std::byte[]>(capacity);
+            _capacity = capacity;
+            _overflow.clear();
+            _overflowBytes = 0;
+        }
+
+        _head = 0;
+    }
+}
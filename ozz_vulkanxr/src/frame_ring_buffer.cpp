@@ -0,0 +1,206 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/frame_ring_buffer.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+
+namespace OZZ {
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    FrameRingBuffer::FrameRingBuffer(VkDevice device, VmaAllocator allocator, const VkPhysicalDeviceLimits& limits,
+                                     uint32_t frameCount, MemoryTracker* memory, VkDeviceSize frameSize)
+            : _device(device), _allocator(allocator), _memory(memory), _frameCount(frameCount) {
+        _uniformAlignment = std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, 16);
+        _storageAlignment = std::max<VkDeviceSize>(limits.minStorageBufferOffsetAlignment, 16);
+
+        // Keeps every region's base aligned for both kinds of binding
+        _frameSize = alignUp(frameSize, std::max(_uniformAlignment, _storageAlignment));
+
+        _uniformRange = std::min<VkDeviceSize>({UNIFORM_WINDOW, limits.maxUniformBufferRange, _frameSize});
+        _storageRange = std::min<VkDeviceSize>({STORAGE_WINDOW, limits.maxStorageBufferRange, _frameSize});
+
+        /*
+         * Descriptor ranges are fixed, so a window bound near the end of the last region would run off the
+         * end of the buffer. Pad the buffer by the larger window so every offset we hand out is bindable.
+         */
+        VkBufferCreateInfo bufferCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bufferCreateInfo.size = _frameSize * frameCount + std::max(_uniformRange, _storageRange);
+        bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+        VmaAllocationCreateInfo allocationCreateInfo{};
+        allocationCreateInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+        allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VmaAllocationInfo allocationInfo{};
+        if (vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &_buffer, &_allocation,
+                            &allocationInfo) != VK_SUCCESS) {
+            spdlog::error("Failed to create frame ring buffer");
+            return;
+        }
+
+        _mapped = static_cast<std::byte*>(allocationInfo.pMappedData);
+        if (_memory) _memory->Track(_allocation, MemoryCategory::Uniform);
+        createDescriptors();
+
+        spdlog::trace("Created frame ring buffer, {} frames of {}KB", frameCount, _frameSize / 1024);
+    }
+
+    FrameRingBuffer::~FrameRingBuffer() {
+        if (_descriptorPool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+            _descriptorPool = VK_NULL_HANDLE;
+        }
+
+        if (_setLayout != VK_NULL_HANDLE) {
+            vkDestroyDescriptorSetLayout(_device, _setLayout, nullptr);
+            _setLayout = VK_NULL_HANDLE;
+        }
+
+        if (_buffer != VK_NULL_HANDLE) {
+            if (_memory) _memory->Untrack(_allocation);
+            vmaDestroyBuffer(_allocator, _buffer, _allocation);
+            _buffer = VK_NULL_HANDLE;
+        }
+    }
+
+    void FrameRingBuffer::BeginFrame(uint32_t slot) {
+        if (slot >= _frameCount) {
+            spdlog::error("Frame ring buffer slot {} out of range ({} frames)", slot, _frameCount);
+            slot = 0;
+        }
+
+        _frameBase = _frameSize * slot;
+        _head.store(0);
+    }
+
+    void FrameRingBuffer::Flush() {
+        auto used = _head.load();
+        if (used > 0 && _allocation != VK_NULL_HANDLE) {
+            vmaFlushAllocation(_allocator, _allocation, _frameBase, used);
+        }
+    }
+
+    FrameAllocation FrameRingBuffer::AllocateUniform(VkDeviceSize size) {
+        return allocate(size, _uniformAlignment, _uniformRange);
+    }
+
+    FrameAllocation FrameRingBuffer::AllocateStorage(VkDeviceSize size) {
+        return allocate(size, _storageAlignment, _storageRange);
+    }
+
+    FrameAllocation FrameRingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize maxSize) {
+        if (_mapped == nullptr) return {};
+
+        if (size > maxSize) {
+            spdlog::error("Frame allocation of {} bytes is larger than its {} byte binding window", size, maxSize);
+            return {};
+        }
+
+        auto head = _head.load();
+        VkDeviceSize offset;
+        do {
+            offset = alignUp(head, alignment);
+            if (offset + size > _frameSize) {
+                spdlog::error("Frame ring buffer exhausted ({} bytes requested, {} used)", size, head);
+                return {};
+            }
+        } while (!_head.compare_exchange_weak(head, offset + size));
+
+        auto absoluteOffset = _frameBase + offset;
+        return FrameAllocation {
+            .Data = _mapped + absoluteOffset,
+            .Offset = static_cast<uint32_t>(absoluteOffset),
+            .Size = size,
+        };
+    }
+
+    void FrameRingBuffer::Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set,
+                               const FrameAllocation& uniform, const FrameAllocation& storage) const {
+        CommandEncoder encoder(commandBuffer);
+        Bind(encoder, pipelineLayout, set, uniform, storage);
+    }
+
+    void FrameRingBuffer::Bind(CommandEncoder& encoder, VkPipelineLayout pipelineLayout, uint32_t set,
+                               const FrameAllocation& uniform, const FrameAllocation& storage) const {
+        const std::array<uint32_t, 2> dynamicOffsets = {
+            uniform.IsValid() ? uniform.Offset : static_cast<uint32_t>(_frameBase),
+            storage.IsValid() ? storage.Offset : static_cast<uint32_t>(_frameBase),
+        };
+
+        encoder.BindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, _descriptorSet, dynamicOffsets);
+    }
+
+    void FrameRingBuffer::createDescriptors() {
+        VkDescriptorSetLayoutBinding bindings[2]{};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+        layoutCreateInfo.bindingCount = 2;
+        layoutCreateInfo.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(_device, &layoutCreateInfo, nullptr, &_setLayout) != VK_SUCCESS) {
+            spdlog::error("Failed to create frame data descriptor set layout");
+            return;
+        }
+
+        VkDescriptorPoolSize poolSizes[] = {
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1},
+        };
+
+        VkDescriptorPoolCreateInfo poolCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+        poolCreateInfo.maxSets = 1;
+        poolCreateInfo.poolSizeCount = 2;
+        poolCreateInfo.pPoolSizes = poolSizes;
+
+        if (vkCreateDescriptorPool(_device, &poolCreateInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+            spdlog::error("Failed to create frame data descriptor pool");
+            return;
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        allocateInfo.descriptorPool = _descriptorPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &_setLayout;
+
+        if (vkAllocateDescriptorSets(_device, &allocateInfo, &_descriptorSet) != VK_SUCCESS) {
+            spdlog::error("Failed to allocate frame data descriptor set");
+            return;
+        }
+
+        // Written once, dynamic offsets pick the actual data every bind
+        VkDescriptorBufferInfo uniformInfo{_buffer, 0, _uniformRange};
+        VkDescriptorBufferInfo storageInfo{_buffer, 0, _storageRange};
+
+        VkWriteDescriptorSet writes[2]{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = _descriptorSet;
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        writes[0].pBufferInfo = &uniformInfo;
+
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = _descriptorSet;
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        writes[1].pBufferInfo = &storageInfo;
+
+        vkUpdateDescriptorSets(_device, 2, writes, 0, nullptr);
+    }
+}
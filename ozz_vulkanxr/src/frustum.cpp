@@ -0,0 +1,153 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/culling/frustum.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace OZZ {
+
+    static glm::vec4 normalisePlane(glm::vec4 plane) {
+        auto length = glm::length(glm::vec3(plane));
+        // A degenerate plane (e.g. an infinite far plane) keeps everything
+        return length > 1e-6f ? plane / length : glm::vec4(0.f, 0.f, 0.f, 1.f);
+    }
+
+    Frustum Frustum::FromViewProjection(const glm::mat4& viewProjection) {
+        // Gribb/Hartmann
+        auto row = [&](int i) {
+            return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        };
+
+        Frustum frustum;
+        frustum.Planes[0] = normalisePlane(row(3) + row(0));
+        frustum.Planes[1] = normalisePlane(row(3) - row(0));
+        frustum.Planes[2] = normalisePlane(row(3) + row(1));
+        frustum.Planes[3] = normalisePlane(row(3) - row(1));
+        frustum.Planes[4] = normalisePlane(row(2));
+        frustum.Planes[5] = normalisePlane(row(3) - row(2));
+        return frustum;
+    }
+
+    Frustum Frustum::Infinite() {
+        Frustum frustum;
+        frustum.Planes.fill(glm::vec4(0.f, 0.f, 0.f, 1.f));
+        return frustum;
+    }
+
+    bool Frustum::IntersectsSphere(glm::vec3 centre, float radius) const {
+        for (const auto& plane : Planes) {
+            if (glm::dot(glm::vec3(plane), centre) + plane.w < -radius) return false;
+        }
+        return true;
+    }
+
+    bool Frustum::IntersectsBox(glm::vec3 min, glm::vec3 max) const {
+        auto centre = (min + max) * 0.5f;
+        auto extents = (max - min) * 0.5f;
+
+        for (const auto& plane : Planes) {
+            auto radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+            if (glm::dot(glm::vec3(plane), centre) + plane.w < -radius) return false;
+        }
+        return true;
+    }
+
+    StereoFrustum StereoFrustum::FromEyes(const FieldOfView& leftFov, const glm::mat4& leftEyeToWorld,
+                                          const FieldOfView& rightFov, const glm::mat4& rightEyeToWorld) {
+        const std::array<const FieldOfView*, 2> fovs = {&leftFov, &rightFov};
+        const std::array<const glm::mat4*, 2> eyeToWorld = {&leftEyeToWorld, &rightEyeToWorld};
+
+        StereoFrustum result;
+        std::array<glm::quat, 2> rotations;
+
+        for (size_t eye = 0; eye < 2; eye++) {
+            auto projection = EyePoseInfo{ .FOV = *fovs[eye] }.GetProjectionMatrix();
+            result.Eyes[eye] = Frustum::FromViewProjection(projection * glm::inverse(*eyeToWorld[eye]));
+            rotations[eye] = glm::normalize(glm::quat_cast(glm::mat3(*eyeToWorld[eye])));
+        }
+
+        // Combined space sits halfway between the eyes and looks down -z like they do
+        auto rotation = glm::normalize(glm::slerp(rotations[0], rotations[1], 0.5f));
+        auto toCombined = glm::conjugate(rotation);
+        auto origin = (glm::vec3((*eyeToWorld[0])[3]) + glm::vec3((*eyeToWorld[1])[3])) * 0.5f;
+
+        // Widest slope on each side over every corner ray of both eyes, starting from a frustum that opens outwards
+        constexpr float MIN_SLOPE = 1e-3f;
+        float tanLeft = -MIN_SLOPE;
+        float tanRight = MIN_SLOPE;
+        float tanDown = -MIN_SLOPE;
+        float tanUp = MIN_SLOPE;
+        // How much further than its depth a point on an eye's far plane can be from that eye
+        float farScale = 1.f;
+
+        for (size_t eye = 0; eye < 2; eye++) {
+            const auto& fov = *fovs[eye];
+            auto l = std::tan(fov.AngleLeft);
+            auto r = std::tan(fov.AngleRight);
+            auto d = std::tan(fov.AngleDown);
+            auto u = std::tan(fov.AngleUp);
+            auto eyeRotation = toCombined * rotations[eye];
+
+            for (auto corner : {glm::vec3(l, u, -1.f), glm::vec3(r, u, -1.f), glm::vec3(l, d, -1.f), glm::vec3(r, d, -1.f)}) {
+                farScale = std::max(farScale, glm::length(corner));
+
+                auto ray = eyeRotation * corner;
+                if (ray.z > -MIN_SLOPE) {
+                    // The eyes diverge too far for one frustum to hold both, only the per-eye tests cull
+                    result.Combined = Frustum::Infinite();
+                    return result;
+                }
+
+                auto depth = -ray.z;
+                tanLeft = std::min(tanLeft, ray.x / depth);
+                tanRight = std::max(tanRight, ray.x / depth);
+                tanDown = std::min(tanDown, ray.y / depth);
+                tanUp = std::max(tanUp, ray.y / depth);
+            }
+        }
+
+        // Pull the apex back along +z until both eyes are inside every side plane
+        std::array<glm::vec3, 2> eyes;
+        float apex = 0.f;
+        for (size_t eye = 0; eye < 2; eye++) {
+            auto p = toCombined * (glm::vec3((*eyeToWorld[eye])[3]) - origin);
+            eyes[eye] = p;
+            apex = std::max({apex, p.x / tanLeft + p.z, p.x / tanRight + p.z, p.y / tanDown + p.z, p.y / tanUp + p.z});
+        }
+
+        // Distance of each eye in front of the apex, nothing either eye sees is nearer than its own eye
+        auto leftDepth = apex - eyes[0].z;
+        auto rightDepth = apex - eyes[1].z;
+        auto nearDepth = std::min(leftDepth, rightDepth);
+        auto farDepth = std::max(leftDepth, rightDepth) + EyePoseInfo::FAR_Z * farScale;
+
+        // In combined space with the apex at (0, 0, apex), a point's depth in front of it is apex - z
+        const std::array<glm::vec4, Frustum::PLANE_COUNT> planes = {
+            glm::vec4(1.f, 0.f, tanLeft, -tanLeft * apex),
+            glm::vec4(-1.f, 0.f, -tanRight, tanRight * apex),
+            glm::vec4(0.f, 1.f, tanDown, -tanDown * apex),
+            glm::vec4(0.f, -1.f, -tanUp, tanUp * apex),
+            glm::vec4(0.f, 0.f, -1.f, apex - nearDepth),
+            glm::vec4(0.f, 0.f, 1.f, farDepth - apex),
+        };
+
+        for (uint32_t i = 0; i < Frustum::PLANE_COUNT; i++) {
+            auto plane = normalisePlane(planes[i]);
+            auto normal = rotation * glm::vec3(plane);
+            result.Combined.Planes[i] = glm::vec4(normal, plane.w - glm::dot(normal, origin));
+        }
+
+        return result;
+    }
+
+    StereoFrustum StereoFrustum::FromEyePoses(const EyePoseInfo& left, const EyePoseInfo& right) {
+        auto eyeToWorld = [](const EyePoseInfo& eye) {
+            return glm::translate(glm::mat4{1.f}, eye.Position) * glm::mat4_cast(eye.Orientation);
+        };
+        return FromEyes(left.FOV, eyeToWorld(left), right.FOV, eyeToWorld(right));
+    }
+}
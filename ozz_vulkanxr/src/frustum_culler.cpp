@@ -0,0 +1,345 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/culling/frustum_culler.h>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+// SSE2 is a given on x86-64. AVX is compiled into its own entry point and only picked when the CPU has it,
+// nothing else in the binary is built for AVX
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define OZZ_CULL_SSE
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define OZZ_CULL_AVX
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC emits AVX intrinsics without /arch:AVX
+#define OZZ_AVX_TARGET
+#define OZZ_CULL_INLINE __forceinline
+#else
+#define OZZ_AVX_TARGET __attribute__((target("avx")))
+#define OZZ_CULL_INLINE [[gnu::always_inline]] inline
+// The kernel templates pass __m256 around outside the AVX entry point, but are always inlined into it
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+#endif
+#else
+#define OZZ_CULL_INLINE inline
+#endif
+
+namespace OZZ {
+
+    uint32_t CullingBounds::AddSphere(glm::vec3 centre, float radius) {
+        auto index = add();
+        SetSphere(index, centre, radius);
+        return index;
+    }
+
+    uint32_t CullingBounds::AddBox(glm::vec3 min, glm::vec3 max) {
+        auto index = add();
+        SetBox(index, min, max);
+        return index;
+    }
+
+    void CullingBounds::SetSphere(uint32_t index, glm::vec3 centre, float radius) {
+        set(index, centre, radius, glm::vec3{0.f});
+    }
+
+    void CullingBounds::SetBox(uint32_t index, glm::vec3 min, glm::vec3 max) {
+        set(index, (min + max) * 0.5f, 0.f, glm::abs(max - min) * 0.5f);
+    }
+
+    void CullingBounds::Clear() {
+        // Whatever is left past the count is masked off by the culler
+        _count = 0;
+    }
+
+    void CullingBounds::Reserve(uint32_t count) {
+        auto padded = (count + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+        if (padded <= _centreX.size()) return;
+
+        for (auto* values : {&_centreX, &_centreY, &_centreZ, &_radius, &_extentX, &_extentY, &_extentZ}) {
+            values->resize(padded, 0.f);
+        }
+    }
+
+    uint32_t CullingBounds::add() {
+        auto index = _count++;
+        if (_count > _centreX.size()) {
+            Reserve(std::max(_count, static_cast<uint32_t>(_centreX.size()) * 2));
+        }
+        return index;
+    }
+
+    void CullingBounds::set(uint32_t index, glm::vec3 centre, float radius, glm::vec3 extents) {
+        if (index >= _count) return;
+
+        _centreX[index] = centre.x;
+        _centreY[index] = centre.y;
+        _centreZ[index] = centre.z;
+        _radius[index] = radius;
+        _extentX[index] = extents.x;
+        _extentY[index] = extents.y;
+        _extentZ[index] = extents.z;
+    }
+
+    namespace {
+        // Each ISA wraps the handful of operations the kernel needs, Width lanes at a time
+#if defined(OZZ_CULL_AVX)
+        // Only ever called from cullAvx, see hasAvx
+        struct AvxLanes {
+            using Float = __m256;
+            static constexpr uint32_t Width = 8;
+
+            OZZ_AVX_TARGET static Float Load(const float* values) { return _mm256_loadu_ps(values); }
+            OZZ_AVX_TARGET static Float Splat(float value) { return _mm256_set1_ps(value); }
+            OZZ_AVX_TARGET static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+            OZZ_AVX_TARGET static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+            OZZ_AVX_TARGET static Float AllSet() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+            // Ordered, a NaN distance culls
+            OZZ_AVX_TARGET static Float GreaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+            OZZ_AVX_TARGET static Float And(Float a, Float b) { return _mm256_and_ps(a, b); }
+            OZZ_AVX_TARGET static uint32_t Bits(Float mask) { return static_cast<uint32_t>(_mm256_movemask_ps(mask)); }
+        };
+#endif
+#if defined(OZZ_CULL_SSE)
+        struct Lanes {
+            using Float = __m128;
+            static constexpr uint32_t Width = 4;
+
+            static Float Load(const float* values) { return _mm_loadu_ps(values); }
+            static Float Splat(float value) { return _mm_set1_ps(value); }
+            static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+            static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+            static Float AllSet() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+            static Float GreaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+            static Float And(Float a, Float b) { return _mm_and_ps(a, b); }
+            static uint32_t Bits(Float mask) { return static_cast<uint32_t>(_mm_movemask_ps(mask)); }
+        };
+        constexpr const char* INSTRUCTION_SET = "SSE";
+#else
+        struct Lanes {
+            using Float = float;
+            static constexpr uint32_t Width = 1;
+
+            static Float Load(const float* values) { return *values; }
+            static Float Splat(float value) { return value; }
+            static Float Add(Float a, Float b) { return a + b; }
+            static Float Mul(Float a, Float b) { return a * b; }
+            static Float AllSet() { return 1.f; }
+            static Float GreaterEqual(Float a, Float b) { return a >= b ? 1.f : 0.f; }
+            static Float And(Float a, Float b) { return a * b; }
+            static uint32_t Bits(Float mask) { return mask != 0.f ? 1u : 0u; }
+        };
+        constexpr const char* INSTRUCTION_SET = "scalar";
+#endif
+
+        static_assert(CullingBounds::BATCH_SIZE % Lanes::Width == 0, "Bounds padding must cover a whole batch");
+
+        // The kernel below is instantiated per ISA and always inlined into its entry point, so the AVX one is
+        // compiled for AVX as a whole
+
+        // A frustum's planes splatted across every lane once per cull instead of once per batch
+        template<typename L>
+        struct SplatFrustum {
+            struct Plane {
+                typename L::Float X, Y, Z, W;
+                typename L::Float AbsX, AbsY, AbsZ;
+            };
+            std::array<Plane, Frustum::PLANE_COUNT> Planes;
+
+            OZZ_CULL_INLINE explicit SplatFrustum(const Frustum& frustum) {
+                for (uint32_t i = 0; i < Frustum::PLANE_COUNT; i++) {
+                    const auto& plane = frustum.Planes[i];
+                    Planes[i] = Plane {
+                        .X = L::Splat(plane.x), .Y = L::Splat(plane.y), .Z = L::Splat(plane.z), .W = L::Splat(plane.w),
+                        .AbsX = L::Splat(std::abs(plane.x)), .AbsY = L::Splat(std::abs(plane.y)),
+                        .AbsZ = L::Splat(std::abs(plane.z)),
+                    };
+                }
+            }
+        };
+
+        template<typename L>
+        struct Batch {
+            typename L::Float X, Y, Z, Radius, ExtentX, ExtentY, ExtentZ;
+        };
+
+        // Spheres and boxes alike: inside a plane while dot(n, c) + w + r + dot(|n|, e) >= 0
+        template<typename L>
+        OZZ_CULL_INLINE uint32_t testBatch(const SplatFrustum<L>& frustum, const Batch<L>& batch) {
+            auto zero = L::Splat(0.f);
+            auto inside = L::AllSet();
+
+            for (const auto& plane : frustum.Planes) {
+                auto distance = L::Add(L::Add(L::Mul(plane.X, batch.X), L::Mul(plane.Y, batch.Y)),
+                                       L::Add(L::Mul(plane.Z, batch.Z), plane.W));
+                auto reach = L::Add(L::Add(L::Mul(plane.AbsX, batch.ExtentX), L::Mul(plane.AbsY, batch.ExtentY)),
+                                    L::Add(L::Mul(plane.AbsZ, batch.ExtentZ), batch.Radius));
+                inside = L::And(inside, L::GreaterEqual(L::Add(distance, reach), zero));
+            }
+
+            return L::Bits(inside);
+        }
+
+        OZZ_CULL_INLINE uint32_t emit(uint32_t bits, uint32_t base, uint32_t* out) {
+            uint32_t count = 0;
+            while (bits != 0) {
+                out[count++] = base + static_cast<uint32_t>(std::countr_zero(bits));
+                bits &= bits - 1;
+            }
+            return count;
+        }
+
+        // CullingBounds' arrays, padded to a whole batch
+        struct BoundsStreams {
+            const float* X;
+            const float* Y;
+            const float* Z;
+            const float* Radius;
+            const float* ExtentX;
+            const float* ExtentY;
+            const float* ExtentZ;
+            uint32_t Count;
+        };
+
+        // Indexed by EyeTarget like FrustumCuller's lists
+        struct CullOutput {
+            std::array<uint32_t*, 3> Visible;
+            std::array<uint32_t, 3> Counts {};
+            uint32_t CulledCombined { 0 };
+        };
+
+        template<typename L>
+        OZZ_CULL_INLINE void cullBatches(const StereoFrustum& frustum, const BoundsStreams& bounds, CullOutput& output) {
+            const SplatFrustum<L> combined(frustum.Combined);
+            const SplatFrustum<L> left(frustum.Eyes[static_cast<size_t>(EyeTarget::Left)]);
+            const SplatFrustum<L> right(frustum.Eyes[static_cast<size_t>(EyeTarget::Right)]);
+
+            auto* leftOut = output.Visible[static_cast<size_t>(EyeTarget::Left)];
+            auto* rightOut = output.Visible[static_cast<size_t>(EyeTarget::Right)];
+            auto* bothOut = output.Visible[static_cast<size_t>(EyeTarget::BOTH)];
+            auto& leftCount = output.Counts[static_cast<size_t>(EyeTarget::Left)];
+            auto& rightCount = output.Counts[static_cast<size_t>(EyeTarget::Right)];
+            auto& bothCount = output.Counts[static_cast<size_t>(EyeTarget::BOTH)];
+
+            constexpr uint32_t fullLanes = (1u << L::Width) - 1;
+            auto count = bounds.Count;
+
+            for (uint32_t base = 0; base < count; base += L::Width) {
+                const Batch<L> batch {
+                    .X = L::Load(bounds.X + base),
+                    .Y = L::Load(bounds.Y + base),
+                    .Z = L::Load(bounds.Z + base),
+                    .Radius = L::Load(bounds.Radius + base),
+                    .ExtentX = L::Load(bounds.ExtentX + base),
+                    .ExtentY = L::Load(bounds.ExtentY + base),
+                    .ExtentZ = L::Load(bounds.ExtentZ + base),
+                };
+
+                // The padding past the last bounds isn't real
+                auto lanes = count - base < L::Width ? (1u << (count - base)) - 1 : fullLanes;
+
+                auto combinedBits = testBatch(combined, batch) & lanes;
+                output.CulledCombined += static_cast<uint32_t>(std::popcount(lanes & ~combinedBits));
+                if (combinedBits == 0) continue;
+
+                auto leftBits = testBatch(left, batch) & combinedBits;
+                auto rightBits = testBatch(right, batch) & combinedBits;
+
+                leftCount += emit(leftBits, base, leftOut + leftCount);
+                rightCount += emit(rightBits, base, rightOut + rightCount);
+                bothCount += emit(leftBits | rightBits, base, bothOut + bothCount);
+            }
+        }
+
+        void cullDefault(const StereoFrustum& frustum, const BoundsStreams& bounds, CullOutput& output) {
+            cullBatches<Lanes>(frustum, bounds, output);
+        }
+
+#if defined(OZZ_CULL_AVX)
+        static_assert(CullingBounds::BATCH_SIZE % AvxLanes::Width == 0, "Bounds padding must cover a whole batch");
+
+        OZZ_AVX_TARGET void cullAvx(const StereoFrustum& frustum, const BoundsStreams& bounds, CullOutput& output) {
+            cullBatches<AvxLanes>(frustum, bounds, output);
+        }
+
+        bool detectAvx() {
+#if defined(_MSC_VER) && !defined(__clang__)
+            // The CPU has to support AVX and the OS has to save the YMM registers
+            int info[4];
+            __cpuid(info, 1);
+            bool osSaves = (info[2] & (1 << 27)) != 0;
+            bool cpuHas = (info[2] & (1 << 28)) != 0;
+            return osSaves && cpuHas && (_xgetbv(0) & 0x6) == 0x6;
+#else
+            // Checks the OS saves the YMM registers as well
+            return __builtin_cpu_supports("avx");
+#endif
+        }
+
+        bool hasAvx() {
+            static const bool avx = detectAvx();
+            return avx;
+        }
+#endif
+    }
+
+    const char* FrustumCuller::GetInstructionSet() {
+#if defined(OZZ_CULL_AVX)
+        if (hasAvx()) return "AVX";
+#endif
+        return INSTRUCTION_SET;
+    }
+
+    void FrustumCuller::Cull(const StereoFrustum& frustum, const CullingBounds& bounds) {
+        auto start = std::chrono::steady_clock::now();
+        auto count = bounds.GetCount();
+
+        for (auto& visible : _visible) {
+            if (visible.size() < count) visible.resize(count);
+        }
+
+        const BoundsStreams streams {
+            .X = bounds._centreX.data(),
+            .Y = bounds._centreY.data(),
+            .Z = bounds._centreZ.data(),
+            .Radius = bounds._radius.data(),
+            .ExtentX = bounds._extentX.data(),
+            .ExtentY = bounds._extentY.data(),
+            .ExtentZ = bounds._extentZ.data(),
+            .Count = count,
+        };
+
+        CullOutput output {
+            .Visible = {_visible[0].data(), _visible[1].data(), _visible[2].data()},
+        };
+
+#if defined(OZZ_CULL_AVX)
+        if (hasAvx()) {
+            cullAvx(frustum, streams, output);
+        } else {
+            cullDefault(frustum, streams, output);
+        }
+#else
+        cullDefault(frustum, streams, output);
+#endif
+
+        _visibleCounts = output.Counts;
+
+        _stats = CullStats {
+            .Tested = count,
+            .CulledCombined = output.CulledCombined,
+            .VisibleLeft = _visibleCounts[static_cast<size_t>(EyeTarget::Left)],
+            .VisibleRight = _visibleCounts[static_cast<size_t>(EyeTarget::Right)],
+            .Visible = _visibleCounts[static_cast<size_t>(EyeTarget::BOTH)],
+            .Time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start),
+        };
+    }
+}
@@ -0,0 +1,690 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/resources/gpu_scene.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace OZZ {
+
+    static uint32_t groupCount(uint32_t count) {
+        return (count + GpuScene::GROUP_SIZE - 1) / GpuScene::GROUP_SIZE;
+    }
+
+    GpuScene::GpuScene(const ResourceContext& context, MeshPool& meshPool, GpuSceneConfiguration config,
+                       uint32_t frameCount, const DepthPyramid* pyramid, const AssetArchive* archive)
+            : _context(context), _meshPool(&meshPool), _config(std::move(config)), _pyramid(pyramid) {
+        if (!_pyramid) {
+            spdlog::error("GPU scene needs the renderer's depth pyramid");
+            return;
+        }
+
+        createDescriptors(frameCount);
+
+        // Set 1 is the depth pyramids, bound whether or not this frame's cull reads them
+        _cullShader = std::make_unique<ComputeShader>(_context, ComputeShaderConfiguration {
+                .ShaderPath = _config.CullShaderPath,
+                .DescriptorSetLayouts = { _cullSetLayout, _pyramid->GetSampleSetLayout() },
+        }, archive);
+        _compactShader = std::make_unique<ComputeShader>(_context, ComputeShaderConfiguration {
+                .ShaderPath = _config.CompactShaderPath,
+                .DescriptorSetLayouts = { _cullSetLayout },
+        }, archive);
+
+        if (!_config.LateCullShaderPath.empty()) {
+            _lateCullShader = std::make_unique<ComputeShader>(_context, ComputeShaderConfiguration {
+                    .ShaderPath = _config.LateCullShaderPath,
+                    .PushConstants = { PushConstantDefinition(sizeof(uint32_t), VK_SHADER_STAGE_COMPUTE_BIT) },
+                    .DescriptorSetLayouts = { _cullSetLayout, _pyramid->GetSampleSetLayout() },
+            }, archive);
+        }
+
+        auto storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        auto cleared = storage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        auto indirect = cleared | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+        _frames.resize(frameCount);
+        for (auto& frame : _frames) {
+            frame.Objects = createBuffer(sizeof(GpuSceneObject) * _config.MaxObjects, storage, true);
+            frame.Meshes = createBuffer(sizeof(GpuSceneMesh) * _config.MaxMeshes, storage, true);
+            frame.Params = createBuffer(sizeof(GpuCullParams), storage, true);
+            frame.InstanceCounts = createBuffer(sizeof(uint32_t) * _config.MaxMeshes, cleared, false);
+            frame.VisibleObjects = createBuffer(sizeof(uint32_t) * _config.MaxObjects, storage, false);
+            frame.DrawCommands = createBuffer(sizeof(VkDrawIndexedIndirectCommand) * _config.MaxMeshes, indirect, false);
+            frame.DrawCount = createBuffer(sizeof(uint32_t), indirect, false);
+            frame.OcclusionFlags = createBuffer(sizeof(uint32_t) * _config.MaxObjects, storage, false);
+            frame.Stats = createBuffer(sizeof(StatsCounters), cleared, true, true);
+
+            for (auto& late : frame.Late) {
+                late.InstanceCounts = createBuffer(sizeof(uint32_t) * _config.MaxMeshes, cleared, false);
+                late.VisibleObjects = createBuffer(sizeof(uint32_t) * _config.MaxObjects, storage, false);
+                late.DrawCommands = createBuffer(sizeof(VkDrawIndexedIndirectCommand) * _config.MaxMeshes, indirect, false);
+                late.DrawCount = createBuffer(sizeof(uint32_t), indirect, false);
+            }
+        }
+
+        // Every slot's sets exist up front, the pool was sized for them
+        std::vector<VkDescriptorSetLayout> layouts;
+        for (uint32_t i = 0; i < frameCount * SETS_PER_FRAME / 2; i++) {
+            layouts.push_back(_cullSetLayout);
+            layouts.push_back(_drawSetLayout);
+        }
+
+        std::vector<VkDescriptorSet> sets(layouts.size());
+        VkDescriptorSetAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        allocateInfo.descriptorPool = _descriptorPool;
+        allocateInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocateInfo.pSetLayouts = layouts.data();
+
+        if (vkAllocateDescriptorSets(_context.Device, &allocateInfo, sets.data()) != VK_SUCCESS) {
+            spdlog::error("Failed to allocate GPU scene descriptor sets");
+            return;
+        }
+
+        for (uint32_t i = 0; i < frameCount; i++) {
+            auto& frame = _frames[i];
+            auto* frameSets = &sets[i * SETS_PER_FRAME];
+            frame.CullSet = frameSets[0];
+            frame.DrawSet = frameSets[1];
+
+            // In binding order, see cull.comp
+            writeDescriptorSets(frame.CullSet, frame.DrawSet, {
+                &frame.Objects, &frame.Meshes, &frame.Params, &frame.InstanceCounts, &frame.VisibleObjects,
+                &frame.DrawCommands, &frame.DrawCount, &frame.OcclusionFlags, &frame.Stats,
+            });
+
+            // The late passes read what the early one wrote and append to lists of their own, see late_cull.comp
+            for (size_t eye = 0; eye < frame.Late.size(); eye++) {
+                auto& late = frame.Late[eye];
+                late.CullSet = frameSets[2 + eye * 2];
+                late.DrawSet = frameSets[3 + eye * 2];
+
+                writeDescriptorSets(late.CullSet, late.DrawSet, {
+                    &frame.Objects, &frame.Meshes, &frame.Params, &late.InstanceCounts, &late.VisibleObjects,
+                    &late.DrawCommands, &late.DrawCount, &frame.OcclusionFlags, &frame.Stats,
+                });
+            }
+        }
+
+        _objects.reserve(_config.MaxObjects);
+        _objectIds.reserve(_config.MaxObjects);
+        _changedAt.reserve(_config.MaxObjects);
+        _meshes.reserve(_config.MaxMeshes);
+
+        if (!IsValid()) {
+            spdlog::error("GPU scene can't be used on this device");
+        } else if (!_config.LateCullShaderPath.empty() && !(_lateCullShader && _lateCullShader->IsValid())) {
+            spdlog::error("GPU scene late cull shader failed to build, occlusion culling stays off");
+        }
+    }
+
+    GpuScene::~GpuScene() {
+        _cullShader.reset();
+        _compactShader.reset();
+        _lateCullShader.reset();
+
+        std::vector<SceneBuffer> buffers;
+        for (auto& frame : _frames) {
+            std::vector<SceneBuffer*> frameBuffers = {&frame.Objects, &frame.Meshes, &frame.Params, &frame.InstanceCounts,
+                                                      &frame.VisibleObjects, &frame.DrawCommands, &frame.DrawCount,
+                                                      &frame.OcclusionFlags, &frame.Stats};
+            for (auto& late : frame.Late) {
+                frameBuffers.insert(frameBuffers.end(), {&late.InstanceCounts, &late.VisibleObjects, &late.DrawCommands,
+                                                         &late.DrawCount});
+            }
+
+            for (auto* buffer : frameBuffers) {
+                if (buffer->Buffer == VK_NULL_HANDLE) continue;
+                if (_context.Memory) _context.Memory->Untrack(buffer->Allocation);
+                buffers.push_back(*buffer);
+            }
+        }
+
+        // Frames still in flight may be culling into or drawing from any slot
+        _context.Defer([device = _context.Device, allocator = _context.Allocator, buffers = std::move(buffers),
+                        pool = _descriptorPool, cullLayout = _cullSetLayout, drawLayout = _drawSetLayout]() {
+            for (auto& buffer : buffers) {
+                vmaDestroyBuffer(allocator, buffer.Buffer, buffer.Allocation);
+            }
+
+            if (pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(device, pool, nullptr);
+            if (cullLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(device, cullLayout, nullptr);
+            if (drawLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(device, drawLayout, nullptr);
+        });
+    }
+
+    bool GpuScene::IsValid() const {
+        bool firstInstance = _context.Capabilities && _context.Capabilities->DrawIndirectFirstInstance;
+        return firstInstance && _cullShader && _cullShader->IsValid() && _compactShader && _compactShader->IsValid() &&
+               !_frames.empty() && _frames.front().CullSet != VK_NULL_HANDLE;
+    }
+
+    bool GpuScene::IsOcclusionCulling() const {
+        return IsValid() && _lateCullShader && _lateCullShader->IsValid() && _pyramid->CanBuild();
+    }
+
+    SceneMeshHandle GpuScene::AddMesh(const MeshHandle& mesh, glm::vec4 bounds) {
+        if (!mesh.IsValid()) return {};
+
+        if (mesh.IndexType != VK_INDEX_TYPE_UINT16) {
+            spdlog::error("GPU scene meshes need 16-bit indices, the pool's large index buffer isn't bound for indirect draws");
+            return {};
+        }
+
+        uint32_t index;
+        if (!_freeMeshes.empty()) {
+            index = _freeMeshes.back();
+            _freeMeshes.pop_back();
+        } else if (_meshes.size() < _config.MaxMeshes) {
+            index = static_cast<uint32_t>(_meshes.size());
+            _meshes.emplace_back();
+        } else {
+            spdlog::error("GPU scene is out of mesh slots ({})", _config.MaxMeshes);
+            return {};
+        }
+
+        _meshes[index] = MeshEntry {
+            .Mesh = mesh,
+            .Bounds = bounds,
+            .InUse = true,
+            .Ready = _meshPool->IsReady(mesh),
+        };
+
+        if (!_meshes[index].Ready) _pendingMeshes++;
+        _meshVersion++;
+
+        return {index + 1};
+    }
+
+    void GpuScene::RemoveMesh(SceneMeshHandle mesh) {
+        if (!mesh.IsValid() || mesh.Id > _meshes.size() || !_meshes[mesh.Id - 1].InUse) return;
+
+        auto& entry = _meshes[mesh.Id - 1];
+        if (entry.ObjectCount > 0) {
+            spdlog::error("Can't remove a GPU scene mesh that {} objects still use", entry.ObjectCount);
+            return;
+        }
+
+        if (!entry.Ready) _pendingMeshes--;
+        entry = {};
+        _freeMeshes.push_back(mesh.Id - 1);
+        _meshVersion++;
+    }
+
+    SceneObjectHandle GpuScene::AddObject(SceneMeshHandle mesh, const glm::mat4& model, glm::vec4 colour) {
+        if (!mesh.IsValid() || mesh.Id > _meshes.size() || !_meshes[mesh.Id - 1].InUse) {
+            spdlog::error("Adding a GPU scene object with an invalid mesh");
+            return {};
+        }
+
+        if (_objects.size() >= _config.MaxObjects) {
+            spdlog::error("GPU scene is out of object slots ({})", _config.MaxObjects);
+            return {};
+        }
+
+        uint32_t id;
+        if (!_freeObjectIds.empty()) {
+            id = _freeObjectIds.back();
+            _freeObjectIds.pop_back();
+        } else {
+            _objectIndices.push_back(INVALID_INDEX);
+            id = static_cast<uint32_t>(_objectIndices.size());
+        }
+
+        auto index = static_cast<uint32_t>(_objects.size());
+        _objects.push_back(GpuSceneObject {
+            .Model = model,
+            .Colour = colour,
+            .Mesh = mesh.Id - 1,
+        });
+        _objectIds.push_back(id);
+        _changedAt.push_back(UINT64_MAX);
+        _objectIndices[id - 1] = index;
+
+        _meshes[mesh.Id - 1].ObjectCount++;
+        _meshVersion++;
+        markChanged(index);
+
+        return {id};
+    }
+
+    void GpuScene::RemoveObject(SceneObjectHandle object) {
+        auto index = objectIndex(object);
+        if (index == INVALID_INDEX) return;
+
+        _meshes[_objects[index].Mesh].ObjectCount--;
+        _meshVersion++;
+
+        // Swap the last object into the hole, its new position is what the slots need to hear about
+        auto last = static_cast<uint32_t>(_objects.size() - 1);
+        if (index != last) {
+            _objects[index] = _objects[last];
+            _objectIds[index] = _objectIds[last];
+            _objectIndices[_objectIds[index] - 1] = index;
+            markChanged(index);
+        }
+
+        _objects.pop_back();
+        _objectIds.pop_back();
+        _changedAt.pop_back();
+
+        _objectIndices[object.Id - 1] = INVALID_INDEX;
+        _freeObjectIds.push_back(object.Id);
+    }
+
+    void GpuScene::SetTransform(SceneObjectHandle object, const glm::mat4& model) {
+        auto index = objectIndex(object);
+        if (index == INVALID_INDEX) return;
+
+        _objects[index].Model = model;
+        markChanged(index);
+    }
+
+    void GpuScene::SetColour(SceneObjectHandle object, glm::vec4 colour) {
+        auto index = objectIndex(object);
+        if (index == INVALID_INDEX) return;
+
+        _objects[index].Colour = colour;
+        markChanged(index);
+    }
+
+    void GpuScene::Cull(VkCommandBuffer commandBuffer, const StereoFrustum& frustum) {
+        if (!IsValid()) return;
+
+        auto& frame = _frames[_context.Clock->Slot.load() % _frames.size()];
+
+        updateMeshReadiness();
+        syncObjects(frame);
+        syncMeshes(frame);
+        trimChanges();
+
+        // The slot's last cull has retired, its counters are about to be cleared
+        readStats(frame);
+
+        auto objectCount = static_cast<uint32_t>(_objects.size());
+        auto meshCount = static_cast<uint32_t>(_meshes.size());
+        // Last frame's depth is only worth testing against once both eyes have some
+        bool occlusion = IsOcclusionCulling() && _pyramid->IsReady();
+
+        auto* params = reinterpret_cast<GpuCullParams*>(frame.Params.Mapped);
+        for (uint32_t view = 0; view < GpuCullParams::MAX_VIEWS; view++) {
+            std::copy(frustum.Eyes[view].Planes.begin(), frustum.Eyes[view].Planes.end(),
+                      params->Planes.begin() + view * GpuCullParams::PLANES_PER_VIEW);
+
+            auto eye = static_cast<EyeTarget>(view);
+            params->ViewProjections[view] = _pyramid->GetViewProjection(eye);
+            params->PreviousViewProjections[view] = _pyramid->GetBuiltViewProjection(eye);
+        }
+        params->ObjectCount = objectCount;
+        params->MeshCount = meshCount;
+        params->DepthSize = {_pyramid->GetDepthExtent().width, _pyramid->GetDepthExtent().height};
+        params->PyramidLevels = _pyramid->GetLevelCount();
+        params->Occlusion = occlusion ? 1 : 0;
+        vmaFlushAllocation(_context.Allocator, frame.Params.Allocation, 0, VK_WHOLE_SIZE);
+
+        _cullSerial++;
+        _culledFrame = _context.Clock->FrameNumber.load();
+        _culledMeshCount = meshCount;
+        _culledWithOcclusion = occlusion && objectCount > 0;
+        frame.CulledObjects = objectCount;
+        frame.StatsPending = true;
+
+        // Visible counts and the draw count start from zero. Without a GPU draw count every mesh's command
+        // is drawn, the ones compaction doesn't reach have to be zero instance draws.
+        vkCmdFillBuffer(commandBuffer, frame.InstanceCounts.Buffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(commandBuffer, frame.DrawCount.Buffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(commandBuffer, frame.Stats.Buffer, 0, VK_WHOLE_SIZE, 0);
+        if (!_context.Capabilities->DrawIndirectCount) {
+            vkCmdFillBuffer(commandBuffer, frame.DrawCommands.Buffer, 0, VK_WHOLE_SIZE, 0);
+        }
+
+        // The late lists too, a late pass that finds nothing still draws from them
+        if (_culledWithOcclusion) {
+            for (auto& late : frame.Late) {
+                vkCmdFillBuffer(commandBuffer, late.InstanceCounts.Buffer, 0, VK_WHOLE_SIZE, 0);
+                vkCmdFillBuffer(commandBuffer, late.DrawCount.Buffer, 0, VK_WHOLE_SIZE, 0);
+                if (!_context.Capabilities->DrawIndirectCount) {
+                    vkCmdFillBuffer(commandBuffer, late.DrawCommands.Buffer, 0, VK_WHOLE_SIZE, 0);
+                }
+            }
+        }
+
+        VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                             1, &barrier, 0, nullptr, 0, nullptr);
+
+        if (objectCount > 0) {
+            _cullShader->Bind(commandBuffer);
+            _cullShader->BindDescriptorSet(commandBuffer, frame.CullSet);
+            _cullShader->BindDescriptorSet(commandBuffer, _pyramid->GetSampleSet(), 1);
+            vkCmdDispatch(commandBuffer, groupCount(objectCount), 1, 1);
+
+            // Compaction reads the visible counts the cull pass accumulated
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+            _compactShader->Bind(commandBuffer);
+            _compactShader->BindDescriptorSet(commandBuffer, frame.CullSet);
+            vkCmdDispatch(commandBuffer, groupCount(meshCount), 1, 1);
+        }
+
+        // Later submissions on the queue are covered too, so both eyes see the results. The host reads the
+        // stats once the slot's fences have signalled.
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    void GpuScene::Draw(VkCommandBuffer commandBuffer, const Shader& shader, uint32_t set) const {
+        CommandEncoder encoder(commandBuffer);
+        Draw(encoder, shader, set);
+    }
+
+    void GpuScene::Draw(CommandEncoder& encoder, const Shader& shader, uint32_t set) const {
+        // Without this frame's cull the slot's commands are left over from an older frame
+        if (_culledFrame != _context.Clock->FrameNumber.load() || _culledMeshCount == 0) return;
+
+        const auto& frame = _frames[_context.Clock->Slot.load() % _frames.size()];
+        drawIndirect(encoder, shader, set, frame.DrawSet, frame.DrawCommands, frame.DrawCount);
+    }
+
+    void GpuScene::CullLate(VkCommandBuffer commandBuffer, EyeTarget eye) {
+        if (eye == EyeTarget::BOTH) {
+            spdlog::error("GPU scene late culls are per eye, each against its own depth");
+            return;
+        }
+
+        auto frameNumber = _context.Clock->FrameNumber.load();
+        if (!_culledWithOcclusion || _culledFrame != frameNumber) return;
+
+        auto& frame = _frames[_context.Clock->Slot.load() % _frames.size()];
+        auto& late = frame.Late[static_cast<size_t>(eye)];
+
+        // The early pass's flags and the cleared late lists, recorded into an earlier submit on the same queue
+        VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        _lateCullShader->Bind(commandBuffer);
+        _lateCullShader->BindDescriptorSet(commandBuffer, late.CullSet);
+        _lateCullShader->BindDescriptorSet(commandBuffer, _pyramid->GetSampleSet(), 1);
+        _lateCullShader->YeetPushConstants(commandBuffer, static_cast<uint32_t>(eye));
+        vkCmdDispatch(commandBuffer, groupCount(frame.CulledObjects), 1, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        // The early pass's compaction, over the eye's late counts
+        _compactShader->Bind(commandBuffer);
+        _compactShader->BindDescriptorSet(commandBuffer, late.CullSet);
+        vkCmdDispatch(commandBuffer, groupCount(_culledMeshCount), 1, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        late.CulledFrame = frameNumber;
+    }
+
+    void GpuScene::DrawLate(CommandEncoder& encoder, const Shader& shader, EyeTarget eye, uint32_t set) const {
+        if (eye == EyeTarget::BOTH || _culledMeshCount == 0) return;
+
+        const auto& frame = _frames[_context.Clock->Slot.load() % _frames.size()];
+        const auto& late = frame.Late[static_cast<size_t>(eye)];
+        if (late.CulledFrame != _context.Clock->FrameNumber.load()) return;
+
+        drawIndirect(encoder, shader, set, late.DrawSet, late.DrawCommands, late.DrawCount);
+    }
+
+    void GpuScene::drawIndirect(CommandEncoder& encoder, const Shader& shader, uint32_t set, VkDescriptorSet drawSet,
+                                const SceneBuffer& commands, const SceneBuffer& count) const {
+        encoder.BindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, shader.GetPipelineLayout(), set, drawSet);
+
+        constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        const auto& capabilities = *_context.Capabilities;
+
+        if (capabilities.DrawIndirectCount) {
+            encoder.DrawIndexedIndirectCount(commands.Buffer, 0, count.Buffer, 0, _culledMeshCount, stride);
+        } else if (capabilities.MultiDrawIndirect) {
+            // Compacted commands first, zero instance ones after
+            encoder.DrawIndexedIndirect(commands.Buffer, 0, _culledMeshCount, stride);
+        } else {
+            for (uint32_t i = 0; i < _culledMeshCount; i++) {
+                encoder.DrawIndexedIndirect(commands.Buffer, VkDeviceSize{i} * stride, 1, stride);
+            }
+        }
+    }
+
+    void GpuScene::readStats(FrameResources& frame) {
+        if (!frame.StatsPending) return;
+
+        StatsCounters counters{};
+        vmaInvalidateAllocation(_context.Allocator, frame.Stats.Allocation, 0, VK_WHOLE_SIZE);
+        std::memcpy(&counters, frame.Stats.Mapped, sizeof(counters));
+
+        _cullStats = GpuCullStats {
+            .Objects = frame.CulledObjects,
+            .Occluded = counters.Occluded,
+            .Recovered = counters.Recovered,
+        };
+        frame.StatsPending = false;
+    }
+
+    GpuScene::SceneBuffer GpuScene::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible,
+                                                 bool readback) {
+        VkBufferCreateInfo bufferCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bufferCreateInfo.size = size;
+        bufferCreateInfo.usage = usage;
+
+        VmaAllocationCreateInfo allocationCreateInfo{};
+        allocationCreateInfo.usage = hostVisible ? (readback ? VMA_MEMORY_USAGE_GPU_TO_CPU : VMA_MEMORY_USAGE_CPU_TO_GPU)
+                                                 : VMA_MEMORY_USAGE_GPU_ONLY;
+        allocationCreateInfo.flags = hostVisible ? VMA_ALLOCATION_CREATE_MAPPED_BIT : 0;
+
+        SceneBuffer buffer{};
+        VmaAllocationInfo allocationInfo{};
+        if (vmaCreateBuffer(_context.Allocator, &bufferCreateInfo, &allocationCreateInfo, &buffer.Buffer,
+                            &buffer.Allocation, &allocationInfo) != VK_SUCCESS) {
+            spdlog::error("Failed to create GPU scene buffer of {} bytes", size);
+            return {};
+        }
+
+        buffer.Mapped = static_cast<std::byte*>(allocationInfo.pMappedData);
+        buffer.Size = size;
+        _context.Track(buffer.Allocation, MemoryCategoryForBufferUsage(usage));
+        return buffer;
+    }
+
+    void GpuScene::createDescriptors(uint32_t frameCount) {
+        std::array<VkDescriptorSetLayoutBinding, CULL_BINDING_COUNT> cullBindings{};
+        for (uint32_t i = 0; i < CULL_BINDING_COUNT; i++) {
+            cullBindings[i].binding = i;
+            cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            cullBindings[i].descriptorCount = 1;
+            cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+        layoutCreateInfo.bindingCount = CULL_BINDING_COUNT;
+        layoutCreateInfo.pBindings = cullBindings.data();
+
+        if (vkCreateDescriptorSetLayout(_context.Device, &layoutCreateInfo, nullptr, &_cullSetLayout) != VK_SUCCESS) {
+            spdlog::error("Failed to create GPU scene cull descriptor set layout");
+            return;
+        }
+
+        // Objects and visible objects, vertex shaders look up their object through gl_InstanceIndex
+        VkDescriptorSetLayoutBinding drawBindings[2]{};
+        for (uint32_t i = 0; i < 2; i++) {
+            drawBindings[i].binding = i;
+            drawBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            drawBindings[i].descriptorCount = 1;
+            drawBindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        }
+
+        layoutCreateInfo.bindingCount = 2;
+        layoutCreateInfo.pBindings = drawBindings;
+
+        if (vkCreateDescriptorSetLayout(_context.Device, &layoutCreateInfo, nullptr, &_drawSetLayout) != VK_SUCCESS) {
+            spdlog::error("Failed to create GPU scene draw descriptor set layout");
+            return;
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, (CULL_BINDING_COUNT + 2) * SETS_PER_FRAME / 2 * frameCount};
+
+        VkDescriptorPoolCreateInfo poolCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+        poolCreateInfo.maxSets = SETS_PER_FRAME * frameCount;
+        poolCreateInfo.poolSizeCount = 1;
+        poolCreateInfo.pPoolSizes = &poolSize;
+
+        if (vkCreateDescriptorPool(_context.Device, &poolCreateInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+            spdlog::error("Failed to create GPU scene descriptor pool");
+        }
+    }
+
+    void GpuScene::writeDescriptorSets(VkDescriptorSet cullSet, VkDescriptorSet drawSet,
+                                       const std::array<const SceneBuffer*, CULL_BINDING_COUNT>& buffers) {
+        std::array<VkDescriptorBufferInfo, CULL_BINDING_COUNT> bufferInfos{};
+        std::array<VkWriteDescriptorSet, CULL_BINDING_COUNT + 2> writes{};
+
+        for (uint32_t binding = 0; binding < CULL_BINDING_COUNT; binding++) {
+            bufferInfos[binding] = {buffers[binding]->Buffer, 0, VK_WHOLE_SIZE};
+
+            auto& write = writes[binding];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = cullSet;
+            write.dstBinding = binding;
+            write.descriptorCount = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.pBufferInfo = &bufferInfos[binding];
+        }
+
+        // The draw set is the objects and the visible list, the same buffers the cull set binds at 0 and 4
+        writes[CULL_BINDING_COUNT] = writes[0];
+        writes[CULL_BINDING_COUNT].dstSet = drawSet;
+        writes[CULL_BINDING_COUNT].dstBinding = 0;
+        writes[CULL_BINDING_COUNT + 1] = writes[4];
+        writes[CULL_BINDING_COUNT + 1].dstSet = drawSet;
+        writes[CULL_BINDING_COUNT + 1].dstBinding = 1;
+
+        vkUpdateDescriptorSets(_context.Device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    void GpuScene::markChanged(uint32_t index) {
+        if (_changedAt[index] == _cullSerial) return;
+
+        _changedAt[index] = _cullSerial;
+        _changes.push_back(index);
+    }
+
+    uint32_t GpuScene::objectIndex(SceneObjectHandle object) const {
+        if (!object.IsValid() || object.Id > _objectIndices.size()) return INVALID_INDEX;
+        return _objectIndices[object.Id - 1];
+    }
+
+    void GpuScene::updateMeshReadiness() {
+        if (_pendingMeshes == 0) return;
+
+        for (auto& mesh : _meshes) {
+            if (mesh.InUse && !mesh.Ready && _meshPool->IsReady(mesh.Mesh)) {
+                mesh.Ready = true;
+                _pendingMeshes--;
+                _meshVersion++;
+            }
+        }
+    }
+
+    void GpuScene::syncObjects(FrameResources& frame) {
+        auto* objects = reinterpret_cast<GpuSceneObject*>(frame.Objects.Mapped);
+        auto changesEnd = _changeBase + _changes.size();
+
+        if (!frame.Synced) {
+            if (!_objects.empty()) {
+                std::memcpy(objects, _objects.data(), _objects.size() * sizeof(GpuSceneObject));
+                vmaFlushAllocation(_context.Allocator, frame.Objects.Allocation, 0,
+                                   _objects.size() * sizeof(GpuSceneObject));
+            }
+            frame.Synced = true;
+            frame.SyncedChanges = changesEnd;
+            return;
+        }
+
+        auto objectCount = static_cast<uint32_t>(_objects.size());
+        uint32_t first = UINT32_MAX;
+        uint32_t last = 0;
+
+        for (auto i = frame.SyncedChanges - _changeBase; i < _changes.size(); i++) {
+            auto index = _changes[i];
+            // Swap-removed since it was logged
+            if (index >= objectCount) continue;
+
+            objects[index] = _objects[index];
+            first = std::min(first, index);
+            last = std::max(last, index);
+        }
+
+        if (first <= last) {
+            vmaFlushAllocation(_context.Allocator, frame.Objects.Allocation, VkDeviceSize{first} * sizeof(GpuSceneObject),
+                               VkDeviceSize{last - first + 1} * sizeof(GpuSceneObject));
+        }
+        frame.SyncedChanges = changesEnd;
+    }
+
+    void GpuScene::syncMeshes(FrameResources& frame) {
+        if (frame.MeshVersion == _meshVersion) return;
+
+        // Each mesh's visible objects get a range as long as its object count, in mesh order
+        auto* meshes = reinterpret_cast<GpuSceneMesh*>(frame.Meshes.Mapped);
+        uint32_t instanceBase = 0;
+
+        for (size_t i = 0; i < _meshes.size(); i++) {
+            const auto& entry = _meshes[i];
+            bool drawable = entry.InUse && entry.Ready;
+
+            meshes[i] = GpuSceneMesh {
+                .IndexCount = drawable ? entry.Mesh.IndexCount : 0,
+                .FirstIndex = entry.Mesh.FirstIndex,
+                .VertexOffset = entry.Mesh.VertexOffset,
+                .InstanceBase = instanceBase,
+                .Bounds = entry.Bounds,
+            };
+            instanceBase += entry.ObjectCount;
+        }
+
+        vmaFlushAllocation(_context.Allocator, frame.Meshes.Allocation, 0, _meshes.size() * sizeof(GpuSceneMesh));
+        frame.MeshVersion = _meshVersion;
+    }
+
+    void GpuScene::trimChanges() {
+        auto changesEnd = _changeBase + _changes.size();
+        auto oldest = changesEnd;
+
+        for (auto& frame : _frames) {
+            if (!frame.Synced) continue;
+
+            // A slot that fell this far behind is cheaper to rewrite in full when it next comes round
+            if (changesEnd - frame.SyncedChanges > _objects.size()) {
+                frame.Synced = false;
+                continue;
+            }
+            oldest = std::min(oldest, frame.SyncedChanges);
+        }
+
+        _changes.erase(_changes.begin(), _changes.begin() + static_cast<std::ptrdiff_t>(oldest - _changeBase));
+        _changeBase = oldest;
+    }
+}
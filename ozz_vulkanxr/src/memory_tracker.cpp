@@ -0,0 +1,179 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/memory_tracker.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstdint>
+
+namespace OZZ {
+
+    namespace {
+        // User data holds category + 1, so untagged allocations (null) can be told apart
+        void* encodeCategory(MemoryCategory category) {
+            return reinterpret_cast<void*>(static_cast<uintptr_t>(category) + 1);
+        }
+
+        bool decodeCategory(void* userData, MemoryCategory& category) {
+            auto value = reinterpret_cast<uintptr_t>(userData);
+            if (value == 0 || value > static_cast<uintptr_t>(MemoryCategory::Count)) return false;
+            category = static_cast<MemoryCategory>(value - 1);
+            return true;
+        }
+    }
+
+    const char* MemoryCategoryName(MemoryCategory category) {
+        switch (category) {
+            case MemoryCategory::Depth: return "Depth";
+            case MemoryCategory::Vertex: return "Vertex";
+            case MemoryCategory::Index: return "Index";
+            case MemoryCategory::Staging: return "Staging";
+            case MemoryCategory::Uniform: return "Uniform";
+            case MemoryCategory::Texture: return "Texture";
+            default: return "Unknown";
+        }
+    }
+
+    MemoryCategory MemoryCategoryForBufferUsage(VkBufferUsageFlags usage) {
+        if ((usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) != 0u) return MemoryCategory::Vertex;
+        if ((usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) != 0u) return MemoryCategory::Index;
+        if ((usage & (VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) != 0u) {
+            return MemoryCategory::Uniform;
+        }
+        return MemoryCategory::Staging;
+    }
+
+    MemoryTracker::MemoryTracker(VkPhysicalDevice physicalDevice, VmaAllocator allocator, bool budgetSupported)
+            : _allocator(allocator), _budgetSupported(budgetSupported) {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memoryProperties);
+        _heapLevels.resize(_memoryProperties.memoryHeapCount, 0);
+    }
+
+    void MemoryTracker::Track(VmaAllocation allocation, MemoryCategory category) {
+        if (allocation == VK_NULL_HANDLE) return;
+
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(_allocator, allocation, &info);
+        vmaSetAllocationUserData(_allocator, allocation, encodeCategory(category));
+
+        auto& stats = _categories[static_cast<size_t>(category)];
+        stats.Bytes += info.size;
+        stats.Allocations++;
+    }
+
+    void MemoryTracker::Untrack(VmaAllocation allocation) {
+        if (allocation == VK_NULL_HANDLE) return;
+
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(_allocator, allocation, &info);
+
+        MemoryCategory category;
+        if (!decodeCategory(info.pUserData, category)) return;
+
+        auto& stats = _categories[static_cast<size_t>(category)];
+        stats.Bytes -= info.size;
+        stats.Allocations--;
+        vmaSetAllocationUserData(_allocator, allocation, nullptr);
+    }
+
+    void MemoryTracker::BeginFrame(uint64_t frameNumber) {
+        // VMA only refetches budgets from the driver when the frame index moves on
+        vmaSetCurrentFrameIndex(_allocator, static_cast<uint32_t>(frameNumber));
+
+        // The callback runs after the lock is released, so it's free to call back into the tracker
+        MemoryBudgetCallback callback;
+        std::vector<MemoryBudgetEvent> events;
+        {
+            std::lock_guard lock(_callbackMutex);
+            if (!_callback || _thresholds.empty()) return;
+
+            // Checked every frame, so straight off the stack rather than through getHeapBudgets
+            std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+            vmaGetHeapBudgets(_allocator, budgets.data());
+
+            for (uint32_t i = 0; i < _memoryProperties.memoryHeapCount; i++) {
+                auto heap = makeHeapBudget(i, budgets[i]);
+                auto fraction = heap.GetUsageFraction();
+                auto level = static_cast<size_t>(std::upper_bound(_thresholds.begin(), _thresholds.end(), fraction) -
+                                                 _thresholds.begin());
+
+                auto& previous = _heapLevels[heap.Heap];
+                if (level == previous) continue;
+
+                bool rising = level > previous;
+                // Report the threshold that was crossed last, the highest one going up and the lowest one coming down
+                auto threshold = rising ? _thresholds[level - 1] : _thresholds[level];
+                previous = level;
+
+                if (rising) {
+                    spdlog::warn("Memory heap {} is at {:.0f}% of its budget ({} / {} bytes)", heap.Heap,
+                                 fraction * 100.f, heap.Usage, heap.Budget);
+                }
+
+                events.push_back(MemoryBudgetEvent {
+                    .Heap = heap,
+                    .Threshold = threshold,
+                    .Rising = rising,
+                });
+            }
+
+            if (events.empty()) return;
+            callback = _callback;
+        }
+
+        for (const auto& event : events) {
+            callback(event);
+        }
+    }
+
+    void MemoryTracker::SetBudgetCallback(std::vector<float> thresholds, MemoryBudgetCallback callback) {
+        std::sort(thresholds.begin(), thresholds.end());
+
+        std::lock_guard lock(_callbackMutex);
+        _thresholds = std::move(thresholds);
+        _callback = std::move(callback);
+        // Start over so heaps already past a threshold are reported against the new ones
+        std::fill(_heapLevels.begin(), _heapLevels.end(), 0);
+    }
+
+    MemoryStats MemoryTracker::GetStats() const {
+        MemoryStats stats {
+            .Heaps = getHeapBudgets(),
+            .BudgetSupported = _budgetSupported,
+        };
+
+        for (size_t i = 0; i < _categories.size(); i++) {
+            stats.Categories[i] = MemoryCategoryStats {
+                .Bytes = _categories[i].Bytes.load(),
+                .Allocations = _categories[i].Allocations.load(),
+            };
+        }
+
+        return stats;
+    }
+
+    std::vector<HeapBudget> MemoryTracker::getHeapBudgets() const {
+        std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+        vmaGetHeapBudgets(_allocator, budgets.data());
+
+        std::vector<HeapBudget> heaps;
+        heaps.reserve(_memoryProperties.memoryHeapCount);
+
+        for (uint32_t i = 0; i < _memoryProperties.memoryHeapCount; i++) {
+            heaps.push_back(makeHeapBudget(i, budgets[i]));
+        }
+
+        return heaps;
+    }
+
+    HeapBudget MemoryTracker::makeHeapBudget(uint32_t heap, const VmaBudget& budget) const {
+        return HeapBudget {
+            .Heap = heap,
+            .DeviceLocal = (_memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0u,
+            .Usage = budget.usage,
+            .Budget = budget.budget,
+            .AllocatorBytes = budget.statistics.blockBytes,
+        };
+    }
+}
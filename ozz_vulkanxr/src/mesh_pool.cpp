@@ -0,0 +1,344 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <spdlog/spdlog.h>
+#include <bit>
+#include <cstring>
+#include "ozz_vulkan/resources/mesh_pool.h"
+
+namespace {
+    VmaVirtualBlock createVirtualBlock(VkDeviceSize size) {
+        VmaVirtualBlockCreateInfo blockCreateInfo{};
+        blockCreateInfo.size = size;
+
+        VmaVirtualBlock block{VK_NULL_HANDLE};
+        if (vmaCreateVirtualBlock(&blockCreateInfo, &block) != VK_SUCCESS) {
+            spdlog::error("Failed to create mesh pool virtual block");
+        }
+        return block;
+    }
+
+    VkBuffer createPoolBuffer(const OZZ::ResourceContext& context, VkBufferUsageFlags usage, VkDeviceSize size,
+                              VmaAllocation* allocation) {
+        VkBufferCreateInfo bufferCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bufferCreateInfo.size = size;
+        bufferCreateInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        context.Uploads->ApplySharingMode(bufferCreateInfo);
+
+        VmaAllocationCreateInfo allocationCreateInfo{};
+        allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+        VkBuffer buffer{VK_NULL_HANDLE};
+        if (vmaCreateBuffer(context.Allocator, &bufferCreateInfo, &allocationCreateInfo, &buffer, allocation, nullptr) != VK_SUCCESS) {
+            spdlog::error("Failed to create mesh pool buffer of {} bytes", size);
+            return VK_NULL_HANDLE;
+        }
+        context.Track(*allocation, OZZ::MemoryCategoryForBufferUsage(usage));
+        return buffer;
+    }
+
+    constexpr uint64_t HASH_MULTIPLIER_LOW = 0x87c37b91114253d5ull;
+    constexpr uint64_t HASH_MULTIPLIER_HIGH = 0x4cf5ad432745937full;
+
+    // MurmurHash3's 64-bit finalizer
+    uint64_t mixHash(uint64_t value) {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdull;
+        value ^= value >> 33;
+        value *= 0xc4ceb9fe1a85ec53ull;
+        value ^= value >> 33;
+        return value;
+    }
+
+    void hashWord(uint64_t& low, uint64_t& high, uint64_t word) {
+        low = std::rotl(low ^ (word * HASH_MULTIPLIER_LOW), 31) * HASH_MULTIPLIER_HIGH;
+        high = std::rotl(high ^ (word * HASH_MULTIPLIER_HIGH), 33) * HASH_MULTIPLIER_LOW + low;
+    }
+
+    // Eight bytes at a time into two lanes mixed differently, the last word is zero padded
+    void hashBytes(uint64_t& low, uint64_t& high, const void* data, size_t size) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            hashWord(low, high, word);
+        }
+
+        uint64_t tail = 0;
+        std::memcpy(&tail, bytes + i, size - i);
+        hashWord(low, high, tail);
+        // Tells apart inputs that only differ in trailing zeros
+        hashWord(low, high, size);
+    }
+}
+
+OZZ::MeshPool::MeshPool(const ResourceContext& context, uint32_t vertexStride, uint32_t vertexCapacity,
+                        uint32_t indexCapacity) : _context(context), _vertexStride(vertexStride) {
+    _vertexBuffer = createPoolBuffer(context, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                     VkDeviceSize{vertexCapacity} * vertexStride, &_vertexAllocation);
+
+    // Virtual blocks count elements rather than bytes, offsets come back as vertexOffset / firstIndex
+    _vertexBlock = createVirtualBlock(vertexCapacity);
+    _indices16 = createIndexStorage(VK_INDEX_TYPE_UINT16, indexCapacity);
+    // Up front rather than on first use, Draw() reads its buffer without taking the lock
+    _indices32 = createIndexStorage(VK_INDEX_TYPE_UINT32, DEFAULT_LARGE_INDEX_CAPACITY);
+
+    spdlog::trace("Created mesh pool with room for {} {} byte vertices and {} indices", vertexCapacity, vertexStride, indexCapacity);
+}
+
+OZZ::MeshPool::~MeshPool() {
+    if (!_entries.empty()) {
+        spdlog::warn("Destroying mesh pool with {} meshes still alive", _entries.size());
+    }
+
+    // The transfer queue may still be writing into the pool
+    for (auto& [id, entry] : _entries) {
+        _context.Uploads->Wait(entry.Handle.UploadValue);
+    }
+
+    if (_vertexBlock != VK_NULL_HANDLE) {
+        vmaClearVirtualBlock(_vertexBlock);
+        vmaDestroyVirtualBlock(_vertexBlock);
+    }
+
+    if (_vertexBuffer != VK_NULL_HANDLE) {
+        if (_context.Memory) _context.Memory->Untrack(_vertexAllocation);
+        vmaDestroyBuffer(_context.Allocator, _vertexBuffer, _vertexAllocation);
+    }
+
+    destroyIndexStorage(_indices16);
+    destroyIndexStorage(_indices32);
+}
+
+OZZ::MeshHandle OZZ::MeshPool::add(const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount,
+                                   VkIndexType indexType, bool narrowIndices) {
+    if (vertexCount == 0 || indexCount == 0) {
+        spdlog::error("Can't add an empty mesh to the mesh pool");
+        return {};
+    }
+
+    // Hashed as handed over, narrowing happens on the way into staging
+    auto vertexBytes = size_t{vertexCount} * _vertexStride;
+    auto indexBytes = size_t{indexCount} * IndexSize(narrowIndices ? VK_INDEX_TYPE_UINT32 : indexType);
+    auto hash = hashMesh(vertices, vertexCount, indices, indexCount, narrowIndices ? VK_INDEX_TYPE_UINT32 : indexType);
+
+    std::lock_guard lock(_mutex);
+
+    if (auto it = _entriesByHash.find(hash); it != _entriesByHash.end()) {
+        auto& entry = _entries.at(it->second);
+        if (entry.Handle.VertexCount == vertexCount && entry.Handle.IndexCount == indexCount &&
+            entry.Handle.IndexType == indexType) {
+            entry.References++;
+            return entry.Handle;
+        }
+    }
+
+    auto indexOffset = stagingIndexOffset(vertexCount);
+    auto write = _context.Uploads->BeginStagingWrite(indexOffset + VkDeviceSize{indexCount} * IndexSize(indexType));
+    if (!write.IsValid()) {
+        spdlog::error("Failed to reserve staging memory for a mesh of {} vertices", vertexCount);
+        return {};
+    }
+
+    std::memcpy(write.Data, vertices, vertexBytes);
+    if (narrowIndices) {
+        NarrowIndices({static_cast<const uint32_t*>(indices), indexCount},
+                      reinterpret_cast<uint16_t*>(write.Data + indexOffset));
+    } else {
+        std::memcpy(write.Data + indexOffset, indices, indexBytes);
+    }
+
+    return commit(write, vertexCount, indexCount, indexType, hash);
+}
+
+OZZ::MeshHandle OZZ::MeshPool::addBuilt(StagingWrite& write, uint32_t vertexCount, uint32_t indexCount,
+                                        VkIndexType indexType) {
+    std::lock_guard lock(_mutex);
+    return commit(write, vertexCount, indexCount, indexType, std::nullopt);
+}
+
+OZZ::MeshHandle OZZ::MeshPool::commit(StagingWrite& write, uint32_t vertexCount, uint32_t indexCount,
+                                      VkIndexType indexType, std::optional<ContentHash> hash) {
+    Entry entry {
+        .Hash = hash.value_or(ContentHash{}),
+        .References = 1,
+    };
+
+    VmaVirtualAllocationCreateInfo vertexAllocationInfo{};
+    vertexAllocationInfo.size = vertexCount;
+
+    VkDeviceSize vertexOffset = 0;
+    if (vmaVirtualAllocate(_vertexBlock, &vertexAllocationInfo, &entry.VertexAllocation, &vertexOffset) != VK_SUCCESS) {
+        spdlog::error("Mesh pool is out of vertex space ({} vertices requested)", vertexCount);
+        _context.Uploads->CancelStagingWrite(write);
+        return {};
+    }
+
+    auto& indexStorage = getIndexStorage(indexType);
+
+    VmaVirtualAllocationCreateInfo indexAllocationInfo{};
+    indexAllocationInfo.size = indexCount;
+
+    VkDeviceSize firstIndex = 0;
+    if (vmaVirtualAllocate(indexStorage.Block, &indexAllocationInfo, &entry.IndexAllocation, &firstIndex) != VK_SUCCESS) {
+        spdlog::error("Mesh pool is out of index space ({} indices requested)", indexCount);
+        vmaVirtualFree(_vertexBlock, entry.VertexAllocation);
+        _context.Uploads->CancelStagingWrite(write);
+        return {};
+    }
+
+    auto indexSize = IndexSize(indexType);
+
+    // Both streams in one submit
+    StagingCopy copies[2] = {
+        {
+            .SrcOffset = 0,
+            .Dst = _vertexBuffer,
+            .DstOffset = vertexOffset * _vertexStride,
+            .Size = VkDeviceSize{vertexCount} * _vertexStride,
+        },
+        {
+            .SrcOffset = stagingIndexOffset(vertexCount),
+            .Dst = indexStorage.Buffer,
+            .DstOffset = firstIndex * indexSize,
+            .Size = VkDeviceSize{indexCount} * indexSize,
+        },
+    };
+    auto uploadValue = _context.Uploads->SubmitStagingWrite(write, copies);
+
+    entry.Handle = MeshHandle {
+        .Id = _nextId++,
+        .VertexOffset = static_cast<int32_t>(vertexOffset),
+        .VertexCount = vertexCount,
+        .FirstIndex = static_cast<uint32_t>(firstIndex),
+        .IndexCount = indexCount,
+        .IndexType = indexType,
+        .UploadValue = uploadValue,
+    };
+
+    if (hash.has_value()) {
+        _entriesByHash[*hash] = entry.Handle.Id;
+    }
+    auto handle = entry.Handle;
+    _entries.emplace(handle.Id, entry);
+
+    return handle;
+}
+
+VkDeviceSize OZZ::MeshPool::stagingIndexOffset(uint32_t vertexCount) const {
+    // Staging writes start 16 byte aligned, keep the indices on a boundary of their own
+    return (VkDeviceSize{vertexCount} * _vertexStride + 15) & ~VkDeviceSize{15};
+}
+
+void OZZ::MeshPool::Release(const MeshHandle& mesh) {
+    if (!mesh.IsValid()) return;
+
+    std::function<void()> freeRanges;
+    {
+        std::lock_guard lock(_mutex);
+
+        auto it = _entries.find(mesh.Id);
+        if (it == _entries.end()) {
+            spdlog::error("Releasing unknown mesh {}", mesh.Id);
+            return;
+        }
+
+        auto& entry = it->second;
+        if (--entry.References > 0) return;
+
+        freeRanges = [this, uploadValue = entry.Handle.UploadValue, vertexAllocation = entry.VertexAllocation,
+                      indexBlock = getIndexStorage(entry.Handle.IndexType).Block, indexAllocation = entry.IndexAllocation]() {
+            // The ranges are about to be handed out again, the old upload has to be done writing them
+            _context.Uploads->Wait(uploadValue);
+
+            std::lock_guard lock(_mutex);
+            vmaVirtualFree(_vertexBlock, vertexAllocation);
+            vmaVirtualFree(indexBlock, indexAllocation);
+        };
+
+        if (auto byHash = _entriesByHash.find(entry.Hash); byHash != _entriesByHash.end() && byHash->second == mesh.Id) {
+            _entriesByHash.erase(byHash);
+        }
+        _entries.erase(it);
+    }
+
+    // The handle is gone right away, but the ranges stay reserved until no frame in flight can draw from them.
+    // Deferred outside the lock since Defer runs it on the spot when there's no deletion queue
+    _context.Defer(std::move(freeRanges));
+}
+
+void OZZ::MeshPool::Bind(VkCommandBuffer commandBuffer) const {
+    CommandEncoder encoder(commandBuffer);
+    Bind(encoder);
+}
+
+void OZZ::MeshPool::Bind(CommandEncoder& encoder) const {
+    encoder.BindVertexBuffer(0, _vertexBuffer);
+    encoder.BindIndexBuffer(_indices16.Buffer, 0, VK_INDEX_TYPE_UINT16);
+}
+
+void OZZ::MeshPool::Draw(VkCommandBuffer commandBuffer, const MeshHandle& mesh, uint32_t instanceCount,
+                         uint32_t firstInstance) const {
+    CommandEncoder encoder(commandBuffer);
+    Draw(encoder, mesh, instanceCount, firstInstance);
+}
+
+void OZZ::MeshPool::Draw(CommandEncoder& encoder, const MeshHandle& mesh, uint32_t instanceCount,
+                         uint32_t firstInstance) const {
+    if (mesh.IndexType == VK_INDEX_TYPE_UINT16) {
+        encoder.DrawIndexed(mesh.IndexCount, instanceCount, mesh.FirstIndex, mesh.VertexOffset, firstInstance);
+        return;
+    }
+
+    // Large meshes are rare, swap to the 32-bit indices and back so Bind() stays valid for everything else
+    encoder.BindIndexBuffer(_indices32.Buffer, 0, VK_INDEX_TYPE_UINT32);
+    encoder.DrawIndexed(mesh.IndexCount, instanceCount, mesh.FirstIndex, mesh.VertexOffset, firstInstance);
+    encoder.BindIndexBuffer(_indices16.Buffer, 0, VK_INDEX_TYPE_UINT16);
+}
+
+VkBuffer OZZ::MeshPool::GetIndexBuffer(VkIndexType indexType) const {
+    return indexType == VK_INDEX_TYPE_UINT16 ? _indices16.Buffer : _indices32.Buffer;
+}
+
+size_t OZZ::MeshPool::GetMeshCount() const {
+    std::lock_guard lock(_mutex);
+    return _entries.size();
+}
+
+OZZ::MeshPool::ContentHash OZZ::MeshPool::hashMesh(const void* vertices, uint32_t vertexCount, const void* indices,
+                                                  uint32_t indexCount, VkIndexType indexType) const {
+    uint64_t low = 0x9e3779b97f4a7c15ull;
+    uint64_t high = 0xcbf29ce484222325ull;
+    hashBytes(low, high, vertices, size_t{vertexCount} * _vertexStride);
+    hashBytes(low, high, indices, size_t{indexCount} * IndexSize(indexType));
+
+    return { .Low = mixHash(low), .High = mixHash(high + low) };
+}
+
+OZZ::MeshPool::IndexStorage OZZ::MeshPool::createIndexStorage(VkIndexType indexType, uint32_t capacity) {
+    IndexStorage storage {};
+    storage.Buffer = createPoolBuffer(_context, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                      VkDeviceSize{capacity} * IndexSize(indexType), &storage.Allocation);
+    storage.Block = createVirtualBlock(capacity);
+    return storage;
+}
+
+void OZZ::MeshPool::destroyIndexStorage(IndexStorage& storage) {
+    if (storage.Block != VK_NULL_HANDLE) {
+        vmaClearVirtualBlock(storage.Block);
+        vmaDestroyVirtualBlock(storage.Block);
+        storage.Block = VK_NULL_HANDLE;
+    }
+
+    if (storage.Buffer != VK_NULL_HANDLE) {
+        if (_context.Memory) _context.Memory->Untrack(storage.Allocation);
+        vmaDestroyBuffer(_context.Allocator, storage.Buffer, storage.Allocation);
+        storage.Buffer = VK_NULL_HANDLE;
+    }
+}
+
+OZZ::MeshPool::IndexStorage& OZZ::MeshPool::getIndexStorage(VkIndexType indexType) {
+    return indexType == VK_INDEX_TYPE_UINT16 ? _indices16 : _indices32;
+}
@@ -0,0 +1,428 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/resources/meshlet.h>
+#include <ozz_vulkan/resources/shader.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace OZZ {
+
+    namespace {
+        constexpr uint32_t UNASSIGNED = std::numeric_limits<uint32_t>::max();
+        // Normals spread further than this from their average leave nothing to cull, about 84 degrees
+        constexpr float MIN_CONE_SPREAD = 0.1f;
+
+        // Bounding sphere and backface cone of the meshlet just finished, meshoptimizer's construction
+        void computeBounds(Meshlet& meshlet, const MeshletData& data, std::span<const Vertex> vertices) {
+            auto vertexIndices = std::span(data.Vertices).subspan(meshlet.VertexOffset, meshlet.VertexCount);
+            auto position = [&](uint32_t local) { return vertices[vertexIndices[local]].Position; };
+
+            glm::vec3 min { std::numeric_limits<float>::max() };
+            glm::vec3 max { std::numeric_limits<float>::lowest() };
+            for (auto index : vertexIndices) {
+                min = glm::min(min, vertices[index].Position);
+                max = glm::max(max, vertices[index].Position);
+            }
+
+            meshlet.Center = (min + max) * 0.5f;
+            meshlet.Radius = 0.f;
+            for (auto index : vertexIndices) {
+                meshlet.Radius = std::max(meshlet.Radius, glm::length(vertices[index].Position - meshlet.Center));
+            }
+
+            // Facing comes from the vertex normals, so it doesn't matter which winding the mesh was built with
+            std::vector<glm::vec3> normals;
+            std::vector<glm::vec3> corners;
+            normals.reserve(meshlet.TriangleCount);
+            corners.reserve(meshlet.TriangleCount);
+
+            glm::vec3 axis { 0.f };
+            for (uint32_t i = 0; i < meshlet.TriangleCount; i++) {
+                const auto* triangle = &data.Triangles[(meshlet.TriangleOffset + i) * 3];
+                glm::vec3 a = position(triangle[0]), b = position(triangle[1]), c = position(triangle[2]);
+
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                float area = glm::length(normal);
+                // Zero area triangles are never rasterized, they have no say in the cone
+                if (area == 0.f) continue;
+                normal /= area;
+
+                glm::vec3 shading = vertices[vertexIndices[triangle[0]]].Normal + vertices[vertexIndices[triangle[1]]].Normal +
+                                    vertices[vertexIndices[triangle[2]]].Normal;
+                if (glm::dot(normal, shading) < 0.f) normal = -normal;
+
+                normals.push_back(normal);
+                corners.push_back(a);
+                axis += normal;
+            }
+
+            meshlet.ConeApex = meshlet.Center;
+            meshlet.ConeAxis = glm::vec3 { 0.f };
+            meshlet.ConeCutoff = 1.f;
+
+            float axisLength = glm::length(axis);
+            if (normals.empty() || axisLength == 0.f) return;
+            axis /= axisLength;
+
+            float minDot = 1.f;
+            for (const auto& normal : normals) {
+                minDot = std::min(minDot, glm::dot(normal, axis));
+            }
+            if (minDot <= MIN_CONE_SPREAD) return;
+
+            // Pull the apex back along the axis until it's behind every triangle's plane, concave patches need
+            // it further back than convex ones
+            float maxT = 0.f;
+            for (size_t i = 0; i < normals.size(); i++) {
+                float t = glm::dot(meshlet.Center - corners[i], normals[i]) / glm::dot(axis, normals[i]);
+                maxT = std::max(maxT, t);
+            }
+
+            meshlet.ConeApex = meshlet.Center - axis * maxT;
+
+            // Anything in front of a plane could see its triangle, the cone would cull it anyway
+            for (size_t i = 0; i < normals.size(); i++) {
+                assert(glm::dot(meshlet.ConeApex - corners[i], normals[i]) <= 1e-4f * std::max(meshlet.Radius, 1.f) &&
+                       "Meshlet cone apex in front of one of its triangles");
+            }
+            meshlet.ConeAxis = axis;
+            meshlet.ConeCutoff = std::sqrt(1.f - minDot * minDot);
+        }
+    }
+
+    MeshletData BuildMeshlets(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                              uint32_t maxVertices, uint32_t maxTriangles) {
+        MeshletData data;
+
+        // Triangles index their vertices with a byte
+        maxVertices = std::clamp(maxVertices, 3u, 256u);
+        maxTriangles = std::max(maxTriangles, 1u);
+
+        auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+        if (triangleCount == 0 || vertices.empty()) return data;
+
+        for (auto index : indices) {
+            if (index >= vertices.size()) {
+                spdlog::error("Can't build meshlets, index {} is past the mesh's {} vertices", index, vertices.size());
+                return data;
+            }
+        }
+
+        // Triangles around each vertex, flattened
+        std::vector<uint32_t> adjacencyOffsets(vertices.size() + 1, 0);
+        for (auto index : indices) {
+            adjacencyOffsets[index + 1]++;
+        }
+        for (size_t i = 1; i < adjacencyOffsets.size(); i++) {
+            adjacencyOffsets[i] += adjacencyOffsets[i - 1];
+        }
+
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> adjacencyCursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (uint32_t i = 0; i < triangleCount * 3; i++) {
+            adjacency[adjacencyCursor[indices[i]]++] = i / 3;
+        }
+
+        std::vector<glm::vec3> centroids(triangleCount);
+        std::vector<bool> used(triangleCount, false);
+        uint32_t remaining = triangleCount;
+
+        for (uint32_t i = 0; i < triangleCount; i++) {
+            uint32_t a = indices[i * 3], b = indices[i * 3 + 1], c = indices[i * 3 + 2];
+            centroids[i] = (vertices[a].Position + vertices[b].Position + vertices[c].Position) / 3.f;
+
+            // Collapsed triangles would waste a slot drawing nothing
+            if (a == b || b == c || a == c) {
+                used[i] = true;
+                remaining--;
+            }
+        }
+
+        // Where each source vertex sits in the meshlet being built
+        std::vector<uint32_t> localIndex(vertices.size(), UNASSIGNED);
+
+        Meshlet current {};
+        glm::vec3 centroidSum { 0.f };
+
+        auto newVertexCount = [&](uint32_t triangle) {
+            uint32_t count = 0;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                if (localIndex[indices[triangle * 3 + corner]] == UNASSIGNED) count++;
+            }
+            return count;
+        };
+
+        auto append = [&](uint32_t triangle) {
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                auto vertex = indices[triangle * 3 + corner];
+                if (localIndex[vertex] == UNASSIGNED) {
+                    localIndex[vertex] = current.VertexCount++;
+                    data.Vertices.push_back(vertex);
+                }
+                data.Triangles.push_back(static_cast<uint8_t>(localIndex[vertex]));
+            }
+
+            current.TriangleCount++;
+            centroidSum += centroids[triangle];
+            used[triangle] = true;
+            remaining--;
+        };
+
+        auto flush = [&]() {
+            if (current.TriangleCount == 0) return;
+
+            computeBounds(current, data, vertices);
+            for (uint32_t i = 0; i < current.VertexCount; i++) {
+                localIndex[data.Vertices[current.VertexOffset + i]] = UNASSIGNED;
+            }
+            data.Meshlets.push_back(current);
+
+            current = {
+                .VertexOffset = static_cast<uint32_t>(data.Vertices.size()),
+                .TriangleOffset = static_cast<uint32_t>(data.Triangles.size() / 3),
+            };
+            centroidSum = glm::vec3 { 0.f };
+        };
+
+        uint32_t nextSeed = 0;
+        while (remaining > 0) {
+            uint32_t best = UNASSIGNED;
+
+            if (current.TriangleCount > 0 && current.TriangleCount < maxTriangles) {
+                glm::vec3 center = centroidSum / static_cast<float>(current.TriangleCount);
+                uint32_t bestNew = UNASSIGNED;
+                float bestDistance = std::numeric_limits<float>::max();
+
+                // Only triangles sharing a vertex with the meshlet, so it grows as one patch
+                for (uint32_t i = 0; i < current.VertexCount; i++) {
+                    auto vertex = data.Vertices[current.VertexOffset + i];
+                    for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++) {
+                        auto triangle = adjacency[a];
+                        if (used[triangle]) continue;
+
+                        auto added = newVertexCount(triangle);
+                        if (current.VertexCount + added > maxVertices) continue;
+
+                        auto offset = centroids[triangle] - center;
+                        float distance = glm::dot(offset, offset);
+                        if (added < bestNew || (added == bestNew && distance < bestDistance)) {
+                            best = triangle;
+                            bestNew = added;
+                            bestDistance = distance;
+                        }
+                    }
+                }
+            }
+
+            if (best == UNASSIGNED) {
+                flush();
+                while (used[nextSeed]) nextSeed++;
+                best = nextSeed;
+            }
+
+            append(best);
+        }
+        flush();
+
+        return data;
+    }
+
+    MeshletMesh::MeshletMesh(const ResourceContext& context, std::span<const Vertex> vertices, std::span<const uint32_t> indices)
+            : _context(context) {
+        if (!_context.Capabilities || !_context.Capabilities->MeshShader) {
+            spdlog::error("Meshlet meshes need VK_EXT_mesh_shader, draw the mesh through a mesh pool instead");
+            return;
+        }
+
+        auto data = BuildMeshlets(vertices, indices, MAX_VERTICES, MAX_TRIANGLES);
+        if (data.IsEmpty()) {
+            spdlog::error("Mesh of {} vertices and {} indices has no meshlets", vertices.size(), indices.size());
+            return;
+        }
+
+        upload(data, vertices);
+        createDescriptors();
+
+        spdlog::trace("Split {} triangles into {} meshlets of {} vertices", _triangleCount, _meshletCount, data.Vertices.size());
+    }
+
+    MeshletMesh::~MeshletMesh() {
+        _context.Defer([context = _context, buffers = std::to_array(_buffers), allocations = std::to_array(_allocations),
+                        uploadValue = _uploadValue, pool = _descriptorPool, layout = _setLayout]() {
+            // The transfer queue may still be writing into them
+            context.Uploads->Wait(uploadValue);
+
+            for (uint32_t i = 0; i < BufferCount; i++) {
+                if (buffers[i] == VK_NULL_HANDLE) continue;
+                if (context.Memory) context.Memory->Untrack(allocations[i]);
+                vmaDestroyBuffer(context.Allocator, buffers[i], allocations[i]);
+            }
+
+            if (pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(context.Device, pool, nullptr);
+            if (layout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(context.Device, layout, nullptr);
+        });
+    }
+
+    void MeshletMesh::Draw(CommandEncoder& encoder, const Shader& shader, const glm::mat4& model, const glm::vec4& colour,
+                           uint32_t set) const {
+        if (!IsValid()) return;
+
+        encoder.BindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, shader.GetPipelineLayout(), set, _descriptorSet);
+
+        DrawConstants constants {
+                .Model = model,
+                .Colour = colour,
+                .MeshletCount = _meshletCount,
+        };
+        encoder.PushConstants(shader.GetPipelineLayout(), VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, constants);
+        encoder.DrawMeshTasks((_meshletCount + TASK_GROUP_SIZE - 1) / TASK_GROUP_SIZE);
+    }
+
+    void MeshletMesh::upload(const MeshletData& data, std::span<const Vertex> vertices) {
+        _meshletCount = static_cast<uint32_t>(data.Meshlets.size());
+        _triangleCount = static_cast<uint32_t>(data.Triangles.size() / 3);
+
+        const VkDeviceSize sizes[BufferCount] = {
+                VkDeviceSize{_meshletCount} * sizeof(GpuMeshlet),
+                VkDeviceSize{data.Vertices.size()} * sizeof(GpuVertex),
+                VkDeviceSize{_triangleCount} * sizeof(uint32_t),
+        };
+        constexpr MemoryCategory categories[BufferCount] = { MemoryCategory::Index, MemoryCategory::Vertex, MemoryCategory::Index };
+
+        // One staging write for all three, each buffer's part starts 16 byte aligned
+        VkDeviceSize offsets[BufferCount] {};
+        VkDeviceSize total = 0;
+        for (uint32_t i = 0; i < BufferCount; i++) {
+            offsets[i] = total;
+            total += (sizes[i] + 15) & ~VkDeviceSize{15};
+        }
+
+        for (uint32_t i = 0; i < BufferCount; i++) {
+            VkBufferCreateInfo bufferCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+            bufferCreateInfo.size = sizes[i];
+            bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            _context.Uploads->ApplySharingMode(bufferCreateInfo);
+
+            VmaAllocationCreateInfo allocationCreateInfo{};
+            allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+            if (vmaCreateBuffer(_context.Allocator, &bufferCreateInfo, &allocationCreateInfo, &_buffers[i], &_allocations[i],
+                                nullptr) != VK_SUCCESS) {
+                spdlog::error("Failed to create meshlet buffer of {} bytes", sizes[i]);
+                _meshletCount = 0;
+                return;
+            }
+            _context.Track(_allocations[i], categories[i]);
+        }
+
+        auto write = _context.Uploads->BeginStagingWrite(total);
+        if (!write.IsValid()) {
+            spdlog::error("Couldn't stage {} bytes of meshlets", total);
+            _meshletCount = 0;
+            return;
+        }
+
+        auto* meshlets = reinterpret_cast<GpuMeshlet*>(write.Data + offsets[Meshlets]);
+        for (const auto& meshlet : data.Meshlets) {
+            *meshlets++ = {
+                    .Sphere = glm::vec4(meshlet.Center, meshlet.Radius),
+                    .ConeApex = glm::vec4(meshlet.ConeApex, 0.f),
+                    .ConeAxisCutoff = glm::vec4(meshlet.ConeAxis, meshlet.ConeCutoff),
+                    .VertexOffset = meshlet.VertexOffset,
+                    .TriangleOffset = meshlet.TriangleOffset,
+                    .VertexCount = meshlet.VertexCount,
+                    .TriangleCount = meshlet.TriangleCount,
+            };
+        }
+
+        auto* gpuVertices = reinterpret_cast<GpuVertex*>(write.Data + offsets[Vertices]);
+        for (auto index : data.Vertices) {
+            *gpuVertices++ = {
+                    .Position = glm::vec4(vertices[index].Position, 1.f),
+                    .Colour = glm::vec4(vertices[index].Colour, 1.f),
+            };
+        }
+
+        // Three byte indices to a uint, the mesh shader unpacks them
+        auto* triangles = reinterpret_cast<uint32_t*>(write.Data + offsets[Triangles]);
+        for (uint32_t i = 0; i < _triangleCount; i++) {
+            const auto* triangle = &data.Triangles[i * 3];
+            *triangles++ = uint32_t{triangle[0]} | (uint32_t{triangle[1]} << 8) | (uint32_t{triangle[2]} << 16);
+        }
+
+        StagingCopy copies[BufferCount];
+        for (uint32_t i = 0; i < BufferCount; i++) {
+            copies[i] = {
+                    .SrcOffset = offsets[i],
+                    .Dst = _buffers[i],
+                    .Size = sizes[i],
+            };
+        }
+        _uploadValue = _context.Uploads->SubmitStagingWrite(write, copies);
+    }
+
+    void MeshletMesh::createDescriptors() {
+        if (_meshletCount == 0) return;
+
+        // Meshlets, vertices and triangles, in BufferIndex order
+        VkDescriptorSetLayoutBinding bindings[BufferCount] {};
+        for (uint32_t i = 0; i < BufferCount; i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+        layoutCreateInfo.bindingCount = BufferCount;
+        layoutCreateInfo.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(_context.Device, &layoutCreateInfo, nullptr, &_setLayout) != VK_SUCCESS) {
+            spdlog::error("Failed to create meshlet descriptor set layout");
+            return;
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BufferCount};
+
+        VkDescriptorPoolCreateInfo poolCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+        poolCreateInfo.maxSets = 1;
+        poolCreateInfo.poolSizeCount = 1;
+        poolCreateInfo.pPoolSizes = &poolSize;
+
+        if (vkCreateDescriptorPool(_context.Device, &poolCreateInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+            spdlog::error("Failed to create meshlet descriptor pool");
+            return;
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        allocateInfo.descriptorPool = _descriptorPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &_setLayout;
+
+        if (vkAllocateDescriptorSets(_context.Device, &allocateInfo, &_descriptorSet) != VK_SUCCESS) {
+            spdlog::error("Failed to allocate meshlet descriptor set");
+            return;
+        }
+
+        VkDescriptorBufferInfo bufferInfos[BufferCount] {};
+        VkWriteDescriptorSet writes[BufferCount] {};
+        for (uint32_t i = 0; i < BufferCount; i++) {
+            bufferInfos[i] = { _buffers[i], 0, VK_WHOLE_SIZE };
+
+            writes[i] = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+            writes[i].dstSet = _descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+
+        vkUpdateDescriptorSets(_context.Device, BufferCount, writes, 0, nullptr);
+    }
+}
@@ -5,6 +5,13 @@
 #include <ozz_vulkan/renderer.h>
 #include "ozz_vulkan/internal/xr_utils.h"
 #include "ozz_vulkan/internal/vk_utils.h"
+#include "ozz_vulkan/internal/init_graph.h"
+#include "ozz_vulkan/internal/allocation_tracker.h"
+
+#include <algorithm>
+#include <cassert>
+#include <future>
+#include <thread>
 
 namespace OZZ {
 
@@ -15,36 +22,84 @@ namespace OZZ {
         Cleanup();
     }
 
-    void Renderer::Init() {
+    bool Renderer::Init() {
         spdlog::set_level(spdlog::level::trace);
 
         spdlog::info("Initializing Renderer.");
-        initXrInstance();
-        initGetXrSystem();
-        initVulkanInstance();
-        initVulkanDebugMessenger();
-        initVulkanDevice();
-        initVulkanMemoryAllocator();
-        initXrSession();
-        initXrReferenceSpaces();
-        initXrSwapchains();
-        createCommandPool();
-        createFrameData();
+
+        /*
+         * Stages only wait on what they actually need, anything without a path between
+         * them in this graph runs concurrently.
+         */
+        InitGraph graph;
+        graph.AddStage("vk-instance-support", {}, [this]() { return enumerateVulkanInstanceSupport(); });
+        graph.AddStage("xr-instance", {}, [this]() { return initXrInstance(); });
+        graph.AddStage("xr-system", {"xr-instance"}, [this]() { return initGetXrSystem(); });
+        graph.AddStage("vk-instance", {"xr-system", "vk-instance-support"}, [this]() { return initVulkanInstance(); });
+        graph.AddStage("vk-debug-messenger", {"vk-instance"}, [this]() { return initVulkanDebugMessenger(); });
+        graph.AddStage("vk-device", {"vk-debug-messenger"}, [this]() { return initVulkanDevice(); });
+        graph.AddStage("vma", {"vk-device"}, [this]() { return initVulkanMemoryAllocator(); });
+        graph.AddStage("upload-manager", {"vma"}, [this]() { return createUploadManager(); });
+        graph.AddStage("defragmenter", {"upload-manager"}, [this]() { return createDefragmenter(); });
+        graph.AddStage("frame-ring", {"vma"}, [this]() { return createFrameRingBuffer(); });
+        graph.AddStage("view-buffer", {"vma"}, [this]() { return createViewBuffer(); });
+        graph.AddStage("bindless-set", {"vk-device"}, [this]() { return createBindlessSet(); });
+        graph.AddStage("command-pool", {"vk-device"}, [this]() { return createCommandPool(); });
+        graph.AddStage("xr-session", {"vk-device"}, [this]() { return initXrSession(); });
+        graph.AddStage("xr-reference-spaces", {"xr-session"}, [this]() { return initXrReferenceSpaces(); });
+        graph.AddStage("xr-swapchains", {"xr-session"}, [this]() { return initXrSwapchains(); });
+        graph.AddStage("frame-data", {"xr-swapchains", "vma", "command-pool"}, [this]() { return createFrameData(); });
+        bool succeeded = graph.Run();
+        if (!succeeded) {
+            spdlog::error("Renderer initialization failed");
+        }
+
+        startupTimings = graph.GetTimings();
+        graph.LogTimings();
+        return succeeded;
     }
 
     bool Renderer::Update() {
-        return processXREvents();
+        bool shouldExit;
+        if (xrSessionLost) {
+            shouldExit = !tryRecoverXrSession();
+        } else {
+            shouldExit = processXREvents();
+        }
+
+        // Frames keep retiring while the session is idle, resources dropped meanwhile shouldn't pile up
+        retireFrames();
+
+        /*
+         * Nothing to render until the runtime moves us to READY, and xrWaitFrame is the only
+         * thing throttling the frame loop. Sleep briefly rather than spin on the event queue.
+         */
+        if (!shouldExit && !IsSessionRunning()) {
+            std::this_thread::sleep_for(IDLE_WAIT_INTERVAL);
+        }
+
+        return shouldExit;
     }
 
     std::optional<FrameInfo> Renderer::BeginFrame() {
-        // Get available frame cache
-        currentFrameBufferCache = getAvailableFrameBufferCache(vkDevice);
-        if (!xrSessionInitialized) return std::nullopt;
+        // Everything the app allocated last frame is gone
+        frameArena.Reset();
+        frameAllocationBaseline = AllocationTracker::GetThreadAllocationCount();
+
+        // Pick up uploads that finished since last frame
+        uploadManager->BeginFrame();
+        memoryTracker->BeginFrame(frameNumber);
+
+        if (!IsSessionRunning()) return std::nullopt;
 
         XrFrameWaitInfo frameWaitInfo{XR_TYPE_FRAME_WAIT_INFO};
 
         XrFrameState frameState{XR_TYPE_FRAME_STATE};
-        XrResult result = xrWaitFrame(xrSession, &frameWaitInfo, &frameState);
+        XrResult result;
+        {
+            AllocationTracker::IgnoreScope ignoreRuntime;
+            result = xrWaitFrame(xrSession, &frameWaitInfo, &frameState);
+        }
 
         if (result != XR_SUCCESS) {
             spdlog::error("Failed to wait for frame {}", result);
@@ -52,10 +107,23 @@ namespace OZZ {
         }
 
         if (!frameState.shouldRender) {
-            spdlog::warn("Frame should not be rendered");
+            // Frames still have to be begun and ended to keep the session in sync, just with no layers
+            submitEmptyFrame(frameState.predictedDisplayTime);
             return std::nullopt;
         }
 
+        // Get available frame cache, only once we know this frame is going to be rendered
+        currentFrameBufferCache = getAvailableFrameBufferCache(vkDevice);
+        frameRing->BeginFrame(currentFrameBufferCache->Slot);
+        frameCommandStats = {};
+
+        frameClock.FrameNumber = currentFrameBufferCache->FrameNumber;
+        frameClock.Slot = currentFrameBufferCache->Slot;
+        frameClock.InFrame = true;
+
+        // Buffers only ever move between frames, before anything is recorded against them
+        defragmenter->Update();
+
         return FrameInfo {
             .PredictedDisplayTime = frameState.predictedDisplayTime
         };
@@ -72,22 +140,96 @@ namespace OZZ {
         return newBuffer;
     }
 
-    void Renderer::RenderFrame(const FrameInfo& frameInfo) {
-        // Clean and check framebuffer caches
-        for (auto& cache : frameCommandBufferCache) {
-            cache->CheckAndClearCaches();
+    CommandEncoder Renderer::RequestCommandEncoder(EyeTarget target) {
+        auto commandBuffer = RequestCommandBuffer(target);
+        if (commandBuffer == VK_NULL_HANDLE) return {};
+
+        return CommandEncoder(commandBuffer, &frameCommandStats.Eyes[static_cast<size_t>(target)]);
+    }
+
+    std::unique_ptr<StaticBundle> Renderer::CreateStaticBundle() {
+        return std::make_unique<StaticBundle>(GetResourceContext(), commandPool, GetSwapchainFormat(), depthFormat);
+    }
+
+    void Renderer::ExecuteBundle(const StaticBundle& bundle, EyeTarget target) {
+        if (!currentFrameBufferCache) {
+            spdlog::warn("No selected frame buffer cache. Have you began the frame?");
+            return;
         }
 
+        if (!bundle.IsRecorded()) {
+            spdlog::warn("Skipping a static bundle that hasn't been recorded");
+            return;
+        }
+
+        currentFrameBufferCache->PushBundleCommandBuffer(bundle.GetCommandBuffer(), target);
+
+        // The bundle's commands run again every time, count them like any other eye's
+        if (target == EyeTarget::BOTH) {
+            frameCommandStats.Eyes[static_cast<size_t>(EyeTarget::Left)] += bundle.GetRecordedStats();
+            frameCommandStats.Eyes[static_cast<size_t>(EyeTarget::Right)] += bundle.GetRecordedStats();
+        } else {
+            frameCommandStats.Eyes[static_cast<size_t>(target)] += bundle.GetRecordedStats();
+        }
+    }
+
+    VkCommandBuffer Renderer::RequestPreRenderCommandBuffer() {
+        if (!currentFrameBufferCache) {
+            spdlog::warn("No selected frame buffer cache. Have you began the frame?");
+            return VK_NULL_HANDLE;
+        }
+        auto newBuffer = getCommandBufferForSubmission();
+        currentFrameBufferCache->PushPreRenderCommandBuffer(newBuffer);
+
+        return newBuffer;
+    }
+
+    VkCommandBuffer Renderer::RequestPostDepthCommandBuffer(EyeTarget target) {
+        if (!currentFrameBufferCache) {
+            spdlog::warn("No selected frame buffer cache. Have you began the frame?");
+            return VK_NULL_HANDLE;
+        }
+        auto newBuffer = getCommandBufferForSubmission();
+        currentFrameBufferCache->PushPostDepthCommandBuffer(newBuffer, target);
+
+        return newBuffer;
+    }
+
+    CommandEncoder Renderer::RequestLateCommandEncoder(EyeTarget target) {
+        if (!currentFrameBufferCache) {
+            spdlog::warn("No selected frame buffer cache. Have you began the frame?");
+            return {};
+        }
+        auto newBuffer = getCommandBufferForSubmission();
+        if (newBuffer == VK_NULL_HANDLE) return {};
+        currentFrameBufferCache->PushLateCommandBuffer(newBuffer, target);
+
+        return CommandEncoder(newBuffer, &frameCommandStats.Eyes[static_cast<size_t>(target)]);
+    }
+
+    void Renderer::RenderFrame(const FrameInfo& frameInfo) {
+        retireFrames();
+
         if (!xrSessionInitialized) return;
 
+        // The runtime submits to our queue between begin and end frame
+        auto queueLock = lockGraphicsQueue();
+
         XrFrameBeginInfo frameBeginInfo{XR_TYPE_FRAME_BEGIN_INFO};
-        auto result = xrBeginFrame(xrSession, &frameBeginInfo);
+        XrResult result;
+        {
+            AllocationTracker::IgnoreScope ignoreRuntime;
+            result = xrBeginFrame(xrSession, &frameBeginInfo);
+        }
 
         if (result != XR_SUCCESS) {
             spdlog::error("Failed to begin frame {}", result);
             return;
         }
 
+        // Everything the app wrote into the frame ring has to be visible before the eyes are submitted
+        frameRing->Flush();
+
         for (auto eye = 0; eye < EYE_COUNT; eye++) {
             renderEye(
                     &swapchains[eye],
@@ -99,27 +241,13 @@ namespace OZZ {
 
         XrCompositionLayerProjectionView projectionLayerViews[EYE_COUNT] = {};
 
-        auto [leftEye, rightEye] = GetEyePoseInfo(frameInfo.PredictedDisplayTime).value();
-
-        std::vector <XrView> views = {
-                {
-                        .type = XR_TYPE_VIEW,
-                        .next = nullptr,
-                        .pose = getPoseFromEyePose(leftEye),
-                        .fov = getFovFromEyeFov(leftEye)
-                },
-                {
-                        .type = XR_TYPE_VIEW,
-                        .next = nullptr,
-                        .pose = getPoseFromEyePose(rightEye),
-                        .fov = getFovFromEyeFov(rightEye)
-                }
-        };
+        // The same views the app rendered with if it asked for them this frame, no second xrLocateViews
+        bool viewsLocated = locateViews(frameInfo.PredictedDisplayTime);
 
         for (auto eye = 0; eye < EYE_COUNT; eye++) {
             projectionLayerViews[eye].type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
-            projectionLayerViews[eye].pose = views[eye].pose;
-            projectionLayerViews[eye].fov = views[eye].fov;
+            projectionLayerViews[eye].pose = lastViews[eye].pose;
+            projectionLayerViews[eye].fov = lastViews[eye].fov;
             projectionLayerViews[eye].subImage.swapchain = swapchains[eye].handle;
             projectionLayerViews[eye].subImage.imageRect = { { 0, 0 }, { swapchains[eye].width, swapchains[eye].height } };
             projectionLayerViews[eye].subImage.imageArrayIndex = 0;
@@ -135,11 +263,15 @@ namespace OZZ {
         XrFrameEndInfo frameEndInfo{XR_TYPE_FRAME_END_INFO};
         frameEndInfo.displayTime = frameInfo.PredictedDisplayTime;
         frameEndInfo.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
-        frameEndInfo.layerCount = 1;
-        frameEndInfo.layers = &pLayer;
+        // Without views there's nothing sensible to project the eyes with, end the frame without layers
+        frameEndInfo.layerCount = viewsLocated ? 1 : 0;
+        frameEndInfo.layers = viewsLocated ? &pLayer : nullptr;
 
         _pauseValidation = true;
-        result = xrEndFrame(xrSession, &frameEndInfo);
+        {
+            AllocationTracker::IgnoreScope ignoreRuntime;
+            result = xrEndFrame(xrSession, &frameEndInfo);
+        }
 
         if (result != XR_SUCCESS) {
             spdlog::error("Failed to end frame {}", result);
@@ -149,9 +281,55 @@ namespace OZZ {
         _pauseValidation = false;
     }
 
+    void Renderer::submitEmptyFrame(int64_t displayTime) {
+        auto queueLock = lockGraphicsQueue();
+
+        XrFrameBeginInfo frameBeginInfo{XR_TYPE_FRAME_BEGIN_INFO};
+        XrResult result;
+        {
+            AllocationTracker::IgnoreScope ignoreRuntime;
+            result = xrBeginFrame(xrSession, &frameBeginInfo);
+        }
+
+        if (XR_FAILED(result)) {
+            spdlog::error("Failed to begin frame {}", result);
+            return;
+        }
+
+        XrFrameEndInfo frameEndInfo{XR_TYPE_FRAME_END_INFO};
+        frameEndInfo.displayTime = displayTime;
+        frameEndInfo.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
+        frameEndInfo.layerCount = 0;
+        frameEndInfo.layers = nullptr;
+
+        {
+            AllocationTracker::IgnoreScope ignoreRuntime;
+            result = xrEndFrame(xrSession, &frameEndInfo);
+        }
+
+        if (XR_FAILED(result)) {
+            spdlog::error("Failed to end frame {}", result);
+        }
+    }
+
     void Renderer::EndFrame() {
-        // No more frame buffer cache
+        frameClock.InFrame = false;
+
+        // No more frame buffer cache, it's recycled once its fences signal
+        if (currentFrameBufferCache) {
+            currentFrameBufferCache->Finish();
+            lastFrameCommandStats = frameCommandStats;
+        }
         currentFrameBufferCache = nullptr;
+
+        if constexpr (AllocationTracker::Enabled) {
+            // Caches, pools and the frame arena are still finding their size during the first frames
+            auto allocations = AllocationTracker::GetThreadAllocationCount() - frameAllocationBaseline;
+            if (frameNumber > ALLOCATION_WARMUP_FRAMES && allocations > 0) {
+                spdlog::error("Frame {} made {} heap allocations", frameNumber, allocations);
+                assert(false && "Steady-state frames must not allocate, use the frame arena");
+            }
+        }
     }
 
     void Renderer::renderEye(Swapchain* swapchain, const std::vector<std::unique_ptr<SwapchainImage>>& images,
@@ -160,6 +338,8 @@ namespace OZZ {
         XrSwapchainImageAcquireInfo acquireInfo{XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
         uint32_t swapchainImageIndex;
 
+        // Nothing below allocates on our side, but the runtime and the driver are called all the way through
+        AllocationTracker::IgnoreScope ignoreRuntime;
         XrResult result = xrAcquireSwapchainImage(swapchain->handle, &acquireInfo, &swapchainImageIndex);
 
         if (result != XR_SUCCESS) {
@@ -187,6 +367,15 @@ namespace OZZ {
             return;
         }
 
+        // Compute and transfers the frame depends on can't go inside rendering, the first eye runs them up front
+        auto preRenderBuffers = currentFrameBufferCache->TakePreRenderCommandBuffers();
+        if (!preRenderBuffers.empty()) {
+            vkCmdExecuteCommands(image->commandBuffer, static_cast<uint32_t>(preRenderBuffers.size()), preRenderBuffers.data());
+        }
+
+        // Static bundles read the eye's view out of the view buffer, it has to be written before rendering starts
+        viewBuffer->RecordUpdate(image->commandBuffer, eye);
+
         VkClearValue colorClear{};
         colorClear.color = { 0.2f, 0.2f, 0.2f, 1.0f};
 
@@ -235,6 +424,14 @@ namespace OZZ {
             spdlog::error("No frame buffer cache");
         }
 
+        // Static content first, so its depth is down before the dynamic draws test against it
+        for (auto target : {eye, EyeTarget::BOTH}) {
+            auto& bundles = currentFrameBufferCache->GetBundleCommandBuffers(target);
+            if (!bundles.empty()) {
+                vkCmdExecuteCommands(image->commandBuffer, static_cast<uint32_t>(bundles.size()), bundles.data());
+            }
+        }
+
         auto& eyeBuffers = currentFrameBufferCache->GetCommandBuffers(eye);
         auto& bothBuffers = currentFrameBufferCache->GetCommandBuffers(EyeTarget::BOTH);
 
@@ -247,16 +444,59 @@ namespace OZZ {
 
         vkCmdEndRendering(image->commandBuffer);
 
+        // This frame's depth, for whatever the post-depth buffers cull and for next frame's early culls
+        depthPyramid->Record(image->commandBuffer, eye, image->depthImage, image->depthImageView);
+
+        for (auto target : {eye, EyeTarget::BOTH}) {
+            auto& postDepthBuffers = currentFrameBufferCache->GetPostDepthCommandBuffers(target);
+            if (!postDepthBuffers.empty()) {
+                vkCmdExecuteCommands(image->commandBuffer, static_cast<uint32_t>(postDepthBuffers.size()), postDepthBuffers.data());
+            }
+        }
+
+        // Late draws land on top of the main pass, both attachments are loaded rather than cleared
+        auto& lateEyeBuffers = currentFrameBufferCache->GetLateCommandBuffers(eye);
+        auto& lateBothBuffers = currentFrameBufferCache->GetLateCommandBuffers(EyeTarget::BOTH);
+
+        if (!lateEyeBuffers.empty() || !lateBothBuffers.empty()) {
+            color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            depth_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            vkCmdBeginRendering(image->commandBuffer, &renderingInfo);
+
+            for (auto* buffers : {&lateEyeBuffers, &lateBothBuffers}) {
+                if (!buffers->empty()) {
+                    vkCmdExecuteCommands(image->commandBuffer, static_cast<uint32_t>(buffers->size()), buffers->data());
+                }
+            }
+
+            vkCmdEndRendering(image->commandBuffer);
+        }
+
         if (vkEndCommandBuffer(image->commandBuffer) != VK_SUCCESS) {
             spdlog::error("Failed to record command buffer");
             return;
         }
 
-        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        /*
+         * Wait on every upload the app could have seen complete. Those values are already signalled so this
+         * never stalls, but it orders the transfer queue's writes before our reads.
+         */
+        VkSemaphore uploadSemaphore = uploadManager->GetTimelineSemaphore();
+        uint64_t uploadValue = uploadManager->GetVisibleValue();
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        if (deviceCapabilities.MeshShader) {
+            waitStage |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+        }
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+        timelineSubmitInfo.waitSemaphoreValueCount = 1;
+        timelineSubmitInfo.pWaitSemaphoreValues = &uploadValue;
 
         VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-        submitInfo.waitSemaphoreCount = 0;
-        submitInfo.pWaitSemaphores = nullptr;
+        submitInfo.pNext = &timelineSubmitInfo;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &uploadSemaphore;
         submitInfo.pWaitDstStageMask = &waitStage;
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &image->commandBuffer;
@@ -270,6 +510,7 @@ namespace OZZ {
             spdlog::error("Failed to submit queue");
             return;
         }
+        currentFrameBufferCache->MarkSubmitted(eye);
 
         XrSwapchainImageReleaseInfo releaseInfo{XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
         result = xrReleaseSwapchainImage(swapchain->handle, &releaseInfo);
@@ -282,54 +523,46 @@ namespace OZZ {
 
     void Renderer::WaitIdle() {
         if (vkDevice != nullptr) {
+            // vkDeviceWaitIdle needs every queue externally synchronized, including the transfer queue
+            std::lock_guard queueLock(vkQueueMutex);
             vkDeviceWaitIdle(vkDevice);
         }
     }
 
     void Renderer::Cleanup() {
         spdlog::info("Shutting down renderer.");
+        auto shutdownStart = std::chrono::steady_clock::now();
 
-        vkDeviceWaitIdle(vkDevice);
+        WaitIdle();
 
-        // clear swapchain images
-        wrappedSwapchainImages.clear();
+        // clear swapchain images, swapchains, spaces and the session
+        destroyXrSessionResources();
+
+        // Its build shader hands its pipeline to the deletion queue
+        depthPyramid.reset();
+
+        // The device is idle, nothing queued for deletion can still be in use
+        deletionQueue.FlushAll();
+        // Released slots are handed back by the flush
+        bindlessSet.reset();
+        defragmenter.reset();
+
+        // Waits for any uploads still in flight
+        meshPools.clear();
+        uploadManager.reset();
 
         // Clear framebuffer cache
         currentFrameBufferCache = nullptr;
         frameCommandBufferCache.clear();
+        frameRing.reset();
+        viewBuffer.reset();
+        memoryTracker.reset();
 
         if (commandPool != VK_NULL_HANDLE) {
             vkDestroyCommandPool(vkDevice, commandPool, nullptr);
             commandPool = VK_NULL_HANDLE;
         }
 
-        // Destroy OpenXR Swapchains
-        for (auto& swapchain : swapchains) {
-            xrDestroySwapchain(swapchain.handle);
-            swapchain.handle = XR_NULL_HANDLE;
-            spdlog::trace("Destroyed OpenXR Swapchain.");
-        }
-
-        swapchains.clear();
-
-        // Destroy OpenXR Application Space if exists
-        if (xrApplicationSpace != XR_NULL_HANDLE) {
-            xrDestroySpace(xrApplicationSpace);
-            xrApplicationSpace = XR_NULL_HANDLE;
-            spdlog::trace("Destroyed OpenXR Application Space.");
-        }
-
-
-        // Destroy OpenXR Session if exists
-        if (xrSession != XR_NULL_HANDLE) {
-            auto result = xrDestroySession(xrSession);
-            if (result != XR_SUCCESS) {
-                spdlog::error("Failed to destroy OpenXR Session {}", result);
-            }
-            xrSession = XR_NULL_HANDLE;
-            spdlog::trace("Destroyed OpenXR Session.");
-        }
-
         // Destroy vma allocator if exists
         if (vmaAllocator != VK_NULL_HANDLE) {
             vmaDestroyAllocator(vmaAllocator);
@@ -376,19 +609,35 @@ namespace OZZ {
         if (xrInstance != XR_NULL_HANDLE) {
             spdlog::trace("Destroying OpenXR Instance.");
 
-            std::thread t([&]() {
-                xrDestroyInstance(xrInstance);
-                xrInstance = XR_NULL_HANDLE;
-                spdlog::trace("Destroyed OpenXR Instance.");
-            });
-            t.detach();
-            spdlog::trace("Detached OpenXR Instance Destroyer Thread.");
+            /*
+             * Some runtimes hang in xrDestroyInstance. Destroy it on its own thread and only wait
+             * as long as we're willing to, rather than sleeping a fixed amount every shutdown.
+             * The thread doesn't touch the renderer so it's safe to outlive it.
+             */
+            auto instance = xrInstance;
+            xrInstance = XR_NULL_HANDLE;
+
+            auto destroyed = std::make_shared<std::promise<void>>();
+            auto destroyedFuture = destroyed->get_future();
+
+            std::thread([instance, destroyed]() {
+                xrDestroyInstance(instance);
+                destroyed->set_value();
+            }).detach();
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+            if (destroyedFuture.wait_for(XR_INSTANCE_DESTROY_TIMEOUT) == std::future_status::ready) {
+                spdlog::trace("Destroyed OpenXR Instance.");
+            } else {
+                spdlog::warn("OpenXR Instance destruction timed out, abandoning it.");
+            }
         }
+
+        std::chrono::duration<double, std::milli> shutdownDuration = std::chrono::steady_clock::now() - shutdownStart;
+        spdlog::info("Renderer shutdown took {:.2f}ms", shutdownDuration.count());
     }
 
-    std::optional<std::tuple<EyePoseInfo, EyePoseInfo>> Renderer::GetEyePoseInfo(int64_t predictedDisplayTime) const {
+    bool Renderer::locateViews(int64_t predictedDisplayTime) const {
+        if (lastViewsTime == predictedDisplayTime) return true;
 
         XrViewLocateInfo viewLocateInfo{XR_TYPE_VIEW_LOCATE_INFO};
         viewLocateInfo.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
@@ -397,15 +646,28 @@ namespace OZZ {
 
         XrViewState viewState{XR_TYPE_VIEW_STATE};
         uint32_t viewCount = EYE_COUNT;
-        std::vector<XrView> views(viewCount, {XR_TYPE_VIEW});
+        lastViews.fill({XR_TYPE_VIEW});
 
-        auto result = xrLocateViews(xrSession, &viewLocateInfo, &viewState, viewCount, &viewCount, views.data());
+        XrResult result;
+        {
+            AllocationTracker::IgnoreScope ignoreRuntime;
+            result = xrLocateViews(xrSession, &viewLocateInfo, &viewState, viewCount, &viewCount, lastViews.data());
+        }
 
         if (result != XR_SUCCESS) {
             spdlog::error("Failed to locate views {}", result);
-            return std::nullopt;
+            lastViewsTime = -1;
+            return false;
         }
 
+        lastViewsTime = predictedDisplayTime;
+        return true;
+    }
+
+    std::optional<std::tuple<EyePoseInfo, EyePoseInfo>> Renderer::GetEyePoseInfo(int64_t predictedDisplayTime) const {
+        if (!locateViews(predictedDisplayTime)) return std::nullopt;
+        const auto& views = lastViews;
+
         // Build Eye Pose Info
         EyePoseInfo leftEyePoseInfo = {
                 .FOV = {views[0].fov.angleDown, views[0].fov.angleLeft, views[0].fov.angleRight, views[0].fov.angleUp},
@@ -441,7 +703,11 @@ namespace OZZ {
 
 
         XrSpaceLocation spaceLocation{XR_TYPE_SPACE_LOCATION};
-        auto result = xrLocateSpace(xrViewSpace, xrApplicationSpace, frameInfo.PredictedDisplayTime, &spaceLocation);
+        XrResult result;
+        {
+            AllocationTracker::IgnoreScope ignoreRuntime;
+            result = xrLocateSpace(xrViewSpace, xrApplicationSpace, frameInfo.PredictedDisplayTime, &spaceLocation);
+        }
         if (result != XR_SUCCESS) {
             spdlog::error("Failed to locate OpenXR View Reference Space {}", result);
             return std::nullopt;
@@ -455,20 +721,121 @@ namespace OZZ {
         return headPoseInfo;
     }
 
+    bool Renderer::MountAssetArchive(const std::filesystem::path& path) {
+        auto archive = std::make_unique<AssetArchive>(path);
+        if (!archive->IsOpen()) {
+            return false;
+        }
+
+        assetArchive = std::move(archive);
+        return true;
+    }
+
+    bool Renderer::MountAssetArchive(const void* data, size_t size) {
+        auto archive = std::make_unique<AssetArchive>(data, size);
+        if (!archive->IsOpen()) {
+            return false;
+        }
+
+        assetArchive = std::move(archive);
+        return true;
+    }
+
     std::unique_ptr<Shader> Renderer::CreateShader(ShaderConfiguration &config) {
         config.SwapchainColorFormat = static_cast<VkFormat>(swapchainColorFormat);
-        return std::make_unique<Shader>(vkDevice, config);
+        return std::make_unique<Shader>(GetResourceContext(), config, assetArchive.get());
     }
 
-    std::unique_ptr<VertexBuffer> Renderer::CreateVertexBuffer(const std::vector<Vertex> &vertices) {
-        return std::make_unique<VertexBuffer>(vmaAllocator, vertices);
+    std::unique_ptr<ComputeShader> Renderer::CreateComputeShader(ComputeShaderConfiguration &config) {
+        return std::make_unique<ComputeShader>(GetResourceContext(), config, assetArchive.get());
     }
 
-    std::unique_ptr<IndexBuffer> Renderer::CreateIndexBuffer(const std::vector<uint32_t> &indices) {
-        return std::make_unique<IndexBuffer>(vmaAllocator, indices);
+    bool Renderer::EnableOcclusionCulling(const std::filesystem::path& pyramidShaderPath) {
+        ComputeShaderConfiguration config {
+                .ShaderPath = pyramidShaderPath,
+                .PushConstants = { PushConstantDefinition(sizeof(DepthPyramid::LevelSizes), VK_SHADER_STAGE_COMPUTE_BIT) },
+                .DescriptorSetLayouts = { depthPyramid->GetBuildSetLayout() },
+        };
+
+        depthPyramid->SetBuildShader(CreateComputeShader(config));
+        return depthPyramid->CanBuild();
     }
 
-    void Renderer::initXrInstance() {
+    bool Renderer::createFrameRingBuffer() {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(vkPhysicalDevice, &properties);
+
+        frameRing = std::make_unique<FrameRingBuffer>(vkDevice, vmaAllocator, properties.limits, MAX_FRAMES_IN_FLIGHT,
+                                                      memoryTracker.get());
+
+        return true;
+    }
+
+    bool Renderer::createViewBuffer() {
+        viewBuffer = std::make_unique<ViewBuffer>(vkDevice, vmaAllocator, memoryTracker.get(), deviceCapabilities.MeshShader);
+
+        return true;
+    }
+
+    bool Renderer::createBindlessSet() {
+        if (!deviceCapabilities.DescriptorIndexing) {
+            spdlog::info("Descriptor indexing unavailable, no bindless set");
+            return true;
+        }
+
+        VkPhysicalDeviceVulkan12Properties vulkan12Properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES};
+        VkPhysicalDeviceProperties2 properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+        properties.pNext = &vulkan12Properties;
+        vkGetPhysicalDeviceProperties2(vkPhysicalDevice, &properties);
+
+        // The limits cover every set of a pipeline layout, the view buffer, mesh sets and a stage's colour
+        // attachments included. Those get BINDLESS_RESERVED_RESOURCES of each, the arrays split the rest.
+        auto available = [](uint32_t limit) {
+            return limit > BINDLESS_RESERVED_RESOURCES ? limit - BINDLESS_RESERVED_RESOURCES : 0;
+        };
+        auto resourceShare = available(vulkan12Properties.maxPerStageUpdateAfterBindResources) / 2;
+        // A combined image sampler counts against both the sampler and the sampled image limits
+        auto textureCapacity = std::min({BINDLESS_TEXTURE_CAPACITY, resourceShare,
+                                         available(vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers),
+                                         available(vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages),
+                                         available(vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers),
+                                         available(vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages)});
+        auto bufferCapacity = std::min({BINDLESS_BUFFER_CAPACITY, resourceShare,
+                                        available(vulkan12Properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers),
+                                        available(vulkan12Properties.maxDescriptorSetUpdateAfterBindStorageBuffers)});
+
+        bindlessSet = std::make_unique<BindlessSet>(vkDevice, textureCapacity, bufferCapacity, &deletionQueue);
+        if (!bindlessSet->IsValid()) {
+            bindlessSet.reset();
+        }
+
+        return true;
+    }
+
+    MeshPool& Renderer::getMeshPool(std::type_index layout, uint32_t stride) {
+        std::lock_guard lock(meshPoolMutex);
+
+        auto& pool = meshPools[layout];
+        if (!pool) {
+            pool = std::make_unique<MeshPool>(GetResourceContext(), stride);
+        }
+        return *pool;
+    }
+
+    void Renderer::retireFrames() {
+        // Everything older than the oldest frame still being recorded or in flight is done with
+        uint64_t oldestLive = frameNumber + 1;
+        for (auto& cache : frameCommandBufferCache) {
+            cache->CheckAndClearCaches();
+            if (!cache->Available) {
+                oldestLive = std::min(oldestLive, cache->FrameNumber);
+            }
+        }
+
+        deletionQueue.Flush(oldestLive - 1);
+    }
+
+    bool Renderer::initXrInstance() {
         spdlog::trace("Creating OpenXR Instance.");
 
         // create union of extensions required by platform and graphics plugins
@@ -487,10 +854,13 @@ namespace OZZ {
         XrResult result = xrCreateInstance(&createInfo, &xrInstance);
         if (XR_FAILED(result)) {
             spdlog::error("Failed to create OpenXR instance {}", result);
+            return false;
         }
+
+        return true;
     }
 
-    void Renderer::initGetXrSystem() {
+    bool Renderer::initGetXrSystem() {
         // Initialize System
         spdlog::trace("Initializing OpenXR System.");
 
@@ -500,28 +870,20 @@ namespace OZZ {
 
         if (XR_FAILED(result)) {
             spdlog::error("Failed to get OpenXR system {}", result);
+            return false;
         } else {
             spdlog::trace("Got OpenXR system {}", xrSystemId);
         }
-    }
-
-    void Renderer::initVulkanInstance() {
-        // Initialize vulkan instance
-        spdlog::trace("Initializing Vulkan Instance.");
 
-        XrGraphicsRequirementsVulkan2KHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_VULKAN2_KHR};
-        auto result = xrGetVulkanGraphicsRequirements2KHR(xrInstance, xrSystemId, &graphicsRequirements);
-
-        if (XR_FAILED(result)) {
-            spdlog::error("Failed to get OpenXR Vulkan Graphics Requirements {}", result);
-            return;
-        }
+        return true;
+    }
 
-        spdlog::trace("Vulkan Min API Version {}", graphicsRequirements.minApiVersionSupported);
-        spdlog::trace("Vulkan Max API Version {}", graphicsRequirements.maxApiVersionSupported);
+    bool Renderer::enumerateVulkanInstanceSupport() {
+        // Only needs the loader, so this runs alongside OpenXR instance creation
+        spdlog::trace("Enumerating Vulkan Instance Layers and Extensions.");
 
         // Get validation layers
-        std::vector<const char *> vulkanInstanceLayers;
+        vulkanInstanceLayers.clear();
 
         uint32_t layerCount;
         vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
@@ -554,7 +916,7 @@ namespace OZZ {
         }
 
         // get vulkan instance extensions
-        std::vector<const char *> vulkanInstanceExtensions;
+        vulkanInstanceExtensions.clear();
 
         uint32_t extensionCount;
         vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
@@ -574,6 +936,24 @@ namespace OZZ {
             vulkanInstanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
         }
 
+        return true;
+    }
+
+    bool Renderer::initVulkanInstance() {
+        // Initialize vulkan instance
+        spdlog::trace("Initializing Vulkan Instance.");
+
+        XrGraphicsRequirementsVulkan2KHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_VULKAN2_KHR};
+        auto result = xrGetVulkanGraphicsRequirements2KHR(xrInstance, xrSystemId, &graphicsRequirements);
+
+        if (XR_FAILED(result)) {
+            spdlog::error("Failed to get OpenXR Vulkan Graphics Requirements {}", result);
+            return false;
+        }
+
+        spdlog::trace("Vulkan Min API Version {}", graphicsRequirements.minApiVersionSupported);
+        spdlog::trace("Vulkan Max API Version {}", graphicsRequirements.maxApiVersionSupported);
+
         // Create vulkan instance
         VkApplicationInfo appInfo{VK_STRUCTURE_TYPE_APPLICATION_INFO};
         appInfo.pApplicationName = "Hello OpenXR";
@@ -601,18 +981,22 @@ namespace OZZ {
 
         if (XR_FAILED(result)) {
             spdlog::error("Failed to create OpenXR Vulkan Instance {}", result);
+            return false;
         } else {
             spdlog::trace("Created OpenXR Vulkan Instance");
         }
 
         if (vkResult != VK_SUCCESS) {
             spdlog::error("Failed to create Vulkan Instance {}", vkResult);
+            return false;
         } else {
             spdlog::trace("Created Vulkan Instance");
         }
+
+        return true;
     }
 
-    void Renderer::initVulkanDebugMessenger() {
+    bool Renderer::initVulkanDebugMessenger() {
         // Create vulkan debug messenger
         spdlog::trace("Creating Vulkan Debug Messenger");
 
@@ -633,14 +1017,16 @@ namespace OZZ {
                                                   &vkDebugMessenger);
 
         if (vkResult != VK_SUCCESS) {
-            spdlog::error("Failed to create Vulkan Debug Messenger {}", vkResult);
-            return;
+            // Validation output only, the renderer works without it
+            spdlog::warn("Failed to create Vulkan Debug Messenger {}", vkResult);
         } else {
             spdlog::trace("Created Vulkan Debug Messenger");
         }
+
+        return true;
     }
 
-    void Renderer::initVulkanDevice() {
+    bool Renderer::initVulkanDevice() {
         // Get Vulkan Physical Device
         spdlog::trace("Getting Vulkan Physical Device");
 
@@ -652,7 +1038,7 @@ namespace OZZ {
 
         if (XR_FAILED(result)) {
             spdlog::error("Failed to get OpenXR Vulkan Graphics Device {}", result);
-            return;
+            return false;
         } else {
             spdlog::trace("Got OpenXR Vulkan Graphics Device");
         }
@@ -661,9 +1047,9 @@ namespace OZZ {
         spdlog::trace("Getting Vulkan Graphics Queue");
 
         VkDeviceQueueCreateInfo deviceQueueCreateInfo{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
-        float queuePriorities = 0;
+        float queuePriorities[2] = {0.f, 0.f};
         deviceQueueCreateInfo.queueCount = 1;
-        deviceQueueCreateInfo.pQueuePriorities = &queuePriorities;
+        deviceQueueCreateInfo.pQueuePriorities = queuePriorities;
 
         uint32_t queueFamilyCount = 0;
         vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, nullptr);
@@ -678,22 +1064,129 @@ namespace OZZ {
             }
         }
 
+        // Uploads prefer a dedicated transfer family, then a second graphics queue, and only share the graphics queue as a last resort
+        vkTransferQueueFamilyIndex = vkQueueFamilyIndex;
+        uint32_t transferQueueIndex = 0;
+
+        for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+            auto flags = queueFamilyProperties[i].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) != 0u && (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0u) {
+                vkTransferQueueFamilyIndex = i;
+                break;
+            }
+        }
+
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos = { deviceQueueCreateInfo };
+
+        if (vkTransferQueueFamilyIndex != vkQueueFamilyIndex) {
+            VkDeviceQueueCreateInfo transferQueueCreateInfo{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+            transferQueueCreateInfo.queueFamilyIndex = vkTransferQueueFamilyIndex;
+            transferQueueCreateInfo.queueCount = 1;
+            transferQueueCreateInfo.pQueuePriorities = queuePriorities;
+            queueCreateInfos.push_back(transferQueueCreateInfo);
+            spdlog::trace("Using dedicated transfer queue family {}", vkTransferQueueFamilyIndex);
+        } else if (queueFamilyProperties[vkQueueFamilyIndex].queueCount > 1) {
+            queueCreateInfos[0].queueCount = 2;
+            transferQueueIndex = 1;
+            spdlog::trace("Using a second graphics queue for transfers");
+        } else {
+            transferQueueShared = true;
+            spdlog::trace("Sharing the graphics queue for transfers");
+        }
+
         // Get device extensions and features
         spdlog::trace("Getting Vulkan Device Extensions and Features");
         std::vector<const char *> deviceExtensions = {
             VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME
         };
 
+        uint32_t deviceExtensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(vkPhysicalDevice, nullptr, &deviceExtensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableDeviceExtensions(deviceExtensionCount);
+        vkEnumerateDeviceExtensionProperties(vkPhysicalDevice, nullptr, &deviceExtensionCount, availableDeviceExtensions.data());
+
+        auto isDeviceExtSupported = [&](const char *extName) -> bool {
+            for (const auto &availableExtension: availableDeviceExtensions) {
+                if (strcmp(extName, availableExtension.extensionName) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        // Lets VMA report real per-heap usage and budget instead of guessing from heap sizes
+        memoryBudgetSupported = isDeviceExtSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (memoryBudgetSupported) {
+            deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        // GPU driven draws are optional, see DeviceCapabilities
+        bool meshShaderExtSupported = isDeviceExtSupported(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+        VkPhysicalDeviceMeshShaderFeaturesEXT supportedMeshShaderFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT};
+        VkPhysicalDeviceVulkan12Features supportedVulkan12Features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+        supportedVulkan12Features.pNext = meshShaderExtSupported ? &supportedMeshShaderFeatures : nullptr;
+        VkPhysicalDeviceFeatures2 supportedFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+        supportedFeatures.pNext = &supportedVulkan12Features;
+        vkGetPhysicalDeviceFeatures2(vkPhysicalDevice, &supportedFeatures);
+
+        deviceCapabilities.DrawIndirectCount = supportedVulkan12Features.drawIndirectCount == VK_TRUE;
+        deviceCapabilities.MultiDrawIndirect = supportedFeatures.features.multiDrawIndirect == VK_TRUE;
+        deviceCapabilities.DrawIndirectFirstInstance = supportedFeatures.features.drawIndirectFirstInstance == VK_TRUE;
+        // Meshlets are culled in the task shader, mesh shaders alone aren't worth it
+        deviceCapabilities.MeshShader = meshShaderExtSupported && supportedMeshShaderFeatures.taskShader == VK_TRUE &&
+                                        supportedMeshShaderFeatures.meshShader == VK_TRUE;
+        if (deviceCapabilities.MeshShader) {
+            deviceExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+        }
+
+        // Everything BindlessSet relies on, VK_EXT_descriptor_indexing is core since 1.2
+        deviceCapabilities.DescriptorIndexing = supportedVulkan12Features.runtimeDescriptorArray == VK_TRUE &&
+                supportedVulkan12Features.descriptorBindingPartiallyBound == VK_TRUE &&
+                supportedVulkan12Features.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+                supportedVulkan12Features.descriptorBindingStorageBufferUpdateAfterBind == VK_TRUE &&
+                supportedVulkan12Features.descriptorBindingUpdateUnusedWhilePending == VK_TRUE &&
+                supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing == VK_TRUE &&
+                supportedVulkan12Features.shaderStorageBufferArrayNonUniformIndexing == VK_TRUE;
+        const VkBool32 descriptorIndexing = deviceCapabilities.DescriptorIndexing ? VK_TRUE : VK_FALSE;
+
+        VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+            .taskShader = VK_TRUE,
+            .meshShader = VK_TRUE
+        };
+
+        // Timeline semaphores moved in with the rest of 1.2, the two can't be enabled through separate structs
+        VkPhysicalDeviceVulkan12Features vulkan12Features {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .pNext = deviceCapabilities.MeshShader ? &meshShaderFeatures : nullptr,
+            .drawIndirectCount = deviceCapabilities.DrawIndirectCount ? VK_TRUE : VK_FALSE,
+            .shaderSampledImageArrayNonUniformIndexing = descriptorIndexing,
+            .shaderStorageBufferArrayNonUniformIndexing = descriptorIndexing,
+            .descriptorBindingSampledImageUpdateAfterBind = descriptorIndexing,
+            .descriptorBindingStorageBufferUpdateAfterBind = descriptorIndexing,
+            .descriptorBindingUpdateUnusedWhilePending = descriptorIndexing,
+            .descriptorBindingPartiallyBound = descriptorIndexing,
+            .runtimeDescriptorArray = descriptorIndexing,
+            .timelineSemaphore = VK_TRUE
+        };
+
         VkPhysicalDeviceDynamicRenderingFeaturesKHR features {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+            .pNext = &vulkan12Features,
             .dynamicRendering = VK_TRUE
         };
 
         VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.multiDrawIndirect = supportedFeatures.features.multiDrawIndirect;
+        deviceFeatures.drawIndirectFirstInstance = supportedFeatures.features.drawIndirectFirstInstance;
+
+        spdlog::trace("Indirect draws: count {}, multi-draw {}, first instance {}", deviceCapabilities.DrawIndirectCount,
+                      deviceCapabilities.MultiDrawIndirect, deviceCapabilities.DrawIndirectFirstInstance);
+        spdlog::trace("Mesh shaders: {}, descriptor indexing: {}", deviceCapabilities.MeshShader, deviceCapabilities.DescriptorIndexing);
 
         VkDeviceCreateInfo deviceCreateInfo { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
-        deviceCreateInfo.queueCreateInfoCount = 1;
-        deviceCreateInfo.pQueueCreateInfos = &deviceQueueCreateInfo;
+        deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+        deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
         deviceCreateInfo.enabledLayerCount = 0;
         deviceCreateInfo.ppEnabledLayerNames = nullptr;
         deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
@@ -716,38 +1209,74 @@ namespace OZZ {
 
         if (XR_FAILED(result)) {
             spdlog::error("Failed to create OpenXR Vulkan Device {}", result);
+            return false;
         } else {
             spdlog::trace("Created OpenXR Vulkan Device");
         }
 
         if (vkResult != VK_SUCCESS) {
             spdlog::error("Failed to create Vulkan Device {}", vkResult);
+            return false;
         } else {
             spdlog::trace("Created Vulkan Device");
         }
 
+        // The static loader only exports core entry points
+        CommandEncoder::LoadDeviceFunctions(vkDevice, deviceCapabilities.MeshShader);
+        if (deviceCapabilities.MeshShader && !CommandEncoder::CanDrawMeshTasks()) {
+            spdlog::warn("VK_EXT_mesh_shader is enabled but vkCmdDrawMeshTasksEXT couldn't be loaded, using the classic path");
+            deviceCapabilities.MeshShader = false;
+        }
+
         // Get the vulkan graphics queue
         vkGetDeviceQueue(vkDevice, vkQueueFamilyIndex, 0, &vkQueue);
+        vkGetDeviceQueue(vkDevice, vkTransferQueueFamilyIndex, transferQueueIndex, &vkTransferQueue);
+
+        return true;
     }
 
-    void Renderer::initVulkanMemoryAllocator() {
+    bool Renderer::initVulkanMemoryAllocator() {
         // initialize vma allocator
         VmaAllocatorCreateInfo vmaAllocatorCreateInfo{};
         vmaAllocatorCreateInfo.physicalDevice = vkPhysicalDevice;
         vmaAllocatorCreateInfo.device = vkDevice;
         vmaAllocatorCreateInfo.instance = vkInstance;
+        // Budget queries go through vkGetPhysicalDeviceMemoryProperties2, core since 1.1
+        vmaAllocatorCreateInfo.vulkanApiVersion = VK_API_VERSION_1_1;
+
+        if (memoryBudgetSupported) {
+            vmaAllocatorCreateInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+        }
 
         auto vkResult = vmaCreateAllocator(&vmaAllocatorCreateInfo, &vmaAllocator);
 
         // check if successful
         if (vkResult != VK_SUCCESS) {
             spdlog::error("Failed to create VMA Allocator {}", vkResult);
-        } else {
-            spdlog::trace("Created VMA Allocator");
+            return false;
         }
+
+        spdlog::trace("Created VMA Allocator, memory budget {}", memoryBudgetSupported ? "enabled" : "estimated");
+        memoryTracker = std::make_unique<MemoryTracker>(vkPhysicalDevice, vmaAllocator, memoryBudgetSupported);
+
+        return true;
+    }
+
+    bool Renderer::createUploadManager() {
+        uploadManager = std::make_unique<UploadManager>(vkDevice, vmaAllocator, vkTransferQueue, vkTransferQueueFamilyIndex,
+                                                        vkQueueFamilyIndex, &vkQueueMutex, memoryTracker.get());
+
+        return true;
+    }
+
+    bool Renderer::createDefragmenter() {
+        defragmenter = std::make_unique<Defragmenter>(vkDevice, vmaAllocator, *uploadManager, deletionQueue,
+                                                      memoryTracker.get());
+
+        return true;
     }
 
-    void Renderer::initXrSession() {
+    bool Renderer::initXrSession() {
         // Create XR Session
         spdlog::trace("Creating XR Session");
 
@@ -765,13 +1294,15 @@ namespace OZZ {
 
         if (XR_FAILED(result)) {
             spdlog::error("Failed to create OpenXR Session {}", result);
-            return;
+            return false;
         } else {
             spdlog::trace("Created OpenXR Session");
         }
+
+        return true;
     }
 
-    void Renderer::initXrReferenceSpaces() {
+    bool Renderer::initXrReferenceSpaces() {
         // Create Reference Space
         spdlog::trace("Creating XR Reference Space");
 
@@ -783,19 +1314,21 @@ namespace OZZ {
 
         if (XR_FAILED(result)) {
             spdlog::error("Failed to create OpenXR Reference Space {}", result);
-            return;
+            return false;
         } else {
             spdlog::trace("Created OpenXR Reference Space");
         }
+
+        return true;
     }
 
-    void Renderer::initXrSwapchains() {
+    bool Renderer::initXrSwapchains() {
         XrSystemProperties systemProperties{XR_TYPE_SYSTEM_PROPERTIES};
         auto result = xrGetSystemProperties(xrInstance, xrSystemId, &systemProperties);
 
         if (XR_FAILED(result)) {
             spdlog::error("Failed to get OpenXR System Properties {}", result);
-            return;
+            return false;
         } else {
             spdlog::trace("Got OpenXR System Properties");
         }
@@ -818,7 +1351,7 @@ namespace OZZ {
 
         if (XR_FAILED(result)) {
             spdlog::error("Failed to get OpenXR View Configuration count {}", result);
-            return;
+            return false;
         }
 
         viewConfigurationViews.resize(viewCount, {XR_TYPE_VIEW_CONFIGURATION_VIEW});
@@ -826,7 +1359,7 @@ namespace OZZ {
 
         if (XR_FAILED(result)) {
             spdlog::error("Failed to get OpenXR View Configuration Views {}", result);
-            return;
+            return false;
         } else {
             spdlog::trace("Got OpenXR View Configuration Views");
         }
@@ -838,19 +1371,25 @@ namespace OZZ {
 
             if (XR_FAILED(result)) {
                 spdlog::error("Failed to get OpenXR Swapchain Format count {}", result);
-                return;
+                return false;
             }
             std::vector<int64_t > swapchainFormats(swapchainFormatCount);
             result = xrEnumerateSwapchainFormats(xrSession, swapchainFormatCount, &swapchainFormatCount, swapchainFormats.data());
 
             if (XR_FAILED(result)) {
                 spdlog::error("Failed to get OpenXR Swapchain Formats {}", result);
-                return;
+                return false;
             } else {
                 spdlog::trace("Got OpenXR Swapchain Formats");
             }
 
-            swapchainColorFormat = SelectColorSwapchainFormat(swapchainFormats);
+            // Pipelines are built for the first format picked, a recovered session has to keep using it
+            if (swapchainColorFormat == -1) {
+                swapchainColorFormat = SelectColorSwapchainFormat(swapchainFormats);
+            } else if (std::ranges::find(swapchainFormats, swapchainColorFormat) == swapchainFormats.end()) {
+                spdlog::error("OpenXR runtime no longer offers Swapchain Format {}", swapchainColorFormat);
+                return false;
+            }
 
             spdlog::info("Selected Swapchain Format: {}", swapchainColorFormat);
 
@@ -875,7 +1414,7 @@ namespace OZZ {
 
                 if (XR_FAILED(result)) {
                     spdlog::error("Failed to create OpenXR Swapchain {}", result);
-                    return;
+                    return false;
                 } else {
                     spdlog::trace("Created OpenXR Swapchain");
                 }
@@ -888,7 +1427,7 @@ namespace OZZ {
 
                 if (XR_FAILED(result)) {
                     spdlog::error("Failed to get OpenXR Swapchain Image count {}", result);
-                    return;
+                    return false;
                 }
 
                 swapchainImages[i].resize(swapchainImageCount, {XR_TYPE_SWAPCHAIN_IMAGE_VULKAN2_KHR});
@@ -897,15 +1436,17 @@ namespace OZZ {
 
                 if (XR_FAILED(result)) {
                     spdlog::error("Failed to get OpenXR Swapchain Images {}", result);
-                    return;
+                    return false;
                 } else {
                     spdlog::trace("Got OpenXR Swapchain Images");
                 }
             }
         }
+
+        return true;
     }
 
-    void Renderer::createCommandPool() {
+    bool Renderer::createCommandPool() {
         VkCommandPoolCreateInfo commandPoolCreateInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
         commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
         commandPoolCreateInfo.queueFamilyIndex = vkQueueFamilyIndex;
@@ -914,101 +1455,91 @@ namespace OZZ {
 
         if (vkResult != VK_SUCCESS) {
             spdlog::error("Failed to create Vulkan Command Pool {}", vkResult);
-            return;
+            return false;
         } else {
             spdlog::trace("Created Vulkan Command Pool");
         }
+
+        return true;
     }
 
-    void Renderer::createFrameData() {
+    bool Renderer::createFrameData() {
+        if (swapchains.size() < EYE_COUNT) {
+            spdlog::error("Can't create frame data without a swapchain per eye");
+            return false;
+        }
+
         wrappedSwapchainImages.resize(EYE_COUNT);
 
-        VkFormat depthFormat = findDepthFormat(vkPhysicalDevice);
+        depthFormat = findDepthFormat(vkPhysicalDevice);
 
         spdlog::info("Selected Depth Format: {}", depthFormat);
+
+        // Every image's layout transition goes into one command buffer and one submit
+        auto queueLock = lockGraphicsQueue();
+        auto setupCommandBuffer = beginSingleTimeCommands(vkDevice, commandPool);
+
         for (auto eye = 0; eye < EYE_COUNT; eye++) {
             wrappedSwapchainImages[eye] = std::vector<std::unique_ptr<SwapchainImage>> {swapchainImages[eye].size() };
             for (auto i = 0; i < swapchainImages[eye].size(); i++) {
                 wrappedSwapchainImages[eye][i] = std::make_unique<SwapchainImage> (
                         vkDevice,
                         vmaAllocator,
+                        memoryTracker.get(),
                         &swapchains[eye],
                         swapchainImages[eye][i],
+                        depthFormat,
                         commandPool,
-                        vkQueue
+                        setupCommandBuffer
                 );
             }
         }
+
+        // Kept across session recovery so GPU scenes can hold on to it, only its images follow the swapchains
+        if (!depthPyramid) {
+            depthPyramid = std::make_unique<DepthPyramid>(vkDevice, vmaAllocator, memoryTracker.get());
+        }
+        depthPyramid->Resize(setupCommandBuffer, {static_cast<uint32_t>(swapchains[0].width),
+                                                  static_cast<uint32_t>(swapchains[0].height)}, depthFormat);
+
+        vkEndCommandBuffer(setupCommandBuffer);
+        endSingleTimeCommands(vkDevice, commandPool, vkQueue, setupCommandBuffer);
+
+        return true;
     }
 
     bool Renderer::processXREvents() {
-        XrEventDataBuffer eventDataBuffer{XR_TYPE_EVENT_DATA_BUFFER};
-
-        XrResult result = xrPollEvent(xrInstance, &eventDataBuffer);
+        if (xrInstance == XR_NULL_HANDLE) return false;
+
+        // Drain every pending event, state can move through several stages between frames
+        while (true) {
+            XrEventDataBuffer eventDataBuffer{XR_TYPE_EVENT_DATA_BUFFER};
+            XrResult result = xrPollEvent(xrInstance, &eventDataBuffer);
+
+            if (result == XR_EVENT_UNAVAILABLE) {
+                return false;
+            } else if (XR_FAILED(result)) {
+                spdlog::error("Failed to poll OpenXR event {}", result);
+                return false;
+            }
 
-        if (result == XR_EVENT_UNAVAILABLE) {
-            return false;
-        } else if (XR_FAILED(result)) {
-            spdlog::error("Failed to poll OpenXR event {}", result);
-            return false;
-        } else {
             spdlog::trace("Got OpenXR event");
             switch (eventDataBuffer.type) {
                 case XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING: {
                     spdlog::info("Instance loss pending");
-                    break;
+                    handleXrLoss(true);
+                    return false;
                 }
                 case XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED: {
                     auto event = *reinterpret_cast<const XrEventDataSessionStateChanged *> (&eventDataBuffer);
-                    switch(event.state){
-                        case XR_SESSION_STATE_UNKNOWN:
-                        case XR_SESSION_STATE_MAX_ENUM:
-                            spdlog::info("Session state changed to unknown");
-                            break;
-                        case XR_SESSION_STATE_IDLE:
-                            spdlog::info("Session state changed to idle");
-                            xrSessionInitialized = false;
-                            break;
-                        case XR_SESSION_STATE_READY: {
-                            spdlog::info("Session state changed to ready");
-                            // begin openxr session
-                            XrSessionBeginInfo sessionBeginInfo{XR_TYPE_SESSION_BEGIN_INFO};
-                            sessionBeginInfo.primaryViewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
-
-                            result = xrBeginSession(xrSession, &sessionBeginInfo);
-                            if (XR_FAILED(result)) {
-                                spdlog::error("Failed to begin OpenXR session {}", result);
-                                return true;
-                            } else {
-                                spdlog::trace("Began OpenXR session");
-                            }
-                            xrSessionInitialized = true;
-                            break;
-                        }
-                        case XR_SESSION_STATE_SYNCHRONIZED:
-                        case XR_SESSION_STATE_VISIBLE:
-                        case XR_SESSION_STATE_FOCUSED:
-                            xrSessionInitialized = true;
-                            break;
-                        case XR_SESSION_STATE_STOPPING:
-                            spdlog::info("Session state changed to stopping");
-
-                            result = xrEndSession(xrSession);
-                            if (XR_FAILED(result)) {
-                                spdlog::error("Failed to end OpenXR session {}", result);
-                            } else {
-                                spdlog::trace("Ended OpenXR session");
-                            }
-                            return true;
-                            break;
-                        case XR_SESSION_STATE_LOSS_PENDING:
-                            spdlog::info("Session state changed to loss pending");
-                            break;
-                        case XR_SESSION_STATE_EXITING:
-                            spdlog::info("Session state changed to exiting");
-                            break;
+                    if (handleSessionStateChanged(event)) {
+                        return true;
                     }
 
+                    // The session is gone, anything left in the queue belongs to it
+                    if (xrSessionLost) {
+                        return false;
+                    }
                     break;
                 }
                 case XR_TYPE_EVENT_DATA_REFERENCE_SPACE_CHANGE_PENDING: {
@@ -1024,12 +1555,229 @@ namespace OZZ {
                     break;
                 }
             }
+        }
+    }
+
+    bool Renderer::handleSessionStateChanged(const XrEventDataSessionStateChanged& event) {
+        switch(event.state){
+            case XR_SESSION_STATE_UNKNOWN:
+            case XR_SESSION_STATE_MAX_ENUM:
+                spdlog::info("Session state changed to unknown");
+                sessionState = SessionState::Unknown;
+                break;
+            case XR_SESSION_STATE_IDLE:
+                spdlog::info("Session state changed to idle");
+                sessionState = SessionState::Idle;
+                xrSessionInitialized = false;
+                break;
+            case XR_SESSION_STATE_READY: {
+                spdlog::info("Session state changed to ready");
+                sessionState = SessionState::Ready;
+                // begin openxr session
+                XrSessionBeginInfo sessionBeginInfo{XR_TYPE_SESSION_BEGIN_INFO};
+                sessionBeginInfo.primaryViewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+
+                auto result = xrBeginSession(xrSession, &sessionBeginInfo);
+                if (XR_FAILED(result)) {
+                    spdlog::error("Failed to begin OpenXR session {}", result);
+                    return true;
+                } else {
+                    spdlog::trace("Began OpenXR session");
+                }
+                xrSessionInitialized = true;
+                break;
+            }
+            case XR_SESSION_STATE_SYNCHRONIZED:
+                spdlog::info("Session state changed to synchronized");
+                sessionState = SessionState::Synchronized;
+                break;
+            case XR_SESSION_STATE_VISIBLE:
+                spdlog::info("Session state changed to visible");
+                sessionState = SessionState::Visible;
+                break;
+            case XR_SESSION_STATE_FOCUSED:
+                spdlog::info("Session state changed to focused");
+                sessionState = SessionState::Focused;
+                break;
+            case XR_SESSION_STATE_STOPPING: {
+                spdlog::info("Session state changed to stopping");
+                sessionState = SessionState::Stopping;
+                xrSessionInitialized = false;
+
+                // Back to idle, the runtime either restarts us (READY) or asks us to exit (EXITING)
+                auto result = xrEndSession(xrSession);
+                if (XR_FAILED(result)) {
+                    spdlog::error("Failed to end OpenXR session {}", result);
+                } else {
+                    spdlog::trace("Ended OpenXR session");
+                }
+                break;
+            }
+            case XR_SESSION_STATE_LOSS_PENDING:
+                spdlog::info("Session state changed to loss pending");
+                sessionState = SessionState::LossPending;
+                handleXrLoss(false);
+                break;
+            case XR_SESSION_STATE_EXITING:
+                spdlog::info("Session state changed to exiting");
+                sessionState = SessionState::Exiting;
+                return true;
+        }
+
+        return false;
+    }
+
+    void Renderer::destroyXrSessionResources() {
+        // clear swapchain images
+        wrappedSwapchainImages.clear();
+        for (auto& images : swapchainImages) {
+            images.clear();
+        }
+
+        // Destroy OpenXR Swapchains
+        for (auto& swapchain : swapchains) {
+            xrDestroySwapchain(swapchain.handle);
+            swapchain.handle = XR_NULL_HANDLE;
+            spdlog::trace("Destroyed OpenXR Swapchain.");
+        }
+
+        swapchains.clear();
+        viewConfigurationViews.clear();
+
+        // Destroy OpenXR View Space if exists
+        if (xrViewSpace != XR_NULL_HANDLE) {
+            xrDestroySpace(xrViewSpace);
+            xrViewSpace = XR_NULL_HANDLE;
+            spdlog::trace("Destroyed OpenXR View Space.");
+        }
+
+        // Destroy OpenXR Application Space if exists
+        if (xrApplicationSpace != XR_NULL_HANDLE) {
+            xrDestroySpace(xrApplicationSpace);
+            xrApplicationSpace = XR_NULL_HANDLE;
+            spdlog::trace("Destroyed OpenXR Application Space.");
+        }
+
+        // Destroy OpenXR Session if exists
+        if (xrSession != XR_NULL_HANDLE) {
+            auto result = xrDestroySession(xrSession);
+            if (result != XR_SUCCESS) {
+                spdlog::error("Failed to destroy OpenXR Session {}", result);
+            }
+            xrSession = XR_NULL_HANDLE;
+            spdlog::trace("Destroyed OpenXR Session.");
+        }
+
+        xrSessionInitialized = false;
+    }
+
+    void Renderer::handleXrLoss(bool instanceLost) {
+        spdlog::warn("OpenXR {} lost, tearing down XR resources and keeping Vulkan alive", instanceLost ? "instance" : "session");
+
+        // The swapchain images are about to go away, nothing in flight may still be using them
+        WaitIdle();
+        destroyXrSessionResources();
+
+        if (instanceLost && xrInstance != XR_NULL_HANDLE) {
+            xrDestroyInstance(xrInstance);
+            xrInstance = XR_NULL_HANDLE;
+            xrSystemId = XR_NULL_SYSTEM_ID;
+        }
+
+        xrSessionLost = true;
+        sessionState = SessionState::Lost;
+        // Give the runtime a moment before the first attempt
+        lastXrRecoveryAttempt = std::chrono::steady_clock::now();
+    }
+
+    bool Renderer::tryRecoverXrSession() {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastXrRecoveryAttempt < XR_RECOVERY_RETRY_INTERVAL) {
+            return true;
+        }
+        lastXrRecoveryAttempt = now;
+
+        if (xrInstance == XR_NULL_HANDLE) {
+            initXrInstance();
+            if (xrInstance == XR_NULL_HANDLE) {
+                return true;
+            }
+        }
+
+        // The system is unavailable until the headset comes back, keep retrying until it does
+        XrSystemGetInfo systemInfo{XR_TYPE_SYSTEM_GET_INFO};
+        systemInfo.formFactor = XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY;
+        auto result = xrGetSystem(xrInstance, &systemInfo, &xrSystemId);
+
+        if (result == XR_ERROR_FORM_FACTOR_UNAVAILABLE) {
+            return true;
+        } else if (XR_FAILED(result)) {
+            spdlog::error("Failed to get OpenXR system during recovery {}", result);
+            return true;
+        }
+
+        // Required before creating a session
+        XrGraphicsRequirementsVulkan2KHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_VULKAN2_KHR};
+        result = xrGetVulkanGraphicsRequirements2KHR(xrInstance, xrSystemId, &graphicsRequirements);
+
+        if (XR_FAILED(result)) {
+            spdlog::error("Failed to get OpenXR Vulkan Graphics Requirements during recovery {}", result);
+            return true;
+        }
+
+        // Our device, allocator and every resource created on it are only reusable if the runtime still wants the same GPU
+        VkPhysicalDevice physicalDevice{VK_NULL_HANDLE};
+        XrVulkanGraphicsDeviceGetInfoKHR deviceGetInfoKHR{XR_TYPE_VULKAN_GRAPHICS_DEVICE_GET_INFO_KHR};
+        deviceGetInfoKHR.systemId = xrSystemId;
+        deviceGetInfoKHR.vulkanInstance = vkInstance;
+
+        result = xrGetVulkanGraphicsDevice2KHR(xrInstance, &deviceGetInfoKHR, &physicalDevice);
+
+        if (XR_FAILED(result)) {
+            spdlog::error("Failed to get OpenXR Vulkan Graphics Device during recovery {}", result);
+            return true;
+        }
+
+        if (physicalDevice != vkPhysicalDevice) {
+            spdlog::error("OpenXR runtime now requires a different physical device, a full restart is required");
+            return false;
+        }
+
+        auto recoveryStart = std::chrono::steady_clock::now();
+
+        if (!initXrSession()) {
+            return true;
+        }
+
+        initXrReferenceSpaces();
+
+        // Shaders, their pipelines and every static bundle recorded with them target the original format
+        if (!initXrSwapchains() || swapchains.empty() || swapchains.size() != viewConfigurationViews.size()) {
+            spdlog::error("Couldn't recreate the swapchains in format {} during recovery, a full restart is required",
+                          swapchainColorFormat);
+            destroyXrSessionResources();
             return false;
         }
 
+        if (!createFrameData()) {
+            destroyXrSessionResources();
+            return false;
+        }
+
+        xrSessionLost = false;
+        sessionState = SessionState::Idle;
+
+        std::chrono::duration<double, std::milli> recoveryDuration = std::chrono::steady_clock::now() - recoveryStart;
+        spdlog::info("Recovered OpenXR session in {:.2f}ms", recoveryDuration.count());
+        return true;
     }
 
     VkCommandBuffer Renderer::getCommandBufferForSubmission() {
+        // One the cache recorded in an earlier frame if it has one, beginning it again resets it
+        if (auto recycled = currentFrameBufferCache->TakeRecycledCommandBuffer(); recycled != VK_NULL_HANDLE) {
+            return recycled;
+        }
+
         // create a new secondary command buffer
         VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
         allocInfo.commandPool = commandPool;
@@ -7,34 +7,50 @@
 #include <ozz_vulkan/internal/utils.h>
 #include <ozz_vulkan/internal/vk_utils.h>
 
+#include <atomic>
 #include <utility>
 #include <spdlog/spdlog.h>
 
 namespace OZZ {
 
-    Shader::Shader(VkDevice device, ShaderConfiguration config) : _device(device), _config(std::move(config)) {
-        spdlog::trace("Creating shader with vertex shader path: {} and fragment shader path: {}",
-                      _config.VertexShaderPath.string(), _config.FragmentShaderPath.string());
+    static std::atomic<uint32_t> nextShaderId { 1 };
+
+    Shader::Shader(const ResourceContext& context, ShaderConfiguration config, const AssetArchive* archive) :
+            _device(context.Device),
+            _context(context),
+            _archive(archive),
+            _config(std::move(config)),
+            _id(nextShaderId.fetch_add(1, std::memory_order_relaxed)) {
+        spdlog::trace("Creating shader with {} shader path: {} and fragment shader path: {}", IsMeshShading() ? "mesh" : "vertex",
+                      IsMeshShading() ? _config.MeshShaderPath.string() : _config.VertexShaderPath.string(),
+                      _config.FragmentShaderPath.string());
         createPipeline();
     }
 
     Shader::~Shader() {
         spdlog::trace("Destroying shader");
-        if (_pipeline != VK_NULL_HANDLE) {
-            vkDestroyPipeline(_device, _pipeline, nullptr);
-            _pipeline = VK_NULL_HANDLE;
-        }
+        // Frames still in flight may have the pipeline bound
+        _context.Defer([device = _device, pipeline = _pipeline, pipelineLayout = _pipelineLayout]() {
+            if (pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, pipeline, nullptr);
+            }
 
-        if (_pipelineLayout != VK_NULL_HANDLE) {
-            vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
-            _pipelineLayout = VK_NULL_HANDLE;
-        }
+            if (pipelineLayout != VK_NULL_HANDLE) {
+                vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+            }
+        });
+        _pipeline = VK_NULL_HANDLE;
+        _pipelineLayout = VK_NULL_HANDLE;
     }
 
     void Shader::Bind(VkCommandBuffer commandBuffer) {
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
     }
 
+    void Shader::Bind(CommandEncoder& encoder) const {
+        encoder.BindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
+    }
+
     void Shader::recreatePipeline() {
 
     }
@@ -44,23 +60,26 @@ namespace OZZ {
     }
 
     void Shader::createPipeline() {
-        auto vertShaderCode = readFile(_config.VertexShaderPath);
-        auto fragShaderCode = readFile(_config.FragmentShaderPath);
-
-        VkShaderModule vertShaderModule = createShaderModule(_device, vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(_device, fragShaderCode);
-
-        VkPipelineShaderStageCreateInfo vertShaderStageInfo{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
-        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertShaderStageInfo.module = vertShaderModule;
-        vertShaderStageInfo.pName = "main";
-
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
-        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragShaderStageInfo.module = fragShaderModule;
-        fragShaderStageInfo.pName = "main";
-
-        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+        // Vertex and fragment, or an optional task shader, mesh and fragment
+        std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+        auto addStage = [&](VkShaderStageFlagBits stage, const std::filesystem::path& path) {
+            VkPipelineShaderStageCreateInfo stageInfo{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+            stageInfo.stage = stage;
+            stageInfo.module = loadShaderModule(path);
+            stageInfo.pName = "main";
+            shaderStages.push_back(stageInfo);
+        };
+
+        const bool meshShading = IsMeshShading();
+        if (meshShading) {
+            if (!_config.TaskShaderPath.empty()) {
+                addStage(VK_SHADER_STAGE_TASK_BIT_EXT, _config.TaskShaderPath);
+            }
+            addStage(VK_SHADER_STAGE_MESH_BIT_EXT, _config.MeshShaderPath);
+        } else {
+            addStage(VK_SHADER_STAGE_VERTEX_BIT, _config.VertexShaderPath);
+        }
+        addStage(VK_SHADER_STAGE_FRAGMENT_BIT, _config.FragmentShaderPath);
 
         std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
 
@@ -68,14 +87,13 @@ namespace OZZ {
         dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
         dynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
 
-        auto bindings = Vertex::getBindingDescription();
-        auto attributes = Vertex::getAttributeDescriptions();
+        const auto& vertexLayout = _config.VertexLayout;
 
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
         vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.vertexAttributeDescriptionCount = attributes.size();
-        vertexInputInfo.pVertexBindingDescriptions = &bindings;
-        vertexInputInfo.pVertexAttributeDescriptions = attributes.data();
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexLayout.Attributes.size());
+        vertexInputInfo.pVertexBindingDescriptions = &vertexLayout.Binding;
+        vertexInputInfo.pVertexAttributeDescriptions = vertexLayout.Attributes.data();
 
         VkPipelineInputAssemblyStateCreateInfo inputAssembly{
                 VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
@@ -119,7 +137,8 @@ namespace OZZ {
         depthStencil.maxDepthBounds = 1.f;
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-        pipelineLayoutInfo.setLayoutCount = 0;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(_config.DescriptorSetLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = _config.DescriptorSetLayouts.data();
         pipelineLayoutInfo.pushConstantRangeCount = _config.PushConstants.size();
         pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
@@ -141,10 +160,11 @@ namespace OZZ {
         renderingCreateInfo.depthAttachmentFormat = VK_FORMAT_D32_SFLOAT;
 
         VkGraphicsPipelineCreateInfo pipelineInfo{VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+        pipelineInfo.pStages = shaderStages.data();
+        // Mesh shaders emit their own primitives
+        pipelineInfo.pVertexInputState = meshShading ? nullptr : &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = meshShading ? nullptr : &inputAssembly;
         pipelineInfo.pViewportState = &viewportState;
         pipelineInfo.pRasterizationState = &rasterizer;
         pipelineInfo.pMultisampleState = &multisampling;
@@ -161,8 +181,22 @@ namespace OZZ {
         } else {
             spdlog::trace("Created graphics pipeline");
         }
-        vkDestroyShaderModule(_device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(_device, vertShaderModule, nullptr);
+        for (const auto& stage : shaderStages) {
+            vkDestroyShaderModule(_device, stage.module, nullptr);
+        }
+    }
+
+    VkShaderModule Shader::loadShaderModule(const std::filesystem::path& path) {
+        // Prefer the mounted archive, SPIR-V is handed to the driver straight out of the mapping
+        if (_archive) {
+            if (auto asset = _archive->Load(path.generic_string()); asset.has_value()) {
+                return createShaderModule(_device, asset->Data(), asset->Size());
+            }
+            spdlog::warn("Shader {} not found in asset archive, falling back to disk", path.string());
+        }
+
+        auto code = readFile(path);
+        return createShaderModule(_device, code);
     }
 
 
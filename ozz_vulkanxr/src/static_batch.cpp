@@ -0,0 +1,174 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/resources/static_batch.h>
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+
+namespace OZZ {
+
+    StaticBatch::~StaticBatch() {
+        release();
+    }
+
+    StaticBatch::StaticBatch(StaticBatch&& other) noexcept
+            : _pool(other._pool), _clusters(std::move(other._clusters)), _stats(other._stats) {
+        other._pool = nullptr;
+        other._clusters.clear();
+    }
+
+    StaticBatch& StaticBatch::operator=(StaticBatch&& other) noexcept {
+        if (this != &other) {
+            release();
+            _pool = other._pool;
+            _clusters = std::move(other._clusters);
+            _stats = other._stats;
+            other._pool = nullptr;
+            other._clusters.clear();
+        }
+        return *this;
+    }
+
+    bool StaticBatch::IsReady() const {
+        if (!_pool) return false;
+        return std::all_of(_clusters.begin(), _clusters.end(), [this](const StaticCluster& cluster) {
+            return !cluster.Mesh.IsValid() || _pool->IsReady(cluster.Mesh);
+        });
+    }
+
+    void StaticBatch::release() {
+        if (!_pool) return;
+        for (const auto& cluster : _clusters) {
+            if (cluster.Mesh.IsValid()) _pool->Release(cluster.Mesh);
+        }
+        _clusters.clear();
+        _pool = nullptr;
+    }
+
+    void StaticBatcher::Add(uint32_t group, std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                            const glm::mat4& transform, glm::vec3 colour) {
+        if (vertices.empty() || indices.empty()) return;
+
+        if (vertices.size() > MAX_CLUSTER_VERTICES) {
+            spdlog::error("Static mesh of {} vertices is too large to batch, the limit is {}", vertices.size(),
+                          MAX_CLUSTER_VERTICES);
+            return;
+        }
+
+        // Normals go through the inverse transpose so non-uniform scales don't skew them
+        auto normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+        glm::vec3 min { std::numeric_limits<float>::max() };
+        glm::vec3 max { std::numeric_limits<float>::lowest() };
+
+        auto firstVertex = static_cast<uint32_t>(_vertices.size());
+        for (const auto& vertex : vertices) {
+            auto& transformed = _vertices.emplace_back(vertex);
+            transformed.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.f));
+            transformed.Colour = vertex.Colour * colour;
+
+            auto normal = normalMatrix * vertex.Normal;
+            auto length = glm::length(normal);
+            transformed.Normal = length > 0.f ? normal / length : normal;
+
+            min = glm::min(min, transformed.Position);
+            max = glm::max(max, transformed.Position);
+        }
+
+        auto firstIndex = static_cast<uint32_t>(_indices.size());
+        _indices.insert(_indices.end(), indices.begin(), indices.end());
+
+        auto centre = (min + max) * 0.5f;
+        _pieces.push_back({
+            .Group = group,
+            .Cell = glm::ivec3(glm::floor(centre / _cellSize)),
+            .FirstVertex = firstVertex,
+            .VertexCount = static_cast<uint32_t>(vertices.size()),
+            .FirstIndex = firstIndex,
+            .IndexCount = static_cast<uint32_t>(indices.size()),
+        });
+    }
+
+    std::vector<StaticBatcher::PendingCluster> StaticBatcher::buildClusters() {
+        // Pieces of the same group and cell end up next to each other
+        std::vector<uint32_t> order(_pieces.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            const auto& left = _pieces[a];
+            const auto& right = _pieces[b];
+            return std::tie(left.Group, left.Cell.x, left.Cell.y, left.Cell.z) <
+                   std::tie(right.Group, right.Cell.x, right.Cell.y, right.Cell.z);
+        });
+
+        std::vector<PendingCluster> clusters;
+        const Piece* previous = nullptr;
+
+        for (auto index : order) {
+            const auto& piece = _pieces[index];
+
+            bool sameBucket = previous && previous->Group == piece.Group && previous->Cell == piece.Cell;
+            bool fits = !clusters.empty() &&
+                        clusters.back().Vertices.size() + piece.VertexCount <= MAX_CLUSTER_VERTICES;
+            if (!sameBucket || !fits) {
+                auto& cluster = clusters.emplace_back();
+                cluster.Cluster.Group = piece.Group;
+                cluster.Cluster.Min = glm::vec3(std::numeric_limits<float>::max());
+                cluster.Cluster.Max = glm::vec3(std::numeric_limits<float>::lowest());
+            }
+            previous = &piece;
+
+            auto& cluster = clusters.back();
+            auto base = static_cast<uint32_t>(cluster.Vertices.size());
+
+            for (uint32_t i = 0; i < piece.VertexCount; i++) {
+                const auto& vertex = cluster.Vertices.emplace_back(_vertices[piece.FirstVertex + i]);
+                cluster.Cluster.Min = glm::min(cluster.Cluster.Min, vertex.Position);
+                cluster.Cluster.Max = glm::max(cluster.Cluster.Max, vertex.Position);
+            }
+
+            for (uint32_t i = 0; i < piece.IndexCount; i++) {
+                cluster.Indices.push_back(static_cast<uint16_t>(base + _indices[piece.FirstIndex + i]));
+            }
+
+            cluster.Cluster.PieceCount++;
+        }
+
+        // Relative to the centre, that's where the precision of a compact layout is
+        for (auto& cluster : clusters) {
+            cluster.Cluster.Center = (cluster.Cluster.Min + cluster.Cluster.Max) * 0.5f;
+            for (auto& vertex : cluster.Vertices) {
+                vertex.Position -= cluster.Cluster.Center;
+            }
+        }
+
+        return clusters;
+    }
+
+    StaticBatch StaticBatcher::finish(MeshPool& pool, std::vector<PendingCluster>& clusters) {
+        StaticBatchStats stats {
+            .Pieces = static_cast<uint32_t>(_pieces.size()),
+        };
+
+        std::vector<StaticCluster> built;
+        built.reserve(clusters.size());
+        for (auto& cluster : clusters) {
+            if (!cluster.Cluster.Mesh.IsValid()) continue;
+
+            stats.Vertices += static_cast<uint32_t>(cluster.Vertices.size());
+            stats.Indices += static_cast<uint32_t>(cluster.Indices.size());
+            built.push_back(cluster.Cluster);
+        }
+        stats.Clusters = static_cast<uint32_t>(built.size());
+
+        spdlog::info("Batched {} static meshes into {} clusters, {} fewer draws", stats.Pieces, stats.Clusters,
+                     stats.GetDrawsSaved());
+
+        _vertices.clear();
+        _indices.clear();
+        _pieces.clear();
+
+        return {&pool, std::move(built), stats};
+    }
+}
@@ -0,0 +1,105 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/resources/static_bundle.h>
+#include <ozz_vulkan/internal/defragmenter.h>
+#include <spdlog/spdlog.h>
+
+namespace OZZ {
+
+    StaticBundle::StaticBundle(const ResourceContext& context, VkCommandPool commandPool, VkFormat colorFormat,
+                               VkFormat depthFormat)
+            : _context(context), _commandPool(commandPool), _colorFormat(colorFormat), _depthFormat(depthFormat) {}
+
+    StaticBundle::~StaticBundle() {
+        releaseCommandBuffer();
+    }
+
+    bool StaticBundle::NeedsRecording() const {
+        if (!_recorded) return true;
+        return _context.Defrag && _context.Defrag->GetGeneration() != _generation;
+    }
+
+    CommandEncoder StaticBundle::Begin(VkExtent2D extent) {
+        if (_recording) {
+            spdlog::warn("Static bundle begun again before it was ended, starting over");
+        }
+
+        releaseCommandBuffer();
+        _recorded = false;
+        _recordedStats = {};
+
+        VkCommandBufferAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        allocateInfo.commandPool = _commandPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocateInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(_context.Device, &allocateInfo, &_commandBuffer) != VK_SUCCESS) {
+            spdlog::error("Failed to allocate static bundle command buffer");
+            _commandBuffer = VK_NULL_HANDLE;
+            return {};
+        }
+
+        VkCommandBufferInheritanceRenderingInfo renderingInheritance{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO};
+        renderingInheritance.colorAttachmentCount = 1;
+        renderingInheritance.pColorAttachmentFormats = &_colorFormat;
+        renderingInheritance.depthAttachmentFormat = _depthFormat;
+        renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+        inheritanceInfo.pNext = &renderingInheritance;
+
+        // Simultaneous so both eyes and every frame in flight can hold it at once
+        VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        if (vkBeginCommandBuffer(_commandBuffer, &beginInfo) != VK_SUCCESS) {
+            spdlog::error("Failed to begin static bundle command buffer");
+            releaseCommandBuffer();
+            return {};
+        }
+
+        _recording = true;
+        // Taken before recording, a move during it makes the next NeedsRecording() true
+        if (_context.Defrag) _generation = _context.Defrag->GetGeneration();
+
+        CommandEncoder encoder(_commandBuffer, &_recordedStats);
+
+        VkViewport viewport{0, 0, static_cast<float>(extent.width), static_cast<float>(extent.height), 0, 1};
+        VkRect2D scissor{{0, 0}, extent};
+        encoder.SetViewport(viewport);
+        encoder.SetScissor(scissor);
+
+        return encoder;
+    }
+
+    void StaticBundle::End(CommandEncoder& encoder) {
+        if (!_recording || encoder.GetCommandBuffer() != _commandBuffer) {
+            spdlog::error("Ending a static bundle with an encoder it didn't begin");
+            return;
+        }
+
+        _recording = false;
+        if (vkEndCommandBuffer(_commandBuffer) != VK_SUCCESS) {
+            spdlog::error("Failed to end static bundle command buffer");
+            releaseCommandBuffer();
+            return;
+        }
+
+        _recorded = true;
+    }
+
+    void StaticBundle::releaseCommandBuffer() {
+        if (_commandBuffer == VK_NULL_HANDLE) return;
+
+        _context.Defer([device = _context.Device, pool = _commandPool, commandBuffer = _commandBuffer]() {
+            vkFreeCommandBuffers(device, pool, 1, &commandBuffer);
+        });
+
+        _commandBuffer = VK_NULL_HANDLE;
+        _recording = false;
+        _recorded = false;
+    }
+}
@@ -0,0 +1,475 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/upload_manager.h>
+#include <spdlog/spdlog.h>
+#include <cstring>
+
+namespace OZZ {
+
+    // Buffer to image copies need offsets aligned to the texel size (and 4), 16 covers every format we use
+    static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+    static VkDeviceSize alignStaging(VkDeviceSize value) {
+        return (value + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+    }
+
+    UploadManager::UploadManager(VkDevice device, VmaAllocator allocator, VkQueue queue, uint32_t queueFamilyIndex,
+                                 uint32_t graphicsQueueFamilyIndex, std::mutex* queueMutex, MemoryTracker* memory,
+                                 VkDeviceSize stagingSize)
+            : _device(device), _allocator(allocator), _memory(memory), _queue(queue), _queueFamilyIndex(queueFamilyIndex),
+              _queueMutex(queueMutex), _ringSize(stagingSize) {
+
+        _sharedFamilies[0] = graphicsQueueFamilyIndex;
+        _sharedFamilies[1] = queueFamilyIndex;
+        _concurrentSharing = graphicsQueueFamilyIndex != queueFamilyIndex;
+
+        VkCommandPoolCreateInfo commandPoolCreateInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+        if (vkCreateCommandPool(device, &commandPoolCreateInfo, nullptr, &_commandPool) != VK_SUCCESS) {
+            spdlog::error("Failed to create upload command pool");
+        }
+
+        VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo{VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+        semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        semaphoreTypeCreateInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreCreateInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+        semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &_timeline) != VK_SUCCESS) {
+            spdlog::error("Failed to create upload timeline semaphore");
+        }
+
+        VkBufferCreateInfo ringCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        ringCreateInfo.size = _ringSize;
+        ringCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+        VmaAllocationCreateInfo ringAllocationCreateInfo{};
+        ringAllocationCreateInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+        ringAllocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VmaAllocationInfo ringAllocationInfo{};
+        if (vmaCreateBuffer(allocator, &ringCreateInfo, &ringAllocationCreateInfo, &_ringBuffer, &_ringAllocation,
+                            &ringAllocationInfo) != VK_SUCCESS) {
+            spdlog::error("Failed to create staging ring");
+        } else {
+            _ringData = static_cast<std::byte*>(ringAllocationInfo.pMappedData);
+            if (_memory) _memory->Track(_ringAllocation, MemoryCategory::Staging);
+            spdlog::trace("Created {}MB staging ring, transfer queue family {}", _ringSize / (1024 * 1024), queueFamilyIndex);
+        }
+    }
+
+    UploadManager::~UploadManager() {
+        std::lock_guard lock(_mutex);
+
+        // Nothing can be released while the transfer queue may still be reading it
+        if (_nextValue > 1) {
+            Wait(_nextValue - 1);
+        }
+
+        while (!_inFlight.empty()) {
+            retire(_inFlight.front());
+            _inFlight.pop_front();
+        }
+
+        if (_ringBuffer != VK_NULL_HANDLE) {
+            if (_memory) _memory->Untrack(_ringAllocation);
+            vmaDestroyBuffer(_allocator, _ringBuffer, _ringAllocation);
+            _ringBuffer = VK_NULL_HANDLE;
+        }
+
+        if (_commandPool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(_device, _commandPool, nullptr);
+            _commandPool = VK_NULL_HANDLE;
+        }
+
+        if (_timeline != VK_NULL_HANDLE) {
+            vkDestroySemaphore(_device, _timeline, nullptr);
+            _timeline = VK_NULL_HANDLE;
+        }
+    }
+
+    uint64_t UploadManager::UploadToBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+        if (size == 0) return GetVisibleValue();
+
+        std::lock_guard lock(_mutex);
+        retireCompleted();
+
+        // Nothing gets recorded without staging, the failure was already logged
+        auto staging = allocateStaging(size);
+        if (staging.Data == nullptr) return GetVisibleValue();
+
+        std::memcpy(staging.Data, data, size);
+        vmaFlushAllocation(_allocator, staging.OverflowAllocation ? staging.OverflowAllocation : _ringAllocation,
+                           staging.Offset, size);
+
+        auto commandBuffer = beginCommandBuffer();
+
+        VkBufferCopy region{};
+        region.srcOffset = staging.Offset;
+        region.dstOffset = dstOffset;
+        region.size = size;
+        vkCmdCopyBuffer(commandBuffer, staging.Buffer, dst, 1, &region);
+
+        vkEndCommandBuffer(commandBuffer);
+        return submit(commandBuffer, staging);
+    }
+
+    uint64_t UploadManager::UploadToImage(VkImage image, VkExtent3D extent, VkImageAspectFlags aspect, const void* data,
+                                          VkDeviceSize size, VkImageLayout finalLayout) {
+        std::lock_guard lock(_mutex);
+        retireCompleted();
+
+        // Nothing gets recorded without staging, the failure was already logged
+        auto staging = allocateStaging(size);
+        if (staging.Data == nullptr) return GetVisibleValue();
+
+        std::memcpy(staging.Data, data, size);
+        vmaFlushAllocation(_allocator, staging.OverflowAllocation ? staging.OverflowAllocation : _ringAllocation,
+                           staging.Offset, size);
+
+        auto commandBuffer = beginCommandBuffer();
+
+        VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {aspect, 0, 1, 0, 1};
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = staging.Offset;
+        region.imageSubresource = {aspect, 0, 0, 1};
+        region.imageExtent = extent;
+        vkCmdCopyBufferToImage(commandBuffer, staging.Buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        // The transfer queue can't name graphics stages, the timeline wait on the graphics side covers visibility
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = finalLayout;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        vkEndCommandBuffer(commandBuffer);
+        return submit(commandBuffer, staging);
+    }
+
+    uint64_t UploadManager::CopyBuffers(const std::vector<BufferCopy>& copies) {
+        if (copies.empty()) return GetVisibleValue();
+
+        std::lock_guard lock(_mutex);
+        retireCompleted();
+
+        auto commandBuffer = beginCommandBuffer();
+
+        for (const auto& copy : copies) {
+            VkBufferCopy region{};
+            region.size = copy.Size;
+            vkCmdCopyBuffer(commandBuffer, copy.Src, copy.Dst, 1, &region);
+        }
+
+        vkEndCommandBuffer(commandBuffer);
+        return submit(commandBuffer, StagingAllocation{});
+    }
+
+    StagingWrite UploadManager::BeginStagingWrite(VkDeviceSize size) {
+        if (size == 0) return {};
+
+        std::lock_guard lock(_mutex);
+        retireCompleted();
+
+        auto staging = allocateStaging(size);
+        if (staging.Data == nullptr) return {};
+
+        return StagingWrite {
+            .Data = static_cast<std::byte*>(staging.Data),
+            .Size = size,
+            .Staging = staging,
+        };
+    }
+
+    uint64_t UploadManager::SubmitStagingWrite(StagingWrite& write, std::span<const StagingCopy> copies) {
+        if (!write.IsValid()) return GetVisibleValue();
+
+        if (copies.empty()) {
+            CancelStagingWrite(write);
+            return GetVisibleValue();
+        }
+
+        std::lock_guard lock(_mutex);
+
+        vmaFlushAllocation(_allocator, write.Staging.OverflowAllocation ? write.Staging.OverflowAllocation : _ringAllocation,
+                           write.Staging.Offset, write.Size);
+
+        auto commandBuffer = beginCommandBuffer();
+
+        for (const auto& copy : copies) {
+            VkBufferCopy region{};
+            region.srcOffset = write.Staging.Offset + copy.SrcOffset;
+            region.dstOffset = copy.DstOffset;
+            region.size = copy.Size;
+            vkCmdCopyBuffer(commandBuffer, write.Staging.Buffer, copy.Dst, 1, &region);
+        }
+
+        vkEndCommandBuffer(commandBuffer);
+        auto value = submit(commandBuffer, write.Staging);
+
+        write = {};
+        return value;
+    }
+
+    void UploadManager::CancelStagingWrite(StagingWrite& write) {
+        if (!write.IsValid()) return;
+
+        std::lock_guard lock(_mutex);
+        releaseStaging(write.Staging);
+        write = {};
+    }
+
+    void UploadManager::Wait(uint64_t value) {
+        if (IsVisible(value)) return;
+
+        VkSemaphoreWaitInfo waitInfo{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &_timeline;
+        waitInfo.pValues = &value;
+
+        if (vkWaitSemaphores(_device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+            spdlog::error("Failed to wait for upload {}", value);
+            return;
+        }
+
+        markVisible(value);
+    }
+
+    void UploadManager::BeginFrame() {
+        std::lock_guard lock(_mutex);
+        retireCompleted();
+    }
+
+    void UploadManager::ApplySharingMode(VkBufferCreateInfo& createInfo) const {
+        if (_concurrentSharing) {
+            createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = _sharedFamilies;
+        }
+    }
+
+    void UploadManager::ApplySharingMode(VkImageCreateInfo& createInfo) const {
+        if (_concurrentSharing) {
+            createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = _sharedFamilies;
+        }
+    }
+
+    StagingAllocation UploadManager::allocateStaging(VkDeviceSize size) {
+        auto alignedSize = alignStaging(size);
+
+        if (alignedSize > _ringSize || _ringData == nullptr) {
+            spdlog::trace("Upload of {} bytes doesn't fit the staging ring, using a dedicated staging buffer", size);
+            return allocateOverflow(size);
+        }
+
+        while (true) {
+            if (auto staging = tryAllocateRing(alignedSize); staging.has_value()) {
+                return *staging;
+            }
+
+            if (_inFlight.empty()) {
+                // Held up by staging writes nobody has submitted yet, waiting won't free anything
+                spdlog::trace("Staging ring is held by open staging writes, using a dedicated staging buffer");
+                return allocateOverflow(size);
+            }
+
+            // Ring is full of in flight uploads, wait for the oldest one and try again
+            Wait(_inFlight.front().Value);
+            retireCompleted();
+        }
+    }
+
+    std::optional<StagingAllocation> UploadManager::tryAllocateRing(VkDeviceSize size) {
+        if (_ringUsed == 0) {
+            _ringHead = _ringTail = 0;
+        }
+
+        VkDeviceSize offset;
+        VkDeviceSize consumed;
+
+        if (_ringHead > _ringTail || _ringUsed == 0) {
+            // Free space is [head, end) and [0, tail)
+            if (_ringSize - _ringHead >= size) {
+                offset = _ringHead;
+                consumed = size;
+            } else if (_ringTail >= size) {
+                // Wrap, the tail end of the ring is wasted until this allocation retires
+                offset = 0;
+                consumed = (_ringSize - _ringHead) + size;
+            } else {
+                return std::nullopt;
+            }
+        } else {
+            // Free space is [head, tail)
+            if (_ringTail - _ringHead >= size) {
+                offset = _ringHead;
+                consumed = size;
+            } else {
+                return std::nullopt;
+            }
+        }
+
+        _ringHead = offset + size;
+        _ringUsed += consumed;
+        _ringSpans.push_back({
+            .End = offset + size,
+            .Bytes = consumed,
+        });
+
+        return StagingAllocation {
+            .Buffer = _ringBuffer,
+            .Offset = offset,
+            .Data = _ringData + offset,
+            .RingSpan = _ringSpanBase + _ringSpans.size() - 1,
+        };
+    }
+
+    StagingAllocation UploadManager::allocateOverflow(VkDeviceSize size) {
+        StagingAllocation staging{};
+
+        VkBufferCreateInfo bufferCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bufferCreateInfo.size = size;
+        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+        VmaAllocationCreateInfo allocationCreateInfo{};
+        allocationCreateInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+        allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VmaAllocationInfo allocationInfo{};
+        if (vmaCreateBuffer(_allocator, &bufferCreateInfo, &allocationCreateInfo, &staging.Buffer,
+                            &staging.OverflowAllocation, &allocationInfo) != VK_SUCCESS) {
+            spdlog::error("Failed to create overflow staging buffer of {} bytes", size);
+            return {};
+        }
+
+        if (_memory) _memory->Track(staging.OverflowAllocation, MemoryCategory::Staging);
+
+        staging.Data = allocationInfo.pMappedData;
+        return staging;
+    }
+
+    VkCommandBuffer UploadManager::beginCommandBuffer() {
+        VkCommandBuffer commandBuffer{VK_NULL_HANDLE};
+
+        if (!_freeCommandBuffers.empty()) {
+            commandBuffer = _freeCommandBuffers.back();
+            _freeCommandBuffers.pop_back();
+        } else {
+            VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+            allocInfo.commandPool = _commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(_device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+                spdlog::error("Failed to allocate upload command buffer");
+            }
+        }
+
+        VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        return commandBuffer;
+    }
+
+    uint64_t UploadManager::submit(VkCommandBuffer commandBuffer, const StagingAllocation& staging) {
+        // Values are handed out under _mutex, so they increase in submission order as the timeline requires
+        uint64_t value = _nextValue++;
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+        timelineSubmitInfo.signalSemaphoreValueCount = 1;
+        timelineSubmitInfo.pSignalSemaphoreValues = &value;
+
+        VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+        submitInfo.pNext = &timelineSubmitInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &_timeline;
+
+        VkResult result;
+        if (_queueMutex) {
+            std::lock_guard queueLock(*_queueMutex);
+            result = vkQueueSubmit(_queue, 1, &submitInfo, VK_NULL_HANDLE);
+        } else {
+            result = vkQueueSubmit(_queue, 1, &submitInfo, VK_NULL_HANDLE);
+        }
+
+        if (result != VK_SUCCESS) {
+            spdlog::error("Failed to submit upload {}", result);
+        }
+
+        _inFlight.push_back({
+            .Value = value,
+            .Staging = staging,
+            .CommandBuffer = commandBuffer,
+        });
+
+        return value;
+    }
+
+    void UploadManager::retireCompleted() {
+        uint64_t completed = 0;
+        vkGetSemaphoreCounterValue(_device, _timeline, &completed);
+
+        while (!_inFlight.empty() && _inFlight.front().Value <= completed) {
+            retire(_inFlight.front());
+            _inFlight.pop_front();
+        }
+
+        markVisible(completed);
+    }
+
+    void UploadManager::retire(Submission& submission) {
+        releaseStaging(submission.Staging);
+
+        vkResetCommandBuffer(submission.CommandBuffer, 0);
+        _freeCommandBuffers.push_back(submission.CommandBuffer);
+    }
+
+    void UploadManager::releaseStaging(const StagingAllocation& staging) {
+        if (staging.OverflowAllocation != VK_NULL_HANDLE) {
+            if (_memory) _memory->Untrack(staging.OverflowAllocation);
+            vmaDestroyBuffer(_allocator, staging.Buffer, staging.OverflowAllocation);
+            return;
+        }
+
+        // Device to device copies have no staging at all
+        if (staging.Buffer == VK_NULL_HANDLE) return;
+
+        _ringSpans[staging.RingSpan - _ringSpanBase].Released = true;
+
+        while (!_ringSpans.empty() && _ringSpans.front().Released) {
+            _ringTail = _ringSpans.front().End;
+            _ringUsed -= _ringSpans.front().Bytes;
+            _ringSpans.pop_front();
+            _ringSpanBase++;
+        }
+    }
+
+    void UploadManager::markVisible(uint64_t value) {
+        auto current = _visibleValue.load();
+        while (current < value && !_visibleValue.compare_exchange_weak(current, value)) {}
+    }
+
+} // OZZ
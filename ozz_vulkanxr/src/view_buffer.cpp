@@ -0,0 +1,137 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+
+#include <ozz_vulkan/internal/view_buffer.h>
+#include <spdlog/spdlog.h>
+
+namespace OZZ {
+
+    ViewBuffer::ViewBuffer(VkDevice device, VmaAllocator allocator, MemoryTracker* memory, bool meshShaders)
+            : _device(device), _allocator(allocator), _memory(memory) {
+        if (meshShaders) {
+            _shaderStages |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+            _pipelineStages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+        }
+
+        VkBufferCreateInfo bufferCreateInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bufferCreateInfo.size = sizeof(ViewUniforms);
+        bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+        VmaAllocationCreateInfo allocationCreateInfo{};
+        allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+        if (vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &_buffer, &_allocation,
+                            nullptr) != VK_SUCCESS) {
+            spdlog::error("Failed to create view buffer");
+            return;
+        }
+
+        if (_memory) _memory->Track(_allocation, MemoryCategory::Uniform);
+        createDescriptors();
+    }
+
+    ViewBuffer::~ViewBuffer() {
+        if (_descriptorPool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+            _descriptorPool = VK_NULL_HANDLE;
+        }
+
+        if (_setLayout != VK_NULL_HANDLE) {
+            vkDestroyDescriptorSetLayout(_device, _setLayout, nullptr);
+            _setLayout = VK_NULL_HANDLE;
+        }
+
+        if (_buffer != VK_NULL_HANDLE) {
+            if (_memory) _memory->Untrack(_allocation);
+            vmaDestroyBuffer(_allocator, _buffer, _allocation);
+            _buffer = VK_NULL_HANDLE;
+        }
+    }
+
+    void ViewBuffer::Set(EyeTarget eye, const ViewUniforms& uniforms) {
+        if (eye == EyeTarget::BOTH) {
+            _views.fill(uniforms);
+            return;
+        }
+        _views[static_cast<size_t>(eye)] = uniforms;
+    }
+
+    void ViewBuffer::RecordUpdate(VkCommandBuffer commandBuffer, EyeTarget eye) const {
+        if (_buffer == VK_NULL_HANDLE || eye == EyeTarget::BOTH) return;
+
+        // Whatever read the buffer earlier in the queue, the other eye or an older frame, is done first
+        VkBufferMemoryBarrier barrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+        barrier.srcAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = _buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(commandBuffer, _pipelineStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier,
+                             0, nullptr);
+
+        vkCmdUpdateBuffer(commandBuffer, _buffer, 0, sizeof(ViewUniforms), &_views[static_cast<size_t>(eye)]);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, _pipelineStages, 0, 0, nullptr, 1, &barrier,
+                             0, nullptr);
+    }
+
+    void ViewBuffer::Bind(CommandEncoder& encoder, VkPipelineLayout pipelineLayout, uint32_t set) const {
+        encoder.BindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, _descriptorSet);
+    }
+
+    void ViewBuffer::createDescriptors() {
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        binding.descriptorCount = 1;
+        binding.stageFlags = _shaderStages;
+
+        VkDescriptorSetLayoutCreateInfo layoutCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+        layoutCreateInfo.bindingCount = 1;
+        layoutCreateInfo.pBindings = &binding;
+
+        if (vkCreateDescriptorSetLayout(_device, &layoutCreateInfo, nullptr, &_setLayout) != VK_SUCCESS) {
+            spdlog::error("Failed to create view data descriptor set layout");
+            return;
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1};
+
+        VkDescriptorPoolCreateInfo poolCreateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+        poolCreateInfo.maxSets = 1;
+        poolCreateInfo.poolSizeCount = 1;
+        poolCreateInfo.pPoolSizes = &poolSize;
+
+        if (vkCreateDescriptorPool(_device, &poolCreateInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+            spdlog::error("Failed to create view data descriptor pool");
+            return;
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        allocateInfo.descriptorPool = _descriptorPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &_setLayout;
+
+        if (vkAllocateDescriptorSets(_device, &allocateInfo, &_descriptorSet) != VK_SUCCESS) {
+            spdlog::error("Failed to allocate view data descriptor set");
+            return;
+        }
+
+        VkDescriptorBufferInfo bufferInfo{_buffer, 0, sizeof(ViewUniforms)};
+
+        VkWriteDescriptorSet write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        write.dstSet = _descriptorSet;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        write.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    }
+}
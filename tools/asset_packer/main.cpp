@@ -0,0 +1,214 @@
+//
+// Created by ozzadar on 19/10/26.
+//
+// Packs loose assets into a single indexed archive that the renderer can mmap.
+//
+// usage: ozz_asset_packer --base <dir> --out <archive> [--embed <source.cpp> --symbol <name>] [--lz4] <paths...>
+//
+// Entry names are the file paths relative to --base, using forward slashes, so
+// "assets/shaders/simple.vert.spv" resolves the same whether loaded from disk or from the archive.
+//
+
+#include <ozz_vulkan/internal/asset_archive_format.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(OZZ_WITH_LZ4)
+#include <lz4.h>
+#endif
+
+namespace fs = std::filesystem;
+using namespace OZZ::Archive;
+
+struct PackedFile {
+    std::string Name;
+    std::vector<char> Data;
+    uint32_t Flags {ENTRY_FLAG_NONE};
+    uint64_t Size {0};
+};
+
+static bool readWholeFile(const fs::path& path, std::vector<char>& out) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    out.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(out.data(), static_cast<std::streamsize>(out.size()));
+    return true;
+}
+
+static void compressEntry(PackedFile& file) {
+#if defined(OZZ_WITH_LZ4)
+    std::vector<char> compressed(LZ4_compressBound(static_cast<int>(file.Data.size())));
+    auto compressedSize = LZ4_compress_default(file.Data.data(), compressed.data(),
+                                               static_cast<int>(file.Data.size()),
+                                               static_cast<int>(compressed.size()));
+
+    // Only keep the compressed blob if it's actually worth decompressing at runtime
+    if (compressedSize > 0 && static_cast<size_t>(compressedSize) < file.Data.size() * 9 / 10) {
+        compressed.resize(compressedSize);
+        file.Data = std::move(compressed);
+        file.Flags |= ENTRY_FLAG_LZ4;
+    }
+#else
+    (void) file;
+#endif
+}
+
+static std::vector<char> buildArchive(std::vector<PackedFile>& files) {
+    std::sort(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) {
+        return HashName(a.Name) < HashName(b.Name);
+    });
+
+    std::vector<char> archive(sizeof(ArchiveHeader));
+    std::vector<ArchiveEntry> entries;
+    std::string strings;
+
+    for (auto& file : files) {
+        archive.resize(AlignUp(archive.size(), ARCHIVE_DATA_ALIGNMENT));
+
+        ArchiveEntry entry {};
+        entry.NameHash = HashName(file.Name);
+        entry.NameOffset = static_cast<uint32_t>(strings.size());
+        entry.NameLength = static_cast<uint32_t>(file.Name.size());
+        entry.DataOffset = archive.size();
+        entry.StoredSize = file.Data.size();
+        entry.Size = file.Size;
+        entry.Flags = file.Flags;
+
+        archive.insert(archive.end(), file.Data.begin(), file.Data.end());
+        strings += file.Name;
+        entries.push_back(entry);
+    }
+
+    archive.resize(AlignUp(archive.size(), alignof(ArchiveEntry)));
+
+    ArchiveHeader header {};
+    std::memcpy(header.Magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.Version = ARCHIVE_VERSION;
+    header.EntryCount = static_cast<uint32_t>(entries.size());
+    header.EntryTableOffset = archive.size();
+    header.StringTableOffset = header.EntryTableOffset + entries.size() * sizeof(ArchiveEntry);
+    header.StringTableSize = static_cast<uint32_t>(strings.size());
+
+    auto entryBytes = reinterpret_cast<const char*>(entries.data());
+    archive.insert(archive.end(), entryBytes, entryBytes + entries.size() * sizeof(ArchiveEntry));
+    archive.insert(archive.end(), strings.begin(), strings.end());
+
+    std::memcpy(archive.data(), &header, sizeof(header));
+    return archive;
+}
+
+static bool writeEmbeddedSource(const fs::path& path, const std::string& symbol, const std::vector<char>& archive) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        return false;
+    }
+
+    out << "// Generated by ozz_asset_packer. Do not edit.\n";
+    out << "#include <cstddef>\n\n";
+    out << "extern const size_t " << symbol << "_size = " << archive.size() << ";\n";
+    out << "alignas(" << ARCHIVE_DATA_ALIGNMENT << ") extern const unsigned char " << symbol << "[] = {\n";
+
+    for (size_t i = 0; i < archive.size(); i++) {
+        out << static_cast<unsigned>(static_cast<unsigned char>(archive[i])) << ',';
+        if (i % 32 == 31) out << '\n';
+    }
+
+    out << "\n};\n";
+    return true;
+}
+
+int main(int argc, char** argv) {
+    fs::path base = fs::current_path();
+    fs::path output;
+    fs::path embedOutput;
+    std::string symbol = "ozz_embedded_assets";
+    bool compress = false;
+    std::vector<fs::path> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--base" && i + 1 < argc) {
+            base = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--embed" && i + 1 < argc) {
+            embedOutput = argv[++i];
+        } else if (arg == "--symbol" && i + 1 < argc) {
+            symbol = argv[++i];
+        } else if (arg == "--lz4") {
+            compress = true;
+        } else {
+            inputs.emplace_back(arg);
+        }
+    }
+
+    if (output.empty() && embedOutput.empty()) {
+        std::cerr << "usage: ozz_asset_packer --base <dir> --out <archive> [--embed <source.cpp> --symbol <name>] [--lz4] <paths...>\n";
+        return 1;
+    }
+
+#if !defined(OZZ_WITH_LZ4)
+    if (compress) {
+        std::cerr << "LZ4 support not compiled in, packing uncompressed\n";
+        compress = false;
+    }
+#endif
+
+    std::vector<PackedFile> files;
+    auto addFile = [&](const fs::path& path) -> bool {
+        PackedFile file;
+        file.Name = fs::relative(path, base).generic_string();
+        if (!readWholeFile(path, file.Data)) {
+            std::cerr << "Failed to read " << path << '\n';
+            return false;
+        }
+        file.Size = file.Data.size();
+        if (compress) {
+            compressEntry(file);
+        }
+        files.push_back(std::move(file));
+        return true;
+    };
+
+    for (const auto& input : inputs) {
+        auto path = input.is_absolute() ? input : base / input;
+        if (fs::is_directory(path)) {
+            for (const auto& entry : fs::recursive_directory_iterator(path)) {
+                if (entry.is_regular_file() && !addFile(entry.path())) return 1;
+            }
+        } else if (fs::is_regular_file(path)) {
+            if (!addFile(path)) return 1;
+        } else {
+            std::cerr << "No such file or directory " << path << '\n';
+            return 1;
+        }
+    }
+
+    auto archive = buildArchive(files);
+
+    if (!output.empty()) {
+        std::ofstream out(output, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open " << output << " for writing\n";
+            return 1;
+        }
+        out.write(archive.data(), static_cast<std::streamsize>(archive.size()));
+    }
+
+    if (!embedOutput.empty() && !writeEmbeddedSource(embedOutput, symbol, archive)) {
+        std::cerr << "Failed to write " << embedOutput << '\n';
+        return 1;
+    }
+
+    std::cout << "Packed " << files.size() << " assets (" << archive.size() << " bytes)\n";
+    return 0;
+}